@@ -0,0 +1,47 @@
+#ifndef FIRMWARE_BENCH_H
+#define FIRMWARE_BENCH_H
+
+#include "num.h"
+#include <stddef.h>
+
+// Fills mat with 0, 1, ..., period - 1 over and over. Small integers keep every
+// product and sum exact, so the result doesn't depend on the order a kernel
+// adds things up in. There's no fcvt, hence the counting in floats.
+static inline void bench_fill(float *const mat, const size_t size, const int period)
+{
+    float value = 0;
+    int phase = 0;
+
+    for (size_t i = 0; i < size; ++i) {
+        mat[i] = value;
+        value += 1.0F;
+
+        if (++phase == period) {
+            phase = 0;
+            value = 0;
+        }
+    }
+}
+
+// Sum of the elements' bit patterns
+static inline u32 bench_checksum(const float *const mat, const size_t size)
+{
+    u32 sum = 0;
+
+    for (size_t i = 0; i < size; ++i) {
+        u32 bits;
+        __builtin_memcpy(&bits, &mat[i], sizeof(bits));
+        sum += bits;
+    }
+
+    return sum;
+}
+
+// Ends the simulation, which reports code as the exit code
+[[noreturn]] static inline void bench_exit(const u32 code)
+{
+    __asm__ volatile("mv a0, %0\n\tecall" : : "r"(code));
+    __builtin_unreachable();
+}
+
+#endif
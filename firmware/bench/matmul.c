@@ -0,0 +1,24 @@
+// The hand-written matmul from matmul.s, whose inner loop interleaves address
+// arithmetic with loads and FP operations.
+
+#include "bench.h"
+
+constexpr int N = 16;
+constexpr int ROUNDS = 4;
+
+void matmul(const float *mat1, const float *mat2, int m, int n, int p, float *dest);
+
+static float mat_a[N * N];
+static float mat_b[N * N];
+static float mat_c[N * N];
+
+void main(void)
+{
+    bench_fill(mat_a, N * N, 5);
+    bench_fill(mat_b, N * N, 3);
+
+    for (int i = 0; i < ROUNDS; ++i)
+        matmul(mat_a, mat_b, N, N, N, mat_c);
+
+    bench_exit(bench_checksum(mat_c, N * N));
+}
@@ -0,0 +1,21 @@
+// strassen_mul from strassen.c, one level of recursion above its naive
+// multiplication. Larger matrices don't fit in RAM along with the temporaries.
+
+#include "bench.h"
+#include "strassen.h"
+
+constexpr int N = 20;
+
+static float mat_a[N * N];
+static float mat_b[N * N];
+static float mat_c[N * N];
+
+void main(void)
+{
+    bench_fill(mat_a, N * N, 5);
+    bench_fill(mat_b, N * N, 3);
+
+    strassen_mul(mat_a, mat_b, mat_c, N);
+
+    bench_exit(bench_checksum(mat_c, N * N));
+}
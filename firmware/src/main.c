@@ -4,7 +4,7 @@
 #include "tachyon.h"
 #include <stddef.h>
 
-// Ideas for VBlank use and draw buffering from https://www.nesdev.org/wiki/The_frame_and_NMIs
+// Ideas for VBlank use from https://www.nesdev.org/wiki/The_frame_and_NMIs
 
 static constexpr size_t AUCH_SOUNDS = 0;
 static constexpr size_t AUCH_PAUSE_SOUND = 1;
@@ -76,40 +76,40 @@ typedef enum : u8 {
 } SpriteIdx;
 
 // Calculates a tattr value based on:
-// - Sprite index (4 bits)
-// - Palette index (2 bits)
+// - Sprite index (8 bits)
+// - Palette index (3 bits)
 // - Extra flags (TF_FLIP_X or TF_FLIP_Y, 1 bit each)
-#define MK_TATTR(spr_idx, pal_idx, flags) ((spr_idx) | ((pal_idx) << 4) | (flags))
+#define MK_TATTR(spr_idx, pal_idx, flags) ((spr_idx) | ((pal_idx) << 8) | (flags))
 
-static constexpr u8 TF_FLIP_X = 0b1000'0000;
-static constexpr u8 TF_FLIP_Y = 0b0100'0000;
+static constexpr u16 TF_FLIP_X = 1 << 15;
+static constexpr u16 TF_FLIP_Y = 1 << 14;
 
-static constexpr u8 TATTR_BACKGROUND = MK_TATTR(SPR_BACKGROUND, PAL_BG, 0);
-static constexpr u8 TATTR_WALL = MK_TATTR(SPR_WALL, PAL_BG, 0);
-static constexpr u8 TATTR_APPLE = MK_TATTR(SPR_APPLE, PAL_APPLE, 0);
+static constexpr u16 TATTR_BACKGROUND = MK_TATTR(SPR_BACKGROUND, PAL_BG, 0);
+static constexpr u16 TATTR_WALL = MK_TATTR(SPR_WALL, PAL_BG, 0);
+static constexpr u16 TATTR_APPLE = MK_TATTR(SPR_APPLE, PAL_APPLE, 0);
 
-static constexpr u8 TATTR_SNAKE_HEAD[] = {
+static constexpr u16 TATTR_SNAKE_HEAD[] = {
     [DIR_UP] = MK_TATTR(SPR_SNAKE_HEAD_DOWN, PAL_SNAKE, TF_FLIP_Y),
     [DIR_RIGHT] = MK_TATTR(SPR_SNAKE_HEAD_RIGHT, PAL_SNAKE, 0),
     [DIR_DOWN] = MK_TATTR(SPR_SNAKE_HEAD_DOWN, PAL_SNAKE, 0),
     [DIR_LEFT] = MK_TATTR(SPR_SNAKE_HEAD_RIGHT, PAL_SNAKE, TF_FLIP_X),
 };
 
-static constexpr u8 TATTR_SNAKE_BODY[] = {
+static constexpr u16 TATTR_SNAKE_BODY[] = {
     [DIR_UP] = MK_TATTR(SPR_SNAKE_BODY_DOWN, PAL_SNAKE, 0),
     [DIR_RIGHT] = MK_TATTR(SPR_SNAKE_BODY_RIGHT, PAL_SNAKE, 0),
     [DIR_DOWN] = MK_TATTR(SPR_SNAKE_BODY_DOWN, PAL_SNAKE, 0),
     [DIR_LEFT] = MK_TATTR(SPR_SNAKE_BODY_RIGHT, PAL_SNAKE, 0),
 };
 
-static constexpr u8 TATTR_SNAKE_BODY_TURN[] = {
+static constexpr u16 TATTR_SNAKE_BODY_TURN[] = {
     [DIR_UP] = MK_TATTR(SPR_SNAKE_BODY_TURN, PAL_SNAKE, TF_FLIP_X | TF_FLIP_Y),
     [DIR_RIGHT] = MK_TATTR(SPR_SNAKE_BODY_TURN, PAL_SNAKE, TF_FLIP_X),
     [DIR_DOWN] = MK_TATTR(SPR_SNAKE_BODY_TURN, PAL_SNAKE, 0),
     [DIR_LEFT] = MK_TATTR(SPR_SNAKE_BODY_TURN, PAL_SNAKE, TF_FLIP_Y),
 };
 
-static constexpr u8 TATTR_SNAKE_TAIL[] = {
+static constexpr u16 TATTR_SNAKE_TAIL[] = {
     [DIR_UP] = MK_TATTR(SPR_SNAKE_TAIL_DOWN, PAL_SNAKE, TF_FLIP_Y),
     [DIR_RIGHT] = MK_TATTR(SPR_SNAKE_TAIL_RIGHT, PAL_SNAKE, 0),
     [DIR_DOWN] = MK_TATTR(SPR_SNAKE_TAIL_DOWN, PAL_SNAKE, 0),
@@ -131,40 +131,6 @@ static constexpr size_t STEP_DELAY_CAP = 8;
 static bool dead;
 static size_t step_delay;
 
-typedef struct {
-    u8 tx;
-    u8 ty;
-    u8 tattr;
-} DrawBufEntry;
-
-static constexpr size_t DRAW_BUF_CAPACITY = 16;
-
-static DrawBufEntry draw_buf[DRAW_BUF_CAPACITY];
-static size_t draw_buf_size = 0;
-
-static void draw_buf_push(const u8 tx, const u8 ty, const u8 tattr)
-{
-    if (draw_buf_size >= DRAW_BUF_CAPACITY)
-        return;
-
-    draw_buf[draw_buf_size] = (DrawBufEntry){
-        .tx = tx,
-        .ty = ty,
-        .tattr = tattr,
-    };
-    ++draw_buf_size;
-}
-
-static inline void draw_buf_flush(void)
-{
-    for (size_t i = 0; i < draw_buf_size; ++i) {
-        const DrawBufEntry entry = draw_buf[i];
-        video_set_tile(entry.tx, entry.ty, entry.tattr);
-    }
-
-    draw_buf_size = 0;
-}
-
 static void randomize_apple(void)
 {
     static Position candidates[(VIDEO_TILES_H - 2) * (VIDEO_TILES_V - 2)];
@@ -256,48 +222,48 @@ static inline void game_step(void)
             --step_delay;
 
         randomize_apple();
-        draw_buf_push(apple.x, apple.y, TATTR_APPLE);
+        video_set_tile(apple.x, apple.y, TATTR_APPLE);
 
         audio_play_note(AUCH_SOUNDS, NOTE_E5, 9);
     } else {
-        draw_buf_push(prev_tail.pos.x, prev_tail.pos.y, TATTR_BACKGROUND);
+        video_set_tile(prev_tail.pos.x, prev_tail.pos.y, TATTR_BACKGROUND);
     }
 
     const SnakePart tail = snake[snake_size - 1];
 
     if (snake_size > 2) {
         if (head->dir == prev_dir)
-            draw_buf_push(snake[1].pos.x, snake[1].pos.y, TATTR_SNAKE_BODY[head->dir]);
+            video_set_tile(snake[1].pos.x, snake[1].pos.y, TATTR_SNAKE_BODY[head->dir]);
         else if (head->dir == (prev_dir + 1) % 4)
-            draw_buf_push(snake[1].pos.x, snake[1].pos.y, TATTR_SNAKE_BODY_TURN[head->dir]);
+            video_set_tile(snake[1].pos.x, snake[1].pos.y, TATTR_SNAKE_BODY_TURN[head->dir]);
         else
-            draw_buf_push(snake[1].pos.x, snake[1].pos.y,
-                          TATTR_SNAKE_BODY_TURN[dir_opposite(prev_dir)]);
+            video_set_tile(snake[1].pos.x, snake[1].pos.y,
+                           TATTR_SNAKE_BODY_TURN[dir_opposite(prev_dir)]);
     }
 
-    draw_buf_push(tail.pos.x, tail.pos.y, TATTR_SNAKE_TAIL[tail.dir]);
-    draw_buf_push(head->pos.x, head->pos.y, TATTR_SNAKE_HEAD[head->dir]);
+    video_set_tile(tail.pos.x, tail.pos.y, TATTR_SNAKE_TAIL[tail.dir]);
+    video_set_tile(head->pos.x, head->pos.y, TATTR_SNAKE_HEAD[head->dir]);
 }
 
 static bool sleeping;
 
+static bool frame_started(void)
+{
+    return !sleeping;
+}
+
+// Runs wait_fn, then sleeps until the next vertical blank
 static void wait_frame(void (*const wait_fn)())
 {
     sleeping = true;
-
-    while (sleeping)
-        (*wait_fn)();
+    (*wait_fn)();
+    wait_until(1U << IRQ_VBLANK, frame_started);
 }
 
-static bool enable_irq;
 static bool paused;
 
-__attribute__((interrupt)) void irq_handler(void)
+IRQ_HANDLER(irq_vblank_handler)
 {
-    if (!enable_irq)
-        return;
-
-    draw_buf_flush();
     sleeping = false;
 }
 
@@ -335,15 +301,13 @@ static void game_init(void)
     audio_set_paused(AUCH_MUSIC, false);
     audio_set_paused(AUCH_MUSIC_BASS, false);
 
-    draw_buf_push(snake[0].pos.x, snake[0].pos.y, TATTR_SNAKE_HEAD[snake[0].dir]);
-    draw_buf_push(apple.x, apple.y, TATTR_APPLE);
+    video_set_tile(snake[0].pos.x, snake[0].pos.y, TATTR_SNAKE_HEAD[snake[0].dir]);
+    video_set_tile(apple.x, apple.y, TATTR_APPLE);
 }
 
 // Runs at @ ~72 Hz
 static inline void fixed_loop(void)
 {
-    audio_tick();
-
     static u8 prev_joypad = 0xFF;
 
     const u8 joypad = joypad_read();
@@ -412,9 +376,9 @@ static inline void fixed_loop(void)
 
 void main(void)
 {
-    enable_irq = false;
     VCTRL->display_on = false;
 
+    lcd_init();
     audio_init();
     rand_seed();
 
@@ -433,16 +397,16 @@ void main(void)
     extern const u8 TDATA_SNAKE_TAIL_RIGHT[];
     extern const u8 TDATA_SNAKE_TAIL_DOWN[];
 
-    video_load_tdata(SPR_BACKGROUND, (const u16 *)TDATA_BACKGROUND);
-    video_load_tdata(SPR_APPLE, (const u16 *)TDATA_APPLE);
-    video_load_tdata(SPR_SNAKE_HEAD_RIGHT, (const u16 *)TDATA_SNAKE_HEAD_RIGHT);
-    video_load_tdata(SPR_SNAKE_HEAD_DOWN, (const u16 *)TDATA_SNAKE_HEAD_DOWN);
-    video_load_tdata(SPR_SNAKE_BODY_RIGHT, (const u16 *)TDATA_SNAKE_BODY_RIGHT);
-    video_load_tdata(SPR_SNAKE_BODY_DOWN, (const u16 *)TDATA_SNAKE_BODY_DOWN);
-    video_load_tdata(SPR_WALL, (const u16 *)TDATA_WALL);
-    video_load_tdata(SPR_SNAKE_BODY_TURN, (const u16 *)TDATA_SNAKE_BODY_TURN);
-    video_load_tdata(SPR_SNAKE_TAIL_RIGHT, (const u16 *)TDATA_SNAKE_TAIL_RIGHT);
-    video_load_tdata(SPR_SNAKE_TAIL_DOWN, (const u16 *)TDATA_SNAKE_TAIL_DOWN);
+    video_load_tdata(SPR_BACKGROUND, (const u16 *)TDATA_BACKGROUND, 1);
+    video_load_tdata(SPR_APPLE, (const u16 *)TDATA_APPLE, 1);
+    video_load_tdata(SPR_SNAKE_HEAD_RIGHT, (const u16 *)TDATA_SNAKE_HEAD_RIGHT, 1);
+    video_load_tdata(SPR_SNAKE_HEAD_DOWN, (const u16 *)TDATA_SNAKE_HEAD_DOWN, 1);
+    video_load_tdata(SPR_SNAKE_BODY_RIGHT, (const u16 *)TDATA_SNAKE_BODY_RIGHT, 1);
+    video_load_tdata(SPR_SNAKE_BODY_DOWN, (const u16 *)TDATA_SNAKE_BODY_DOWN, 1);
+    video_load_tdata(SPR_WALL, (const u16 *)TDATA_WALL, 1);
+    video_load_tdata(SPR_SNAKE_BODY_TURN, (const u16 *)TDATA_SNAKE_BODY_TURN, 1);
+    video_load_tdata(SPR_SNAKE_TAIL_RIGHT, (const u16 *)TDATA_SNAKE_TAIL_RIGHT, 1);
+    video_load_tdata(SPR_SNAKE_TAIL_DOWN, (const u16 *)TDATA_SNAKE_TAIL_DOWN, 1);
 
     // Top and bottom borders
     for (size_t x = 0; x < VIDEO_TILES_H; ++x) {
@@ -628,8 +592,9 @@ void main(void)
     audio_play_sequence(AUCH_MUSIC_BASS, music_bass, ARR_SIZE(music_bass), true);
 
     game_init();
+    video_present();
 
-    enable_irq = true;
+    irq_enable(IRQ_VBLANK);
 
     // Turn on display after next vblank
     wait_frame(rand_update);
@@ -638,6 +603,10 @@ void main(void)
     // Weeeeeeeeeeeeeeeeeee infinite loop
     while (true) {
         wait_frame(loop);
+
+        // Drawn into the hidden page, shown from the next vblank on
+        video_begin_frame();
         fixed_loop();
+        video_present();
     }
 }
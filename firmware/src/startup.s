@@ -1,13 +1,59 @@
 .section .text._start
 .global _start
-.extern irq_handler
 
 _start:
     la      sp, __stack_top
     la      gp, __global_pointer$
 
-    la      t0, irq_handler
+    # Vectored mode, each interrupt jumps to its own entry
+    la      t0, irq_vectors
+    ori     t0, t0, 1
     csrw    mtvec, t0
 
+    # Sources are still off in mie until something enables them
+    csrsi   mstatus, 8
+
     call    main
     j       .
+
+# One entry per interrupt cause, see Irq in tachyon.h. Handlers nobody defined
+# return right away. Entries are 4 bytes apart, so these jumps can't be
+# compressed.
+.section .text.irq_vectors
+.balign 4
+.option push
+.option norvc
+irq_vectors:
+    .rept 7
+    j       irq_unhandled
+    .endr
+    j       irq_timer_handler
+    .rept 8
+    j       irq_unhandled
+    .endr
+    j       irq_vblank_handler
+    j       irq_hblank_handler
+    j       irq_joypad_handler
+    j       irq_lcd_handler
+    j       irq_audio_handler
+    j       irq_dma_handler
+.option pop
+
+irq_unhandled:
+    mret
+
+.weak irq_timer_handler
+.weak irq_vblank_handler
+.weak irq_hblank_handler
+.weak irq_joypad_handler
+.weak irq_lcd_handler
+.weak irq_audio_handler
+.weak irq_dma_handler
+
+.set irq_timer_handler, irq_unhandled
+.set irq_vblank_handler, irq_unhandled
+.set irq_hblank_handler, irq_unhandled
+.set irq_joypad_handler, irq_unhandled
+.set irq_lcd_handler, irq_unhandled
+.set irq_audio_handler, irq_unhandled
+.set irq_dma_handler, irq_unhandled
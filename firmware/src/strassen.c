@@ -1,6 +1,8 @@
+#include "strassen.h"
+
 #define UMBRAL 16
 
-static void strassen_mul(const float *A, const float *B, float *C, int n)
+void strassen_mul(const float *A, const float *B, float *C, int n)
 {
     if (n <= UMBRAL) {
         const float *row_a = A;
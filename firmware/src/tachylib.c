@@ -3,14 +3,85 @@
 #include "tachyon.h"
 #include <stddef.h>
 
+static constexpr size_t LCD_QUEUE_SIZE = 256;
+static constexpr u8 LCD_WATERMARK = 4;
+
+// Set on queued instructions, as opposed to characters
+static constexpr u16 LCD_QUEUE_INSTR = 1 << 8;
+
+// Single producer (lcd_send), single consumer (lcd_pump)
+static volatile u16 lcd_queue[LCD_QUEUE_SIZE];
+static volatile size_t lcd_queue_head = 0;
+static volatile size_t lcd_queue_tail = 0;
+
+static void lcd_write(const u16 entry)
+{
+    if (entry & LCD_QUEUE_INSTR)
+        LCD->instr = entry;
+    else
+        LCD->data = entry;
+}
+
+static void lcd_send(const u16 entry)
+{
+    // Only skip the queue when it's empty, to keep everything in order
+    if (lcd_queue_head == lcd_queue_tail && !(LCD->status & LCD_FULL)) {
+        lcd_write(entry);
+        return;
+    }
+
+    const size_t next = (lcd_queue_tail + 1) % LCD_QUEUE_SIZE;
+
+    // Drop output rather than wait
+    if (next == lcd_queue_head)
+        return;
+
+    lcd_queue[lcd_queue_tail] = entry;
+    lcd_queue_tail = next;
+}
+
+static void lcd_pump(void)
+{
+    while (lcd_queue_head != lcd_queue_tail && !(LCD->status & LCD_FULL)) {
+        lcd_write(lcd_queue[lcd_queue_head]);
+        lcd_queue_head = (lcd_queue_head + 1) % LCD_QUEUE_SIZE;
+    }
+}
+
+IRQ_HANDLER(irq_lcd_handler)
+{
+    // Clears LCD_IRQ
+    LCD->watermark = LCD->watermark;
+    lcd_pump();
+}
+
+void lcd_init(void)
+{
+    LCD->watermark = LCD_WATERMARK_IRQ | LCD_WATERMARK;
+    irq_enable(IRQ_LCD);
+}
+
+// Waits until everything has been sent
+void lcd_flush(void)
+{
+    while (lcd_queue_head != lcd_queue_tail) {
+        // Nothing else drains the queue without the interrupt
+        if (!(LCD->watermark & LCD_WATERMARK_IRQ))
+            lcd_pump();
+    }
+
+    while (LCD->status & LCD_BUSY) {
+    }
+}
+
 void lcd_send_instr(const u8 instr)
 {
-    LCD->instr = instr;
+    lcd_send(LCD_QUEUE_INSTR | instr);
 }
 
 void lcd_print_char(const char c)
 {
-    LCD->data = c;
+    lcd_send((u8)c);
 }
 
 void lcd_print(const char *restrict s)
@@ -60,85 +131,200 @@ void lcd_print_hex(const u32 n)
     }
 }
 
+u64 timer_now(void)
+{
+    u32 hi, lo;
+
+    // Retry if the low half wrapped in between
+    do {
+        hi = TIMER->mtimeh;
+        lo = TIMER->mtime;
+    } while (TIMER->mtimeh != hi);
+
+    return ((u64)hi << 32) | lo;
+}
+
+void timer_set_alarm(const u64 time)
+{
+    // Keep it from passing through a value earlier than both the old and new one
+    TIMER->mtimecmph = UINT32_MAX;
+    TIMER->mtimecmp = time;
+    TIMER->mtimecmph = time >> 32;
+}
+
+IRQ_HANDLER(irq_timer_handler)
+{
+    // Stays pending until mtimecmp moves on
+    irq_disable(IRQ_TIMER);
+}
+
+void wait_until(const u32 irqs, bool (*const done)(void))
+{
+    u32 enabled;
+    __asm__ volatile("csrrs %0, mie, %1" : "=r"(enabled) : "r"(irqs));
+
+    while (true) {
+        u32 mstatus;
+        __asm__ volatile("csrrci %0, mstatus, 8" : "=r"(mstatus));
+
+        const bool finished = done();
+        if (!finished)
+            cpu_wait();
+
+        // Whatever woke it up is taken here
+        __asm__ volatile("csrs mstatus, %0" : : "r"(mstatus & 8));
+
+        if (finished)
+            break;
+    }
+
+    __asm__ volatile("csrc mie, %0" : : "r"(irqs & ~enabled));
+}
+
+static u64 deadline;
+
+static bool deadline_passed(void)
+{
+    return timer_now() >= deadline;
+}
+
+void sleep_until(const u64 time)
+{
+    deadline = time;
+    timer_set_alarm(time);
+    wait_until(1U << IRQ_TIMER, deadline_passed);
+}
+
+void sleep_cycles(const u64 cycles)
+{
+    sleep_until(timer_now() + cycles);
+}
+
+void dma_wait(void)
+{
+    while (DMA->status & DMA_BUSY) {
+    }
+}
+
+// Transfers only start once the previous one is done, so the source of a copy
+// must be left alone until the next dma_wait().
+void dma_copy(volatile void *const dst, const void *const src, const size_t count, const u32 size)
+{
+    const u32 step = 1 << size;
+
+    dma_wait();
+    DMA->src = (u32)src;
+    DMA->dst = (u32)dst;
+    DMA->count = count;
+    DMA->stride = (step << 16) | step;
+    DMA->ctrl = size;
+}
+
+void dma_scatter(volatile void *const base, const u32 entries[], const size_t count,
+                 const u32 size)
+{
+    dma_wait();
+    DMA->src = (u32)entries;
+    DMA->dst = (u32)base;
+    DMA->count = count;
+    DMA->ctrl = size | DMA_SCATTER;
+}
+
+// Too short to be worth setting up a transfer
 void video_load_palette(const size_t pal_idx, const u16 palette[])
 {
     for (size_t i = 0; i < VIDEO_PALETTE_SIZE; ++i)
         VPALETTE[(VIDEO_PALETTE_SIZE * pal_idx) + i] = palette[i];
 }
 
-void video_load_tdata(const size_t tdata_idx, const u16 data[])
+void video_load_tdata(const size_t tdata_idx, const u16 data[], const size_t count)
 {
-    for (size_t i = 0; i < 8; ++i)
-        VTDATA[(8 * tdata_idx) + i] = data[i];
+    dma_copy(&VTDATA[8 * tdata_idx], data, 8 * count, DMA_SIZE_HALF);
 }
 
-void video_set_tile(const u8 tx, const u8 ty, const u8 tattr)
+// The page shown after reset is 0
+static size_t video_back_page = 1;
+
+void video_set_tile(const u8 tx, const u8 ty, const u16 tattr)
 {
-    VTATTR[(ty * VIDEO_TILES_H) + tx] = tattr;
+    // Don't race a pending upload
+    dma_wait();
+    VTATTR[(VTATTR_PAGE_SIZE * video_back_page) + (ty * VIDEO_MAP_W) + tx] = tattr;
 }
 
-typedef struct {
-    const AudioSequencePart *seq;
-    u32 cur_note;
-    size_t seq_size;
-    size_t seq_idx_next;
-    size_t timer;
-    bool is_playing;
-    bool loop;
-    bool paused;
-} AudioChannelPlayer;
+void video_begin_frame(void)
+{
+    while (VCTRL->page & VIDEO_FLIP_PENDING) {
+    }
+
+    volatile u16 *const back = &VTATTR[VTATTR_PAGE_SIZE * video_back_page];
+    volatile u16 *const front = &VTATTR[VTATTR_PAGE_SIZE * (video_back_page ^ 1)];
 
-static AudioChannelPlayer audio_ctrl[AUDIO_CHANNELS];
+    dma_copy(back, (const void *)front, VTATTR_SIZE, DMA_SIZE_HALF);
+}
+
+void video_present(void)
+{
+    // Tiles still on their way would land in the shown page
+    dma_wait();
+
+    VCTRL->page = video_back_page;
+    video_back_page ^= 1;
+}
+
+void video_set_scroll(const u8 x, const u8 y)
+{
+    VCTRL->scroll_x = x;
+    VCTRL->scroll_y = y;
+}
+
+void video_set_sprite(const size_t idx, const u8 x, const u8 y, const u16 tattr)
+{
+    VCTRL->sprites[idx] = VIDEO_SPRITE_ENABLE | ((u32)tattr << 16) | ((u32)y << 8) | x;
+}
+
+void video_hide_sprite(const size_t idx)
+{
+    VCTRL->sprites[idx] = 0;
+}
+
+// audio_play_note plays its note as a one-step sequence, which the sequencer
+// reads from RAM, so it has to outlive the call
+static AudioSequencePart audio_notes[AUDIO_CHANNELS];
 
 void audio_init(void)
 {
     for (size_t i = 0; i < AUDIO_CHANNELS; ++i) {
+        AUDIO->channels[i].ctrl = AUDIO_STOP;
         AUDIO->channels[i].note = NOTE_NONE;
-
-        audio_ctrl[i] = (AudioChannelPlayer){
-            .seq = nullptr,
-            .cur_note = NOTE_NONE,
-            .seq_size = 0,
-            .seq_idx_next = 0,
-            .timer = 0,
-            .is_playing = false,
-            .loop = false,
-            .paused = false,
-        };
     }
 }
 
 void audio_play_note(const size_t channel, const MusicNote note, const size_t duration)
 {
-    audio_ctrl[channel].seq = nullptr;
-    audio_ctrl[channel].cur_note = note;
-    audio_ctrl[channel].seq_size = 0;
-    audio_ctrl[channel].seq_idx_next = 0;
-    audio_ctrl[channel].timer = duration;
-    audio_ctrl[channel].is_playing = true;
+    audio_notes[channel] = (AudioSequencePart){.note = note, .duration = duration};
+
+    AUDIO->channels[channel].seq = (u32)&audio_notes[channel];
+    AUDIO->channels[channel].seq_size = 1;
+    AUDIO->channels[channel].ctrl = AUDIO_START;
 
+    // Sound right away instead of on the next tick
     AUDIO->channels[channel].note = note;
 }
 
 void audio_play_sequence(const size_t channel, const AudioSequencePart seq[], const size_t n,
                          const bool loop)
 {
-    audio_ctrl[channel].seq = seq;
-    audio_ctrl[channel].seq_size = n;
-    audio_ctrl[channel].seq_idx_next = 0;
-    audio_ctrl[channel].timer = 0;
-    audio_ctrl[channel].is_playing = true;
-    audio_ctrl[channel].loop = loop;
+    AUDIO->channels[channel].seq = (u32)seq;
+    AUDIO->channels[channel].seq_size = n;
+    AUDIO->channels[channel].ctrl = AUDIO_START | (loop ? AUDIO_LOOP : 0);
 }
 
 void audio_set_paused(const size_t channel, const bool paused)
 {
-    audio_ctrl[channel].paused = paused;
-
-    if (paused)
-        AUDIO->channels[channel].note = NOTE_NONE;
-    else
-        AUDIO->channels[channel].note = audio_ctrl[channel].cur_note;
+    // Without START or STOP, the sequence carries on from where it was
+    const u32 ctrl = AUDIO->channels[channel].ctrl;
+    AUDIO->channels[channel].ctrl = (ctrl & AUDIO_LOOP) | (paused ? AUDIO_PAUSE : 0);
 }
 
 void audio_set_volume(const size_t channel, const u16 volume)
@@ -146,52 +332,109 @@ void audio_set_volume(const size_t channel, const u16 volume)
     AUDIO->channels[channel].volume = volume;
 }
 
-void audio_tick(void)
+static bool joypad_done(void)
 {
-    for (size_t i = 0; i < AUDIO_CHANNELS; ++i) {
-        AudioChannelPlayer *const ctrl = &audio_ctrl[i];
-
-        if (!ctrl->is_playing || ctrl->paused)
-            continue;
-
-        if (ctrl->timer == 0) {
-            if (ctrl->seq_idx_next >= ctrl->seq_size) {
-                // Finished sound/sequence
-                AUDIO->channels[i].note = NOTE_NONE;
+    return JOYPAD->data_valid;
+}
 
-                ctrl->seq = nullptr;
-                ctrl->cur_note = NOTE_NONE;
-                ctrl->seq_size = 0;
-                ctrl->seq_idx_next = 0;
-                ctrl->is_playing = false;
-            } else {
-                // Next sequence part
-                const AudioSequencePart part = ctrl->seq[ctrl->seq_idx_next];
-                AUDIO->channels[i].note = part.note;
+static bool joypad_done_or_late(void)
+{
+    return JOYPAD->data_valid || timer_now() >= deadline;
+}
 
-                ctrl->cur_note = part.note;
-                ctrl->timer = part.duration;
-                ++ctrl->seq_idx_next;
+u8 joypad_read(void)
+{
+    while (!JOYPAD->ready) {
+    }
 
-                if (ctrl->loop && ctrl->seq_idx_next >= ctrl->seq_size)
-                    ctrl->seq_idx_next = 0;
-            }
-        }
+    JOYPAD->start_read = 1;
+    wait_until(1U << IRQ_JOYPAD, joypad_done);
 
-        if (ctrl->is_playing)
-            --ctrl->timer;
-    }
+    return JOYPAD->data;
 }
 
-u8 joypad_read(void)
+bool joypad_read_timeout(u8 *const buttons, const u64 timeout)
 {
     while (!JOYPAD->ready) {
     }
 
+    deadline = timer_now() + timeout;
+    timer_set_alarm(deadline);
+
     JOYPAD->start_read = 1;
+    wait_until(1U << IRQ_JOYPAD | 1U << IRQ_TIMER, joypad_done_or_late);
+
+    if (!JOYPAD->data_valid)
+        return false;
+
+    *buttons = JOYPAD->data;
+    return true;
+}
 
-    while (!JOYPAD->data_valid) {
+// The counters are read in halves, so retry if the high half changed meanwhile
+#define DEFINE_CSR_READ64(csr)                                       \
+    static u64 csr_read_##csr(void)                                  \
+    {                                                                \
+        u32 hi, lo, hi_again;                                        \
+                                                                     \
+        do {                                                         \
+            __asm__ volatile("csrr %0, " #csr "h" : "=r"(hi));       \
+            __asm__ volatile("csrr %0, " #csr : "=r"(lo));           \
+            __asm__ volatile("csrr %0, " #csr "h" : "=r"(hi_again)); \
+        } while (hi != hi_again);                                    \
+                                                                     \
+        return ((u64)hi << 32) | lo;                                 \
     }
 
-    return JOYPAD->data;
+DEFINE_CSR_READ64(mcycle)
+DEFINE_CSR_READ64(minstret)
+DEFINE_CSR_READ64(mhpmcounter3)
+DEFINE_CSR_READ64(mhpmcounter4)
+DEFINE_CSR_READ64(mhpmcounter5)
+DEFINE_CSR_READ64(mhpmcounter6)
+
+void perf_select(const size_t counter, const PerfEvent event)
+{
+    // CSR numbers are immediates, so each counter needs its own instruction
+    switch (counter) {
+    case 0:
+        __asm__ volatile("csrw mhpmevent3, %0" : : "r"(event));
+        break;
+    case 1:
+        __asm__ volatile("csrw mhpmevent4, %0" : : "r"(event));
+        break;
+    case 2:
+        __asm__ volatile("csrw mhpmevent5, %0" : : "r"(event));
+        break;
+    case 3:
+        __asm__ volatile("csrw mhpmevent6, %0" : : "r"(event));
+        break;
+    default:
+        break;
+    }
+}
+
+void perf_snapshot(PerfSnapshot *const snap)
+{
+    snap->cycles = csr_read_mcycle();
+    snap->instret = csr_read_minstret();
+    snap->counters[0] = csr_read_mhpmcounter3();
+    snap->counters[1] = csr_read_mhpmcounter4();
+    snap->counters[2] = csr_read_mhpmcounter5();
+    snap->counters[3] = csr_read_mhpmcounter6();
+}
+
+void perf_print_delta(const PerfSnapshot *const start, const PerfSnapshot *const end)
+{
+    lcd_print("cyc ");
+    lcd_print_hex(end->cycles - start->cycles);
+    lcd_print(" ins ");
+    lcd_print_hex(end->instret - start->instret);
+
+    for (size_t i = 0; i < PERF_COUNTERS; ++i) {
+        lcd_print(" e");
+        lcd_print_int(i + 3);
+        lcd_print_char(' ');
+        lcd_print_hex(end->counters[i] - start->counters[i]);
+    }
 }
@@ -64,6 +64,66 @@ typedef enum : u32 {
     NOTE_F6 = FREQ_TO_PERIOD(1396),
 } MusicNote;
 
+// Defines the handler for an interrupt, named as in Irq (see tachyon.h), e.g.
+// IRQ_HANDLER(irq_vblank_handler) { ... }. With SHADOW_REGS the core already
+// keeps the interrupted program's integer registers apart, so the handler is
+// an ordinary function called from a bare entry that only has to mret. Float
+// registers aren't banked, so such handlers must leave them alone.
+#ifdef SHADOW_REGS
+#define IRQ_HANDLER(name)                                                                          \
+    __attribute__((used)) static void name##_body(void);                                           \
+    __attribute__((naked)) void name(void)                                                         \
+    {                                                                                              \
+        __asm__ volatile("call " #name "_body\n\tmret");                                           \
+    }                                                                                              \
+    static void name##_body(void)
+#else
+#define IRQ_HANDLER(name) __attribute__((interrupt)) void name(void)
+#endif
+
+// Interrupts are globally enabled from startup, each source only once it's
+// enabled here.
+static inline void irq_enable(const Irq irq)
+{
+    __asm__ volatile("csrs mie, %0" : : "r"(1U << irq));
+}
+
+static inline void irq_disable(const Irq irq)
+{
+    __asm__ volatile("csrc mie, %0" : : "r"(1U << irq));
+}
+
+// Stops fetching instructions until an interrupt enabled in mie is pending,
+// see wait_until()
+static inline void cpu_wait(void)
+{
+    __asm__ volatile("wfi");
+}
+
+// Sleeps until done() returns true, checking it again whenever one of the
+// interrupts in irqs (a mask of 1U << Irq, enabled meanwhile) comes up.
+// Interrupts stay off between the check and the wfi, so one arriving in
+// between wakes it up right away instead of being missed.
+void wait_until(u32 irqs, bool (*done)(void));
+
+// Clock cycles since reset
+u64 timer_now(void);
+
+// Raises IRQ_TIMER once timer_now() reaches time. tachylib's handler turns
+// IRQ_TIMER off when it fires, so each alarm is only taken once.
+void timer_set_alarm(u64 time);
+
+// Sleeps until timer_now() reaches time, or for a number of cycles
+void sleep_until(u64 time);
+void sleep_cycles(u64 cycles);
+
+// LCD output never blocks: whatever doesn't fit in the hardware FIFO waits in
+// a software queue, which irq_lcd_handler() tops it up from. lcd_init() has the
+// LCD raise IRQ_LCD when its FIFO runs low.
+void lcd_init(void);
+
+void lcd_flush(void);
+
 void lcd_send_instr(u8 instr);
 
 void lcd_print_char(char c);
@@ -76,15 +136,45 @@ void lcd_print_int(int n);
 
 void lcd_print_hex(u32 n);
 
+// Scatter list entry writing value at offset bytes from the transfer base
+static inline u32 dma_scatter_entry(const u16 offset, const u16 value)
+{
+    return ((u32)value << 16) | offset;
+}
+
+// The DMA has a single set of registers, so once an interrupt handler starts
+// transfers nothing else should.
+void dma_wait(void);
+
+void dma_copy(volatile void *dst, const void *src, size_t count, u32 size);
+
+void dma_scatter(volatile void *base, const u32 entries[], size_t count, u32 size);
+
 void video_load_palette(size_t pal_idx, const u16 palette[]);
 
-void video_load_tdata(const size_t tdata_idx, const u16 data[]);
+// Loads count consecutive tiles, as laid out by tools/generate_tdata.sh
+void video_load_tdata(const size_t tdata_idx, const u16 data[], size_t count);
 
-void video_set_tile(u8 tx, u8 ty, u8 tattr);
+// Draws into the hidden tile attribute page, see video_begin_frame()
+void video_set_tile(u8 tx, u8 ty, u16 tattr);
 
-void audio_init(void);
+// Waits for the last video_present() to take effect, then copies the shown page
+// into the hidden one so that drawing can carry on from it
+void video_begin_frame(void);
+
+// Shows the hidden page from the next vertical blank on
+void video_present(void);
+
+// Takes effect along with the next page flip
+void video_set_scroll(u8 x, u8 y);
 
-void audio_tick(void);
+// Places a sprite with its top left corner at screen pixel (x, y). Positions
+// wrap around at 256, so sprites can stick out of the left and top edges.
+void video_set_sprite(size_t idx, u8 x, u8 y, u16 tattr);
+
+void video_hide_sprite(size_t idx);
+
+void audio_init(void);
 
 void audio_set_paused(size_t channel, bool paused);
 
@@ -96,4 +186,19 @@ void audio_play_sequence(size_t channel, const AudioSequencePart seq[], const si
 
 u8 joypad_read(void);
 
+// Like joypad_read(), but gives up after timeout cycles and returns false
+bool joypad_read_timeout(u8 *buttons, u64 timeout);
+
+typedef struct {
+    u64 cycles;
+    u64 instret;
+    u64 counters[PERF_COUNTERS];
+} PerfSnapshot;
+
+void perf_select(size_t counter, PerfEvent event);
+
+void perf_snapshot(PerfSnapshot *snap);
+
+void perf_print_delta(const PerfSnapshot *start, const PerfSnapshot *end);
+
 #endif
@@ -19,33 +19,96 @@ constexpr size_t VIDEO_TILES_H = 25;
 constexpr size_t VIDEO_TILES_V = 19;
 constexpr size_t VIDEO_TILES_TOTAL = VIDEO_TILES_H * VIDEO_TILES_V;
 
-constexpr size_t VTATTR_SIZE = VIDEO_TILES_TOTAL;
+// The screen shows VIDEO_TILES_H x VIDEO_TILES_V tiles out of a larger map,
+// starting at the scroll offsets and wrapping around its edges
+constexpr size_t VIDEO_MAP_W = 32;
+constexpr size_t VIDEO_MAP_H = 32;
 
-constexpr size_t VIDEO_VPAL_SIZE = 4;
+// Screen size in pixels, with tiles being 8x8
+constexpr size_t VIDEO_WIDTH = 200;
+constexpr size_t VIDEO_HEIGHT = 150;
+
+// Tile attributes come in two pages of a whole map each, one after the other
+constexpr size_t VTATTR_SIZE = VIDEO_MAP_W * VIDEO_MAP_H;
+constexpr size_t VTATTR_PAGE_SIZE = VTATTR_SIZE;
+
+constexpr size_t VIDEO_VPAL_SIZE = 8;
 constexpr size_t VIDEO_PALETTE_SIZE = 4;
 
+// Writes to instr and data are queued in a hardware FIFO, see lcd_unit
 typedef struct {
     union {
         volatile u8 instr;
         volatile const u8 status;
     };
     volatile u8 data;
+    volatile const u8 level;
+    // LCD_WATERMARK_IRQ and the FIFO level that raises it. Writing it clears
+    // LCD_IRQ and LCD_OVERFLOW.
+    volatile u8 watermark;
 } Lcd;
 
+constexpr size_t LCD_FIFO_DEPTH = 16;
+
+constexpr u8 LCD_BUSY = 1 << 0;
+constexpr u8 LCD_FULL = 1 << 1;
+constexpr u8 LCD_IRQ = 1 << 2;
+constexpr u8 LCD_OVERFLOW = 1 << 3;
+
+constexpr u8 LCD_WATERMARK_IRQ = 1 << 7;
+
+constexpr size_t VIDEO_SPRITES = 32;
+constexpr size_t VIDEO_SPRITES_PER_LINE = 8;
+
 typedef struct {
     volatile bool display_on;
+    u8 _pad[3];
+    // Page to show from the next vertical blank. Reads back VIDEO_PAGE_SHOWN
+    // and VIDEO_FLIP_PENDING.
+    volatile u32 page;
+    // Map pixel at the top left corner of the screen, from the next vertical
+    // blank on
+    volatile u32 scroll_x;
+    volatile u32 scroll_y;
+    u32 _reserved[60];
+    // {tattr, y, x}, with VIDEO_SPRITE_ENABLE set in tattr, see video_set_sprite()
+    volatile u32 sprites[VIDEO_SPRITES];
 } VideoControl;
 
+constexpr u32 VIDEO_PAGE_SHOWN = 1 << 0;
+constexpr u32 VIDEO_FLIP_PENDING = 1 << 1;
+
+// Bit 11 of a sprite's tattr, unused by tiles
+constexpr u32 VIDEO_SPRITE_ENABLE = 1 << 27;
+
 constexpr size_t AUDIO_CHANNELS = 4;
 constexpr u16 AUDIO_MAX_VOLUME = 256;
 
+constexpr u32 AUDIO_START = 1 << 0;
+constexpr u32 AUDIO_LOOP = 1 << 1;
+constexpr u32 AUDIO_PAUSE = 1 << 2;
+constexpr u32 AUDIO_STOP = 1 << 3;
+
+constexpr u32 AUDIO_PLAYING = 1 << 0;
+
 typedef struct {
     volatile u32 note;
     volatile u16 volume;
+    u16 _pad;
+    // Array of {note, duration} pairs, durations in ticks
+    volatile u32 seq;
+    volatile u32 seq_size;
+    // Write AUDIO_START/LOOP/PAUSE/STOP, read AUDIO_PLAYING/LOOP/PAUSE
+    volatile u32 ctrl;
+    volatile const u32 position;
+    volatile const u32 timer;
+    u32 _reserved;
 } AudioChannel;
 
 typedef struct {
     AudioChannel channels[AUDIO_CHANNELS];
+    // Cycles per sequencer tick, one video frame by default
+    volatile u32 tick;
 } AudioControl;
 
 typedef struct {
@@ -57,7 +120,47 @@ typedef struct {
     volatile const u8 data;
 } Joypad;
 
-constexpr size_t VIDEO_TDATA_SIZE = 16 * 8;
+constexpr size_t VIDEO_TDATA_TILES = 256;
+constexpr size_t VIDEO_TDATA_SIZE = VIDEO_TDATA_TILES * 8;
+
+// Copies over the bus in the background, see dma_unit
+typedef struct {
+    volatile u32 src;
+    volatile u32 dst;
+    volatile u32 count;
+    volatile u32 stride;
+    volatile u32 ctrl;
+    volatile u32 status;
+} Dma;
+
+constexpr u32 DMA_SIZE_BYTE = 0;
+constexpr u32 DMA_SIZE_HALF = 1;
+constexpr u32 DMA_SIZE_WORD = 2;
+constexpr u32 DMA_SCATTER = 1 << 2;
+constexpr u32 DMA_IRQ = 1 << 3;
+
+constexpr u32 DMA_BUSY = 1 << 0;
+constexpr u32 DMA_DONE = 1 << 1;
+
+// Machine timer, see timer_unit. mtime counts clock cycles.
+typedef struct {
+    volatile u32 mtime;
+    volatile u32 mtimeh;
+    volatile u32 mtimecmp;
+    volatile u32 mtimecmph;
+} Timer;
+
+// Interrupt causes, which are also their bits in mie and mip. Each one has an
+// entry in the vector table in startup.s, calling the handler named after it.
+typedef enum : u32 {
+    IRQ_TIMER = 7,   // irq_timer_handler
+    IRQ_VBLANK = 16, // irq_vblank_handler
+    IRQ_HBLANK,      // irq_hblank_handler
+    IRQ_JOYPAD,      // irq_joypad_handler, a joypad read finished
+    IRQ_LCD,         // irq_lcd_handler, taken by tachylib
+    IRQ_AUDIO,       // irq_audio_handler, a sequence that doesn't loop ended
+    IRQ_DMA,         // irq_dma_handler, a transfer with DMA_IRQ finished
+} Irq;
 
 constexpr u8 JP_RIGHT = 1 << 0;
 constexpr u8 JP_LEFT = 1 << 1;
@@ -68,19 +171,45 @@ constexpr u8 JP_SELECT = 1 << 5;
 constexpr u8 JP_B = 1 << 6;
 constexpr u8 JP_A = 1 << 7;
 
+// mhpmcounter3 and up, each counting the cycles its mhpmevent selector is high
+constexpr size_t PERF_COUNTERS = 4;
+
+typedef enum : u32 {
+    PERF_NONE,
+    PERF_LOAD_USE,
+    PERF_FP_STALL,
+    PERF_MULDIV_STALL,
+    PERF_BRANCH_FLUSH,
+    PERF_TRAP,
+    PERF_ICACHE_STALL,
+    PERF_DCACHE_STALL,
+    PERF_MMIO_RNG,
+    PERF_MMIO_VTATTR,
+    PERF_MMIO_VTDATA,
+    PERF_MMIO_JOYPAD,
+    PERF_MMIO_VPAL,
+    PERF_MMIO_VCTRL,
+    PERF_MMIO_LCD,
+    PERF_MMIO_AUDIO,
+} PerfEvent;
+
 constexpr size_t RNG_BASE = 0x2000'0000;
+constexpr size_t DMA_BASE = 0x3000'0000;
 constexpr size_t VTATTR_BASE = 0x4000'0000;
 constexpr size_t VTDATA_BASE = 0x5000'0000;
 constexpr size_t JOYPAD_BASE = 0x6000'0000;
+constexpr size_t TIMER_BASE = 0x7000'0000;
 constexpr size_t VPALETTE_BASE = 0x8000'0000;
 constexpr size_t VCTRL_BASE = 0xA000'0000;
 constexpr size_t LCD_BASE = 0xC000'0000;
 constexpr size_t AUDIO_BASE = 0xE000'0000;
 
 #define RNG (*(volatile u32 *)RNG_BASE)
-#define VTATTR ((volatile u8 *)VTATTR_BASE)
+#define DMA ((Dma *)DMA_BASE)
+#define VTATTR ((volatile u16 *)VTATTR_BASE)
 #define VTDATA ((volatile u16 *)VTDATA_BASE)
 #define JOYPAD ((Joypad *)JOYPAD_BASE)
+#define TIMER ((Timer *)TIMER_BASE)
 #define VPALETTE ((volatile u16 *)VPALETTE_BASE)
 #define VCTRL ((VideoControl *)VCTRL_BASE)
 #define LCD ((Lcd *)LCD_BASE)
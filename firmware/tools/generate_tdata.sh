@@ -1,6 +1,11 @@
 #!/usr/bin/env bash
 set -euo pipefail
 
+# Turns a .tdata file into a C array of tile data, in the format the video unit
+# takes. Each line is a row of 8 color indices from 0 to 3. Files may hold any
+# number of 8x8 tiles one below the other, which end up consecutive in the
+# array, so a whole tile set can be loaded with a single video_load_tdata().
+
 pack_row() {
     local row="$1"
     local lo=0
@@ -12,14 +17,36 @@ pack_row() {
         lo=$(( lo | (b0 << (7-i)) ))
         hi=$(( hi | (b1 << (7-i)) ))
     done
-    printf "%02x %02x\n" "$lo" "$hi"
+    printf "  0x%02x, 0x%02x,\n" "$lo" "$hi"
 }
 
 input_file="$1"
 basename=$(basename "$input_file")
 pic_name="TDATA_${basename%.*}"
+pic_name="${pic_name^^}"
+
+rows=0
+data=""
+
+while IFS= read -r line || [[ -n "$line" ]]; do
+    [[ -z "$line" ]] && continue
+
+    if [[ ! "$line" =~ ^[0-3]{8}$ ]]; then
+        echo "$input_file:$((rows + 1)): expected 8 digits from 0 to 3, got '$line'" >&2
+        exit 1
+    fi
+
+    data+=$(pack_row "$line")$'\n'
+    rows=$((rows + 1))
+done < "$input_file"
+
+if (( rows == 0 || rows % 8 != 0 )); then
+    echo "$input_file: $rows rows, expected a multiple of 8" >&2
+    exit 1
+fi
 
-while IFS= read -r line; do
-    digits=$(printf "%s" "$line")
-    pack_row "$digits"
-done < "$input_file" | xxd -r -p | xxd -i -n "$pic_name" -C
+# Read as u16 rows, so it has to be halfword aligned
+echo "const unsigned char ${pic_name}[] __attribute__((aligned(2))) = {"
+printf "%s" "$data"
+echo "};"
+echo "const unsigned int ${pic_name}_TILES = $((rows / 8));"
@@ -1,9 +1,56 @@
 `ifndef CPU_CSR_FILE_VH
 `define CPU_CSR_FILE_VH
 
+`define CSR_FFLAGS 12'h001
+`define CSR_FRM 12'h002
+`define CSR_FCSR 12'h003
+`define CSR_MSTATUS 12'h300
+`define CSR_MIE 12'h304
 `define CSR_MTVEC 12'h305
 `define CSR_MEPC 12'h341
+`define CSR_MCAUSE 12'h342
+`define CSR_MIP 12'h344
 `define CSR_MCYCLE 12'hB00
 `define CSR_MINSTRET 12'hB02
+`define CSR_MCYCLEH 12'hB80
+`define CSR_MINSTRETH 12'hB82
+
+`define MSTATUS_MIE 3
+`define MSTATUS_MPIE 7
+
+// Interrupt causes, and bits of mie/mip. Local interrupts are numbered from
+// IRQ_LOCAL up, one per line into the core.
+`define IRQ_MTI 7
+`define IRQ_LOCAL 16
+`define IRQ_LOCAL_LINES 16
+
+// Counter n lives at base + n, for n = 3 up to 3 + HPM_COUNTERS - 1
+`define CSR_MHPMEVENT3 12'h323
+`define CSR_MHPMCOUNTER3 12'hB03
+`define CSR_MHPMCOUNTER3H 12'hB83
+
+// Events selectable through mhpmevent. Each counter adds one for every cycle
+// its event is high.
+`define HPM_EVENT_BITS 4
+`define HPM_EVENTS 16
+
+`define HPM_EVENT_NONE 4'd0
+`define HPM_EVENT_LOAD_USE 4'd1
+`define HPM_EVENT_FP_STALL 4'd2
+`define HPM_EVENT_MULDIV_STALL 4'd3
+`define HPM_EVENT_BRANCH_FLUSH 4'd4
+`define HPM_EVENT_TRAP 4'd5
+`define HPM_EVENT_ICACHE_STALL 4'd6
+`define HPM_EVENT_DCACHE_STALL 4'd7
+
+// Accesses to each peripheral, reported by the system around the core
+`define HPM_EVENT_MMIO_RNG 4'd8
+`define HPM_EVENT_MMIO_VTATTR 4'd9
+`define HPM_EVENT_MMIO_VTDATA 4'd10
+`define HPM_EVENT_MMIO_JOYPAD 4'd11
+`define HPM_EVENT_MMIO_VPAL 4'd12
+`define HPM_EVENT_MMIO_VCTRL 4'd13
+`define HPM_EVENT_MMIO_LCD 4'd14
+`define HPM_EVENT_MMIO_AUDIO 4'd15
 
 `endif
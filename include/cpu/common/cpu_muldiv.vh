@@ -0,0 +1,13 @@
+`ifndef CPU_MULDIV_VH
+`define CPU_MULDIV_VH
+
+`define MD_MUL 3'b000
+`define MD_MULH 3'b001
+`define MD_MULHSU 3'b010
+`define MD_MULHU 3'b011
+`define MD_DIV 3'b100
+`define MD_DIVU 3'b101
+`define MD_REM 3'b110
+`define MD_REMU 3'b111
+
+`endif
@@ -1,10 +1,39 @@
 `ifndef MACROS_VH
 `define MACROS_VH
 
-`define OP_ADD 3'b000
-`define OP_SUB 3'b001
-`define OP_MUL 3'b010
-`define OP_DIV 3'b100
+`define OP_ADD 4'b0000
+`define OP_SUB 4'b0001
+`define OP_MUL 4'b0010
+`define OP_FMADD 4'b0011
+`define OP_DIV 4'b0100
+`define OP_FMSUB 4'b0101
+`define OP_FNMSUB 4'b0110
+`define OP_FNMADD 4'b0111
+`define OP_SQRT 4'b1000
+
+// Operations of fp_misc, which are done in a single cycle outside float_alu
+`define FP_MISC_SGNJ 4'd0
+`define FP_MISC_SGNJN 4'd1
+`define FP_MISC_SGNJX 4'd2
+`define FP_MISC_MIN 4'd3
+`define FP_MISC_MAX 4'd4
+`define FP_MISC_EQ 4'd5
+`define FP_MISC_LT 4'd6
+`define FP_MISC_LE 4'd7
+`define FP_MISC_CVT_W 4'd8
+`define FP_MISC_CVT_WU 4'd9
+`define FP_MISC_CVT_S_W 4'd10
+`define FP_MISC_CVT_S_WU 4'd11
+`define FP_MISC_CLASS 4'd12
+
+// Rounding modes, as in the rm field of instructions and frm. RM_DYN picks
+// the one in frm.
+`define RM_RNE 3'b000
+`define RM_RTZ 3'b001
+`define RM_RDN 3'b010
+`define RM_RUP 3'b011
+`define RM_RMM 3'b100
+`define RM_DYN 3'b111
 
 `define F_INEXACT 0
 `define F_UNDERFLOW 1
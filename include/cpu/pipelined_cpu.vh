@@ -0,0 +1,13 @@
+`ifndef PIPELINED_CPU_VH
+`define PIPELINED_CPU_VH
+
+`define BP_NONE 2'd0
+`define BP_BIMODAL 2'd1
+`define BP_GSHARE 2'd2
+
+`define BTB_KIND_COND 2'd0
+`define BTB_KIND_JUMP 2'd1
+`define BTB_KIND_CALL 2'd2
+`define BTB_KIND_RET 2'd3
+
+`endif
@@ -20,6 +20,8 @@
 `define RESULT_SRC_PC_TARGET 3'd2
 `define RESULT_SRC_PC_STEP 3'd3
 `define RESULT_SRC_FP_ALU 3'd4
+`define RESULT_SRC_MULDIV 3'd5
+`define RESULT_SRC_FP_MISC 3'd6
 
 `define REGW_SRC_RESULT 1'd0
 `define REGW_SRC_CSR 1'd1
@@ -0,0 +1,278 @@
+`ifndef AUDIO_UNIT_REF_VH
+`define AUDIO_UNIT_REF_VH
+
+// audio_unit as it was before its mixer's dividers were replaced by phase
+// accumulators, for benches to compare the mixer against. Periods take effect
+// as soon as they're written.
+module audio_unit_ref #(
+    parameter PWM_WIDTH = 8,
+    parameter WAVE_DATA_SIZE = 256,
+    parameter WAVE_DATA_SOURCE = "/home/jdgt/Code/utec/arqui/riscv-cpu/data/cosine.mem",
+    // One frame of video_unit, as firmware used to tick sequences on v_sync
+    parameter TICK_CYCLES = 1040 * 666
+) (
+    input wire clk,
+    input wire rst_n,
+
+    input wire [7:0] addr,
+
+    input wire [31:0] wdata,
+    input wire wenable,
+    output reg [31:0] rdata,
+
+    // Sequence reads
+    output reg  [31:0] m_addr,
+    output reg         m_ren,
+    input  wire [31:0] m_rdata,
+    input  wire        m_ready,
+
+    output wire [PWM_WIDTH:0] out
+);
+  localparam PWM_MAX = 2 ** PWM_WIDTH;
+  localparam CHANNELS = 4;
+
+  localparam REG_PERIOD = 3'd0;
+  localparam REG_VOLUME = 3'd1;
+  localparam REG_SEQ = 3'd2;
+  localparam REG_SEQ_LEN = 3'd3;
+  localparam REG_CTRL = 3'd4;
+  localparam REG_POSITION = 3'd5;
+  localparam REG_TIMER = 3'd6;
+
+  localparam CTRL_START = 0;
+  localparam CTRL_LOOP = 1;
+  localparam CTRL_PAUSE = 2;
+  localparam CTRL_STOP = 3;
+
+  localparam FETCH_IDLE = 2'd0;
+  localparam FETCH_PERIOD = 2'd1;
+  localparam FETCH_DURATION = 2'd2;
+
+  wire       global_sel = addr[7];
+  wire [1:0] channel_sel = addr[6:5];
+  wire [2:0] reg_sel = addr[4:2];
+
+  reg [       31:0] periods      [0:CHANNELS-1];
+  reg [PWM_WIDTH:0] volumes      [0:CHANNELS-1];
+  reg [       31:0] seq_addrs    [0:CHANNELS-1];
+  reg [       31:0] seq_lens     [0:CHANNELS-1];
+  reg [       31:0] seq_positions[0:CHANNELS-1];
+  reg [       31:0] timers       [0:CHANNELS-1];
+
+  reg [CHANNELS-1:0] playing;
+  reg [CHANNELS-1:0] looping;
+  reg [CHANNELS-1:0] paused;
+  reg [CHANNELS-1:0] fetch_pending;
+
+  reg [31:0] tick_cycles;
+  reg [31:0] tick_ctr;
+  wire tick = tick_ctr == 0;
+
+  // One channel's step is fetched at a time
+  reg [1:0] fetch_state;
+  reg [1:0] fetch_channel;
+  reg [31:0] fetch_period;
+  // The channel was restarted or stopped while its step was being fetched
+  reg fetch_abort;
+
+  reg [1:0] fetch_next;
+  integer j;
+
+  always @(*) begin
+    fetch_next = 0;
+
+    for (j = CHANNELS - 1; j >= 0; j = j - 1) begin
+      if (fetch_pending[j]) fetch_next = j;
+    end
+
+    m_ren  = fetch_state != FETCH_IDLE;
+    m_addr = seq_addrs[fetch_channel] + {seq_positions[fetch_channel], 3'b000} +
+             (fetch_state == FETCH_DURATION ? 32'd4 : 32'd0);
+  end
+
+  wire [31:0] ctr_1, ctr_2, ctr_3, ctr_4;
+
+  reg [$clog2(WAVE_DATA_SIZE)-1:0] wave_data[0:WAVE_DATA_SIZE-1];
+
+  integer i;
+
+  always @(posedge clk) begin
+    if (!rst_n) begin
+      for (i = 0; i < CHANNELS; i = i + 1) begin
+        periods[i]       <= 0;
+        volumes[i]       <= PWM_MAX;
+        seq_addrs[i]     <= 0;
+        seq_lens[i]      <= 0;
+        seq_positions[i] <= 0;
+        timers[i]        <= 0;
+      end
+
+      playing       <= 0;
+      looping       <= 0;
+      paused        <= 0;
+      fetch_pending <= 0;
+
+      tick_cycles   <= TICK_CYCLES;
+      tick_ctr      <= TICK_CYCLES - 1;
+
+      fetch_state   <= FETCH_IDLE;
+      fetch_channel <= 0;
+      fetch_period  <= 0;
+      fetch_abort   <= 0;
+    end else begin
+      tick_ctr <= tick ? tick_cycles - 1 : tick_ctr - 1;
+
+      if (tick) begin
+        for (i = 0; i < CHANNELS; i = i + 1) begin
+          if (playing[i] && !paused[i]) begin
+            if (timers[i] != 0) begin
+              timers[i] <= timers[i] - 1;
+            end else if (seq_positions[i] < seq_lens[i]) begin
+              fetch_pending[i] <= 1;
+            end else begin
+              // Finished
+              playing[i] <= 0;
+              periods[i] <= 0;
+            end
+          end
+        end
+      end
+
+      case (fetch_state)
+        FETCH_IDLE: begin
+          if (|fetch_pending) begin
+            fetch_channel <= fetch_next;
+            fetch_abort   <= 0;
+            fetch_state   <= FETCH_PERIOD;
+          end
+        end
+        FETCH_PERIOD: begin
+          if (m_ready) begin
+            fetch_period <= m_rdata;
+            fetch_state  <= FETCH_DURATION;
+          end
+        end
+        FETCH_DURATION: begin
+          if (m_ready) begin
+            if (!fetch_abort) begin
+              periods[fetch_channel] <= fetch_period;
+              // The step's own tick counts too
+              timers[fetch_channel]  <= m_rdata == 0 ? 0 : m_rdata - 1;
+
+              if (looping[fetch_channel] &&
+                  seq_positions[fetch_channel] + 1 >= seq_lens[fetch_channel]) begin
+                seq_positions[fetch_channel] <= 0;
+              end else begin
+                seq_positions[fetch_channel] <= seq_positions[fetch_channel] + 1;
+              end
+            end
+
+            fetch_pending[fetch_channel] <= 0;
+            fetch_state <= FETCH_IDLE;
+          end
+        end
+        default: ;
+      endcase
+
+      if (wenable && global_sel) begin
+        tick_cycles <= wdata;
+        tick_ctr    <= wdata - 1;
+      end else if (wenable) begin
+        case (reg_sel)
+          REG_PERIOD: periods[channel_sel] <= wdata;
+          REG_VOLUME: volumes[channel_sel] <= wdata[PWM_WIDTH:0];
+          REG_SEQ:    seq_addrs[channel_sel] <= wdata;
+          REG_SEQ_LEN: seq_lens[channel_sel] <= wdata;
+          REG_CTRL: begin
+            looping[channel_sel] <= wdata[CTRL_LOOP];
+            paused[channel_sel]  <= wdata[CTRL_PAUSE];
+
+            if (wdata[CTRL_START] || wdata[CTRL_STOP]) begin
+              playing[channel_sel]       <= wdata[CTRL_START] && !wdata[CTRL_STOP];
+              seq_positions[channel_sel] <= 0;
+              timers[channel_sel]        <= 0;
+              fetch_pending[channel_sel] <= 0;
+
+              if (fetch_state != FETCH_IDLE && fetch_channel == channel_sel) fetch_abort <= 1;
+            end
+          end
+          default: ;
+        endcase
+      end
+    end
+  end
+
+  always @(*) begin
+    if (global_sel) begin
+      rdata = tick_cycles;
+    end else begin
+      case (reg_sel)
+        REG_PERIOD:   rdata = periods[channel_sel];
+        REG_VOLUME:   rdata = {{(32 - PWM_WIDTH + 1) {1'b0}}, volumes[channel_sel]};
+        REG_SEQ:      rdata = seq_addrs[channel_sel];
+        REG_SEQ_LEN:  rdata = seq_lens[channel_sel];
+        REG_CTRL: begin
+          rdata = {29'b0, paused[channel_sel], looping[channel_sel], playing[channel_sel]};
+        end
+        REG_POSITION: rdata = seq_positions[channel_sel];
+        REG_TIMER:    rdata = timers[channel_sel];
+        default:      rdata = 32'b0;
+      endcase
+    end
+  end
+
+  // Paused channels are muted, but keep their period for when they resume
+  wire [31:0] period_1 = paused[0] ? 32'b0 : periods[0];
+  wire [31:0] period_2 = paused[1] ? 32'b0 : periods[1];
+  wire [31:0] period_3 = paused[2] ? 32'b0 : periods[2];
+  wire [31:0] period_4 = paused[3] ? 32'b0 : periods[3];
+
+  counter cnt1 (
+      .clk(clk),
+      .rst_n(rst_n),
+      .compare(periods[0]),
+      .out(ctr_1)
+  );
+
+  counter cnt2 (
+      .clk(clk),
+      .rst_n(rst_n),
+      .compare(periods[1]),
+      .out(ctr_2)
+  );
+
+  counter cnt3 (
+      .clk(clk),
+      .rst_n(rst_n),
+      .compare(periods[2]),
+      .out(ctr_3)
+  );
+
+  counter cnt4 (
+      .clk(clk),
+      .rst_n(rst_n),
+      .compare(periods[3]),
+      .out(ctr_4)
+  );
+
+  wire channel_1 = period_1 != 0 && ctr_1 >= (period_1 / 2);
+  wire channel_2 = period_2 != 0 && ctr_2 >= (period_2 / 2);
+  wire [31:0] channel_3 = (period_3 == 0) ? 0 : ctr_3;
+
+  wire [$clog2(WAVE_DATA_SIZE)-1:0] wave_idx = (ctr_4 * (WAVE_DATA_SIZE - 1)) / (period_4 - 1);
+  wire [7:0] channel_4 = wave_data[wave_idx];
+
+  wire [PWM_WIDTH+1:0] channel_1_norm = channel_1 ? volumes[0] : 0;
+  wire [PWM_WIDTH+1:0] channel_2_norm = channel_2 ? volumes[1] : 0;
+  wire [PWM_WIDTH+1:0] channel_3_norm = (channel_3 * volumes[2]) / (period_3 - 1);
+  wire [PWM_WIDTH+1:0] channel_4_norm = (channel_4 * volumes[3]) / 255;
+
+  wire [PWM_WIDTH+2:0] sum = channel_1_norm + channel_2_norm + channel_3_norm + channel_4_norm;
+  assign out = sum / 4;
+
+  initial begin
+    $readmemh(WAVE_DATA_SOURCE, wave_data);
+  end
+endmodule
+
+`endif
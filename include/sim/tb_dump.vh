@@ -0,0 +1,35 @@
+`ifndef TB_DUMP_VH
+`define TB_DUMP_VH
+
+// Opt-in waveform dumping for the testbenches. Nothing is dumped unless the
+// simulation runs with +vcd=FILE, and +vcd_start=N / +vcd_end=N narrow the
+// dump down to a range of clk cycles:
+//
+//   vvp build/cpu/pipelined_cpu_tb.out +vcd=dump.vcd +vcd_start=5000 +vcd_end=6000
+`define TB_DUMP(scope, clk) \
+  reg [8*256-1:0] tb_vcd_file; \
+  reg             tb_vcd_enable; \
+  integer         tb_vcd_start; \
+  integer         tb_vcd_end; \
+  integer         tb_vcd_cycle; \
+  \
+  initial begin \
+    tb_vcd_enable = $value$plusargs("vcd=%s", tb_vcd_file); \
+    if (!$value$plusargs("vcd_start=%d", tb_vcd_start)) tb_vcd_start = 0; \
+    if (!$value$plusargs("vcd_end=%d", tb_vcd_end)) tb_vcd_end = -1; \
+    tb_vcd_cycle = 0; \
+    \
+    if (tb_vcd_enable) begin \
+      $dumpfile(tb_vcd_file); \
+      $dumpvars(0, scope); \
+      if (tb_vcd_start > 0) $dumpoff; \
+    end \
+  end \
+  \
+  always @(posedge clk) begin \
+    tb_vcd_cycle = tb_vcd_cycle + 1; \
+    if (tb_vcd_enable && tb_vcd_cycle == tb_vcd_start) $dumpon; \
+    if (tb_vcd_enable && tb_vcd_cycle == tb_vcd_end) $dumpoff; \
+  end
+
+`endif
@@ -0,0 +1,71 @@
+`ifndef TB_PL_CORE_VH
+`define TB_PL_CORE_VH
+
+`include "pipelined_cpu.vh"
+
+// pipelined_cpu on a single dual_word_ram for both its program and data, with
+// memory that is always ready and no interrupts. Benches write their program
+// into ram.data, see tb_rv32.vh, and check the stores on the data port.
+module tb_pl_core #(
+    parameter BRANCH_PREDICTOR = `BP_GSHARE,
+    parameter DUAL_ISSUE       = 0,
+    parameter EARLY_BRANCH     = 0,
+    // Whether the core gets the word after the fetched one
+    parameter NEXT_VALID       = 0
+) (
+    input wire clk,
+    input wire rst_n,
+
+    output wire [31:0] data_addr,
+    output wire [31:0] data_wdata,
+    output wire [ 3:0] data_wenable
+);
+  wire [31:0] instr_addr;
+  wire [31:0] instr_data;
+  wire [31:0] instr_data_next;
+  wire [31:0] data_rdata;
+
+  dual_word_ram #(
+      .SIZE_WORDS(2 ** 11)
+  ) ram (
+      .clk(clk),
+
+      .addr_1   (data_addr[12:0]),
+      .wdata_1  (data_wdata),
+      .wenable_1(data_wenable),
+      .rdata_1  (data_rdata),
+
+      .addr_2      (instr_addr[12:0]),
+      .rdata_2     (instr_data),
+      .rdata_2_next(instr_data_next)
+  );
+
+  pipelined_cpu #(
+      .BRANCH_PREDICTOR(BRANCH_PREDICTOR),
+      .DUAL_ISSUE      (DUAL_ISSUE),
+      .EARLY_BRANCH    (EARLY_BRANCH)
+  ) cpu (
+      .clk  (clk),
+      .rst_n(rst_n),
+
+      .instr_addr      (instr_addr),
+      .instr_data      (instr_data),
+      .instr_ready     (1'b1),
+      .instr_data_next (NEXT_VALID ? instr_data_next : {32{1'bx}}),
+      .instr_next_valid(NEXT_VALID != 0),
+
+      .data_addr   (data_addr),
+      .data_wdata  (data_wdata),
+      .data_wenable(data_wenable),
+      .data_ren    (),
+      .data_rdata  (data_rdata),
+      .data_ready  (1'b1),
+
+      .irq      (16'b0),
+      .timer_irq(1'b0),
+
+      .ext_events(8'b0)
+  );
+endmodule
+
+`endif
@@ -0,0 +1,118 @@
+// Instruction encoders for the testbenches that write their programs straight
+// into a RAM. Included inside a module body, so it has no include guard:
+//
+//   ram.data[0] = lui(S0, DATA >> 12);
+//   ram.data[1] = sw(T0, S0, 4);
+//
+// Immediates are taken as is, so negative offsets are written as -13'd8 and
+// the like, sized to the instruction's immediate.
+
+localparam NOP = 32'h00000013;
+
+function [31:0] i_type(input [2:0] funct3, input [6:0] opcode, input [4:0] rd, input [4:0] rs1,
+                       input [11:0] imm);
+  i_type = {imm, rs1, funct3, rd, opcode};
+endfunction
+
+function [31:0] r_type(input [6:0] funct7, input [2:0] funct3, input [4:0] rd, input [4:0] rs1,
+                       input [4:0] rs2);
+  r_type = {funct7, rs2, rs1, funct3, rd, 7'b0110011};
+endfunction
+
+function [31:0] s_type(input [2:0] funct3, input [6:0] opcode, input [4:0] rs2, input [4:0] rs1,
+                       input [11:0] imm);
+  s_type = {imm[11:5], rs2, rs1, funct3, imm[4:0], opcode};
+endfunction
+
+function [31:0] addi(input [4:0] rd, input [4:0] rs1, input [11:0] imm);
+  addi = i_type(3'b000, 7'b0010011, rd, rs1, imm);
+endfunction
+
+function [31:0] andi(input [4:0] rd, input [4:0] rs1, input [11:0] imm);
+  andi = i_type(3'b111, 7'b0010011, rd, rs1, imm);
+endfunction
+
+function [31:0] slli(input [4:0] rd, input [4:0] rs1, input [4:0] shamt);
+  slli = i_type(3'b001, 7'b0010011, rd, rs1, {7'b0000000, shamt});
+endfunction
+
+function [31:0] lui(input [4:0] rd, input [19:0] imm);
+  lui = {imm, rd, 7'b0110111};
+endfunction
+
+function [31:0] auipc(input [4:0] rd, input [19:0] imm);
+  auipc = {imm, rd, 7'b0010111};
+endfunction
+
+function [31:0] add(input [4:0] rd, input [4:0] rs1, input [4:0] rs2);
+  add = r_type(7'b0000000, 3'b000, rd, rs1, rs2);
+endfunction
+
+function [31:0] sub(input [4:0] rd, input [4:0] rs1, input [4:0] rs2);
+  sub = r_type(7'b0100000, 3'b000, rd, rs1, rs2);
+endfunction
+
+// RV32M, funct3 picks mul, mulh, mulhsu, mulhu, div, divu, rem or remu
+function [31:0] muldiv(input [2:0] funct3, input [4:0] rd, input [4:0] rs1, input [4:0] rs2);
+  muldiv = r_type(7'b0000001, funct3, rd, rs1, rs2);
+endfunction
+
+function [31:0] div(input [4:0] rd, input [4:0] rs1, input [4:0] rs2);
+  div = muldiv(3'b100, rd, rs1, rs2);
+endfunction
+
+function [31:0] divu(input [4:0] rd, input [4:0] rs1, input [4:0] rs2);
+  divu = muldiv(3'b101, rd, rs1, rs2);
+endfunction
+
+function [31:0] lw(input [4:0] rd, input [4:0] rs1, input [11:0] imm);
+  lw = i_type(3'b010, 7'b0000011, rd, rs1, imm);
+endfunction
+
+function [31:0] sw(input [4:0] rs2, input [4:0] rs1, input [11:0] imm);
+  sw = s_type(3'b010, 7'b0100011, rs2, rs1, imm);
+endfunction
+
+function [31:0] fsw(input [4:0] rs2, input [4:0] rs1, input [11:0] imm);
+  fsw = s_type(3'b010, 7'b0100111, rs2, rs1, imm);
+endfunction
+
+function [31:0] branch(input [2:0] funct3, input [4:0] rs1, input [4:0] rs2, input [12:0] imm);
+  branch = {imm[12], imm[10:5], rs2, rs1, funct3, imm[4:1], imm[11], 7'b1100011};
+endfunction
+
+function [31:0] blt(input [4:0] rs1, input [4:0] rs2, input [12:0] imm);
+  blt = branch(3'b100, rs1, rs2, imm);
+endfunction
+
+function [31:0] jal(input [4:0] rd, input [20:0] imm);
+  jal = {imm[20], imm[10:1], imm[11], imm[19:12], rd, 7'b1101111};
+endfunction
+
+function [31:0] jalr(input [4:0] rd, input [4:0] rs1, input [11:0] imm);
+  jalr = i_type(3'b000, 7'b1100111, rd, rs1, imm);
+endfunction
+
+function [31:0] op_fp(input [6:0] funct7, input [4:0] rs2, input [4:0] rs1, input [2:0] rm,
+                      input [4:0] rd);
+  op_fp = {funct7, rs2, rs1, rm, rd, 7'b1010011};
+endfunction
+
+// opcode picks fmadd.s, fmsub.s, fnmsub.s or fnmadd.s
+function [31:0] op_fma(input [6:0] opcode, input [4:0] rs3, input [4:0] rs2, input [4:0] rs1,
+                       input [2:0] rm, input [4:0] rd);
+  op_fma = {rs3, 2'b00, rs2, rs1, rm, rd, opcode};
+endfunction
+
+// rs1 holds the immediate for the csrr*i forms
+function [31:0] csr(input [2:0] funct3, input [4:0] rd, input [4:0] rs1, input [11:0] addr);
+  csr = i_type(funct3, 7'b1110011, rd, rs1, addr);
+endfunction
+
+function [31:0] csrrw(input [11:0] addr, input [4:0] rs1);
+  csrrw = csr(3'b001, 5'd0, rs1, addr);
+endfunction
+
+function [31:0] csrrsi(input [11:0] addr, input [4:0] uimm);
+  csrrsi = csr(3'b110, 5'd0, uimm, addr);
+endfunction
@@ -13,7 +13,9 @@ pkgs.mkShell {
     glibc_multi
     gtkwave
     iverilog
+    verilator
     xxd
+    zlib
 
     riscvPkgs.buildPackages.binutils
     riscvPkgs.buildPackages.gcc
@@ -0,0 +1,50 @@
+#!/usr/bin/env bash
+# Measures simulation speed of the Verilator model against thread count.
+#
+# For every configuration this reports the speed of a single run, and the
+# aggregate speed of as many concurrent runs as fit in the machine's cores
+# (nproc / threads), which is what matters when running many seeds at once.
+#
+# usage: sim/bench.sh <firmware.elf|firmware.mem>
+#
+# Environment: THREADS (default "1 2 4 8"), HIER (default "0 1"),
+#              CYCLES (default 20000000), plus any SIM_* make variable.
+set -euo pipefail
+
+firmware="$1"
+threads_list="${THREADS:-1 2 4 8}"
+hier_list="${HIER:-0 1}"
+cycles="${CYCLES:-20000000}"
+cores=$(nproc)
+
+run_sim() {
+    local target="$1"
+    "$target" --quiet --max-cycles "$cycles" "$firmware" 2>&1 >/dev/null |
+        sed -n 's/^time:.*(\([0-9.]*\) MHz)$/\1/p'
+}
+
+printf "%-8s %-5s %10s %6s %14s\n" "threads" "hier" "MHz" "jobs" "aggregate MHz"
+
+for hier in $hier_list; do
+    for threads in $threads_list; do
+        if ((threads > cores)); then
+            continue
+        fi
+
+        make --no-print-directory -s sim SIM_THREADS="$threads" SIM_HIER="$hier" >/dev/null
+        target=$(make --no-print-directory -s sim-target SIM_THREADS="$threads" SIM_HIER="$hier")
+
+        single=$(run_sim "$target")
+
+        jobs=$((cores / threads))
+        results=$(mktemp)
+        for ((i = 0; i < jobs; i++)); do
+            run_sim "$target" >>"$results" &
+        done
+        wait
+        aggregate=$(awk '{ sum += $1 } END { printf "%.3f", sum }' "$results")
+        rm -f "$results"
+
+        printf "%-8s %-5s %10s %6s %14s\n" "$threads" "$hier" "$single" "$jobs" "$aggregate"
+    done
+done
@@ -0,0 +1,182 @@
+#include "firmware.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <elf.h>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+#include <vector>
+
+namespace sim
+{
+
+namespace
+{
+
+std::vector<uint8_t> read_file(const std::filesystem::path &path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        throw std::runtime_error("could not open " + path.string());
+
+    return {std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+}
+
+template <typename T>
+T read_struct(const std::vector<uint8_t> &bytes, size_t offset)
+{
+    if (offset + sizeof(T) > bytes.size())
+        throw std::runtime_error("truncated ELF file");
+
+    T value;
+    std::memcpy(&value, bytes.data() + offset, sizeof(T));
+    return value;
+}
+
+// Calls fn(name, sym) for every entry of the ELF's symbol tables
+template <typename Fn>
+void for_each_symbol(const std::vector<uint8_t> &elf, const Elf32_Ehdr &ehdr, Fn fn)
+{
+    for (size_t i = 0; i < ehdr.e_shnum; ++i) {
+        const auto symtab = read_struct<Elf32_Shdr>(elf, ehdr.e_shoff + i * ehdr.e_shentsize);
+        if (symtab.sh_type != SHT_SYMTAB)
+            continue;
+
+        const auto strtab =
+            read_struct<Elf32_Shdr>(elf, ehdr.e_shoff + symtab.sh_link * ehdr.e_shentsize);
+
+        for (size_t off = 0; off + sizeof(Elf32_Sym) <= symtab.sh_size; off += sizeof(Elf32_Sym)) {
+            const auto sym = read_struct<Elf32_Sym>(elf, symtab.sh_offset + off);
+            const size_t name_off = strtab.sh_offset + sym.st_name;
+            if (name_off >= elf.size())
+                continue;
+
+            const char *name = reinterpret_cast<const char *>(elf.data() + name_off);
+            fn(std::string_view(name, strnlen(name, elf.size() - name_off)), sym);
+        }
+    }
+}
+
+std::optional<uint32_t> find_symbol(const std::vector<uint8_t> &elf, const Elf32_Ehdr &ehdr,
+                                    std::string_view name)
+{
+    std::optional<uint32_t> addr;
+
+    for_each_symbol(elf, ehdr, [&](std::string_view sym_name, const Elf32_Sym &sym) {
+        if (!addr && sym_name == name)
+            addr = sym.st_value;
+    });
+
+    return addr;
+}
+
+Elf32_Ehdr read_ehdr(const std::vector<uint8_t> &elf)
+{
+    const auto ehdr = read_struct<Elf32_Ehdr>(elf, 0);
+
+    if (std::memcmp(ehdr.e_ident, ELFMAG, SELFMAG) != 0 || ehdr.e_ident[EI_CLASS] != ELFCLASS32 ||
+        ehdr.e_ident[EI_DATA] != ELFDATA2LSB || ehdr.e_machine != EM_RISCV)
+        throw std::runtime_error("not a 32-bit little-endian RISC-V ELF");
+
+    return ehdr;
+}
+
+std::filesystem::path write_mem(const std::vector<uint8_t> &image)
+{
+    std::string path = (std::filesystem::temp_directory_path() / "tachyon-XXXXXX.mem").string();
+
+    const int fd = mkstemps(path.data(), 4);
+    if (fd < 0)
+        throw std::runtime_error("could not create a temporary .mem file");
+    close(fd);
+
+    std::ofstream mem(path);
+    mem << std::hex << std::setfill('0');
+
+    for (size_t i = 0; i < image.size(); i += 4) {
+        const uint32_t word = image[i] | (image[i + 1] << 8) | (image[i + 2] << 16) |
+                              (static_cast<uint32_t>(image[i + 3]) << 24);
+        mem << std::setw(8) << word << '\n';
+    }
+
+    return path;
+}
+
+Firmware load_elf(const std::vector<uint8_t> &elf)
+{
+    const auto ehdr = read_ehdr(elf);
+
+    std::vector<uint8_t> image;
+
+    for (size_t i = 0; i < ehdr.e_phnum; ++i) {
+        const auto phdr = read_struct<Elf32_Phdr>(elf, ehdr.e_phoff + i * ehdr.e_phentsize);
+        if (phdr.p_type != PT_LOAD || phdr.p_memsz == 0)
+            continue;
+
+        if (phdr.p_offset + phdr.p_filesz > elf.size())
+            throw std::runtime_error("truncated ELF file");
+
+        // .bss and friends stay zeroed
+        const size_t end = (phdr.p_paddr + phdr.p_memsz + 3) & ~size_t{3};
+        if (image.size() < end)
+            image.resize(end, 0);
+
+        std::memcpy(image.data() + phdr.p_paddr, elf.data() + phdr.p_offset, phdr.p_filesz);
+    }
+
+    return {.mem_path = write_mem(image), .tohost = find_symbol(elf, ehdr, "tohost")};
+}
+
+} // namespace
+
+Firmware load_firmware(const std::filesystem::path &path)
+{
+    const auto bytes = read_file(path);
+
+    if (bytes.size() >= SELFMAG && std::memcmp(bytes.data(), ELFMAG, SELFMAG) == 0)
+        return load_elf(bytes);
+
+    return {.mem_path = path, .tohost = std::nullopt};
+}
+
+std::vector<Symbol> load_functions(const std::filesystem::path &path)
+{
+    const auto elf = read_file(path);
+    const auto ehdr = read_ehdr(elf);
+
+    std::vector<Symbol> functions;
+
+    for_each_symbol(elf, ehdr, [&](std::string_view name, const Elf32_Sym &sym) {
+        if (ELF32_ST_TYPE(sym.st_info) == STT_FUNC && sym.st_shndx != SHN_UNDEF)
+            functions.push_back({std::string(name), sym.st_value, sym.st_size});
+    });
+
+    std::ranges::sort(functions, {}, &Symbol::addr);
+    return functions;
+}
+
+std::vector<uint32_t> read_mem(const std::filesystem::path &path)
+{
+    std::ifstream mem(path);
+    if (!mem)
+        throw std::runtime_error("could not open " + path.string());
+
+    std::vector<uint32_t> words;
+    std::string line;
+
+    while (std::getline(mem, line)) {
+        if (line.empty() || line.starts_with("//"))
+            continue;
+
+        words.push_back(std::stoul(line, nullptr, 16));
+    }
+
+    return words;
+}
+
+} // namespace sim
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace sim
+{
+
+struct Firmware {
+    // Path to a word-per-line .mem file as expected by $readmemh
+    std::filesystem::path mem_path;
+    // Address of the `tohost` symbol, if the firmware is an ELF that has one
+    std::optional<uint32_t> tohost;
+};
+
+// Loads a .mem or .elf file. ELF files are flattened into a temporary .mem
+// image, with every PT_LOAD segment placed at its physical address.
+//
+// Throws std::runtime_error if the file can't be read or isn't a 32-bit
+// little-endian RISC-V ELF.
+Firmware load_firmware(const std::filesystem::path &path);
+
+struct Symbol {
+    std::string name;
+    uint32_t addr = 0;
+    uint32_t size = 0;
+};
+
+// Reads the function symbols of an ELF file, sorted by address. Throws like
+// load_firmware.
+std::vector<Symbol> load_functions(const std::filesystem::path &path);
+
+// Reads a word-per-line .mem file into memory, as $readmemh would
+std::vector<uint32_t> read_mem(const std::filesystem::path &path);
+
+} // namespace sim
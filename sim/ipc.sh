@@ -0,0 +1,62 @@
+#!/usr/bin/env bash
+# Compares the IPC of the pipeline with and without one of its options on each
+# firmware given: dual issue by default (SIM_DUAL_ISSUE, see DUAL_ISSUE in
+# pipelined_cpu), or whichever SIM_* make variable FEATURE names, such as
+# SIM_EARLY_BRANCH.
+#
+# Programs run until they ecall or for CYCLES cycles, whichever comes first.
+# IPC is counted over the cycles the core is awake, so that the game loop, which
+# sleeps until every frame, is measured on the work it does. Both cores must end
+# a program the same way, with the same exit code.
+#
+# usage: sim/ipc.sh <firmware.elf|firmware.mem>...
+#
+# Environment: CYCLES (default 5000000), FEATURE (default SIM_DUAL_ISSUE), plus
+#              any other SIM_* make variable.
+set -euo pipefail
+
+cycles="${CYCLES:-5000000}"
+feature="${FEATURE:-SIM_DUAL_ISSUE}"
+
+run_sim() {
+    local target="$1" firmware="$2"
+    "$target" --quiet --max-cycles "$cycles" "$firmware" 2>&1 >/dev/null || true
+}
+
+awake_ipc() {
+    sed -n 's/^instructions:.*, \([0-9.]*\) awake)$/\1/p' <<<"$1"
+}
+
+exit_line() {
+    sed -n 's/^exit: //p' <<<"$1"
+}
+
+make --no-print-directory -s sim "$feature=0" >/dev/null
+make --no-print-directory -s sim "$feature=1" >/dev/null
+off_target=$(make --no-print-directory -s sim-target "$feature=0")
+on_target=$(make --no-print-directory -s sim-target "$feature=1")
+
+echo "$feature"
+printf "%-16s %8s %8s %8s\n" "firmware" "off" "on" "speedup"
+
+status=0
+
+for firmware in "$@"; do
+    off=$(run_sim "$off_target" "$firmware")
+    on=$(run_sim "$on_target" "$firmware")
+    name=$(basename "${firmware%.*}")
+
+    if [[ "$(exit_line "$off")" != "$(exit_line "$on")" ]]; then
+        echo "$name: run without $feature ended with '$(exit_line "$off")'," \
+            "with it '$(exit_line "$on")'" >&2
+        status=1
+    fi
+
+    off_ipc=$(awake_ipc "$off")
+    on_ipc=$(awake_ipc "$on")
+    speedup=$(awk -v a="$off_ipc" -v b="$on_ipc" 'BEGIN { printf "%.3f", a > 0 ? b / a : 0 }')
+
+    printf "%-16s %8s %8s %8s\n" "$name" "$off_ipc" "$on_ipc" "$speedup"
+done
+
+exit "$status"
@@ -0,0 +1,1521 @@
+#include "iss.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cfenv>
+#include <cmath>
+#include <cstdio>
+
+namespace iss
+{
+
+namespace
+{
+
+constexpr uint32_t CSR_FFLAGS = 0x001;
+constexpr uint32_t CSR_FRM = 0x002;
+constexpr uint32_t CSR_FCSR = 0x003;
+constexpr uint32_t CSR_MSTATUS = 0x300;
+constexpr uint32_t CSR_MIE = 0x304;
+constexpr uint32_t CSR_MTVEC = 0x305;
+constexpr uint32_t CSR_MEPC = 0x341;
+constexpr uint32_t CSR_MCAUSE = 0x342;
+constexpr uint32_t CSR_MIP = 0x344;
+constexpr uint32_t CSR_MCYCLE = 0xB00;
+constexpr uint32_t CSR_MINSTRET = 0xB02;
+constexpr uint32_t CSR_MCYCLEH = 0xB80;
+constexpr uint32_t CSR_MINSTRETH = 0xB82;
+constexpr uint32_t CSR_MHPMEVENT3 = 0x323;
+constexpr uint32_t CSR_MHPMCOUNTER3 = 0xB03;
+constexpr uint32_t CSR_MHPMCOUNTER3H = 0xB83;
+
+constexpr uint32_t MSTATUS_MIE = 1 << 3;
+constexpr uint32_t MSTATUS_MPIE = 1 << 7;
+// MPP, always machine mode
+constexpr uint32_t MSTATUS_MPP = 3 << 11;
+
+constexpr uint32_t IRQ_LOCAL = 16;
+// Local interrupts and the timer, the only writable bits of mie
+constexpr uint32_t MIE_MASK = 0xFFFF'0000 | (1 << IRQ_TIMER);
+
+constexpr uint32_t ECALL_INSTR = 0x00000073;
+constexpr uint32_t WFI_INSTR = 0x10500073;
+
+int32_t imm_i(uint32_t instr)
+{
+    return static_cast<int32_t>(instr) >> 20;
+}
+
+int32_t imm_s(uint32_t instr)
+{
+    return (static_cast<int32_t>(instr & 0xFE00'0000) >> 20) | ((instr >> 7) & 0x1F);
+}
+
+int32_t imm_b(uint32_t instr)
+{
+    return (static_cast<int32_t>(instr & 0x8000'0000) >> 19) | ((instr & 0x80) << 4) |
+           ((instr >> 20) & 0x7E0) | ((instr >> 7) & 0x1E);
+}
+
+int32_t imm_u(uint32_t instr)
+{
+    return static_cast<int32_t>(instr & 0xFFFF'F000);
+}
+
+int32_t imm_j(uint32_t instr)
+{
+    return (static_cast<int32_t>(instr & 0x8000'0000) >> 11) | (instr & 0xF'F000) |
+           ((instr >> 9) & 0x800) | ((instr >> 20) & 0x7FE);
+}
+
+// float_alu flushes denormals to zero on both inputs and outputs. It rounds to
+// nearest even, which is also the host's default, unless asked to round towards
+// zero (see alu_round). fp_misc's conversions follow every rounding mode.
+uint32_t flush_denormal(uint32_t bits)
+{
+    return (bits & 0x7F80'0000) == 0 ? bits & 0x8000'0000 : bits;
+}
+
+float to_float(uint32_t bits)
+{
+    return std::bit_cast<float>(flush_denormal(bits));
+}
+
+uint32_t from_float(float value)
+{
+    return flush_denormal(std::bit_cast<uint32_t>(value));
+}
+
+constexpr uint32_t RM_RTZ = 0b001;
+constexpr uint32_t RM_RDN = 0b010;
+constexpr uint32_t RM_RUP = 0b011;
+constexpr uint32_t RM_RMM = 0b100;
+constexpr uint32_t RM_DYN = 0b111;
+
+constexpr uint32_t CANONICAL_NAN = 0x7FC0'0000;
+
+bool is_nan(uint32_t bits)
+{
+    return (bits & 0x7F80'0000) == 0x7F80'0000 && (bits & 0x7F'FFFF) != 0;
+}
+
+// Runs a float_alu operation under rm, which float_alu takes as towards zero
+// or else as to nearest even. It overflows to infinity either way, where the
+// host would stop at the largest finite value when truncating.
+template <typename Op>
+float alu_round(uint32_t rm, Op op)
+{
+    if (rm != RM_RTZ)
+        return op();
+
+    std::fesetround(FE_TOWARDZERO);
+    std::feclearexcept(FE_OVERFLOW);
+    // Stored before the checks below, so the operation stays in between
+    volatile float value = op();
+    const bool overflow = std::fetestexcept(FE_OVERFLOW);
+    std::fesetround(FE_TONEAREST);
+
+    return overflow ? std::copysign(INFINITY, value) : value;
+}
+
+// fmin/fmax take -0 as less than +0, and a NaN only if both are
+uint32_t fp_min_max(uint32_t a_bits, uint32_t b_bits, bool max)
+{
+    const uint32_t a = flush_denormal(a_bits);
+    const uint32_t b = flush_denormal(b_bits);
+
+    if (is_nan(a) && is_nan(b))
+        return CANONICAL_NAN;
+    if (is_nan(a))
+        return b;
+    if (is_nan(b))
+        return a;
+
+    const float fa = std::bit_cast<float>(a);
+    const float fb = std::bit_cast<float>(b);
+    const bool a_less = fa < fb || (fa == fb && (a >> 31) != 0);
+    return a_less != max ? a : b;
+}
+
+float round_to_integer(float value, uint32_t rm)
+{
+    switch (rm) {
+    case RM_RTZ:
+        return std::trunc(value);
+    case RM_RDN:
+        return std::floor(value);
+    case RM_RUP:
+        return std::ceil(value);
+    case RM_RMM:
+        return std::round(value);
+    default:
+        return std::nearbyint(value);
+    }
+}
+
+// fcvt.w.s and fcvt.wu.s, which saturate, NaNs to the largest value
+uint32_t float_to_int(uint32_t bits, uint32_t rm, bool is_unsigned)
+{
+    const float value = to_float(bits);
+    const float rounded = round_to_integer(value, rm);
+
+    if (is_unsigned) {
+        if (std::isnan(value) || rounded >= 0x1p32f)
+            return UINT32_MAX;
+        return rounded < 0 ? 0 : static_cast<uint32_t>(rounded);
+    }
+
+    if (std::isnan(value) || rounded >= 0x1p31f)
+        return INT32_MAX;
+    if (rounded < -0x1p31f)
+        return static_cast<uint32_t>(INT32_MIN);
+    return static_cast<uint32_t>(static_cast<int32_t>(rounded));
+}
+
+// fcvt.s.w and fcvt.s.wu. The host rounds to nearest even, which is then
+// moved to the neighbour on the other side of the value if rm says so.
+uint32_t int_to_float(int64_t value, uint32_t rm)
+{
+    const float nearest = static_cast<float>(value);
+    const double error = static_cast<double>(nearest) - static_cast<double>(value);
+
+    if (error == 0)
+        return std::bit_cast<uint32_t>(nearest);
+
+    const float other = std::nextafter(nearest, error > 0 ? -INFINITY : INFINITY);
+    const double other_error = static_cast<double>(other) - static_cast<double>(value);
+    bool take_other;
+
+    switch (rm) {
+    case RM_RTZ:
+        take_other = std::abs(other) < std::abs(nearest);
+        break;
+    case RM_RDN:
+        take_other = error > 0;
+        break;
+    case RM_RUP:
+        take_other = error < 0;
+        break;
+    case RM_RMM:
+        take_other = std::abs(other_error) == std::abs(error) &&
+                     std::abs(other) > std::abs(nearest);
+        break;
+    default:
+        take_other = false;
+        break;
+    }
+
+    return std::bit_cast<uint32_t>(take_other ? other : nearest);
+}
+
+// One-hot, from bit 0 for -inf up to bit 9 for a quiet NaN
+uint32_t fp_class(uint32_t bits)
+{
+    const bool sign = bits >> 31;
+    const uint32_t exp = (bits >> 23) & 0xFF;
+    const uint32_t frac = bits & 0x7F'FFFF;
+
+    if (exp == 0xFF && frac != 0)
+        return (frac >> 22) != 0 ? 1 << 9 : 1 << 8;
+    if (exp == 0xFF)
+        return sign ? 1 << 0 : 1 << 7;
+    if (exp != 0)
+        return sign ? 1 << 1 : 1 << 6;
+    if (frac != 0)
+        return sign ? 1 << 2 : 1 << 5;
+    return sign ? 1 << 3 : 1 << 4;
+}
+
+// Encoders for the 32-bit forms of compressed instructions
+constexpr uint32_t OPC_LOAD = 0b0000011;
+constexpr uint32_t OPC_LOAD_FP = 0b0000111;
+constexpr uint32_t OPC_OP_IMM = 0b0010011;
+constexpr uint32_t OPC_STORE = 0b0100011;
+constexpr uint32_t OPC_STORE_FP = 0b0100111;
+constexpr uint32_t OPC_OP = 0b0110011;
+constexpr uint32_t OPC_LUI = 0b0110111;
+constexpr uint32_t OPC_BRANCH = 0b1100011;
+constexpr uint32_t OPC_JALR = 0b1100111;
+constexpr uint32_t OPC_JAL = 0b1101111;
+
+constexpr uint32_t EBREAK_INSTR = 0x00100073;
+
+uint32_t enc_i(int32_t imm, uint32_t rs1, uint32_t funct3, uint32_t rd, uint32_t opcode)
+{
+    return (static_cast<uint32_t>(imm) << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | opcode;
+}
+
+uint32_t enc_s(int32_t imm, uint32_t rs2, uint32_t rs1, uint32_t funct3, uint32_t opcode)
+{
+    const uint32_t u = static_cast<uint32_t>(imm);
+    return ((u >> 5) << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) | ((u & 0x1F) << 7) |
+           opcode;
+}
+
+uint32_t enc_r(uint32_t funct7, uint32_t rs2, uint32_t rs1, uint32_t funct3, uint32_t rd)
+{
+    return (funct7 << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | OPC_OP;
+}
+
+uint32_t enc_b(int32_t imm, uint32_t rs1, uint32_t funct3)
+{
+    const uint32_t u = static_cast<uint32_t>(imm);
+    return (((u >> 12) & 1) << 31) | (((u >> 5) & 0x3F) << 25) | (rs1 << 15) | (funct3 << 12) |
+           (((u >> 1) & 0xF) << 8) | (((u >> 11) & 1) << 7) | OPC_BRANCH;
+}
+
+uint32_t enc_j(int32_t imm, uint32_t rd)
+{
+    const uint32_t u = static_cast<uint32_t>(imm);
+    return (((u >> 20) & 1) << 31) | (((u >> 1) & 0x3FF) << 21) | (((u >> 11) & 1) << 20) |
+           (((u >> 12) & 0xFF) << 12) | (rd << 7) | OPC_JAL;
+}
+
+// Bits hi..lo of instr, moved to bit pos
+uint32_t bits(uint32_t instr, unsigned hi, unsigned lo, unsigned pos)
+{
+    return ((instr >> lo) & ((1u << (hi - lo + 1)) - 1)) << pos;
+}
+
+int32_t sign_extend(uint32_t value, unsigned width)
+{
+    return static_cast<int32_t>(value << (32 - width)) >> (32 - width);
+}
+
+uint64_t splitmix64(uint64_t x)
+{
+    x += 0x9E37'79B9'7F4A'7C15;
+    x = (x ^ (x >> 30)) * 0xBF58'476D'1CE4'E5B9;
+    x = (x ^ (x >> 27)) * 0x94D0'49BB'1331'11EB;
+    return x ^ (x >> 31);
+}
+
+} // namespace
+
+uint32_t expand_rvc(uint32_t instr)
+{
+    if ((instr & 3) == 3)
+        return instr;
+
+    const uint32_t funct3 = (instr >> 13) & 7;
+    const uint32_t rd = (instr >> 7) & 0x1F;
+    const uint32_t rs2 = (instr >> 2) & 0x1F;
+    const uint32_t rd_p = 8 + ((instr >> 2) & 7);
+    const uint32_t rs1_p = 8 + ((instr >> 7) & 7);
+
+    const int32_t imm_ci = sign_extend(bits(instr, 12, 12, 5) | bits(instr, 6, 2, 0), 6);
+    const int32_t imm_lw = bits(instr, 5, 5, 6) | bits(instr, 12, 10, 3) | bits(instr, 6, 6, 2);
+    const int32_t imm_j =
+        sign_extend(bits(instr, 12, 12, 11) | bits(instr, 8, 8, 10) | bits(instr, 10, 9, 8) |
+                        bits(instr, 6, 6, 7) | bits(instr, 7, 7, 6) | bits(instr, 2, 2, 5) |
+                        bits(instr, 11, 11, 4) | bits(instr, 5, 3, 1),
+                    12);
+    const int32_t imm_b = sign_extend(bits(instr, 12, 12, 8) | bits(instr, 6, 5, 6) |
+                                          bits(instr, 2, 2, 5) | bits(instr, 11, 10, 3) |
+                                          bits(instr, 4, 3, 1),
+                                      9);
+
+    switch (((instr & 3) << 3) | funct3) {
+    // Quadrant 0
+    case 0b00'000: {
+        const int32_t imm = bits(instr, 10, 7, 6) | bits(instr, 12, 11, 4) | bits(instr, 5, 5, 3) |
+                            bits(instr, 6, 6, 2);
+        return imm != 0 ? enc_i(imm, 2, 0b000, rd_p, OPC_OP_IMM) : 0;
+    }
+    case 0b00'010:
+        return enc_i(imm_lw, rs1_p, 0b010, rd_p, OPC_LOAD);
+    case 0b00'011:
+        return enc_i(imm_lw, rs1_p, 0b010, rd_p, OPC_LOAD_FP);
+    case 0b00'110:
+        return enc_s(imm_lw, rd_p, rs1_p, 0b010, OPC_STORE);
+    case 0b00'111:
+        return enc_s(imm_lw, rd_p, rs1_p, 0b010, OPC_STORE_FP);
+
+    // Quadrant 1
+    case 0b01'000:
+        return enc_i(imm_ci, rd, 0b000, rd, OPC_OP_IMM);
+    case 0b01'001:
+        return enc_j(imm_j, 1);
+    case 0b01'010:
+        return enc_i(imm_ci, 0, 0b000, rd, OPC_OP_IMM);
+    case 0b01'011:
+        if (rd == 2) {
+            const int32_t imm = sign_extend(bits(instr, 12, 12, 9) | bits(instr, 4, 3, 7) |
+                                                bits(instr, 5, 5, 6) | bits(instr, 2, 2, 5) |
+                                                bits(instr, 6, 6, 4),
+                                            10);
+            return imm != 0 ? enc_i(imm, 2, 0b000, 2, OPC_OP_IMM) : 0;
+        }
+        return imm_ci != 0 ? (static_cast<uint32_t>(imm_ci) << 12) | (rd << 7) | OPC_LUI : 0;
+    case 0b01'100: {
+        const bool rv64 = instr & (1 << 12);
+        switch ((instr >> 10) & 3) {
+        case 0b00:
+            return rv64 ? 0 : enc_i(rs2, rs1_p, 0b101, rs1_p, OPC_OP_IMM);
+        case 0b01:
+            return rv64 ? 0 : enc_i(0x400 | rs2, rs1_p, 0b101, rs1_p, OPC_OP_IMM);
+        case 0b10:
+            return enc_i(imm_ci, rs1_p, 0b111, rs1_p, OPC_OP_IMM);
+        default: {
+            static constexpr uint32_t FUNCT3[] = {0b000, 0b100, 0b110, 0b111};
+            const uint32_t op = (instr >> 5) & 3;
+            return rv64 ? 0 : enc_r(op == 0 ? 0x20 : 0, rd_p, rs1_p, FUNCT3[op], rs1_p);
+        }
+        }
+    }
+    case 0b01'101:
+        return enc_j(imm_j, 0);
+    case 0b01'110:
+        return enc_b(imm_b, rs1_p, 0b000);
+    case 0b01'111:
+        return enc_b(imm_b, rs1_p, 0b001);
+
+    // Quadrant 2
+    case 0b10'000:
+        return instr & (1 << 12) ? 0 : enc_i(rs2, rd, 0b001, rd, OPC_OP_IMM);
+    case 0b10'010:
+    case 0b10'011: {
+        const int32_t imm = bits(instr, 3, 2, 6) | bits(instr, 12, 12, 5) | bits(instr, 6, 4, 2);
+        if (funct3 == 0b010)
+            return rd != 0 ? enc_i(imm, 2, 0b010, rd, OPC_LOAD) : 0;
+        return enc_i(imm, 2, 0b010, rd, OPC_LOAD_FP);
+    }
+    case 0b10'100:
+        if (!(instr & (1 << 12))) {
+            if (rs2 == 0)
+                return rd != 0 ? enc_i(0, rd, 0b000, 0, OPC_JALR) : 0;
+            return enc_r(0, rs2, 0, 0b000, rd);
+        }
+        if (rs2 == 0)
+            return rd == 0 ? EBREAK_INSTR : enc_i(0, rd, 0b000, 1, OPC_JALR);
+        return enc_r(0, rs2, rd, 0b000, rd);
+    case 0b10'110:
+    case 0b10'111: {
+        const int32_t imm = bits(instr, 8, 7, 6) | bits(instr, 12, 9, 2);
+        return enc_s(imm, rs2, 2, 0b010, funct3 == 0b110 ? OPC_STORE : OPC_STORE_FP);
+    }
+
+    default:
+        // RV32DC, RV64 and reserved encodings
+        return 0;
+    }
+}
+
+Decoded decode(uint32_t instr)
+{
+    Decoded d;
+    d.rd = (instr >> 7) & 0x1F;
+    d.rs1 = (instr >> 15) & 0x1F;
+    d.rs2 = (instr >> 20) & 0x1F;
+    d.rs3 = instr >> 27;
+    d.op = Op::ILLEGAL;
+
+    const uint32_t funct3 = (instr >> 12) & 0x7;
+    const uint32_t funct7 = instr >> 25;
+
+    switch (instr & 0x7F) {
+    case 0b0110111:
+        d.op = Op::LUI;
+        d.imm = imm_u(instr);
+        break;
+    case 0b0010111:
+        d.op = Op::AUIPC;
+        d.imm = imm_u(instr);
+        break;
+    case 0b1101111:
+        d.op = Op::JAL;
+        d.imm = imm_j(instr);
+        break;
+    case 0b1100111:
+        d.op = Op::JALR;
+        d.imm = imm_i(instr);
+        break;
+    case 0b1100011: {
+        static constexpr Op BRANCHES[] = {Op::BEQ,     Op::BNE, Op::ILLEGAL, Op::ILLEGAL,
+                                          Op::BLT,     Op::BGE, Op::BLTU,    Op::BGEU};
+        d.op = BRANCHES[funct3];
+        d.imm = imm_b(instr);
+        break;
+    }
+    case 0b0000011: {
+        static constexpr Op LOADS[] = {Op::LB,  Op::LH,  Op::LW,      Op::ILLEGAL,
+                                       Op::LBU, Op::LHU, Op::ILLEGAL, Op::ILLEGAL};
+        d.op = LOADS[funct3];
+        d.imm = imm_i(instr);
+        break;
+    }
+    case 0b0100011: {
+        static constexpr Op STORES[] = {Op::SB,      Op::SH,      Op::SW,      Op::ILLEGAL,
+                                        Op::ILLEGAL, Op::ILLEGAL, Op::ILLEGAL, Op::ILLEGAL};
+        d.op = STORES[funct3];
+        d.imm = imm_s(instr);
+        break;
+    }
+    case 0b0010011: {
+        static constexpr Op ALU_IMM[] = {Op::ADDI, Op::SLLI, Op::SLTI, Op::SLTIU,
+                                         Op::XORI, Op::SRLI, Op::ORI,  Op::ANDI};
+        d.op = ALU_IMM[funct3];
+        if (funct3 == 0b101 && (funct7 & 0x20))
+            d.op = Op::SRAI;
+
+        d.imm = imm_i(instr);
+        if (funct3 == 0b001 || funct3 == 0b101)
+            d.imm &= 0x1F;
+        break;
+    }
+    case 0b0110011: {
+        static constexpr Op ALU[] = {Op::ADD, Op::SLL, Op::SLT, Op::SLTU,
+                                     Op::XOR, Op::SRL, Op::OR,  Op::AND};
+        static constexpr Op MULDIV[] = {Op::MUL, Op::MULH, Op::MULHSU, Op::MULHU,
+                                        Op::DIV, Op::DIVU, Op::REM,    Op::REMU};
+
+        if (funct7 == 0b0000001) {
+            d.op = MULDIV[funct3];
+        } else if (funct7 == 0b0100000) {
+            d.op = funct3 == 0b000 ? Op::SUB : funct3 == 0b101 ? Op::SRA : Op::ILLEGAL;
+        } else if (funct7 == 0) {
+            d.op = ALU[funct3];
+        }
+        break;
+    }
+    case 0b1110011: {
+        // ecall and ebreak decode as mret in scc_control, and pipelined_cpu
+        // picks wfi out. ecall is singled out only to end simulations.
+        static constexpr Op CSR_OPS[] = {Op::MRET,    Op::CSRRW,  Op::CSRRS,  Op::CSRRC,
+                                         Op::ILLEGAL, Op::CSRRWI, Op::CSRRSI, Op::CSRRCI};
+        d.op = instr == ECALL_INSTR ? Op::ECALL
+               : instr == WFI_INSTR ? Op::WFI
+                                    : CSR_OPS[funct3];
+        d.imm = instr >> 20;
+        break;
+    }
+    case 0b0000111:
+        d.op = Op::FLW;
+        d.imm = imm_i(instr);
+        break;
+    case 0b0100111:
+        d.op = Op::FSW;
+        d.imm = imm_s(instr);
+        break;
+    case 0b1010011: {
+        static constexpr Op SGNJ_OPS[] = {Op::FSGNJ, Op::FSGNJN, Op::FSGNJX};
+        static constexpr Op CMP_OPS[] = {Op::FLE, Op::FLT, Op::FEQ};
+
+        d.imm = funct3;
+
+        switch (funct7 >> 2) {
+        case 0b00000:
+            d.op = Op::FADD;
+            break;
+        case 0b00001:
+            d.op = Op::FSUB;
+            break;
+        case 0b00010:
+            d.op = Op::FMUL;
+            break;
+        case 0b00011:
+            d.op = Op::FDIV;
+            break;
+        default:
+            switch (funct7) {
+            case 0b0101100:
+                d.op = Op::FSQRT;
+                break;
+            case 0b0010000:
+                if (funct3 < 3)
+                    d.op = SGNJ_OPS[funct3];
+                break;
+            case 0b0010100:
+                if (funct3 < 2)
+                    d.op = funct3 ? Op::FMAX : Op::FMIN;
+                break;
+            case 0b1010000:
+                if (funct3 < 3)
+                    d.op = CMP_OPS[funct3];
+                break;
+            case 0b1100000:
+                d.op = d.rs2 & 1 ? Op::FCVT_WU_S : Op::FCVT_W_S;
+                break;
+            case 0b1101000:
+                d.op = d.rs2 & 1 ? Op::FCVT_S_WU : Op::FCVT_S_W;
+                break;
+            case 0b1110000:
+                if (funct3 == 0)
+                    d.op = Op::FMV_X_W;
+                else if (funct3 == 1)
+                    d.op = Op::FCLASS;
+                break;
+            case 0b1111000:
+                d.op = Op::FMV_W_X;
+                break;
+            default:
+                break;
+            }
+            break;
+        }
+        break;
+    }
+    case 0b1000011:
+        d.op = Op::FMADD;
+        break;
+    case 0b1000111:
+        d.op = Op::FMSUB;
+        break;
+    case 0b1001011:
+        d.op = Op::FNMSUB;
+        break;
+    case 0b1001111:
+        d.op = Op::FNMADD;
+        break;
+    default:
+        break;
+    }
+
+    return d;
+}
+
+Iss::Iss(const std::vector<uint32_t> &image)
+{
+    for (size_t i = 0; i < image.size() && i < RAM_WORDS; ++i)
+        ram_[i] = image[i];
+}
+
+void Iss::take_irq(uint32_t cause)
+{
+    mepc_ = pc_;
+    mcause_ = 0x8000'0000 | cause;
+    mstatus_mpie_ = mstatus_mie_;
+    mstatus_mie_ = false;
+
+    if (shadow_regs && !in_shadow_) {
+        swap_banks();
+        in_shadow_ = true;
+    }
+
+    if (cause >= IRQ_LOCAL)
+        mip_local_ &= ~(1u << cause);
+
+    pc_ = (mtvec_ & ~3u) + (mtvec_ & 1 ? 4 * cause : 0);
+}
+
+void Iss::swap_banks()
+{
+    for (unsigned i = 1; i < 32; ++i) {
+        if (i != 2 && i != 3)
+            std::swap(x_[i], x_other_[i]);
+    }
+}
+
+void Iss::sleep()
+{
+    // Nothing else raises an interrupt without the program doing something
+    uint64_t cycles = UINT64_MAX;
+    if (mie_ & (1u << IRQ_VBLANK))
+        cycles = next_irq_ - instret_;
+    if (mie_ & (1u << IRQ_TIMER))
+        cycles = std::min(cycles, mtimecmp_ - mtime());
+
+    // Would sleep forever, carry on instead
+    if (cycles == UINT64_MAX)
+        return;
+
+    idle_cycles_ += cycles;
+    mtime_offset_ += cycles;
+    mcycle_offset_ += cycles;
+
+    // v_sync keeps its pace against the clock rather than the instructions
+    const uint64_t until_vsync = next_irq_ - instret_;
+    if (cycles < until_vsync) {
+        next_irq_ -= cycles;
+    } else {
+        mip_local_ |= 1u << IRQ_VBLANK;
+        next_irq_ = instret_ + FRAME_CYCLES - (cycles - until_vsync) % FRAME_CYCLES;
+    }
+}
+
+uint32_t Iss::mip() const
+{
+    return mip_local_ | (mtime() >= mtimecmp_ ? 1u << IRQ_TIMER : 0);
+}
+
+std::optional<uint32_t> Iss::pending_irq() const
+{
+    const uint32_t enabled = mip() & mie_;
+    if (!mstatus_mie_ || enabled == 0)
+        return std::nullopt;
+
+    // Lower local interrupts first, then the timer
+    if (enabled >> IRQ_LOCAL)
+        return IRQ_LOCAL + std::countr_zero(enabled >> IRQ_LOCAL);
+
+    return IRQ_TIMER;
+}
+
+Exit Iss::run(uint64_t max_instrs)
+{
+    const uint64_t end = max_instrs == 0 ? UINT64_MAX : instret_ + max_instrs;
+
+    while (instret_ < end) {
+        if (instret_ >= next_irq_) {
+            mip_local_ |= 1u << IRQ_VBLANK;
+            next_irq_ += FRAME_CYCLES;
+        }
+
+        if (const auto cause = pending_irq())
+            take_irq(*cause);
+
+        // Nothing but the program itself can raise or unmask an interrupt
+        // within this stretch, and whatever does so cuts it short
+        stop_ = std::min(end, next_irq_);
+        if (mtime() < mtimecmp_)
+            stop_ = std::min(stop_, instret_ + (mtimecmp_ - mtime()));
+
+        while (instret_ < stop_) {
+            const Exit exit = execute<false>(nullptr);
+            if (exit != Exit::NONE)
+                return exit;
+        }
+    }
+
+    return Exit::LIMIT;
+}
+
+Exit Iss::step(Retired &retired)
+{
+    retired = Retired{};
+    return execute<true>(&retired);
+}
+
+template <bool Trace>
+[[gnu::always_inline]] inline Exit Iss::execute(Retired *retired)
+{
+    const uint32_t pc = pc_;
+    const uint32_t idx = (pc >> 1) % RAM_HALFWORDS;
+
+    Decoded &d = decoded_[idx];
+    if (d.op == Op::DECODE) {
+        const uint32_t instr = fetch(pc);
+        d = decode(expand_rvc(instr));
+        d.size = (instr & 3) == 3 ? 4 : 2;
+    }
+
+    const uint32_t a = x_[d.rs1];
+    const uint32_t b = x_[d.rs2];
+
+    uint32_t next_pc = pc + d.size;
+    uint32_t result = 0;
+    bool write_x = true;
+    bool volatile_read = false;
+    Exit exit = Exit::NONE;
+
+    // Reads a float operand inside alu_round, after the rounding mode is set
+    const auto fs = [&](uint8_t reg) { return to_float(f_[reg]); };
+
+    // float_alu only ever produces the canonical NaN, while the host's come
+    // with its sign bit set
+    const auto fp_result = [&](float value) {
+        f_[d.rd] = std::isnan(value) ? CANONICAL_NAN : from_float(value);
+        write_x = false;
+
+        if constexpr (Trace) {
+            retired->fp_write = true;
+            retired->fp_alu = true;
+        }
+    };
+
+    // Results of fp_misc that go to a float register, through Writeback
+    const auto fp_misc_result = [&](uint32_t value) {
+        f_[d.rd] = value;
+        write_x = false;
+
+        if constexpr (Trace)
+            retired->fp_write = true;
+    };
+
+    const uint32_t rm = d.imm == RM_DYN ? frm_ : d.imm;
+
+    switch (d.op) {
+    case Op::DECODE:
+    case Op::ILLEGAL:
+        // scc_control makes the core spin on unknown instructions
+        return Exit::ILLEGAL;
+
+    case Op::LUI:
+        result = d.imm;
+        break;
+    case Op::AUIPC:
+        result = pc + d.imm;
+        break;
+    case Op::JAL:
+        result = pc + d.size;
+        next_pc = pc + d.imm;
+        break;
+    case Op::JALR:
+        result = pc + d.size;
+        next_pc = (a + d.imm) & ~1U;
+        break;
+
+    case Op::BEQ:
+        write_x = false;
+        if (a == b)
+            next_pc = pc + d.imm;
+        break;
+    case Op::BNE:
+        write_x = false;
+        if (a != b)
+            next_pc = pc + d.imm;
+        break;
+    case Op::BLT:
+        write_x = false;
+        if (static_cast<int32_t>(a) < static_cast<int32_t>(b))
+            next_pc = pc + d.imm;
+        break;
+    case Op::BGE:
+        write_x = false;
+        if (static_cast<int32_t>(a) >= static_cast<int32_t>(b))
+            next_pc = pc + d.imm;
+        break;
+    case Op::BLTU:
+        write_x = false;
+        if (a < b)
+            next_pc = pc + d.imm;
+        break;
+    case Op::BGEU:
+        write_x = false;
+        if (a >= b)
+            next_pc = pc + d.imm;
+        break;
+
+    case Op::LB:
+    case Op::LH:
+    case Op::LW:
+    case Op::LBU:
+    case Op::LHU:
+        result = load(a + d.imm, d.op, volatile_read);
+        break;
+    case Op::SB:
+    case Op::SH:
+    case Op::SW:
+        write_x = false;
+        if (store(a + d.imm, b, d.op)) {
+            exit_code_ = b >> 1;
+            exit = Exit::TOHOST;
+        }
+        break;
+
+    case Op::ADDI:
+        result = a + d.imm;
+        break;
+    case Op::SLTI:
+        result = static_cast<int32_t>(a) < d.imm;
+        break;
+    case Op::SLTIU:
+        result = a < static_cast<uint32_t>(d.imm);
+        break;
+    case Op::XORI:
+        result = a ^ d.imm;
+        break;
+    case Op::ORI:
+        result = a | d.imm;
+        break;
+    case Op::ANDI:
+        result = a & d.imm;
+        break;
+    case Op::SLLI:
+        result = a << d.imm;
+        break;
+    case Op::SRLI:
+        result = a >> d.imm;
+        break;
+    case Op::SRAI:
+        result = static_cast<int32_t>(a) >> d.imm;
+        break;
+
+    case Op::ADD:
+        result = a + b;
+        break;
+    case Op::SUB:
+        result = a - b;
+        break;
+    case Op::SLL:
+        result = a << (b & 0x1F);
+        break;
+    case Op::SLT:
+        result = static_cast<int32_t>(a) < static_cast<int32_t>(b);
+        break;
+    case Op::SLTU:
+        result = a < b;
+        break;
+    case Op::XOR:
+        result = a ^ b;
+        break;
+    case Op::SRL:
+        result = a >> (b & 0x1F);
+        break;
+    case Op::SRA:
+        result = static_cast<int32_t>(a) >> (b & 0x1F);
+        break;
+    case Op::OR:
+        result = a | b;
+        break;
+    case Op::AND:
+        result = a & b;
+        break;
+
+    case Op::MUL:
+        result = a * b;
+        break;
+    case Op::MULH:
+        result = (int64_t{static_cast<int32_t>(a)} * static_cast<int32_t>(b)) >> 32;
+        break;
+    case Op::MULHSU:
+        result = (int64_t{static_cast<int32_t>(a)} * int64_t{b}) >> 32;
+        break;
+    case Op::MULHU:
+        result = (uint64_t{a} * b) >> 32;
+        break;
+    case Op::DIV:
+        if (b == 0)
+            result = UINT32_MAX;
+        else if (a == 0x8000'0000 && b == UINT32_MAX)
+            result = a;
+        else
+            result = static_cast<int32_t>(a) / static_cast<int32_t>(b);
+        break;
+    case Op::DIVU:
+        result = b == 0 ? UINT32_MAX : a / b;
+        break;
+    case Op::REM:
+        if (b == 0)
+            result = a;
+        else if (a == 0x8000'0000 && b == UINT32_MAX)
+            result = 0;
+        else
+            result = static_cast<int32_t>(a) % static_cast<int32_t>(b);
+        break;
+    case Op::REMU:
+        result = b == 0 ? a : a % b;
+        break;
+
+    case Op::CSRRW:
+    case Op::CSRRS:
+    case Op::CSRRC:
+    case Op::CSRRWI:
+    case Op::CSRRSI:
+    case Op::CSRRCI: {
+        const uint32_t csr = d.imm;
+        const uint32_t src = d.op >= Op::CSRRWI ? d.rs1 : a;
+
+        result = csr_read(csr, volatile_read);
+
+        switch (d.op) {
+        case Op::CSRRW:
+        case Op::CSRRWI:
+            csr_write(csr, src);
+            break;
+        case Op::CSRRS:
+        case Op::CSRRSI:
+            csr_write(csr, result | src);
+            break;
+        default:
+            csr_write(csr, result & ~src);
+            break;
+        }
+        break;
+    }
+    case Op::ECALL:
+        write_x = false;
+        exit_code_ = x_[10];
+        exit = Exit::ECALL;
+        break;
+    case Op::MRET:
+        write_x = false;
+        next_pc = mepc_;
+        mstatus_mie_ = mstatus_mpie_;
+        mstatus_mpie_ = true;
+        if (in_shadow_) {
+            swap_banks();
+            in_shadow_ = false;
+        }
+        stop_ = instret_ + 1;
+        break;
+    case Op::WFI:
+        write_x = false;
+        // step() leaves interrupts to the caller, so it's a nop there
+        if constexpr (!Trace) {
+            if ((mip() & mie_) == 0)
+                sleep();
+        }
+        stop_ = instret_ + 1;
+        break;
+
+    case Op::FLW:
+        write_x = false;
+        f_[d.rd] = load(a + d.imm, Op::LW, volatile_read);
+        if constexpr (Trace)
+            retired->fp_write = true;
+        break;
+    case Op::FSW:
+        write_x = false;
+        if (store(a + d.imm, f_[d.rs2], Op::SW)) {
+            exit_code_ = f_[d.rs2] >> 1;
+            exit = Exit::TOHOST;
+        }
+        break;
+    case Op::FADD:
+        fp_result(alu_round(rm, [&] { return fs(d.rs1) + fs(d.rs2); }));
+        break;
+    case Op::FSUB:
+        fp_result(alu_round(rm, [&] { return fs(d.rs1) - fs(d.rs2); }));
+        break;
+    case Op::FMUL:
+        fp_result(alu_round(rm, [&] { return fs(d.rs1) * fs(d.rs2); }));
+        break;
+    case Op::FDIV:
+        fp_result(alu_round(rm, [&] { return fs(d.rs1) / fs(d.rs2); }));
+        break;
+    case Op::FSQRT:
+        fp_result(alu_round(rm, [&] { return std::sqrt(fs(d.rs1)); }));
+        break;
+    case Op::FMADD:
+        fp_result(alu_round(rm, [&] { return std::fma(fs(d.rs1), fs(d.rs2), fs(d.rs3)); }));
+        break;
+    case Op::FMSUB:
+        fp_result(alu_round(rm, [&] { return std::fma(fs(d.rs1), fs(d.rs2), -fs(d.rs3)); }));
+        break;
+    case Op::FNMSUB:
+        fp_result(alu_round(rm, [&] { return std::fma(-fs(d.rs1), fs(d.rs2), fs(d.rs3)); }));
+        break;
+    case Op::FNMADD:
+        fp_result(alu_round(rm, [&] { return std::fma(-fs(d.rs1), fs(d.rs2), -fs(d.rs3)); }));
+        break;
+    case Op::FSGNJ:
+        fp_misc_result((f_[d.rs2] & 0x8000'0000) | (f_[d.rs1] & 0x7FFF'FFFF));
+        break;
+    case Op::FSGNJN:
+        fp_misc_result((~f_[d.rs2] & 0x8000'0000) | (f_[d.rs1] & 0x7FFF'FFFF));
+        break;
+    case Op::FSGNJX:
+        fp_misc_result((f_[d.rs2] & 0x8000'0000) ^ f_[d.rs1]);
+        break;
+    case Op::FMIN:
+        fp_misc_result(fp_min_max(f_[d.rs1], f_[d.rs2], false));
+        break;
+    case Op::FMAX:
+        fp_misc_result(fp_min_max(f_[d.rs1], f_[d.rs2], true));
+        break;
+    case Op::FEQ:
+        result = to_float(f_[d.rs1]) == to_float(f_[d.rs2]);
+        break;
+    case Op::FLT:
+        result = to_float(f_[d.rs1]) < to_float(f_[d.rs2]);
+        break;
+    case Op::FLE:
+        result = to_float(f_[d.rs1]) <= to_float(f_[d.rs2]);
+        break;
+    case Op::FCVT_W_S:
+        result = float_to_int(f_[d.rs1], rm, false);
+        break;
+    case Op::FCVT_WU_S:
+        result = float_to_int(f_[d.rs1], rm, true);
+        break;
+    case Op::FCVT_S_W:
+        fp_misc_result(int_to_float(static_cast<int32_t>(a), rm));
+        break;
+    case Op::FCVT_S_WU:
+        fp_misc_result(int_to_float(a, rm));
+        break;
+    case Op::FCLASS:
+        result = fp_class(f_[d.rs1]);
+        break;
+    case Op::FMV_X_W:
+        result = f_[d.rs1];
+        break;
+    case Op::FMV_W_X:
+        write_x = false;
+        f_[d.rd] = a;
+        if constexpr (Trace)
+            retired->fp_write = true;
+        break;
+    }
+
+    if (write_x && d.rd != 0)
+        x_[d.rd] = result;
+
+    if constexpr (Trace) {
+        retired->pc = pc;
+        retired->instr = expand_rvc(fetch(pc));
+        retired->volatile_read = volatile_read;
+
+        if (write_x)
+            retired->rd = d.rd;
+        retired->value = x_[d.rd];
+
+        if (retired->fp_write) {
+            retired->frd = d.rd;
+            retired->fvalue = f_[d.rd];
+        }
+    }
+
+    pc_ = next_pc;
+    ++instret_;
+
+    return exit;
+}
+
+uint32_t Iss::fetch(uint32_t pc) const
+{
+    const uint32_t idx = (pc >> 2) % RAM_WORDS;
+    if (!(pc & 2))
+        return ram_[idx];
+
+    return (ram_[idx] >> 16) | (ram_[(idx + 1) % RAM_WORDS] << 16);
+}
+
+uint32_t Iss::load(uint32_t addr, Op op, bool &volatile_read)
+{
+    uint32_t data = 0;
+
+    // Same decoding as tachyon_rv, on the top address nibble
+    switch (addr >> 28) {
+    case 0x0:
+    case 0x1:
+        // dual_word_ram shifts the word by the byte offset instead of
+        // selecting a lane
+        data = ram_[(addr >> 2) % RAM_WORDS] >> (8 * (addr & 3));
+        break;
+    case 0x2:
+        io.rng = static_cast<uint32_t>(splitmix64(instret_ ^ (uint64_t{io.rng} << 32)));
+        data = io.rng;
+        volatile_read = true;
+        break;
+    case 0x3:
+        switch ((addr >> 2) & 7) {
+        case 0:
+            data = io.dma.src;
+            break;
+        case 1:
+            data = io.dma.dst;
+            break;
+        case 2:
+            data = io.dma.count;
+            break;
+        case 3:
+            data = io.dma.stride;
+            break;
+        case 4:
+            data = io.dma.ctrl;
+            break;
+        case 5:
+            data = io.dma.done << 1;
+            break;
+        default:
+            break;
+        }
+        // The RTL may still be busy
+        volatile_read = true;
+        break;
+    case 0x4:
+        data = io.tattr[(addr >> 1) % io.tattr.size()];
+        break;
+    case 0x5:
+        data = io.tdata[(addr >> 1) % io.tdata.size()];
+        break;
+    case 0x6:
+        switch (addr & 3) {
+        case 0:
+            data = 1; // Ready
+            break;
+        case 1:
+            data = io.joypad_valid;
+            break;
+        case 2:
+            data = io.joypad_data;
+            break;
+        default:
+            break;
+        }
+        volatile_read = true;
+        break;
+    case 0x7: {
+        const uint64_t count = addr & 8 ? mtimecmp_ : mtime();
+        data = addr & 4 ? count >> 32 : count;
+        // mtime counts cycles in the RTL, instructions here
+        volatile_read = !(addr & 8);
+        break;
+    }
+    case 0x8:
+    case 0x9:
+        data = io.palette[(addr >> 1) & 0x1F];
+        break;
+    case 0xA:
+    case 0xB:
+        if (addr & 0x100) {
+            data = io.sprites[(addr >> 2) & 0x1F];
+            break;
+        }
+
+        switch ((addr >> 2) & 0x3F) {
+        case 0:
+            data = io.display_on;
+            break;
+        case 1:
+            // Flips wait for the RTL's next vertical blank
+            volatile_read = true;
+            break;
+        case 2:
+        case 3:
+            data = io.scroll[(addr >> 2) & 1];
+            break;
+        default:
+            break;
+        }
+        break;
+    case 0xC:
+    case 0xD:
+        switch (addr & 3) {
+        case 1:
+            data = io.lcd_data;
+            break;
+        case 3:
+            data = io.lcd_watermark;
+            break;
+        default:
+            // Status and FIFO level. Characters go out immediately here, while
+            // the RTL keeps them queued for a while.
+            volatile_read = true;
+            break;
+        }
+        break;
+    case 0xE:
+    case 0xF: {
+        if (addr & 0x80) {
+            data = io.audio_tick;
+            break;
+        }
+
+        const AudioChannel &ch = io.audio[(addr >> 5) & 3];
+        switch ((addr >> 2) & 7) {
+        case 1:
+            data = ch.volume;
+            break;
+        case 2:
+            data = ch.seq;
+            break;
+        case 3:
+            data = ch.seq_len;
+            break;
+        default:
+            // Period, control, position and timer follow the sequencer
+            volatile_read = true;
+            break;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+
+    switch (op) {
+    case Op::LB:
+        return static_cast<int8_t>(data);
+    case Op::LH:
+        return static_cast<int16_t>(data);
+    case Op::LBU:
+        return data & 0xFF;
+    case Op::LHU:
+        return data & 0xFFFF;
+    default:
+        return data;
+    }
+}
+
+bool Iss::store(uint32_t addr, uint32_t value, Op op)
+{
+    switch (addr >> 28) {
+    case 0x0:
+    case 0x1: {
+        const uint32_t idx = (addr >> 2) % RAM_WORDS;
+        const uint32_t shift = 8 * (addr & 3);
+        const uint32_t mask = op == Op::SB ? 0xFF : op == Op::SH ? 0xFFFF : UINT32_MAX;
+
+        ram_[idx] = (ram_[idx] & ~(mask << shift)) | ((value & mask) << shift);
+
+        // Both halves of the word, and whatever starts in the one before and
+        // may run into it
+        for (uint32_t half = 2 * idx + RAM_HALFWORDS - 1; half <= 2 * idx + RAM_HALFWORDS + 1;
+             ++half)
+            decoded_[half % RAM_HALFWORDS].op = Op::DECODE;
+        break;
+    }
+    case 0x3:
+        switch ((addr >> 2) & 7) {
+        case 0:
+            io.dma.src = value;
+            break;
+        case 1:
+            io.dma.dst = value;
+            break;
+        case 2:
+            io.dma.count = value;
+            break;
+        case 3:
+            io.dma.stride = value;
+            break;
+        case 4:
+            dma_start(value);
+            break;
+        case 5:
+            io.dma.done = false;
+            break;
+        default:
+            break;
+        }
+        break;
+    case 0x4: {
+        uint16_t &hword = io.tattr[(addr >> 1) % io.tattr.size()];
+        hword = op == Op::SB ? (hword & 0xFF00) | (value & 0xFF) : value;
+        break;
+    }
+    case 0x5: {
+        uint16_t &hword = io.tdata[(addr >> 1) % io.tdata.size()];
+        hword = op == Op::SB ? (hword & 0xFF00) | (value & 0xFF) : value;
+        break;
+    }
+    case 0x6:
+        // Reads complete right away, and raise the interrupt as they do
+        io.joypad_data = io.joypad_buttons;
+        io.joypad_valid = true;
+        mip_local_ |= 1u << IRQ_JOYPAD;
+        stop_ = instret_ + 1;
+        break;
+    case 0x7: {
+        const uint32_t shift = addr & 4 ? 32 : 0;
+        const uint64_t mask = uint64_t{UINT32_MAX} << shift;
+
+        if (addr & 8) {
+            mtimecmp_ = (mtimecmp_ & ~mask) | (uint64_t{value} << shift);
+        } else {
+            const uint64_t time = (mtime() & ~mask) | (uint64_t{value} << shift);
+            mtime_offset_ = time - instret_;
+        }
+
+        stop_ = instret_ + 1;
+        break;
+    }
+    case 0x8:
+    case 0x9:
+        if (op != Op::SB)
+            io.palette[(addr >> 1) & 0x1F] = value & 0xFFF;
+        break;
+    case 0xA:
+    case 0xB:
+        if (addr & 0x100) {
+            io.sprites[(addr >> 2) & 0x1F] = value;
+            break;
+        }
+
+        // The page register only matters to the RTL's scanout
+        switch ((addr >> 2) & 0x3F) {
+        case 0:
+            io.display_on = value & 1;
+            break;
+        case 2:
+        case 3:
+            io.scroll[(addr >> 2) & 1] = value;
+            break;
+        default:
+            break;
+        }
+        break;
+    case 0xC:
+    case 0xD:
+        if ((addr & 3) == 3) {
+            io.lcd_watermark = value;
+            break;
+        }
+
+        io.lcd_data = value;
+        if ((addr & 1) && io.echo_lcd) {
+            std::putchar(io.lcd_data);
+            std::fflush(stdout);
+        }
+        break;
+    case 0xE:
+    case 0xF: {
+        if (addr & 0x80) {
+            io.audio_tick = value;
+            break;
+        }
+
+        AudioChannel &ch = io.audio[(addr >> 5) & 3];
+        switch ((addr >> 2) & 7) {
+        case 1:
+            ch.volume = value & 0x1FF;
+            break;
+        case 2:
+            ch.seq = value;
+            break;
+        case 3:
+            ch.seq_len = value;
+            break;
+        default:
+            break;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+
+    return tohost && addr == *tohost;
+}
+
+void Iss::dma_start(uint32_t ctrl)
+{
+    Dma &dma = io.dma;
+    dma.ctrl = ctrl & 0xF;
+
+    if (dma.count == 0)
+        return;
+
+    const uint32_t size = ctrl & 3;
+    const bool scatter = ctrl & 4;
+    const Op load_op = size == 0 ? Op::LBU : size == 1 ? Op::LHU : Op::LW;
+    const Op store_op = size == 0 ? Op::SB : size == 1 ? Op::SH : Op::SW;
+
+    const auto src_stride = static_cast<int16_t>(dma.stride);
+    const auto dst_stride = static_cast<int16_t>(dma.stride >> 16);
+
+    bool volatile_read = false;
+
+    for (; dma.count != 0; --dma.count) {
+        const uint32_t data = load(dma.src, scatter ? Op::LW : load_op, volatile_read);
+
+        if (scatter) {
+            store(dma.dst + (data & 0xFFFF), data >> 16, store_op);
+            dma.src += 4;
+        } else {
+            store(dma.dst, data, store_op);
+            dma.src += src_stride;
+            dma.dst += dst_stride;
+        }
+    }
+
+    dma.done = true;
+
+    if (ctrl & 8) {
+        mip_local_ |= 1u << IRQ_DMA;
+        // Stop run() right after this instruction
+        stop_ = instret_ + 1;
+    }
+}
+
+uint32_t Iss::csr_read(uint32_t addr, bool &volatile_read) const
+{
+    switch (addr) {
+    case CSR_FFLAGS:
+        // float_alu's flags aren't modelled, see to_float
+        volatile_read = true;
+        return 0;
+    case CSR_FRM:
+        return frm_;
+    case CSR_FCSR:
+        volatile_read = true;
+        return frm_ << 5;
+    case CSR_MSTATUS:
+        return MSTATUS_MPP | (mstatus_mpie_ ? MSTATUS_MPIE : 0) | (mstatus_mie_ ? MSTATUS_MIE : 0);
+    case CSR_MIE:
+        return mie_;
+    case CSR_MTVEC:
+        return mtvec_;
+    case CSR_MEPC:
+        return mepc_;
+    case CSR_MCAUSE:
+        return mcause_;
+    case CSR_MIP:
+        // The RTL's peripherals raise their interrupts on their own time
+        volatile_read = true;
+        return mip();
+    case CSR_MCYCLE:
+        volatile_read = true;
+        return instret_ + mcycle_offset_;
+    case CSR_MINSTRET:
+        volatile_read = true;
+        return instret_ + minstret_offset_;
+    case CSR_MCYCLEH:
+        volatile_read = true;
+        return (instret_ + mcycle_offset_) >> 32;
+    case CSR_MINSTRETH:
+        volatile_read = true;
+        return (instret_ + minstret_offset_) >> 32;
+    default:
+        break;
+    }
+
+    // The events behind the performance counters only exist in the RTL
+    if (addr - CSR_MHPMEVENT3 < HPM_COUNTERS)
+        return hpm_events_[addr - CSR_MHPMEVENT3];
+
+    if (addr - CSR_MHPMCOUNTER3 < HPM_COUNTERS || addr - CSR_MHPMCOUNTER3H < HPM_COUNTERS)
+        volatile_read = true;
+
+    return 0;
+}
+
+void Iss::csr_write(uint32_t addr, uint32_t value)
+{
+    const auto write_half = [&](uint64_t &offset, bool high) {
+        uint64_t count = instret_ + offset;
+        if (high)
+            count = (count & UINT32_MAX) | (uint64_t{value} << 32);
+        else
+            count = (count & ~uint64_t{UINT32_MAX}) | value;
+        offset = count - instret_;
+    };
+
+    switch (addr) {
+    case CSR_FRM:
+        frm_ = value & 0x7;
+        break;
+    case CSR_FCSR:
+        frm_ = (value >> 5) & 0x7;
+        break;
+    case CSR_MSTATUS:
+        mstatus_mie_ = value & MSTATUS_MIE;
+        mstatus_mpie_ = value & MSTATUS_MPIE;
+        stop_ = instret_ + 1;
+        break;
+    case CSR_MIE:
+        mie_ = value & MIE_MASK;
+        stop_ = instret_ + 1;
+        break;
+    case CSR_MTVEC:
+        mtvec_ = value;
+        break;
+    case CSR_MEPC:
+        mepc_ = value;
+        break;
+    case CSR_MCAUSE:
+        mcause_ = value;
+        break;
+    case CSR_MIP:
+        mip_local_ = value & 0xFFFF'0000;
+        stop_ = instret_ + 1;
+        break;
+    case CSR_MCYCLE:
+    case CSR_MCYCLEH:
+        write_half(mcycle_offset_, addr == CSR_MCYCLEH);
+        break;
+    case CSR_MINSTRET:
+    case CSR_MINSTRETH:
+        write_half(minstret_offset_, addr == CSR_MINSTRETH);
+        break;
+    default:
+        if (addr - CSR_MHPMEVENT3 < HPM_COUNTERS)
+            hpm_events_[addr - CSR_MHPMEVENT3] = value & 0xF;
+        break;
+    }
+}
+
+} // namespace iss
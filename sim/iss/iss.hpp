@@ -0,0 +1,345 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+// Functional (not cycle-accurate) simulator of the Tachyon RV system: the
+// RV32IMFC subset implemented by pipelined_cpu, the CSRs in cpu_csr_file, the
+// memory map from firmware/src/tachyon.h and the v_sync, joypad, DMA and timer
+// interrupts.
+namespace iss
+{
+
+constexpr uint32_t RAM_SIZE = 16 * 1024;
+constexpr uint32_t RAM_WORDS = RAM_SIZE / 4;
+constexpr uint32_t RAM_HALFWORDS = RAM_SIZE / 2;
+
+// mhpmcounter3 and up, as many as cpu_csr_file has by default
+constexpr uint32_t HPM_COUNTERS = 4;
+
+// One 800x600 @ 72 Hz frame, see video_unit. v_sync goes low (and the
+// interrupt is raised) at the start of the vertical sync pulse.
+constexpr uint64_t FRAME_CYCLES = 1040 * 666;
+constexpr uint64_t VSYNC_CYCLE = 1040 * 637;
+
+// Interrupt causes, as numbered in cpu_csr_file.vh and wired up by tachyon_rv
+constexpr uint32_t IRQ_TIMER = 7;
+constexpr uint32_t IRQ_VBLANK = 16;
+constexpr uint32_t IRQ_JOYPAD = 18;
+constexpr uint32_t IRQ_DMA = 21;
+
+enum class Exit {
+    NONE,
+    ECALL,
+    TOHOST,
+    ILLEGAL,
+    LIMIT,
+};
+
+enum class Op : uint8_t {
+    DECODE, // Not decoded yet, or the word was overwritten
+    ILLEGAL,
+
+    LUI,
+    AUIPC,
+    JAL,
+    JALR,
+    BEQ,
+    BNE,
+    BLT,
+    BGE,
+    BLTU,
+    BGEU,
+
+    LB,
+    LH,
+    LW,
+    LBU,
+    LHU,
+    SB,
+    SH,
+    SW,
+
+    ADDI,
+    SLTI,
+    SLTIU,
+    XORI,
+    ORI,
+    ANDI,
+    SLLI,
+    SRLI,
+    SRAI,
+
+    ADD,
+    SUB,
+    SLL,
+    SLT,
+    SLTU,
+    XOR,
+    SRL,
+    SRA,
+    OR,
+    AND,
+
+    MUL,
+    MULH,
+    MULHSU,
+    MULHU,
+    DIV,
+    DIVU,
+    REM,
+    REMU,
+
+    CSRRW,
+    CSRRS,
+    CSRRC,
+    CSRRWI,
+    CSRRSI,
+    CSRRCI,
+    ECALL,
+    MRET,
+    WFI,
+
+    FLW,
+    FSW,
+    FADD,
+    FSUB,
+    FMUL,
+    FDIV,
+    FSQRT,
+    FMADD,
+    FMSUB,
+    FNMSUB,
+    FNMADD,
+    FSGNJ,
+    FSGNJN,
+    FSGNJX,
+    FMIN,
+    FMAX,
+    FEQ,
+    FLT,
+    FLE,
+    FCVT_W_S,
+    FCVT_WU_S,
+    FCVT_S_W,
+    FCVT_S_WU,
+    FCLASS,
+    FMV_X_W,
+    FMV_W_X,
+};
+
+struct Decoded {
+    Op op = Op::DECODE;
+    uint8_t rd = 0;
+    uint8_t rs1 = 0;
+    uint8_t rs2 = 0;
+    uint8_t rs3 = 0;
+    // The rounding mode for float operations
+    int32_t imm = 0;
+    // In bytes, 2 for a compressed instruction
+    uint8_t size = 4;
+};
+
+// The 32-bit instruction a compressed one stands for, as cpu_rvc_expander
+// does. Other instructions are returned as they are, and reserved encodings
+// as 0.
+uint32_t expand_rvc(uint32_t instr);
+Decoded decode(uint32_t instr);
+
+// Register writes of a single instruction, for lockstep comparison
+struct Retired {
+    uint32_t pc = 0;
+    uint32_t instr = 0;
+
+    // x0 means no integer write
+    uint8_t rd = 0;
+    uint32_t value = 0;
+
+    bool fp_write = false;
+    // Written by float_alu rather than through Writeback, so the RTL may do
+    // it out of order
+    bool fp_alu = false;
+    uint8_t frd = 0;
+    uint32_t fvalue = 0;
+
+    // Read a peripheral or a counter, whose value can't be predicted
+    bool volatile_read = false;
+};
+
+// dma_unit registers. Transfers complete as soon as they're started.
+struct Dma {
+    uint32_t src = 0;
+    uint32_t dst = 0;
+    uint32_t count = 0;
+    uint32_t stride = 0;
+    uint32_t ctrl = 0;
+    bool done = false;
+};
+
+// audio_unit channel registers the sequencer leaves alone. Sequences aren't
+// played, so the rest are read as volatile.
+struct AudioChannel {
+    uint16_t volume = 256;
+    uint32_t seq = 0;
+    uint32_t seq_len = 0;
+};
+
+struct Peripherals {
+    uint32_t rng = 1;
+
+    // Both pages
+    std::array<uint16_t, 2048> tattr{};
+    std::array<uint16_t, 2048> tdata{};
+    std::array<uint16_t, 32> palette{};
+    bool display_on = false;
+    std::array<uint8_t, 2> scroll{};
+    std::array<uint32_t, 32> sprites{};
+
+    uint8_t lcd_data = 0;
+    uint8_t lcd_watermark = 0;
+    bool echo_lcd = true;
+
+    // Buttons reported by the next joypad read
+    uint8_t joypad_buttons = 0;
+    uint8_t joypad_data = 0;
+    bool joypad_valid = false;
+
+    std::array<AudioChannel, 4> audio{};
+    uint32_t audio_tick = 1040 * 666;
+
+    Dma dma;
+};
+
+class Iss {
+public:
+    explicit Iss(const std::vector<uint32_t> &image);
+
+    // Runs until an exit condition or until max_instrs instructions (0 = no
+    // limit) have been executed. v_sync interrupts are raised on their own
+    // every FRAME_CYCLES, counting one cycle per instruction, and taken along
+    // with the rest whenever mstatus and mie allow. A wfi skips the time up to
+    // the next v_sync or timer interrupt, if either is enabled.
+    Exit run(uint64_t max_instrs);
+
+    // Executes a single instruction and reports what it wrote. Interrupts are
+    // left to the caller (see take_irq).
+    Exit step(Retired &retired);
+
+    // Takes an interrupt as pipelined_cpu does: mepc gets the address of the
+    // next instruction and execution continues at its entry in mtvec.
+    void take_irq(uint32_t cause);
+
+    uint32_t pc() const
+    {
+        return pc_;
+    }
+    uint64_t instret() const
+    {
+        return instret_;
+    }
+    // Cycles skipped by wfi
+    uint64_t idle_cycles() const
+    {
+        return idle_cycles_;
+    }
+    uint32_t exit_code() const
+    {
+        return exit_code_;
+    }
+
+    uint32_t reg(unsigned idx) const
+    {
+        return x_[idx];
+    }
+    void set_reg(unsigned idx, uint32_t value)
+    {
+        if (idx != 0)
+            x_[idx] = value;
+    }
+
+    uint32_t freg(unsigned idx) const
+    {
+        return f_[idx];
+    }
+    void set_freg(unsigned idx, uint32_t value)
+    {
+        f_[idx] = value;
+    }
+
+    std::optional<uint32_t> tohost;
+    Peripherals io;
+    // Handlers get their own integer registers but sp and gp, as with
+    // pipelined_cpu's SHADOW_REGS
+    bool shadow_regs = false;
+
+private:
+    template <bool Trace>
+    Exit execute(Retired *retired);
+
+    // The (possibly compressed) instruction at pc, which may straddle two
+    // words
+    uint32_t fetch(uint32_t pc) const;
+
+    uint32_t load(uint32_t addr, Op op, bool &volatile_read);
+    // Returns true on a store to tohost
+    bool store(uint32_t addr, uint32_t value, Op op);
+
+    uint32_t csr_read(uint32_t addr, bool &volatile_read) const;
+    void csr_write(uint32_t addr, uint32_t value);
+
+    uint64_t mtime() const
+    {
+        return instret_ + mtime_offset_;
+    }
+    uint32_t mip() const;
+    // The interrupt to take next, if any is pending, enabled and allowed
+    std::optional<uint32_t> pending_irq() const;
+
+    // Runs the transfer set up in io.dma
+    void dma_start(uint32_t ctrl);
+
+    // Swaps x_ with the other register bank
+    void swap_banks();
+
+    // Lets time pass up to the next interrupt enabled in mie that comes up on
+    // its own, for a wfi
+    void sleep();
+
+    std::array<uint32_t, RAM_WORDS> ram_{};
+    // Per halfword, as compressed instructions can start at any of them
+    std::array<Decoded, RAM_HALFWORDS> decoded_{};
+
+    std::array<uint32_t, 32> x_{};
+    std::array<uint32_t, 32> f_{};
+    uint32_t pc_ = 0;
+
+    // Whichever bank isn't in x_, and whether that's the interrupted program's
+    std::array<uint32_t, 32> x_other_{};
+    bool in_shadow_ = false;
+
+    uint32_t mtvec_ = 0;
+    uint32_t mepc_ = 0;
+    uint32_t mcause_ = 0;
+    uint32_t mie_ = 0;
+    // Local interrupts only, the timer's bit comes from mtimecmp
+    uint32_t mip_local_ = 0;
+    bool mstatus_mie_ = false;
+    bool mstatus_mpie_ = false;
+    uint64_t mtime_offset_ = 0;
+    uint64_t mtimecmp_ = UINT64_MAX;
+    uint64_t instret_ = 0;
+    uint64_t idle_cycles_ = 0;
+    uint64_t mcycle_offset_ = 0;
+    uint64_t minstret_offset_ = 0;
+    uint32_t frm_ = 0;
+    uint64_t next_irq_ = VSYNC_CYCLE;
+    // Where run() has to stop and look at interrupts again
+    uint64_t stop_ = 0;
+    std::array<uint32_t, HPM_COUNTERS> hpm_events_{};
+
+    uint32_t exit_code_ = 0;
+};
+
+} // namespace iss
@@ -0,0 +1,143 @@
+#include "../firmware.hpp"
+#include "iss.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace
+{
+
+constexpr uint64_t DEFAULT_MAX_INSTRS = 1'000'000'000;
+
+struct Options {
+    const char *firmware = nullptr;
+    uint64_t max_instrs = DEFAULT_MAX_INSTRS;
+    std::optional<uint32_t> tohost;
+    uint8_t joypad = 0;
+    bool quiet = false;
+    bool shadow_regs = false;
+};
+
+void usage(const char *argv0)
+{
+    std::fprintf(stderr,
+                 "usage: %s [options] <firmware.mem|firmware.elf>\n"
+                 "\n"
+                 "  --max-instrs N   stop after N instructions (default %llu, 0 = no limit)\n"
+                 "  --tohost ADDR    stop on a store to ADDR (default: `tohost` symbol in ELF)\n"
+                 "  --joypad BITS    buttons held down on the joypad (see JP_* in tachyon.h)\n"
+                 "  --quiet          don't echo LCD output\n"
+                 "  --shadow-regs    give interrupt handlers their own registers, as with\n"
+                 "                   SHADOW_REGS=1\n",
+                 argv0, static_cast<unsigned long long>(DEFAULT_MAX_INSTRS));
+}
+
+std::optional<Options> parse_args(int argc, char **argv)
+{
+    Options opts;
+
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+
+        if (std::strcmp(arg, "--max-instrs") == 0 && i + 1 < argc) {
+            opts.max_instrs = std::strtoull(argv[++i], nullptr, 0);
+        } else if (std::strcmp(arg, "--tohost") == 0 && i + 1 < argc) {
+            opts.tohost = std::strtoul(argv[++i], nullptr, 0);
+        } else if (std::strcmp(arg, "--joypad") == 0 && i + 1 < argc) {
+            opts.joypad = std::strtoul(argv[++i], nullptr, 0);
+        } else if (std::strcmp(arg, "--quiet") == 0) {
+            opts.quiet = true;
+        } else if (std::strcmp(arg, "--shadow-regs") == 0) {
+            opts.shadow_regs = true;
+        } else if (arg[0] != '-' && opts.firmware == nullptr) {
+            opts.firmware = arg;
+        } else {
+            return std::nullopt;
+        }
+    }
+
+    if (opts.firmware == nullptr)
+        return std::nullopt;
+
+    return opts;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    const auto opts = parse_args(argc, argv);
+    if (!opts) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    sim::Firmware firmware;
+    std::vector<uint32_t> image;
+
+    try {
+        firmware = sim::load_firmware(opts->firmware);
+        image = sim::read_mem(firmware.mem_path);
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "error: %s\n", e.what());
+        return EXIT_FAILURE;
+    }
+
+    if (firmware.mem_path != opts->firmware)
+        std::filesystem::remove(firmware.mem_path);
+
+    // Big enough that it doesn't fit on the stack
+    auto iss = std::make_unique<iss::Iss>(image);
+    iss->tohost = opts->tohost ? opts->tohost : firmware.tohost;
+    iss->io.echo_lcd = !opts->quiet;
+    iss->io.joypad_buttons = opts->joypad;
+    iss->shadow_regs = opts->shadow_regs;
+
+    const auto start = std::chrono::steady_clock::now();
+    const iss::Exit exit = iss->run(opts->max_instrs);
+    const auto end = std::chrono::steady_clock::now();
+
+    const double seconds = std::chrono::duration<double>(end - start).count();
+    const uint64_t instrs = iss->instret();
+
+    std::fprintf(stderr, "\n");
+
+    switch (exit) {
+    case iss::Exit::ECALL:
+        std::fprintf(stderr, "exit: ecall, a0 = %u\n", iss->exit_code());
+        break;
+    case iss::Exit::TOHOST:
+        std::fprintf(stderr, "exit: tohost, code = %u\n", iss->exit_code());
+        break;
+    case iss::Exit::ILLEGAL:
+        std::fprintf(stderr, "exit: illegal instruction at pc = 0x%08x\n", iss->pc());
+        break;
+    default:
+        std::fprintf(stderr, "exit: reached the instruction budget\n");
+        break;
+    }
+
+    const uint64_t cycles = instrs + iss->idle_cycles();
+
+    std::fprintf(stderr, "instructions: %llu (%.1f frames, %.1f%% asleep)\n",
+                 static_cast<unsigned long long>(instrs),
+                 static_cast<double>(cycles) / iss::FRAME_CYCLES,
+                 cycles ? 100.0 * iss->idle_cycles() / cycles : 0.0);
+    std::fprintf(stderr, "time:         %.3f s (%.1f MIPS)\n", seconds,
+                 seconds > 0 ? instrs / seconds / 1e6 : 0.0);
+
+    switch (exit) {
+    case iss::Exit::ECALL:
+    case iss::Exit::TOHOST:
+        return static_cast<int>(iss->exit_code());
+    default:
+        return EXIT_FAILURE;
+    }
+}
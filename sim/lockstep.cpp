@@ -0,0 +1,119 @@
+#include "lockstep.hpp"
+
+#include <cstdio>
+
+namespace sim
+{
+
+Lockstep::Lockstep(const std::vector<uint32_t> &image, bool shadow_regs)
+    : iss_(std::make_unique<iss::Iss>(image))
+{
+    iss_->io.echo_lcd = false;
+    iss_->shadow_regs = shadow_regs;
+}
+
+bool Lockstep::fail(const iss::Retired &retired, const char *what, uint32_t expected,
+                    uint32_t got)
+{
+    char buf[160];
+    std::snprintf(buf, sizeof(buf),
+                  "lockstep mismatch at pc = 0x%08x (instr 0x%08x, #%llu): %s, "
+                  "ISS 0x%08x, RTL 0x%08x",
+                  retired.pc, retired.instr, static_cast<unsigned long long>(iss_->instret()),
+                  what, expected, got);
+    error_ = buf;
+    return false;
+}
+
+bool Lockstep::match_fp_alu(uint8_t reg)
+{
+    auto &iss_writes = iss_fp_alu_[reg];
+    auto &rtl_writes = rtl_fp_alu_[reg];
+
+    while (!iss_writes.empty() && !rtl_writes.empty()) {
+        const iss::Retired retired = iss_writes.front();
+        const uint32_t value = rtl_writes.front();
+        iss_writes.pop_front();
+        rtl_writes.pop_front();
+
+        if (value != retired.fvalue)
+            return fail(retired, "float_alu result", retired.fvalue, value);
+    }
+
+    return true;
+}
+
+bool Lockstep::retire(bool reg_write, bool freg_write, uint8_t reg_waddr, uint32_t reg_wdata)
+{
+    iss::Retired retired;
+    const iss::Exit exit = iss_->step(retired);
+
+    if (exit == iss::Exit::ILLEGAL)
+        return fail(retired, "ISS hit an illegal instruction", 0, 0);
+
+    if (retired.volatile_read) {
+        if (retired.rd != 0 && reg_write) {
+            iss_->set_reg(retired.rd, reg_wdata);
+            retired.value = reg_wdata;
+        } else if (retired.fp_write && freg_write) {
+            iss_->set_freg(retired.frd, reg_wdata);
+            retired.fvalue = reg_wdata;
+        }
+    }
+
+    const uint8_t rd = reg_write ? reg_waddr : 0;
+    if (retired.rd != rd)
+        return fail(retired, "integer destination", retired.rd, rd);
+    if (rd != 0 && retired.value != reg_wdata)
+        return fail(retired, "integer result", retired.value, reg_wdata);
+
+    const bool iss_freg_write = retired.fp_write && !retired.fp_alu;
+    if (iss_freg_write != freg_write)
+        return fail(retired, "float register write", iss_freg_write, freg_write);
+    if (freg_write && retired.frd != reg_waddr)
+        return fail(retired, "float destination", retired.frd, reg_waddr);
+    if (freg_write && retired.fvalue != reg_wdata)
+        return fail(retired, "float result", retired.fvalue, reg_wdata);
+
+    if (retired.fp_alu) {
+        iss_fp_alu_[retired.frd].push_back(retired);
+        if (!match_fp_alu(retired.frd))
+            return false;
+    }
+
+    if (trap_)
+        trap_->ahead = false;
+
+    return true;
+}
+
+bool Lockstep::cycle(const RtlCycle &rtl)
+{
+    if (rtl.retire && !retire(rtl.reg_write, rtl.freg_write, rtl.reg_waddr, rtl.reg_wdata))
+        return false;
+    if (rtl.retire_b && !retire(rtl.reg_write_b, false, rtl.reg_waddr_b, rtl.reg_wdata_b))
+        return false;
+
+    if (rtl.fp_alu_write) {
+        rtl_fp_alu_[rtl.fp_alu_waddr].push_back(rtl.fp_alu_wdata);
+        if (!match_fp_alu(rtl.fp_alu_waddr))
+            return false;
+    }
+
+    if (rtl.trap)
+        trap_ = PendingTrap{.epc = rtl.trap_epc, .cause = rtl.trap_cause, .ahead = rtl.trap_ahead};
+
+    // Everything older than the interrupted instruction has retired by now
+    if (trap_ && !trap_->ahead) {
+        const uint32_t pc = iss_->pc();
+        if (pc != trap_->epc)
+            return fail({.pc = pc}, "interrupted pc", pc, trap_->epc);
+
+        iss_->take_irq(trap_->cause);
+        trap_.reset();
+    }
+
+    return true;
+}
+
+} // namespace sim
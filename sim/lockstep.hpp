@@ -0,0 +1,80 @@
+#pragma once
+
+#include "iss/iss.hpp"
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace sim
+{
+
+// What the RTL did in one cycle, as seen through sim_tachyon_rv's probes
+struct RtlCycle {
+    bool retire = false;
+
+    bool reg_write = false;
+    bool freg_write = false;
+    uint8_t reg_waddr = 0;
+    uint32_t reg_wdata = 0;
+
+    bool fp_alu_write = false;
+    uint8_t fp_alu_waddr = 0;
+    uint32_t fp_alu_wdata = 0;
+
+    bool trap = false;
+    uint32_t trap_epc = 0;
+    uint8_t trap_cause = 0;
+    bool trap_ahead = false;
+
+    // Pipe B's instruction, retiring after the one above on a dual-issue core.
+    // It only ever writes integer registers.
+    bool retire_b = false;
+    bool reg_write_b = false;
+    uint8_t reg_waddr_b = 0;
+    uint32_t reg_wdata_b = 0;
+};
+
+// Runs the instruction set simulator alongside the RTL, one instruction per
+// instruction retired by pipelined_cpu, and checks that both write the same
+// values to the same registers.
+//
+// Values read from peripherals and counters can't be predicted by the ISS, so
+// it takes them from the RTL instead. float_alu results are written back out
+// of order, so they're matched per destination register.
+class Lockstep {
+public:
+    Lockstep(const std::vector<uint32_t> &image, bool shadow_regs);
+
+    // Returns false on the first mismatch, described by error()
+    bool cycle(const RtlCycle &rtl);
+
+    const std::string &error() const
+    {
+        return error_;
+    }
+
+private:
+    bool fail(const iss::Retired &retired, const char *what, uint32_t expected, uint32_t got);
+    bool retire(bool reg_write, bool freg_write, uint8_t reg_waddr, uint32_t reg_wdata);
+    bool match_fp_alu(uint8_t reg);
+
+    // pipelined_cpu takes an interrupt while the instruction in Memory is
+    // still to retire, so the ISS takes it once that one has
+    struct PendingTrap {
+        uint32_t epc;
+        uint8_t cause;
+        bool ahead;
+    };
+
+    std::unique_ptr<iss::Iss> iss_;
+    std::array<std::deque<iss::Retired>, 32> iss_fp_alu_;
+    std::array<std::deque<uint32_t>, 32> rtl_fp_alu_;
+    std::optional<PendingTrap> trap_;
+    std::string error_;
+};
+
+} // namespace sim
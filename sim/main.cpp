@@ -0,0 +1,377 @@
+#include "Vsim_tachyon_rv.h"
+#include "firmware.hpp"
+#include "lockstep.hpp"
+#include "trace.hpp"
+#include "verilated.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+constexpr uint64_t DEFAULT_MAX_CYCLES = 100'000'000;
+constexpr uint64_t RESET_CYCLES = 4;
+
+// Cycles the instructions older than an ecall need to get through Writeback
+constexpr uint64_t DRAIN_CYCLES = 3;
+
+enum class ExitReason {
+    ECALL,
+    TOHOST,
+    MAX_CYCLES,
+    MISMATCH,
+};
+
+struct Options {
+    const char *firmware = nullptr;
+    uint64_t max_cycles = DEFAULT_MAX_CYCLES;
+    std::optional<uint32_t> tohost;
+    bool quiet = false;
+    bool lockstep = false;
+    const char *trace = nullptr;
+};
+
+void usage(const char *argv0)
+{
+    std::fprintf(stderr,
+                 "usage: %s [options] <firmware.mem|firmware.elf> [+verilator args]\n"
+                 "\n"
+                 "  --max-cycles N   stop after N cycles (default %llu, 0 = no limit)\n"
+                 "  --tohost ADDR    stop on a store to ADDR (default: `tohost` symbol in ELF)\n"
+                 "  --quiet          don't echo LCD output\n"
+                 "  --lockstep       check every register write against the ISS\n"
+                 "  --trace FILE     write a commit trace to FILE (compressed if it ends in .gz)\n",
+                 argv0, static_cast<unsigned long long>(DEFAULT_MAX_CYCLES));
+}
+
+std::optional<Options> parse_args(int argc, char **argv)
+{
+    Options opts;
+
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+
+        if (std::strcmp(arg, "--max-cycles") == 0 && i + 1 < argc) {
+            opts.max_cycles = std::strtoull(argv[++i], nullptr, 0);
+        } else if (std::strcmp(arg, "--tohost") == 0 && i + 1 < argc) {
+            opts.tohost = std::strtoul(argv[++i], nullptr, 0);
+        } else if (std::strcmp(arg, "--quiet") == 0) {
+            opts.quiet = true;
+        } else if (std::strcmp(arg, "--lockstep") == 0) {
+            opts.lockstep = true;
+        } else if (std::strcmp(arg, "--trace") == 0 && i + 1 < argc) {
+            opts.trace = argv[++i];
+        } else if (arg[0] == '+') {
+            // Left for Verilator
+        } else if (arg[0] != '-' && opts.firmware == nullptr) {
+            opts.firmware = arg;
+        } else {
+            return std::nullopt;
+        }
+    }
+
+    if (opts.firmware == nullptr)
+        return std::nullopt;
+
+    return opts;
+}
+
+sim::RtlCycle sample(const Vsim_tachyon_rv &top)
+{
+    return {
+        .retire = static_cast<bool>(top.retire),
+
+        .reg_write = static_cast<bool>(top.reg_write),
+        .freg_write = static_cast<bool>(top.freg_write),
+        .reg_waddr = top.reg_waddr,
+        .reg_wdata = top.reg_wdata,
+
+        .fp_alu_write = static_cast<bool>(top.fp_alu_write),
+        .fp_alu_waddr = top.fp_alu_waddr,
+        .fp_alu_wdata = top.fp_alu_wdata,
+
+        .trap = static_cast<bool>(top.trap),
+        .trap_epc = top.trap_epc,
+        .trap_cause = top.trap_cause,
+        .trap_ahead = static_cast<bool>(top.trap_ahead),
+
+        .retire_b = static_cast<bool>(top.retire_b),
+        .reg_write_b = static_cast<bool>(top.reg_write_b),
+        .reg_waddr_b = top.reg_waddr_b,
+        .reg_wdata_b = top.reg_wdata_b,
+    };
+}
+
+// Records the instruction in Writeback, which has been there for `cycles`
+// cycles with `events` going off
+sim::TraceRecord trace_record(const Vsim_tachyon_rv &top, uint32_t cycles, uint8_t events)
+{
+    const uint32_t opcode = top.commit_instr & 0x7f;
+
+    uint8_t flags = 0;
+    if (top.reg_write)
+        flags |= sim::TRACE_REG_WRITE;
+    if (top.freg_write)
+        flags |= sim::TRACE_FREG_WRITE;
+    if (opcode == 0b0000011 || opcode == 0b0000111)
+        flags |= sim::TRACE_LOAD;
+    if (opcode == 0b0100011 || opcode == 0b0100111)
+        flags |= sim::TRACE_STORE;
+
+    return {
+        .pc = top.commit_pc,
+        .instr = top.commit_instr,
+        .value = flags & (sim::TRACE_REG_WRITE | sim::TRACE_FREG_WRITE) ? top.reg_wdata : 0,
+        .addr = flags & (sim::TRACE_LOAD | sim::TRACE_STORE) ? top.commit_addr : 0,
+        .cycles = cycles,
+        .rd = top.reg_waddr,
+        .flags = flags,
+        .events = events,
+        .reserved = 0,
+    };
+}
+
+// Records pipe B's instruction in Writeback, which retires in the same cycle as
+// the one in pipe A
+sim::TraceRecord trace_record_b(const Vsim_tachyon_rv &top)
+{
+    return {
+        .pc = top.commit_pc_b,
+        .instr = top.commit_instr_b,
+        .value = top.reg_write_b ? top.reg_wdata_b : 0,
+        .addr = 0,
+        .cycles = 0,
+        .rd = top.reg_waddr_b,
+        .flags = static_cast<uint8_t>(top.reg_write_b ? sim::TRACE_REG_WRITE : 0),
+        .events = 0,
+        .reserved = 0,
+    };
+}
+
+// Hit rate of a cache and the cycles it spent refilling lines, or writing them
+// back for the data cache
+void print_cache(const char *name, uint32_t hits, uint32_t misses, uint32_t refill_cycles)
+{
+    const uint64_t accesses = static_cast<uint64_t>(hits) + misses;
+    std::fprintf(stderr, "%s:       %llu accesses (%.1f%% hits), %u refill cycles\n", name,
+                 static_cast<unsigned long long>(accesses),
+                 accesses ? 100.0 * hits / accesses : 0.0, refill_cycles);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    const auto opts = parse_args(argc, argv);
+    if (!opts) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    sim::Firmware firmware;
+    std::vector<uint32_t> lockstep_image;
+    std::unique_ptr<sim::Lockstep> lockstep;
+    std::unique_ptr<sim::TraceWriter> trace;
+
+    try {
+        firmware = sim::load_firmware(opts->firmware);
+        if (opts->lockstep)
+            lockstep_image = sim::read_mem(firmware.mem_path);
+        if (opts->trace)
+            trace = std::make_unique<sim::TraceWriter>(opts->trace);
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "error: %s\n", e.what());
+        return EXIT_FAILURE;
+    }
+
+    const auto tohost = opts->tohost ? opts->tohost : firmware.tohost;
+
+    auto contextp = std::make_unique<VerilatedContext>();
+    contextp->commandArgs(argc, argv);
+
+    const std::string firmware_arg = "+firmware=" + firmware.mem_path.string();
+    const char *extra_args[] = {firmware_arg.c_str()};
+    contextp->commandArgsAdd(1, extra_args);
+
+    auto top = std::make_unique<Vsim_tachyon_rv>(contextp.get());
+
+    uint64_t cycles = 0;
+    uint64_t idle_cycles = 0;
+    uint64_t instructions = 0;
+    bool lcd_enable = false;
+
+    uint32_t trace_cycles = 0;
+    uint8_t trace_events = 0;
+
+    // Called once per cycle, before the clock edge
+    const auto sample_trace = [&] {
+        if (!trace)
+            return;
+
+        ++trace_cycles;
+        trace_events |= top->core_events;
+
+        if (top->retire) {
+            trace->write(trace_record(*top, trace_cycles, trace_events));
+            trace_cycles = 0;
+            trace_events = 0;
+        }
+
+        if (top->retire_b)
+            trace->write(trace_record_b(*top));
+    };
+
+    const auto tick = [&] {
+        top->clk = 1;
+        top->eval();
+        top->clk = 0;
+        top->eval();
+
+        if (lcd_enable && !top->lcd_enable && top->lcd_ctrl == 0b10 && !opts->quiet) {
+            std::putchar(top->lcd_data);
+            std::fflush(stdout);
+        }
+        lcd_enable = top->lcd_enable;
+    };
+
+    top->clk = 0;
+    top->rst_n = 0;
+    top->eval();
+
+    // Whether the ISS needs a second register bank depends on the model
+    if (opts->lockstep)
+        lockstep = std::make_unique<sim::Lockstep>(lockstep_image, top->shadow_regs);
+
+    for (uint64_t i = 0; i < RESET_CYCLES; ++i)
+        tick();
+
+    top->rst_n = 1;
+
+    ExitReason reason = ExitReason::MAX_CYCLES;
+    uint32_t exit_code = 0;
+
+    const auto start = std::chrono::steady_clock::now();
+
+    const auto in_budget = [&] { return opts->max_cycles == 0 || cycles < opts->max_cycles; };
+
+    while (in_budget()) {
+        // Nothing retires, traps or stores while the core sleeps on a wfi, so
+        // the peripherals are left to run without sampling anything
+        if (top->idle) {
+            const uint64_t idle_start = cycles;
+            while (top->idle && in_budget()) {
+                tick();
+                ++cycles;
+            }
+
+            idle_cycles += cycles - idle_start;
+            trace_cycles += static_cast<uint32_t>(cycles - idle_start);
+            continue;
+        }
+
+        // Everything sampled here belongs to the cycle that is about to end
+        instructions += top->retire + top->retire_b;
+        sample_trace();
+
+        if (tohost && top->data_wenable && top->data_ready && top->data_addr == *tohost) {
+            reason = ExitReason::TOHOST;
+            exit_code = top->data_wdata >> 1;
+        }
+
+        const bool ecall = top->ecall;
+
+        if (lockstep && !lockstep->cycle(sample(*top))) {
+            reason = ExitReason::MISMATCH;
+            break;
+        }
+
+        tick();
+        ++cycles;
+
+        if (reason == ExitReason::TOHOST)
+            break;
+
+        if (ecall) {
+            for (uint64_t drained = 0; drained < DRAIN_CYCLES; ++cycles) {
+                instructions += top->retire + top->retire_b;
+                sample_trace();
+                drained += top->data_ready;
+
+                if (lockstep && !lockstep->cycle(sample(*top))) {
+                    reason = ExitReason::MISMATCH;
+                    break;
+                }
+
+                tick();
+            }
+
+            if (reason == ExitReason::MISMATCH)
+                break;
+
+            reason = ExitReason::ECALL;
+            exit_code = top->a0;
+            break;
+        }
+    }
+
+    const auto end = std::chrono::steady_clock::now();
+    const double seconds = std::chrono::duration<double>(end - start).count();
+
+    top->final();
+    trace.reset();
+
+    if (firmware.mem_path != opts->firmware)
+        std::filesystem::remove(firmware.mem_path);
+
+    std::fprintf(stderr, "\n");
+
+    switch (reason) {
+    case ExitReason::ECALL:
+        std::fprintf(stderr, "exit: ecall, a0 = %u\n", exit_code);
+        break;
+    case ExitReason::TOHOST:
+        std::fprintf(stderr, "exit: tohost, code = %u\n", exit_code);
+        break;
+    case ExitReason::MAX_CYCLES:
+        std::fprintf(stderr, "exit: reached the cycle budget\n");
+        break;
+    case ExitReason::MISMATCH:
+        std::fprintf(stderr, "exit: %s\n", lockstep->error().c_str());
+        break;
+    }
+
+    std::fprintf(stderr, "cycles:       %llu (%.1f%% asleep)\n",
+                 static_cast<unsigned long long>(cycles),
+                 cycles ? 100.0 * idle_cycles / cycles : 0.0);
+    const uint64_t awake_cycles = cycles - idle_cycles;
+    std::fprintf(stderr, "instructions: %llu (IPC %.3f, %.3f awake)\n",
+                 static_cast<unsigned long long>(instructions),
+                 cycles ? static_cast<double>(instructions) / cycles : 0.0,
+                 awake_cycles ? static_cast<double>(instructions) / awake_cycles : 0.0);
+    const uint64_t branches = static_cast<uint64_t>(top->bp_hits) + top->bp_misses;
+    std::fprintf(stderr, "branches:     %llu (%.1f%% mispredicted)\n",
+                 static_cast<unsigned long long>(branches),
+                 branches ? 100.0 * top->bp_misses / branches : 0.0);
+    if (top->caches) {
+        print_cache("icache", top->icache_hits, top->icache_misses, top->icache_refill_cycles);
+        print_cache("dcache", top->dcache_hits, top->dcache_misses, top->dcache_refill_cycles);
+    }
+    std::fprintf(stderr, "time:         %.3f s (%.3f MHz)\n", seconds,
+                 seconds > 0 ? cycles / seconds / 1e6 : 0.0);
+
+    switch (reason) {
+    case ExitReason::ECALL:
+    case ExitReason::TOHOST:
+        return static_cast<int>(exit_code);
+    default:
+        return EXIT_FAILURE;
+    }
+}
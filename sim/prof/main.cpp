@@ -0,0 +1,166 @@
+#include "../firmware.hpp"
+#include "../trace.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+
+constexpr size_t DEFAULT_TOP = 20;
+
+// HPM_EVENT_* from cpu_csr_file.vh, as found in TraceRecord::events
+constexpr std::array<const char *, 8> EVENT_NAMES = {
+    nullptr, "load-use", "fp", "muldiv", "branch", "trap", "icache", "dcache",
+};
+
+struct Options {
+    const char *trace = nullptr;
+    const char *elf = nullptr;
+    size_t top = DEFAULT_TOP;
+};
+
+struct Stats {
+    uint64_t cycles = 0;
+    uint64_t instrs = 0;
+    // Cycles beyond the first of each instruction, by the events seen while
+    // they went by. An instruction that saw several events counts for each.
+    std::array<uint64_t, 8> stalls{};
+};
+
+void usage(const char *argv0)
+{
+    std::fprintf(stderr,
+                 "usage: %s [options] <trace> <firmware.elf>\n"
+                 "\n"
+                 "  --top N   only list the N functions with the most cycles (default %zu, 0 = "
+                 "all)\n",
+                 argv0, DEFAULT_TOP);
+}
+
+std::optional<Options> parse_args(int argc, char **argv)
+{
+    Options opts;
+
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+
+        if (std::strcmp(arg, "--top") == 0 && i + 1 < argc) {
+            opts.top = std::strtoull(argv[++i], nullptr, 0);
+        } else if (arg[0] != '-' && opts.trace == nullptr) {
+            opts.trace = arg;
+        } else if (arg[0] != '-' && opts.elf == nullptr) {
+            opts.elf = arg;
+        } else {
+            return std::nullopt;
+        }
+    }
+
+    if (opts.trace == nullptr || opts.elf == nullptr)
+        return std::nullopt;
+
+    return opts;
+}
+
+// Index of the function containing pc, or functions.size() if there's none
+size_t find_function(const std::vector<sim::Symbol> &functions, uint32_t pc)
+{
+    auto it = std::ranges::upper_bound(functions, pc, {}, &sim::Symbol::addr);
+    if (it == functions.begin())
+        return functions.size();
+
+    --it;
+
+    // Symbols without a size (hand-written assembly) extend to the next one
+    if (it->size != 0 && pc >= it->addr + it->size)
+        return functions.size();
+
+    return it - functions.begin();
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    const auto opts = parse_args(argc, argv);
+    if (!opts) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<sim::Symbol> functions;
+    std::vector<Stats> stats;
+    Stats total;
+
+    try {
+        functions = sim::load_functions(opts->elf);
+
+        // The last entry collects everything outside a known function
+        stats.resize(functions.size() + 1);
+
+        // Most of the time is spent in a few loops, so remember the last lookups
+        std::unordered_map<uint32_t, size_t> cache;
+
+        sim::TraceReader trace(opts->trace);
+        sim::TraceRecord record;
+
+        while (trace.next(record)) {
+            auto [it, inserted] = cache.try_emplace(record.pc);
+            if (inserted)
+                it->second = find_function(functions, record.pc);
+
+            for (Stats *s : {&stats[it->second], &total}) {
+                s->cycles += record.cycles;
+                ++s->instrs;
+
+                for (size_t event = 1; event < EVENT_NAMES.size(); ++event) {
+                    if (record.events & (1 << event))
+                        s->stalls[event] += record.cycles - 1;
+                }
+            }
+        }
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "error: %s\n", e.what());
+        return EXIT_FAILURE;
+    }
+
+    std::vector<size_t> order;
+    for (size_t i = 0; i < stats.size(); ++i) {
+        if (stats[i].instrs != 0)
+            order.push_back(i);
+    }
+
+    std::ranges::sort(order, std::greater{}, [&](size_t i) { return stats[i].cycles; });
+    if (opts->top != 0 && order.size() > opts->top)
+        order.resize(opts->top);
+
+    std::printf("%-28s %12s %6s %12s %6s", "function", "cycles", "%", "instrs", "CPI");
+    for (size_t event = 1; event < EVENT_NAMES.size(); ++event)
+        std::printf(" %10s", EVENT_NAMES[event]);
+    std::printf("\n");
+
+    const auto print_row = [&](const char *name, const Stats &s) {
+        std::printf("%-28.28s %12llu %6.2f %12llu %6.2f", name,
+                    static_cast<unsigned long long>(s.cycles),
+                    total.cycles ? 100.0 * s.cycles / total.cycles : 0.0,
+                    static_cast<unsigned long long>(s.instrs),
+                    s.instrs ? static_cast<double>(s.cycles) / s.instrs : 0.0);
+
+        for (size_t event = 1; event < EVENT_NAMES.size(); ++event)
+            std::printf(" %10llu", static_cast<unsigned long long>(s.stalls[event]));
+        std::printf("\n");
+    };
+
+    for (size_t i : order)
+        print_row(i < functions.size() ? functions[i].name.c_str() : "??", stats[i]);
+
+    print_row("total", total);
+}
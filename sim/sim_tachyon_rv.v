@@ -0,0 +1,176 @@
+`default_nettype none
+
+// Top level for the Verilator harness. Wraps tachyon_rv with a single clock
+// and exposes the few internal signals the C++ driver needs to count retired
+// instructions and detect the end of a program.
+module sim_tachyon_rv #(
+    parameter USE_CACHES   = 0,
+    parameter MEM_LATENCY  = 8,
+    parameter STORE_BUFFER = 0,
+    parameter SHADOW_REGS  = 0,
+    parameter DUAL_ISSUE   = 0,
+    parameter EARLY_BRANCH = 0
+) (
+    input wire clk,
+    input wire rst_n,
+
+    output wire [7:0] lcd_data,
+    output wire [1:0] lcd_ctrl,
+    output wire       lcd_enable,
+
+    // An instruction reached Writeback this cycle
+    output wire retire,
+    // An ecall is leaving Decode this cycle
+    output wire ecall,
+    // Asleep on a wfi with nothing left in flight, so nothing but the
+    // peripherals changes until an interrupt wakes the core up
+    output wire idle,
+
+    output wire [31:0] data_addr,
+    output wire [31:0] data_wdata,
+    output wire [ 3:0] data_wenable,
+    output wire        data_ready,
+
+    output wire [31:0] a0,
+
+    // Register file writes and interrupt entry, for lockstep runs against the
+    // instruction set simulator
+    output wire        reg_write,
+    output wire        freg_write,
+    output wire [ 4:0] reg_waddr,
+    output wire [31:0] reg_wdata,
+
+    output wire        fp_alu_write,
+    output wire [ 4:0] fp_alu_waddr,
+    output wire [31:0] fp_alu_wdata,
+
+    output wire        trap,
+    output wire [31:0] trap_epc,
+    output wire [ 4:0] trap_cause,
+    // Memory still holds an instruction that retires after the trap is taken
+    output wire        trap_ahead,
+    output wire        shadow_regs,
+
+    // The instruction in Writeback and the address it accessed, plus the
+    // HPM_EVENT_* stall/flush reasons of the core this cycle, for the commit
+    // trace
+    output wire [31:0] commit_pc,
+    output wire [31:0] commit_instr,
+    output wire [31:0] commit_addr,
+    output wire [ 7:0] core_events,
+
+    // Pipe B's instruction in Writeback, which retires right after the one
+    // above
+    output wire        retire_b,
+    output wire        reg_write_b,
+    output wire [ 4:0] reg_waddr_b,
+    output wire [31:0] reg_wdata_b,
+    output wire [31:0] commit_pc_b,
+    output wire [31:0] commit_instr_b,
+
+    // Branches and jumps the predictor got right and wrong, for the report
+    output wire [31:0] bp_hits,
+    output wire [31:0] bp_misses,
+
+    // Cache counters, all zero without USE_CACHES
+    output wire        caches,
+    output wire [31:0] icache_hits,
+    output wire [31:0] icache_misses,
+    output wire [31:0] icache_refill_cycles,
+    output wire [31:0] dcache_hits,
+    output wire [31:0] dcache_misses,
+    output wire [31:0] dcache_refill_cycles
+);
+  tachyon_rv #(
+      .USE_CACHES  (USE_CACHES),
+      .MEM_LATENCY (MEM_LATENCY),
+      .STORE_BUFFER(STORE_BUFFER),
+      .SHADOW_REGS (SHADOW_REGS),
+      .DUAL_ISSUE  (DUAL_ISSUE),
+      .EARLY_BRANCH(EARLY_BRANCH)
+  ) dut (
+      .clk    (clk),
+      .clk_vga(clk),
+      .rst_n  (rst_n),
+
+      .joypad_scl_out(),
+      .joypad_sda_in (1'b1),
+      .joypad_sda_out(),
+
+      .lcd_data  (lcd_data),
+      .lcd_ctrl  (lcd_ctrl),
+      .lcd_enable(lcd_enable),
+
+      .vga_red  (),
+      .vga_green(),
+      .vga_blue (),
+      .h_sync   (),
+      .v_sync   (),
+
+      .audio_out()
+  );
+
+  // ecall shares its encoding space with mret, so it is seen as an mret being
+  // taken in Decode
+  assign retire = !dut.koishi.bubble_w;
+  assign ecall = dut.koishi.take_mret_d && dut.koishi.instr_d == 32'h00000073;
+  assign idle = dut.koishi.sleeping && !dut.koishi.irq_wake && dut.koishi.bubble_e &&
+                dut.koishi.bubble_m && dut.koishi.bubble_w && dut.koishi.fp_busy == 0;
+
+  assign data_addr = dut.cpu_data_addr;
+  assign data_wdata = dut.cpu_data_wdata;
+  assign data_wenable = dut.cpu_data_wenable;
+  assign data_ready = dut.cpu_data_ready;
+
+  assign a0 = dut.koishi.register_file.g_register[10].val;
+
+  assign reg_write = dut.koishi.reg_write_w && dut.koishi.rd_w != 0;
+  assign freg_write = dut.koishi.regf_write_w;
+  assign reg_waddr = dut.koishi.rd_w;
+  assign reg_wdata = dut.koishi.reg_wd3_w;
+
+  assign fp_alu_write = dut.koishi.fp_alu_retire;
+  assign fp_alu_waddr = dut.koishi.fp_alu_tag_out_e;
+  assign fp_alu_wdata = dut.koishi.fp_alu_result_e;
+
+  assign trap = dut.koishi.trap;
+  assign trap_epc = dut.koishi.trap_epc;
+  assign trap_cause = dut.koishi.irq_cause;
+  assign trap_ahead = !dut.koishi.bubble_m;
+  assign shadow_regs = SHADOW_REGS != 0;
+
+  assign commit_pc = dut.koishi.pc_w;
+  assign commit_instr = dut.koishi.instr_w;
+  assign commit_addr = dut.koishi.data_addr_w;
+  assign core_events = dut.koishi.core_events;
+
+  assign retire_b = !dut.koishi.bubble_b_w;
+  assign reg_write_b = dut.koishi.reg_write_b_w && dut.koishi.rd_b_w != 0;
+  assign reg_waddr_b = dut.koishi.rd_b_w;
+  assign reg_wdata_b = dut.koishi.result_b_w;
+  assign commit_pc_b = dut.koishi.pc_b_w;
+  assign commit_instr_b = dut.koishi.instr_b_w;
+
+  assign bp_hits = dut.koishi.bp_hits;
+  assign bp_misses = dut.koishi.bp_misses;
+
+  assign caches = USE_CACHES != 0;
+
+  generate
+    if (USE_CACHES) begin : g_caches
+      assign icache_hits = dut.g_caches.icache_hits;
+      assign icache_misses = dut.g_caches.icache_misses;
+      assign icache_refill_cycles = dut.g_caches.icache_refill_cycles;
+      assign dcache_hits = dut.g_caches.dcache_hits;
+      assign dcache_misses = dut.g_caches.dcache_misses;
+      assign dcache_refill_cycles = dut.g_caches.dcache_refill_cycles;
+    end else begin : g_no_caches
+      assign icache_hits = 0;
+      assign icache_misses = 0;
+      assign icache_refill_cycles = 0;
+      assign dcache_hits = 0;
+      assign dcache_misses = 0;
+      assign dcache_refill_cycles = 0;
+    end
+  endgenerate
+endmodule
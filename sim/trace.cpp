@@ -0,0 +1,62 @@
+#include "trace.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+namespace sim
+{
+
+TraceWriter::TraceWriter(const std::filesystem::path &path)
+{
+    // Fastest compression level, or plain output ("T") unless asked for .gz
+    file_ = gzopen(path.c_str(), path.extension() == ".gz" ? "wb1" : "wbT");
+    if (file_ == nullptr)
+        throw std::runtime_error("could not create " + path.string());
+
+    gzbuffer(file_, 1 << 20);
+
+    TraceHeader header{};
+    std::memcpy(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    header.record_size = sizeof(TraceRecord);
+    gzwrite(file_, &header, sizeof(header));
+}
+
+TraceWriter::~TraceWriter()
+{
+    gzclose(file_);
+}
+
+void TraceWriter::write(const TraceRecord &record)
+{
+    gzwrite(file_, &record, sizeof(record));
+}
+
+TraceReader::TraceReader(const std::filesystem::path &path)
+{
+    // Reads plain files as they are
+    file_ = gzopen(path.c_str(), "rb");
+    if (file_ == nullptr)
+        throw std::runtime_error("could not open " + path.string());
+
+    gzbuffer(file_, 1 << 20);
+
+    TraceHeader header;
+    if (gzread(file_, &header, sizeof(header)) != sizeof(header) ||
+        std::memcmp(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0 ||
+        header.record_size != sizeof(TraceRecord)) {
+        gzclose(file_);
+        throw std::runtime_error(path.string() + " is not a commit trace");
+    }
+}
+
+TraceReader::~TraceReader()
+{
+    gzclose(file_);
+}
+
+bool TraceReader::next(TraceRecord &record)
+{
+    return gzread(file_, &record, sizeof(record)) == sizeof(record);
+}
+
+} // namespace sim
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <zlib.h>
+
+namespace sim
+{
+
+// Commit trace: a TraceHeader followed by one TraceRecord per instruction
+// that reaches Writeback, all little-endian. Files ending in .gz are
+// compressed.
+constexpr char TRACE_MAGIC[8] = {'T', 'A', 'C', 'H', 'T', 'R', 'C', '1'};
+
+struct TraceHeader {
+    char magic[8];
+    uint32_t record_size;
+    uint32_t reserved;
+};
+
+enum TraceFlags : uint8_t {
+    TRACE_REG_WRITE = 1 << 0,
+    TRACE_FREG_WRITE = 1 << 1,
+    TRACE_LOAD = 1 << 2,
+    TRACE_STORE = 1 << 3,
+};
+
+struct TraceRecord {
+    uint32_t pc;
+    // Compressed instructions as the 32-bit ones they expand to
+    uint32_t instr;
+    // Written to rd. float_alu results skip Writeback, so FP arithmetic has
+    // neither the value nor TRACE_FREG_WRITE.
+    uint32_t value;
+    // Address of a load or store
+    uint32_t addr;
+    // Cycles since the previous record, so the stalls in front of an
+    // instruction are charged to it
+    uint32_t cycles;
+    uint8_t rd;
+    uint8_t flags;
+    // HPM_EVENT_* bits (see cpu_csr_file.vh) raised during those cycles
+    uint8_t events;
+    uint8_t reserved;
+};
+
+static_assert(sizeof(TraceHeader) == 16);
+static_assert(sizeof(TraceRecord) == 24);
+
+class TraceWriter {
+public:
+    // Throws std::runtime_error if the file can't be created
+    explicit TraceWriter(const std::filesystem::path &path);
+    ~TraceWriter();
+
+    TraceWriter(const TraceWriter &) = delete;
+    TraceWriter &operator=(const TraceWriter &) = delete;
+
+    void write(const TraceRecord &record);
+
+private:
+    gzFile file_;
+};
+
+class TraceReader {
+public:
+    // Throws std::runtime_error if the file can't be opened or isn't a trace
+    explicit TraceReader(const std::filesystem::path &path);
+    ~TraceReader();
+
+    TraceReader(const TraceReader &) = delete;
+    TraceReader &operator=(const TraceReader &) = delete;
+
+    // Returns false at the end of the trace
+    bool next(TraceRecord &record);
+
+private:
+    gzFile file_;
+};
+
+} // namespace sim
@@ -2,7 +2,9 @@
 
 `include "cpu_csr_file.vh"
 
-module cpu_csr_file (
+module cpu_csr_file #(
+    parameter HPM_COUNTERS = 4
+) (
     input wire clk,
     input wire rst_n,
 
@@ -13,55 +15,218 @@ module cpu_csr_file (
     input wire [31:0] wdata,
     input wire wenable,
 
-    input wire bubble_w
+    input wire bubble_w,
+    // Second instruction retiring alongside, on pipelined_cpu with DUAL_ISSUE
+    input wire bubble_b_w,
+
+    // One bit per HPM_EVENT_*, high on every cycle the event happens
+    input wire [`HPM_EVENTS-1:0] events,
+
+    // Local interrupts pulse for a cycle and stay pending in mip until taken or
+    // cleared. The machine timer interrupt shows in mip while it's high.
+    input wire [`IRQ_LOCAL_LINES-1:0] irq,
+    input wire timer_irq,
+
+    // Some enabled interrupt is pending, and mstatus.MIE is set. irq_cause is
+    // the one to take first, which goes to trap_vector according to mtvec.
+    output wire irq_pending,
+    output reg [4:0] irq_cause,
+    output wire [31:0] trap_vector,
+    // Some enabled interrupt is pending, whatever mstatus.MIE says, which is
+    // what ends a wfi
+    output wire irq_wake,
+
+    // Records a trap the pipeline already took, returning to trap_epc
+    input wire trap,
+    input wire [31:0] trap_epc,
+    input wire [4:0] trap_cause,
+    // An mret is retiring
+    input wire mret,
+
+    // Exception flags of the float operations finishing this cycle, which
+    // accrue in fflags after any write to it. frm is the dynamic rounding
+    // mode, one of RM_*.
+    input  wire [4:0] fp_flags,
+    output reg  [2:0] frm
 );
+  // Writable bits of mie, the rest are always 0
+  localparam MIE_MASK = {{`IRQ_LOCAL_LINES{1'b1}}, 8'b0, 1'b1, 7'b0};
+
   reg [31:0] mtvec, mtvec_next;
   reg [31:0] mepc, mepc_next;
+  reg [31:0] mcause, mcause_next;
+  reg [31:0] mie, mie_next;
+  reg [`IRQ_LOCAL_LINES-1:0] mip_local, mip_local_next;
+  reg mstatus_mie, mstatus_mie_next;
+  reg mstatus_mpie, mstatus_mpie_next;
   reg [63:0] mcycle, mcycle_next;
   reg [63:0] minstret, minstret_next;
+  reg [4:0] fflags, fflags_next;
+  reg [2:0] frm_next;
+
+  wire [64*HPM_COUNTERS-1:0] hpm_counters;
+  wire [`HPM_EVENT_BITS*HPM_COUNTERS-1:0] hpm_events;
+
+  // MPP always reads as machine mode
+  wire [31:0] mstatus = {19'b0, 2'b11, 3'b0, mstatus_mpie, 3'b0, mstatus_mie, 3'b0};
+  wire [31:0] mip = {mip_local, 8'b0, timer_irq, 7'b0};
+  wire [31:0] irq_enabled = mip & mie;
+
+  assign irq_pending = mstatus_mie && |irq_enabled;
+  assign irq_wake = |irq_enabled;
+  assign trap_vector = {mtvec[31:2], 2'b00} + (mtvec[0] ? {25'b0, irq_cause, 2'b00} : 32'b0);
+
+  // Lower local interrupts first, then the timer
+  integer c;
+
+  always @(*) begin
+    irq_cause = `IRQ_MTI;
+
+    for (c = `IRQ_LOCAL + `IRQ_LOCAL_LINES - 1; c >= `IRQ_LOCAL; c = c - 1) begin
+      if (irq_enabled[c]) irq_cause = c;
+    end
+  end
+
+  integer i;
 
   always @(*) begin
     mtvec_next = mtvec;
     mepc_next = mepc;
+    mcause_next = mcause;
+    mie_next = mie;
+    mip_local_next = mip_local;
+    mstatus_mie_next = mstatus_mie;
+    mstatus_mpie_next = mstatus_mpie;
     mcycle_next = mcycle;
     minstret_next = minstret;
+    fflags_next = fflags;
+    frm_next = frm;
 
     if (wenable) begin
       case (waddr)
-        `CSR_MTVEC:    mtvec_next = wdata;
-        `CSR_MEPC:     mepc_next = wdata;
-        `CSR_MCYCLE:   mcycle_next[31:0] = wdata;
-        `CSR_MINSTRET: minstret_next[31:0] = wdata;
+        `CSR_FFLAGS:    fflags_next = wdata[4:0];
+        `CSR_FRM:       frm_next = wdata[2:0];
+        `CSR_FCSR: begin
+          fflags_next = wdata[4:0];
+          frm_next    = wdata[7:5];
+        end
+        `CSR_MSTATUS: begin
+          mstatus_mie_next  = wdata[`MSTATUS_MIE];
+          mstatus_mpie_next = wdata[`MSTATUS_MPIE];
+        end
+        `CSR_MIE:       mie_next = wdata & MIE_MASK;
+        `CSR_MTVEC:     mtvec_next = wdata;
+        `CSR_MEPC:      mepc_next = wdata;
+        `CSR_MCAUSE:    mcause_next = wdata;
+        `CSR_MIP:       mip_local_next = wdata[31:32-`IRQ_LOCAL_LINES];
+        `CSR_MCYCLE:    mcycle_next[31:0] = wdata;
+        `CSR_MINSTRET:  minstret_next[31:0] = wdata;
+        `CSR_MCYCLEH:   mcycle_next[63:32] = wdata;
+        `CSR_MINSTRETH: minstret_next[63:32] = wdata;
         default: begin
         end
       endcase
     end
 
-    mcycle_next = mcycle_next + 1;
+    if (trap) begin
+      mepc_next         = trap_epc;
+      mcause_next       = {1'b1, 26'b0, trap_cause};
+      mstatus_mpie_next = mstatus_mie;
+      mstatus_mie_next  = 0;
 
-    if (!bubble_w) begin
-      minstret_next = minstret_next + 1;
+      // Taking a local interrupt acknowledges it
+      if (trap_cause >= `IRQ_LOCAL) mip_local_next[trap_cause-`IRQ_LOCAL] = 0;
+    end else if (mret) begin
+      mstatus_mie_next  = mstatus_mpie;
+      mstatus_mpie_next = 1;
     end
 
+    mip_local_next = mip_local_next | irq;
+    fflags_next = fflags_next | fp_flags;
+
+    mcycle_next = mcycle_next + 1;
+
+    minstret_next = minstret_next + !bubble_w + !bubble_b_w;
+
     case (raddr)
-      `CSR_MTVEC:    rdata = mtvec;
-      `CSR_MEPC:     rdata = mepc;
-      `CSR_MCYCLE:   rdata = mcycle[31:0];
-      `CSR_MINSTRET: rdata = minstret[31:0];
-      default:       rdata = {32{1'bx}};
+      `CSR_FFLAGS:    rdata = {27'b0, fflags};
+      `CSR_FRM:       rdata = {29'b0, frm};
+      `CSR_FCSR:      rdata = {24'b0, frm, fflags};
+      `CSR_MSTATUS:   rdata = mstatus;
+      `CSR_MIE:       rdata = mie;
+      `CSR_MTVEC:     rdata = mtvec;
+      `CSR_MEPC:      rdata = mepc;
+      `CSR_MCAUSE:    rdata = mcause;
+      `CSR_MIP:       rdata = mip;
+      `CSR_MCYCLE:    rdata = mcycle[31:0];
+      `CSR_MINSTRET:  rdata = minstret[31:0];
+      `CSR_MCYCLEH:   rdata = mcycle[63:32];
+      `CSR_MINSTRETH: rdata = minstret[63:32];
+      default:        rdata = {32{1'bx}};
     endcase
+
+    for (i = 0; i < HPM_COUNTERS; i = i + 1) begin
+      if (raddr == `CSR_MHPMCOUNTER3 + i) rdata = hpm_counters[64*i+:32];
+      if (raddr == `CSR_MHPMCOUNTER3H + i) rdata = hpm_counters[64*i+32+:32];
+      if (raddr == `CSR_MHPMEVENT3 + i) begin
+        rdata = {{(32 - `HPM_EVENT_BITS) {1'b0}}, hpm_events[`HPM_EVENT_BITS*i+:`HPM_EVENT_BITS]};
+      end
+    end
   end
 
   always @(posedge clk) begin
     if (!rst_n) begin
-      mcycle   <= 0;
-      minstret <= 0;
+      mcause       <= 0;
+      mie          <= 0;
+      mip_local    <= 0;
+      mstatus_mie  <= 0;
+      mstatus_mpie <= 0;
+      mcycle       <= 0;
+      minstret     <= 0;
+      fflags       <= 0;
+      frm          <= 0;
     end else begin
-      mtvec    <= mtvec_next;
-      mepc     <= mepc_next;
-      mcycle   <= mcycle_next;
-      minstret <= minstret_next;
+      mtvec        <= mtvec_next;
+      mepc         <= mepc_next;
+      mcause       <= mcause_next;
+      mie          <= mie_next;
+      mip_local    <= mip_local_next;
+      mstatus_mie  <= mstatus_mie_next;
+      mstatus_mpie <= mstatus_mpie_next;
+      mcycle       <= mcycle_next;
+      minstret     <= minstret_next;
+      fflags       <= fflags_next;
+      frm          <= frm_next;
     end
   end
-endmodule
 
+  genvar n;
+  generate
+    for (n = 0; n < HPM_COUNTERS; n = n + 1) begin : g_hpm
+      reg [63:0] counter;
+      reg [`HPM_EVENT_BITS-1:0] event_sel;
+
+      always @(posedge clk) begin
+        if (!rst_n) begin
+          counter   <= 0;
+          event_sel <= `HPM_EVENT_NONE;
+        end else begin
+          if (wenable && waddr == `CSR_MHPMEVENT3 + n) begin
+            event_sel <= wdata[`HPM_EVENT_BITS-1:0];
+          end
+
+          if (wenable && waddr == `CSR_MHPMCOUNTER3 + n) begin
+            counter[31:0] <= wdata;
+          end else if (wenable && waddr == `CSR_MHPMCOUNTER3H + n) begin
+            counter[63:32] <= wdata;
+          end else if (events[event_sel] && event_sel != `HPM_EVENT_NONE) begin
+            counter <= counter + 1;
+          end
+        end
+      end
+
+      assign hpm_counters[64*n+:64] = counter;
+      assign hpm_events[`HPM_EVENT_BITS*n+:`HPM_EVENT_BITS] = event_sel;
+    end
+  endgenerate
+endmodule
@@ -0,0 +1,154 @@
+`default_nettype none
+
+`include "cpu_muldiv.vh"
+
+// RV32M unit. control is the instruction's funct3.
+//
+// Multiplication always finishes in the same cycle. Division does too unless
+// ITERATIVE_DIV is set, in which case it takes one cycle per significant bit
+// of the dividend. start must be held until done is asserted; dropping it
+// aborts the operation. Operands are sampled when the division starts, which
+// waits while stall is set. A division already running carries on through a
+// stall, and its result is kept for as long as stall is set after that.
+module cpu_muldiv #(
+    parameter ITERATIVE_DIV = 1
+) (
+    input wire clk,
+    input wire rst_n,
+
+    input wire [31:0] src_a,
+    input wire [31:0] src_b,
+    input wire [ 2:0] control,
+    input wire        start,
+    input wire        stall,
+
+    output wire        done,
+    output reg  [31:0] result
+);
+  wire is_div = control[2];
+  wire div_signed = !control[0];
+
+  // Multiplier
+  wire mul_a_signed = control[1:0] != 2'b11;
+  wire mul_b_signed = control[1:0] == 2'b00 || control[1:0] == 2'b01;
+
+  wire signed [32:0] mul_a = {mul_a_signed && src_a[31], src_a};
+  wire signed [32:0] mul_b = {mul_b_signed && src_b[31], src_b};
+  wire signed [65:0] product = mul_a * mul_b;
+
+  // Divider
+  wire neg_a = div_signed && src_a[31];
+  wire neg_b = div_signed && src_b[31];
+  wire [31:0] abs_a = neg_a ? -src_a : src_a;
+  wire [31:0] abs_b = neg_b ? -src_b : src_b;
+
+  wire div_by_zero = src_b == 0;
+  wire div_overflow = div_signed && src_a == 32'h8000_0000 && src_b == 32'hFFFF_FFFF;
+
+  reg [31:0] quotient, remainder;
+
+  generate
+    if (ITERATIVE_DIV) begin : g_iterative_div
+      reg busy, finished;
+      reg [5:0] count;
+      reg [31:0] quot, divisor;
+      reg [31:0] rem;
+      reg [31:0] quot_out, rem_out;
+      reg neg_quot, neg_rem;
+
+      // Leading zeros of the dividend are skipped right away
+      reg [5:0] lz;
+      integer i;
+
+      always @(*) begin
+        lz = 32;
+        for (i = 0; i < 32; i = i + 1) begin
+          if (abs_a[i]) lz = 31 - i;
+        end
+      end
+
+      // One restoring step per cycle
+      wire [32:0] rem_shift = {rem, quot[31]};
+      wire [32:0] rem_sub = rem_shift - {1'b0, divisor};
+      wire rem_ge = !rem_sub[32];
+
+      wire [31:0] quot_step = {quot[30:0], rem_ge};
+      wire [31:0] rem_step = rem_ge ? rem_sub[31:0] : rem_shift[31:0];
+
+      always @(posedge clk) begin
+        if (!rst_n || !start || !is_div) begin
+          busy     <= 0;
+          finished <= 0;
+        end else if (finished) begin
+          // Consumed this cycle, unless the consumer is stalled
+          if (!stall) finished <= 0;
+        end else if (busy) begin
+          quot  <= quot_step;
+          rem   <= rem_step;
+          count <= count - 1;
+
+          if (count == 1) begin
+            quot_out <= neg_quot ? -quot_step : quot_step;
+            rem_out  <= neg_rem ? -rem_step : rem_step;
+            busy     <= 0;
+            finished <= 1;
+          end
+        end else if (stall) begin
+          // The operands may not be ready yet
+        end else if (div_by_zero) begin
+          quot_out <= 32'hFFFF_FFFF;
+          rem_out  <= src_a;
+          finished <= 1;
+        end else if (div_overflow) begin
+          quot_out <= 32'h8000_0000;
+          rem_out  <= 32'b0;
+          finished <= 1;
+        end else if (abs_a < abs_b) begin
+          quot_out <= 32'b0;
+          rem_out  <= src_a;
+          finished <= 1;
+        end else begin
+          quot     <= abs_a << lz;
+          rem      <= 32'b0;
+          divisor  <= abs_b;
+          neg_quot <= neg_a ^ neg_b;
+          neg_rem  <= neg_a;
+          count    <= 32 - lz;
+          busy     <= 1;
+        end
+      end
+
+      always @(*) begin
+        quotient  = quot_out;
+        remainder = rem_out;
+      end
+
+      assign done = !is_div || (start && finished);
+    end else begin : g_comb_div
+      always @(*) begin
+        if (div_by_zero) begin
+          quotient  = 32'hFFFF_FFFF;
+          remainder = src_a;
+        end else if (div_overflow) begin
+          quotient  = 32'h8000_0000;
+          remainder = 32'b0;
+        end else begin
+          quotient  = (neg_a ^ neg_b) ? -(abs_a / abs_b) : abs_a / abs_b;
+          remainder = neg_a ? -(abs_a % abs_b) : abs_a % abs_b;
+        end
+      end
+
+      assign done = 1'b1;
+    end
+  endgenerate
+
+  always @(*) begin
+    case (control)
+      `MD_MUL:                         result = product[31:0];
+      `MD_MULH, `MD_MULHSU, `MD_MULHU: result = product[63:32];
+      `MD_DIV, `MD_DIVU:               result = quotient;
+      `MD_REM, `MD_REMU:               result = remainder;
+      default:                         result = {32{1'bx}};
+    endcase
+  end
+endmodule
@@ -1,7 +1,9 @@
 `default_nettype none
 
 module cpu_register_file #(
-    parameter HARDWIRE_ZERO = 1
+    parameter HARDWIRE_ZERO = 1,
+    // Adds read ports 4/5 and write port 6, for pipelined_cpu's second pipe
+    parameter DUAL_ISSUE    = 0
 ) (
     input wire clk,
 
@@ -12,7 +14,16 @@ module cpu_register_file #(
     input wire we3,
 
     output wire [31:0] rd1,
-    output wire [31:0] rd2
+    output wire [31:0] rd2,
+
+    input wire [4:0] a4,
+    input wire [4:0] a5,
+    input wire [4:0] a6,
+    input wire [31:0] wd6,
+    input wire we6,
+
+    output wire [31:0] rd4,
+    output wire [31:0] rd5
 );
   localparam REGS_START = HARDWIRE_ZERO ? 1 : 0;
   localparam REGS_SIZE = 32;
@@ -25,14 +36,24 @@ module cpu_register_file #(
     if (we3 && (!HARDWIRE_ZERO || a3 != 0)) begin
       regs[a3] <= wd3;
     end
+
+    // Port 6 writes the younger instruction, so it wins when both write the
+    // same register
+    if (DUAL_ISSUE && we6 && (!HARDWIRE_ZERO || a6 != 0)) begin
+      regs[a6] <= wd6;
+    end
   end
 
   if (HARDWIRE_ZERO) begin
     assign rd1 = a1 == 0 ? 0 : regs[a1];
     assign rd2 = a2 == 0 ? 0 : regs[a2];
+    assign rd4 = a4 == 0 ? 0 : regs[a4];
+    assign rd5 = a5 == 0 ? 0 : regs[a5];
   end else begin
     assign rd1 = regs[a1];
     assign rd2 = regs[a2];
+    assign rd4 = regs[a4];
+    assign rd5 = regs[a5];
   end
 
   generate
@@ -42,4 +63,3 @@ module cpu_register_file #(
     end
   endgenerate
 endmodule
-
@@ -0,0 +1,158 @@
+`default_nettype none
+
+// Turns an RV32C instruction (with the RV32FC loads and stores) into the
+// 32-bit one it stands for, and lets 32-bit instructions through as they are.
+// Only data[15:0] matters for a compressed one. Reserved and RV64/D encodings
+// come out as all zeros, which is illegal.
+module cpu_rvc_expander (
+    input  wire [31:0] data,
+    output reg  [31:0] instr,
+    output wire        compressed
+);
+  localparam OP_LOAD = 7'b0000011;
+  localparam OP_LOAD_FP = 7'b0000111;
+  localparam OP_OP_IMM = 7'b0010011;
+  localparam OP_STORE = 7'b0100011;
+  localparam OP_STORE_FP = 7'b0100111;
+  localparam OP_OP = 7'b0110011;
+  localparam OP_LUI = 7'b0110111;
+  localparam OP_BRANCH = 7'b1100011;
+  localparam OP_JALR = 7'b1100111;
+  localparam OP_JAL = 7'b1101111;
+
+  localparam ILLEGAL = 32'h00000000;
+  localparam EBREAK = 32'h00100073;
+
+  function [31:0] i_type(input [11:0] imm, input [4:0] rs1, input [2:0] funct3, input [4:0] rd,
+                         input [6:0] op);
+    i_type = {imm, rs1, funct3, rd, op};
+  endfunction
+
+  function [31:0] s_type(input [11:0] imm, input [4:0] rs2, input [4:0] rs1, input [2:0] funct3,
+                         input [6:0] op);
+    s_type = {imm[11:5], rs2, rs1, funct3, imm[4:0], op};
+  endfunction
+
+  function [31:0] r_type(input [6:0] funct7, input [4:0] rs2, input [4:0] rs1,
+                         input [2:0] funct3, input [4:0] rd);
+    r_type = {funct7, rs2, rs1, funct3, rd, OP_OP};
+  endfunction
+
+  function [31:0] b_type(input [12:0] imm, input [4:0] rs1, input [2:0] funct3);
+    b_type = {imm[12], imm[10:5], 5'd0, rs1, funct3, imm[4:1], imm[11], OP_BRANCH};
+  endfunction
+
+  function [31:0] jal(input [20:0] imm, input [4:0] rd);
+    jal = {imm[20], imm[10:1], imm[11], imm[19:12], rd, OP_JAL};
+  endfunction
+
+  assign compressed = data[1:0] != 2'b11;
+
+  wire [ 1:0] quadrant = data[1:0];
+  wire [ 2:0] funct3 = data[15:13];
+
+  // Full and x8-x15 register fields
+  wire [ 4:0] rd = data[11:7];
+  wire [ 4:0] rs2 = data[6:2];
+  wire [ 4:0] rd_p = {2'b01, data[4:2]};
+  wire [ 4:0] rs1_p = {2'b01, data[9:7]};
+
+  wire [11:0] imm_ci = {{7{data[12]}}, data[6:2]};
+  wire [ 9:0] imm_addi4spn = {data[10:7], data[12:11], data[5], data[6], 2'b00};
+  wire [ 9:0] imm_addi16sp = {data[12], data[4:3], data[5], data[2], data[6], 4'b0};
+  wire [ 6:0] imm_lw = {data[5], data[12:10], data[6], 2'b00};
+  wire [ 7:0] imm_lwsp = {data[3:2], data[12], data[6:4], 2'b00};
+  wire [ 7:0] imm_swsp = {data[8:7], data[12:9], 2'b00};
+  wire [11:0] imm_j = {
+    data[12], data[8], data[10:9], data[6], data[7], data[2], data[11], data[5:3], 1'b0
+  };
+  wire [ 8:0] imm_b = {data[12], data[6:5], data[2], data[11:10], data[4:3], 1'b0};
+
+  always @(*) begin
+    instr = ILLEGAL;
+
+    case (quadrant)
+      2'b00: begin
+        case (funct3)
+          3'b000: begin
+            if (imm_addi4spn != 0) begin
+              instr = i_type({2'b0, imm_addi4spn}, 5'd2, 3'b000, rd_p, OP_OP_IMM);
+            end
+          end
+          3'b010: instr = i_type({5'b0, imm_lw}, rs1_p, 3'b010, rd_p, OP_LOAD);
+          3'b011: instr = i_type({5'b0, imm_lw}, rs1_p, 3'b010, rd_p, OP_LOAD_FP);
+          3'b110: instr = s_type({5'b0, imm_lw}, rd_p, rs1_p, 3'b010, OP_STORE);
+          3'b111: instr = s_type({5'b0, imm_lw}, rd_p, rs1_p, 3'b010, OP_STORE_FP);
+          default: ;
+        endcase
+      end
+
+      2'b01: begin
+        case (funct3)
+          3'b000: instr = i_type(imm_ci, rd, 3'b000, rd, OP_OP_IMM);  // c.addi, c.nop
+          3'b001: instr = jal({{9{imm_j[11]}}, imm_j}, 5'd1);
+          3'b010: instr = i_type(imm_ci, 5'd0, 3'b000, rd, OP_OP_IMM);  // c.li
+          3'b011: begin
+            if (rd == 2) begin
+              if (imm_addi16sp != 0) begin
+                instr = i_type({{2{imm_addi16sp[9]}}, imm_addi16sp}, 5'd2, 3'b000, 5'd2,
+                               OP_OP_IMM);
+              end
+            end else if (imm_ci != 0) begin
+              instr = {{15{data[12]}}, data[6:2], rd, OP_LUI};
+            end
+          end
+          3'b100: begin
+            case (data[11:10])
+              // Shift amounts of 32 and up are RV64 only
+              2'b00: if (!data[12]) instr = i_type({7'h00, rs2}, rs1_p, 3'b101, rs1_p, OP_OP_IMM);
+              2'b01: if (!data[12]) instr = i_type({7'h20, rs2}, rs1_p, 3'b101, rs1_p, OP_OP_IMM);
+              2'b10: instr = i_type(imm_ci, rs1_p, 3'b111, rs1_p, OP_OP_IMM);
+              2'b11: begin
+                if (!data[12]) begin
+                  case (data[6:5])
+                    2'b00: instr = r_type(7'b0100000, rd_p, rs1_p, 3'b000, rs1_p);
+                    2'b01: instr = r_type(7'b0000000, rd_p, rs1_p, 3'b100, rs1_p);
+                    2'b10: instr = r_type(7'b0000000, rd_p, rs1_p, 3'b110, rs1_p);
+                    2'b11: instr = r_type(7'b0000000, rd_p, rs1_p, 3'b111, rs1_p);
+                  endcase
+                end
+              end
+            endcase
+          end
+          3'b101: instr = jal({{9{imm_j[11]}}, imm_j}, 5'd0);
+          3'b110: instr = b_type({{4{imm_b[8]}}, imm_b}, rs1_p, 3'b000);
+          3'b111: instr = b_type({{4{imm_b[8]}}, imm_b}, rs1_p, 3'b001);
+        endcase
+      end
+
+      2'b10: begin
+        case (funct3)
+          3'b000: if (!data[12]) instr = i_type({7'b0000000, rs2}, rd, 3'b001, rd, OP_OP_IMM);
+          3'b010: if (rd != 0) instr = i_type({4'b0, imm_lwsp}, 5'd2, 3'b010, rd, OP_LOAD);
+          3'b011: instr = i_type({4'b0, imm_lwsp}, 5'd2, 3'b010, rd, OP_LOAD_FP);
+          3'b100: begin
+            if (!data[12]) begin
+              if (rs2 == 0) begin
+                if (rd != 0) instr = i_type(12'd0, rd, 3'b000, 5'd0, OP_JALR);  // c.jr
+              end else begin
+                instr = r_type(7'b0000000, rs2, 5'd0, 3'b000, rd);  // c.mv
+              end
+            end else begin
+              if (rs2 == 0) begin
+                instr = rd == 0 ? EBREAK : i_type(12'd0, rd, 3'b000, 5'd1, OP_JALR);  // c.jalr
+              end else begin
+                instr = r_type(7'b0000000, rs2, rd, 3'b000, rd);  // c.add
+              end
+            end
+          end
+          3'b110: instr = s_type({4'b0, imm_swsp}, rs2, 5'd2, 3'b010, OP_STORE);
+          3'b111: instr = s_type({4'b0, imm_swsp}, rs2, 5'd2, 3'b010, OP_STORE_FP);
+          default: ;
+        endcase
+      end
+
+      default: instr = data;
+    endcase
+  end
+endmodule
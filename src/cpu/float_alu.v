@@ -167,6 +167,290 @@ module fp_recip (
   end
 endmodule
 
+// Square root, one result bit per cycle of the restoring digit-by-digit method,
+// so it's exact and rounded like the other units. Takes 25 cycles, during which
+// it can't start another one, and then holds its result until ready_in.
+// round_mode is 1 to truncate and 0 to round to nearest even. Denormals are
+// taken as zero. NaNs and negative numbers give the canonical NaN, which the
+// multiplier turns into an invalid flag.
+module fp_sqrt (
+    input wire clk,
+    input wire rst_n,
+
+    input  wire start,
+    input  wire ready_in,
+    output reg  valid_out,
+    output wire ready_out,
+
+    input wire [31:0] in_bits,
+    input wire round_mode,
+    input wire mode_fp_in,
+
+    output reg  [31:0] out_bits,
+    output reg  [ 4:0] except_flags,
+    output reg         round_mode_out,
+    output reg         mode_fp_out
+);
+  reg [31:0] x;
+  reg busy;
+  reg [4:0] step;
+
+  wire sign_in = x[31];
+  wire [7:0] exp_in = x[30:23];
+  wire [22:0] frac_in = x[22:0];
+
+  wire [8:0] exp_sum = exp_in + 9'd127;
+
+  // An odd exponent is made even by doubling the significand, and the root of
+  // its 24 bits is taken with two more below, for the round bit. The radicand
+  // is shifted out two bits at a time, from the top.
+  reg [49:0] radicand;
+  reg [24:0] root;
+  reg [27:0] rem;
+
+  wire [27:0] rem_next = {rem[25:0], radicand[49:48]};
+  wire [26:0] trial = {root, 2'b01};
+  wire root_bit = rem_next >= trial;
+
+  assign ready_out = !busy && (!valid_out || ready_in);
+
+  always @(posedge clk) begin
+    if (!rst_n) begin
+      busy      <= 0;
+      valid_out <= 0;
+    end else if (start && ready_out) begin
+      x              <= in_bits;
+      round_mode_out <= round_mode;
+      mode_fp_out    <= mode_fp_in;
+
+      radicand <= in_bits[23] ? {1'b0, 1'b1, in_bits[22:0], 25'b0} :
+                                {1'b1, in_bits[22:0], 26'b0};
+      root     <= 0;
+      rem      <= 0;
+      step     <= 0;
+
+      busy      <= 1;
+      valid_out <= 0;
+    end else if (busy) begin
+      radicand <= radicand << 2;
+      root     <= {root[23:0], root_bit};
+      rem      <= root_bit ? rem_next - trial : rem_next;
+      step     <= step + 1;
+
+      if (step == 24) begin
+        busy      <= 0;
+        valid_out <= 1;
+      end
+    end else if (ready_in) begin
+      valid_out <= 0;
+    end
+  end
+
+  reg [24:0] rounded;
+  reg round_up;
+
+  always @(*) begin
+    round_up = !round_mode_out && root[0] && (rem != 0 || root[1]);
+    rounded = {1'b0, root[24:1]} + round_up;
+
+    out_bits = 0;
+    except_flags = 0;
+
+    if (exp_in == 8'hFF && frac_in != 0) begin
+      out_bits = `NAN;
+    end else if (exp_in == 0) begin
+      out_bits = {sign_in, 31'b0};
+    end else if (sign_in) begin
+      out_bits = `NAN;
+    end else if (exp_in == 8'hFF) begin
+      out_bits = `INF;
+    end else begin
+      // The root of the largest significand is just under 2, so rounding
+      // never carries into the exponent
+      out_bits = {1'b0, exp_sum[8:1], rounded[22:0]};
+      except_flags[`F_INEXACT] = root[0] || rem != 0;
+    end
+  end
+endmodule
+
+// The single-cycle operations of the F extension: sign injection, min/max,
+// compares, conversions to and from integers and fclass. op is one of
+// FP_MISC_*, op_a and op_b are float operands and int_a the integer one of
+// fcvt.s.w(u). Rounding follows round_mode, one of RM_*, and denormals are
+// taken as zero everywhere but in sign injection and fclass, like in
+// float_alu.
+module fp_misc (
+    input wire [ 3:0] op,
+    input wire [31:0] op_a,
+    input wire [31:0] op_b,
+    input wire [31:0] int_a,
+    input wire [ 2:0] round_mode,
+
+    output reg [31:0] result,
+    output reg [ 4:0] flags
+);
+  wire [31:0] a = op_a[30:23] == 0 ? {op_a[31], 31'b0} : op_a;
+  wire [31:0] b = op_b[30:23] == 0 ? {op_b[31], 31'b0} : op_b;
+
+  wire nan_a = a[30:23] == 8'hFF && a[22:0] != 0;
+  wire nan_b = b[30:23] == 8'hFF && b[22:0] != 0;
+  wire snan_a = nan_a && !a[22];
+  wire snan_b = nan_b && !b[22];
+  wire zeros = a[30:0] == 0 && b[30:0] == 0;
+
+  // Compares ignore NaNs here, they're handled below
+  wire eq = a == b || zeros;
+  wire lt = a[31] != b[31] ? a[31] && !zeros : a[31] ? a[30:0] > b[30:0] : a[30:0] < b[30:0];
+
+  // Whether to round the magnitude up, given its lowest bit, the one below it
+  // and whether anything under that is set
+  function round_inc(input sign, input lsb, input round, input sticky);
+    case (round_mode)
+      `RM_RTZ: round_inc = 0;
+      `RM_RDN: round_inc = sign && (round || sticky);
+      `RM_RUP: round_inc = !sign && (round || sticky);
+      `RM_RMM: round_inc = round;
+      default: round_inc = round && (sticky || lsb);
+    endcase
+  endfunction
+
+  // Float to integer: a's value times 2^24, so that the integer part is in the
+  // top 32 bits, as long as the exponent is 31 at most
+  wire [8:0] exp_a = {1'b0, a[30:23]} - 9'd127;
+  wire [23:0] sig_a = {a[30:23] != 0, a[22:0]};
+  wire [8:0] shift_a = exp_a + 9'd1;
+  wire [55:0] fixed_a = {32'b0, sig_a} << shift_a[5:0];
+
+  reg [32:0] cvt_mag;
+  reg cvt_round, cvt_sticky;
+
+  always @(*) begin
+    if (!exp_a[8] && exp_a > 31) begin
+      cvt_mag = 33'h1_0000_0000;
+      cvt_round = 0;
+      cvt_sticky = 0;
+    end else if (!exp_a[8] || exp_a == 9'h1FF) begin
+      cvt_mag = {1'b0, fixed_a[55:24]};
+      cvt_round = fixed_a[23];
+      cvt_sticky = fixed_a[22:0] != 0;
+    end else begin
+      cvt_mag = 0;
+      cvt_round = 0;
+      cvt_sticky = sig_a != 0;
+    end
+
+    cvt_mag = cvt_mag + round_inc(a[31], cvt_mag[0], cvt_round, cvt_sticky);
+  end
+
+  // Integer to float, normalized so that the leading one is at bit 31
+  wire int_sign = op == `FP_MISC_CVT_S_W && int_a[31];
+  wire [31:0] int_mag = int_sign ? -int_a : int_a;
+
+  reg [31:0] int_norm;
+  reg [7:0] int_exp;
+  reg [24:0] int_sig;
+  integer i;
+
+  always @(*) begin
+    int_norm = int_mag;
+    int_exp  = 127 + 31;
+
+    for (i = 0; i < 31; i = i + 1) begin
+      if (!int_norm[31]) begin
+        int_norm = int_norm << 1;
+        int_exp  = int_exp - 1;
+      end
+    end
+
+    int_sig = {1'b0, int_norm[31:8]} +
+              round_inc(int_sign, int_norm[8], int_norm[7], int_norm[6:0] != 0);
+
+    // Rounding up all ones carries into the next power of two
+    if (int_sig[24]) begin
+      int_sig = int_sig >> 1;
+      int_exp = int_exp + 1;
+    end
+  end
+
+  always @(*) begin
+    result = 0;
+    flags  = 0;
+
+    case (op)
+      `FP_MISC_SGNJ:  result = {op_b[31], op_a[30:0]};
+      `FP_MISC_SGNJN: result = {!op_b[31], op_a[30:0]};
+      `FP_MISC_SGNJX: result = {op_a[31] ^ op_b[31], op_a[30:0]};
+
+      `FP_MISC_MIN, `FP_MISC_MAX: begin
+        flags[`F_INVALID] = snan_a || snan_b;
+
+        if (nan_a && nan_b) result = `NAN;
+        else if (nan_a) result = b;
+        else if (nan_b) result = a;
+        else if ((lt || (eq && a[31])) == (op == `FP_MISC_MIN)) result = a;
+        else result = b;
+      end
+
+      `FP_MISC_EQ: begin
+        flags[`F_INVALID] = snan_a || snan_b;
+        result = {31'b0, !nan_a && !nan_b && eq};
+      end
+      `FP_MISC_LT, `FP_MISC_LE: begin
+        flags[`F_INVALID] = nan_a || nan_b;
+        result = {31'b0, !nan_a && !nan_b && (lt || (op == `FP_MISC_LE && eq))};
+      end
+
+      `FP_MISC_CVT_W: begin
+        if (nan_a || (!a[31] && cvt_mag > 33'h0_7FFF_FFFF)) begin
+          flags[`F_INVALID] = 1;
+          result = 32'h7FFF_FFFF;
+        end else if (a[31] && cvt_mag > 33'h0_8000_0000) begin
+          flags[`F_INVALID] = 1;
+          result = 32'h8000_0000;
+        end else begin
+          flags[`F_INEXACT] = cvt_round || cvt_sticky;
+          result = a[31] ? -cvt_mag[31:0] : cvt_mag[31:0];
+        end
+      end
+      `FP_MISC_CVT_WU: begin
+        if (nan_a || (!a[31] && cvt_mag[32])) begin
+          flags[`F_INVALID] = 1;
+          result = 32'hFFFF_FFFF;
+        end else if (a[31] && cvt_mag != 0) begin
+          flags[`F_INVALID] = 1;
+          result = 32'h0000_0000;
+        end else begin
+          flags[`F_INEXACT] = cvt_round || cvt_sticky;
+          result = cvt_mag[31:0];
+        end
+      end
+
+      `FP_MISC_CVT_S_W, `FP_MISC_CVT_S_WU: begin
+        if (int_mag != 0) begin
+          flags[`F_INEXACT] = int_norm[7:0] != 0;
+          result = {int_sign, int_exp, int_sig[22:0]};
+        end
+      end
+
+      `FP_MISC_CLASS: begin
+        if (op_a[30:23] == 8'hFF) begin
+          if (op_a[22:0] == 0) result[op_a[31]? 0 : 7] = 1;
+          else result[op_a[22]? 9 : 8] = 1;
+        end else if (op_a[30:23] != 0) begin
+          result[op_a[31]? 1 : 6] = 1;
+        end else if (op_a[22:0] != 0) begin
+          result[op_a[31]? 2 : 5] = 1;
+        end else begin
+          result[op_a[31]? 3 : 4] = 1;
+        end
+      end
+
+      default: begin
+      end
+    endcase
+  end
+endmodule
+
 module mul_decode (
     input wire [31:0] op_a,
     input wire [31:0] op_b,
@@ -334,10 +618,10 @@ module mul_exception (
       mant_a_out     <= 23'b0;
       mant_b_out     <= 23'b0;
     end else begin
-      if (valid_out && ready_in) begin
-        valid_out <= 1'b0;
-      end else if (valid_in && ready_out) begin
+      if (valid_in && ready_out) begin
         valid_out <= 1'b1;
+      end else if (ready_in) begin
+        valid_out <= 1'b0;
       end
       mode_fp_out    <= mode_fp_out_next;
       round_mode_out <= round_mode_out_next;
@@ -441,10 +725,10 @@ module mul_prod (
       spec_result_out   <= 32'b0;
       spec_flags_out    <= 5'b0;
     end else begin
-      if (valid_out && ready_in) begin
-        valid_out <= 1'b0;
-      end else if (valid_in && ready_out) begin
+      if (valid_in && ready_out) begin
         valid_out <= 1'b1;
+      end else if (ready_in) begin
+        valid_out <= 1'b0;
       end
       final_sign        <= final_sign_next;
       exp_sum           <= exp_sum_next;
@@ -541,10 +825,10 @@ module mul_norm (
       spec_result_out   <= 32'b0;
       spec_flags_out    <= 5'b0;
     end else begin
-      if (valid_out && ready_in) begin
-        valid_out <= 1'b0;
-      end else if (valid_in && ready_out) begin
+      if (valid_in && ready_out) begin
         valid_out <= 1'b1;
+      end else if (ready_in) begin
+        valid_out <= 1'b0;
       end
       exp_norm          <= exp_norm_next;
       mant_norm         <= mant_norm_next;
@@ -634,9 +918,13 @@ module mul_round (
       spec_result_out_next   = spec_result_in;
       spec_flags_out_next    = spec_flags_in;
 
-      if (overflow) spec_flags_out_next[`F_OVERFLOW] = 1'b1;
-      if (underflow) spec_flags_out_next[`F_UNDERFLOW] = 1'b1;
-      if (inexact) spec_flags_out_next[`F_INEXACT] = 1'b1;
+      // A special result (NaN, infinity or zero) isn't rounded, so it only
+      // raises the flags it came with
+      if (!spec_override_in) begin
+        if (overflow) spec_flags_out_next[`F_OVERFLOW] = 1'b1;
+        if (underflow) spec_flags_out_next[`F_UNDERFLOW] = 1'b1;
+        if (inexact) spec_flags_out_next[`F_INEXACT] = 1'b1;
+      end
     end
   end
 
@@ -651,10 +939,10 @@ module mul_round (
       spec_result_out   <= 32'b0;
       spec_flags_out    <= 5'b0;
     end else begin
-      if (valid_out && ready_in) begin
-        valid_out <= 1'b0;
-      end else if (valid_in && ready_out) begin
+      if (valid_in && ready_out) begin
         valid_out <= 1'b1;
+      end else if (ready_in) begin
+        valid_out <= 1'b0;
       end
       final_exp         <= final_exp_next;
       final_mant        <= final_mant_next;
@@ -957,16 +1245,16 @@ module fp_align #(
   reg sign_a_aligned_next, sign_b_aligned_next, round_mode_out_next, mode_fp_out_next;
   reg is_a_nan_next, is_b_nan_next, is_a_inf_next, is_b_inf_next;
 
-  wire signed [8:0] exp_diff = exp_a - exp_b;
+  wire signed [E:0] exp_diff = {1'b0, exp_a} - {1'b0, exp_b};
+  wire [E:0] exp_dist = exp_diff >= 0 ? exp_diff : -exp_diff;
   wire [P:0] mant_a_full = exp_a == 0 ? {1'b0, mant_a} : {1'b1, mant_a};
   wire [P:0] mant_b_full = exp_b == 0 ? {1'b0, mant_b} : {1'b1, mant_b};
 
-  reg [$clog2(P+4):0] shamt;
+  // Anything past P+4 bits is shifted out entirely
+  wire [$clog2(P+4):0] shamt = exp_dist > P + 4 ? P + 4 : exp_dist[$clog2(P+4):0];
 
   always @(*) begin
     if (valid_in && ready_out) begin
-      shamt = 0;
-
       sign_a_aligned_next = sign_a_in;
       sign_b_aligned_next = sign_b_in;
       round_mode_out_next = round_mode_in;
@@ -979,15 +1267,11 @@ module fp_align #(
 
       if (exp_diff >= 0) begin
         // a >= b
-        shamt = exp_diff[$clog2(P+4):0];
-
         bigger_exp_next = exp_a;
         mant_a_aligned_next = {mant_a_full, 3'b000};
         mant_b_aligned_next = {mant_b_full, 3'b000} >> shamt;
       end else begin
         // a < b
-        shamt = -exp_diff[$clog2(P+4):0];
-
         bigger_exp_next = exp_b;
         mant_a_aligned_next = {mant_a_full, 3'b000} >> shamt;
         mant_b_aligned_next = {mant_b_full, 3'b000};
@@ -1208,19 +1492,29 @@ module fp_normalize #(
     input  wire mode_fp_in,
     output reg  mode_fp_out
 );
-  reg busy;
-
   reg [P+3:0] mant_next;
   reg [E-1:0] exp_next;
   reg [4:0] flags_next;
 
-  reg valid_out_next, busy_next;
-
   reg sign_out_next, round_mode_out_next, mode_fp_out_next;
 
-  assign ready_out = !busy && ready_in;
+  reg [$clog2(P+4):0] lz;
+  reg [$clog2(P+4):0] shamt;
+
+  integer i;
+
+  assign ready_out = ready_in;
 
   always @(*) begin
+    // Leading zero count, so the whole shift happens in a single cycle
+    lz = P + 4;
+    for (i = 0; i < P + 4; i = i + 1) begin
+      if (mant_in[i]) lz = P + 3 - i;
+    end
+
+    // Can't go below the smallest exponent
+    shamt = lz > exp_in ? exp_in : lz;
+
     if (valid_in && ready_out) begin
       // Use stage inputs
       flags_next          = flags_in;
@@ -1230,7 +1524,10 @@ module fp_normalize #(
       mode_fp_out_next    = mode_fp_in;
 
       if (carry) begin
-        if (exp_in != 8'hFF) begin
+        mant_next = mant_in;
+        exp_next  = exp_in;
+
+        if (exp_in != {E{1'b1}}) begin
           // Shift mantissa right
           mant_next = {1'b1, mant_in[P+3:1]};
           exp_next  = exp_in + 1;
@@ -1241,55 +1538,50 @@ module fp_normalize #(
           end
         end
 
-        if (exp_next == 8'hFF) begin
+        if (exp_next == {E{1'b1}}) begin
           // Got infinity
           mant_next               = {(P + 4) {1'b0}};
           flags_next[`F_OVERFLOW] = 1'b1;
         end
-      end else begin
+      end else if (mant_in == 0) begin
+        mant_next = mant_in;
+        exp_next  = 0;
+      end else if (exp_in == {E{1'b1}}) begin
+        // Inf/NaN pass through
         mant_next = mant_in;
         exp_next  = exp_in;
-      end
-    end else begin
-      // Work with current data
-      flags_next = flags_out;
-
-      sign_out_next = sign_out;
-      round_mode_out_next = round_mode_out;
-      mode_fp_out_next = mode_fp_out;
-
-      if (valid_out) begin
-        mant_next = mant_out;
-        exp_next  = exp_out;
       end else begin
-        mant_next = mant_out << 1;
-        exp_next  = exp_out - 1;
+        mant_next = mant_in << shamt;
+        exp_next  = exp_in - shamt;
+
+        if (exp_next == 0 && shamt != 0) begin
+          flags_next[`F_UNDERFLOW] = 1'b1;
+          flags_next[`F_INEXACT]   = 1'b1;
+        end
       end
 
-      if (exp_next == 8'h00) begin
+      if (exp_next == 0 && flags_next[`F_INEXACT]) begin
         flags_next[`F_UNDERFLOW] = 1'b1;
-        flags_next[`F_INEXACT]   = 1'b1;
       end
-    end
+    end else begin
+      // Keep current outputs
+      mant_next           = mant_out;
+      exp_next            = exp_out;
+      flags_next          = flags_out;
 
-    if (exp_next == 0 && flags_next[`F_INEXACT]) begin
-      flags_next[`F_UNDERFLOW] = 1'b1;
+      sign_out_next       = sign_out;
+      round_mode_out_next = round_mode_out;
+      mode_fp_out_next    = mode_fp_out;
     end
-
-    valid_out_next =
-      (busy || (valid_in && ready_out)) &&
-      (mant_next == 0 || mant_next[P+3] || exp_next == 0 || exp_next == 8'hFF);
-    busy_next = (busy || (valid_in && ready_out)) && !valid_out_next;
   end
 
   always @(posedge clk) begin
     if (!rst_n) begin
       mant_out       <= {(P + 4) {1'b0}};
-      exp_out        <= 8'b0;
+      exp_out        <= {E{1'b0}};
       flags_out      <= 5'b0;
 
       valid_out      <= 1'b0;
-      busy           <= 1'b0;
 
       sign_out       <= 1'b0;
       round_mode_out <= 1'b0;
@@ -1299,8 +1591,7 @@ module fp_normalize #(
       exp_out        <= exp_next;
       flags_out      <= flags_next;
 
-      valid_out      <= valid_out_next;
-      busy           <= busy_next;
+      valid_out      <= !ready_in ? valid_out : valid_in;
 
       sign_out       <= sign_out_next;
       round_mode_out <= round_mode_out_next;
@@ -1346,9 +1637,10 @@ module fp_round #(
   reg [4:0] flags_out_next;
   reg mode_fp_out_next;
 
-  wire rr = mant_in[3];
-  wire m0 = mant_in[2];
-  wire ss = |mant_in[1:0];
+  // mant_in[3] is the last bit kept by fp_packer
+  wire lsb = mant_in[3];
+  wire guard = mant_in[2];
+  wire sticky = |mant_in[1:0];
 
   reg round;
 
@@ -1364,11 +1656,11 @@ module fp_round #(
       mode_fp_out_next = mode_fp_in;
 
       case (round_mode)
-        ROUND_NEAREST_EVEN: round = rr & (m0 | ss);
+        ROUND_NEAREST_EVEN: round = guard & (lsb | sticky);
         ROUND_ZERO:         round = 1'b0;
       endcase
 
-      if (rr | ss) begin
+      if (guard | sticky) begin
         flags_out_next[`F_INEXACT] = 1'b1;
       end
 
@@ -1631,135 +1923,718 @@ module fp_adder #(
   assign mode_fp_out = mode_fp_renormalized;
 endmodule
 
-module fp_decoder (
-    input wire [2:0] op_code,
-    input wire start,
-    input wire ready_in,
-    output wire adder_start,
-    output wire adder_ready_in,
-    output wire multiplier_start,
-    output wire multiplier_ready_in
-);
-  assign adder_start = start && (op_code == `OP_ADD || op_code == `OP_SUB);
-  assign adder_ready_in = ready_in || (op_code != `OP_ADD && op_code != `OP_SUB);
-
-  assign multiplier_start = start && (op_code == `OP_MUL || op_code == `OP_DIV);
-  assign multiplier_ready_in = ready_in || (op_code != `OP_MUL && op_code != `OP_DIV);
+module fma_prep (
+    input wire clk,
+    input wire rst_n,
 
-endmodule
+    input  wire valid_in,
+    input  wire ready_in,
+    output reg  valid_out,
+    output wire ready_out,
 
-module fp_unpacker #(
-    parameter P_SINGLE = 23,
-    parameter E_SINGLE = 8,
-    parameter N_SINGLE = P_SINGLE + E_SINGLE + 1,
-    parameter P_HALF   = 10,
-    parameter E_HALF   = 5,
-    parameter N_HALF   = P_HALF + E_HALF + 1
-) (
-    input wire [N_SINGLE-1:0] op_a,
-    input wire [N_SINGLE-1:0] op_b,
-    input wire mode_fp,
+    input wire        final_sign,
+    input wire [ 8:0] exp_sum,
+    input wire [47:0] mant_prod,
+    input wire        spec_override,
+    input wire [31:0] spec_result,
+    input wire [ 4:0] spec_flags,
+    input wire [31:0] op_c,
+
+    output reg        sign_p,
+    output reg [ 7:0] exp_p,
+    output reg [46:0] mant_p,
+    output reg        sign_c,
+    output reg [ 7:0] exp_c,
+    output reg [46:0] mant_c,
+    output reg [ 4:0] flags_out,
 
-    output wire sign_a,
-    output wire sign_b,
-    output wire [E_SINGLE-1:0] exp_a,
-    output wire [E_SINGLE-1:0] exp_b,
-    output wire [P_SINGLE-1:0] mant_a,
-    output wire [P_SINGLE-1:0] mant_b
+    input  wire round_mode_in,
+    output reg  round_mode_out,
+    input  wire mode_fp_in,
+    output reg  mode_fp_out
 );
-  localparam BIAS_HALF = 2 ** (E_HALF - 1) - 1;
-  localparam BIAS_SINGLE = 2 ** (E_SINGLE - 1) - 1;
-
-  wire fp_single = (mode_fp == `FP_SINGLE);
-
-  wire sign_a_half = op_a[N_HALF-1];
-  wire sign_b_half = op_b[N_HALF-1];
-  wire sign_a_single = op_a[N_SINGLE-1];
-  wire sign_b_single = op_b[N_SINGLE-1];
-
-  wire [E_HALF-1:0] exp_a_half = op_a[N_HALF-2:P_HALF];
-  wire [E_HALF-1:0] exp_b_half = op_b[N_HALF-2:P_HALF];
-  wire [E_SINGLE-1:0] exp_a_single = op_a[N_SINGLE-2:P_SINGLE];
-  wire [E_SINGLE-1:0] exp_b_single = op_b[N_SINGLE-2:P_SINGLE];
-
-  wire [P_HALF-1:0] mant_a_half = op_a[P_HALF-1:0];
-  wire [P_HALF-1:0] mant_b_half = op_b[P_HALF-1:0];
-  wire [P_SINGLE-1:0] mant_a_single = op_a[P_SINGLE-1:0];
-  wire [P_SINGLE-1:0] mant_b_single = op_b[P_SINGLE-1:0];
-
-  assign sign_a = fp_single ? sign_a_single : sign_a_half;
-  assign sign_b = fp_single ? sign_b_single : sign_b_half;
-
-  assign exp_a  = fp_single
-    ? exp_a_single
-    : (exp_a_half == 0 ? 0 : (exp_a_half - BIAS_HALF + BIAS_SINGLE));
-  assign exp_b  = fp_single
-    ? exp_b_single
-    : (exp_b_half == 0 ? 0 : (exp_b_half - BIAS_HALF + BIAS_SINGLE));
+  assign ready_out = ready_in;
 
-  assign mant_a = fp_single ? mant_a_single : (mant_a_half << 13);
-  assign mant_b = fp_single ? mant_b_single : (mant_b_half << 13);
-endmodule
+  // exp_sum wraps around below zero; values past 383 can only be negative
+  wire signed [9:0] exp_signed = {exp_sum >= 9'd384, exp_sum};
+  wire signed [9:0] exp_norm = exp_signed + mant_prod[47];
 
-module fp_packer #(
-    parameter P_SINGLE = 23,
-    parameter E_SINGLE = 8,
-    parameter N_SINGLE = P_SINGLE + E_SINGLE + 1,
-    parameter P_HALF   = 10,
-    parameter E_HALF   = 5,
-    parameter N_HALF   = P_HALF + E_HALF + 1
-) (
-    input wire sign,
-    input wire [E_SINGLE-1:0] exp,
-    input wire [P_SINGLE+3:0] mant,
-    input wire [4:0] flags_in,
-    input wire mode_fp,
+  // The product is kept exact (47 fraction bits) so the sum is rounded once
+  wire [46:0] mant_norm = mant_prod[47] ? mant_prod[46:0] : {mant_prod[45:0], 1'b0};
 
-    output reg [N_SINGLE-1:0] result,
-    output reg [4:0] flags_out
-);
-  localparam BIAS_HALF = 2 ** (E_HALF - 1) - 1;
-  localparam BIAS_SINGLE = 2 ** (E_SINGLE - 1) - 1;
+  wire is_denorm_c = op_c[30:23] == 8'b0 && op_c[22:0] != 23'b0;
 
-  wire [E_HALF-1:0] exp_half = exp - BIAS_SINGLE + BIAS_HALF;
-  // round to nearest
-  wire [P_HALF-1:0] mant_half = mant[P_SINGLE+2-:P_HALF] + mant[P_SINGLE-P_HALF+2];
+  reg sign_p_next, sign_c_next;
+  reg [7:0] exp_p_next, exp_c_next;
+  reg [46:0] mant_p_next, mant_c_next;
+  reg [4:0] flags_out_next;
+  reg round_mode_out_next, mode_fp_out_next;
 
   always @(*) begin
-    flags_out = flags_in;
+    if (valid_in && ready_out) begin
+      flags_out_next      = spec_flags;
+      round_mode_out_next = round_mode_in;
+      mode_fp_out_next    = mode_fp_in;
 
-    if (mode_fp == `FP_SINGLE) begin
-      result = {sign, exp, mant[P_SINGLE+2:3]};
+      sign_c_next         = op_c[31];
+      exp_c_next          = is_denorm_c ? 8'b0 : op_c[30:23];
+      mant_c_next         = is_denorm_c ? 47'b0 : {op_c[22:0], 24'b0};
+
+      sign_p_next         = final_sign;
+
+      if (spec_override) begin
+        sign_p_next = spec_result[31];
+        exp_p_next  = spec_result[30:23];
+        mant_p_next = {spec_result[22:0], 24'b0};
+      end else if (exp_norm >= 255) begin
+        exp_p_next                  = 8'hFF;
+        mant_p_next                 = 47'b0;
+        flags_out_next[`F_OVERFLOW] = 1'b1;
+        flags_out_next[`F_INEXACT]  = 1'b1;
+      end else if (exp_norm <= 0) begin
+        // Flushed to zero, same as denormal inputs
+        exp_p_next                   = 8'b0;
+        mant_p_next                  = 47'b0;
+        flags_out_next[`F_UNDERFLOW] = 1'b1;
+        flags_out_next[`F_INEXACT]   = 1'b1;
+      end else begin
+        exp_p_next  = exp_norm[7:0];
+        mant_p_next = mant_norm;
+      end
     end else begin
-      result = {{(N_SINGLE - N_HALF) {1'b0}}, sign, exp_half, mant_half};
+      // Keep current outputs
+      sign_p_next         = sign_p;
+      exp_p_next          = exp_p;
+      mant_p_next         = mant_p;
+      sign_c_next         = sign_c;
+      exp_c_next          = exp_c;
+      mant_c_next         = mant_c;
+      flags_out_next      = flags_out;
+      round_mode_out_next = round_mode_out;
+      mode_fp_out_next    = mode_fp_out;
+    end
+  end
 
-      if (|mant[P_SINGLE-P_HALF-1:0]) begin
-        flags_out[`F_INEXACT] = 1'b1;
-      end
+  always @(posedge clk) begin
+    if (!rst_n) begin
+      valid_out      <= 1'b0;
+      sign_p         <= 1'b0;
+      exp_p          <= 8'b0;
+      mant_p         <= 47'b0;
+      sign_c         <= 1'b0;
+      exp_c          <= 8'b0;
+      mant_c         <= 47'b0;
+      flags_out      <= 5'b0;
+      round_mode_out <= 1'b0;
+      mode_fp_out    <= 1'b0;
+    end else begin
+      valid_out      <= !ready_in ? valid_out : valid_in;
+      sign_p         <= sign_p_next;
+      exp_p          <= exp_p_next;
+      mant_p         <= mant_p_next;
+      sign_c         <= sign_c_next;
+      exp_c          <= exp_c_next;
+      mant_c         <= mant_c_next;
+      flags_out      <= flags_out_next;
+      round_mode_out <= round_mode_out_next;
+      mode_fp_out    <= mode_fp_out_next;
     end
   end
 endmodule
 
-
+// (a * b) + c with a single rounding. The exact product from the multiplier
+// stages is added to c at 47-bit precision and only then rounded to single.
+module fp_fma (
+    input wire clk,
+    input wire rst_n,
+
+    input wire [31:0] op_a,
+    input wire [31:0] op_b,
+    input wire [31:0] op_c,
+    input wire negate_product,
+    input wire negate_addend,
+    input wire mode_fp,
+    input wire round_mode,
+
+    input  wire start,
+    input  wire ready_in,
+    output wire valid_out,
+    output wire ready_out,
+
+    output wire sign_out,
+    output wire [7:0] exp_out,
+    output wire [26:0] mant_out,
+    output wire [4:0] flags,
+    output wire mode_fp_out
+);
+  localparam PW = 47;
+
+  //s0
+  wire sign_a, sign_b;
+  wire [7:0] exp_a, exp_b;
+  wire [22:0] mant_a, mant_b;
+  wire is_zero_a, is_zero_b, is_nan_a, is_nan_b, is_inf_a, is_inf_b;
+
+  mul_decode s0 (
+      .op_a   ({op_a[31] ^ negate_product, op_a[30:0]}),
+      .op_b   (op_b),
+      .mode_fp(mode_fp),
+
+      .sign_a(sign_a),
+      .sign_b(sign_b),
+      .exp_a (exp_a),
+      .exp_b (exp_b),
+      .mant_a(mant_a),
+      .mant_b(mant_b),
+
+      .is_zero_a(is_zero_a),
+      .is_zero_b(is_zero_b),
+      .is_nan_a (is_nan_a),
+      .is_nan_b (is_nan_b),
+      .is_inf_a (is_inf_a),
+      .is_inf_b (is_inf_b)
+  );
+
+  //s1
+  wire s1_valid, s1_ready;
+  wire [31:0] spec_result;
+  wire [4:0] spec_flags;
+  wire spec_override;
+
+  wire mode_fp_s1;
+  wire round_mode_s1;
+
+  wire sign_a_s1;
+  wire sign_b_s1;
+  wire [7:0] exp_a_s1, exp_b_s1;
+  wire [22:0] mant_a_s1, mant_b_s1;
+
+  mul_exception s1 (
+      .clk      (clk),
+      .rst_n    (rst_n),
+      .valid_in (start),
+      .ready_in (s2_ready),
+      .valid_out(s1_valid),
+      .ready_out(s1_ready),
+
+      .is_zero_a(is_zero_a),
+      .is_zero_b(is_zero_b),
+      .is_nan_a (is_nan_a),
+      .is_nan_b (is_nan_b),
+      .is_inf_a (is_inf_a),
+      .is_inf_b (is_inf_b),
+
+      .initial_flags(5'b0),
+
+      .spec_result  (spec_result),
+      .spec_flags   (spec_flags),
+      .spec_override(spec_override),
+
+      .mode_fp_in (mode_fp),
+      .mode_fp_out(mode_fp_s1),
+
+      .round_mode_in (round_mode),
+      .round_mode_out(round_mode_s1),
+
+      .sign_a_in(sign_a),
+      .sign_b_in(sign_b),
+      .exp_a_in (exp_a),
+      .exp_b_in (exp_b),
+      .mant_a_in(mant_a),
+      .mant_b_in(mant_b),
+
+      .sign_a_out(sign_a_s1),
+      .sign_b_out(sign_b_s1),
+      .exp_a_out (exp_a_s1),
+      .exp_b_out (exp_b_s1),
+      .mant_a_out(mant_a_s1),
+      .mant_b_out(mant_b_s1)
+  );
+
+  //s2
+  wire s2_valid, s2_ready;
+  wire final_sign;
+  wire [8:0] exp_sum;
+  wire [47:0] mant_prod;
+
+  wire mode_fp_s2;
+  wire round_mode_s2;
+
+  wire spec_override_s2;
+  wire [31:0] spec_result_s2;
+  wire [4:0] spec_flags_s2;
+
+  mul_prod s2 (
+      .clk      (clk),
+      .rst_n    (rst_n),
+      .valid_in (s1_valid),
+      .ready_in (prep_ready),
+      .valid_out(s2_valid),
+      .ready_out(s2_ready),
+
+      .sign_a(sign_a_s1),
+      .sign_b(sign_b_s1),
+      .exp_a (exp_a_s1),
+      .exp_b (exp_b_s1),
+      .mant_a(mant_a_s1),
+      .mant_b(mant_b_s1),
+
+      .final_sign(final_sign),
+      .exp_sum   (exp_sum),
+      .mant_prod (mant_prod),
+
+      .mode_fp_in (mode_fp_s1),
+      .mode_fp_out(mode_fp_s2),
+
+      .round_mode_in (round_mode_s1),
+      .round_mode_out(round_mode_s2),
+
+      .spec_override_in(spec_override),
+      .spec_result_in  (spec_result),
+      .spec_flags_in   (spec_flags),
+
+      .spec_override_out(spec_override_s2),
+      .spec_result_out  (spec_result_s2),
+      .spec_flags_out   (spec_flags_s2)
+  );
+
+  // The addend waits here while the product is computed
+  wire [31:0] op_c_s2;
+
+  fp_tag_fifo #(
+      .WIDTH     (32),
+      .DEPTH_BITS(2)
+  ) addend_fifo (
+      .clk  (clk),
+      .rst_n(rst_n),
+
+      .push   (start && s1_ready),
+      .data_in({op_c[31] ^ negate_addend, op_c[30:0]}),
+
+      .pop     (s2_valid && prep_ready),
+      .data_out(op_c_s2)
+  );
+
+  //s3
+  wire prep_valid, prep_ready;
+  wire sign_p, sign_c;
+  wire [7:0] exp_p, exp_c;
+  wire [PW-1:0] mant_p, mant_c;
+  wire [4:0] flags_prep;
+  wire round_mode_prep, mode_fp_prep;
+
+  fma_prep s3 (
+      .clk      (clk),
+      .rst_n    (rst_n),
+      .valid_in (s2_valid),
+      .ready_in (align_ready),
+      .valid_out(prep_valid),
+      .ready_out(prep_ready),
+
+      .final_sign   (final_sign),
+      .exp_sum      (exp_sum),
+      .mant_prod    (mant_prod),
+      .spec_override(spec_override_s2),
+      .spec_result  (spec_result_s2),
+      .spec_flags   (spec_flags_s2),
+      .op_c         (op_c_s2),
+
+      .sign_p   (sign_p),
+      .exp_p    (exp_p),
+      .mant_p   (mant_p),
+      .sign_c   (sign_c),
+      .exp_c    (exp_c),
+      .mant_c   (mant_c),
+      .flags_out(flags_prep),
+
+      .round_mode_in (round_mode_s2),
+      .round_mode_out(round_mode_prep),
+      .mode_fp_in    (mode_fp_s2),
+      .mode_fp_out   (mode_fp_prep)
+  );
+
+  // Product exceptions are merged back in once the sum is done
+  wire [4:0] flags_product;
+
+  fp_tag_fifo #(
+      .WIDTH(5)
+  ) flags_fifo (
+      .clk  (clk),
+      .rst_n(rst_n),
+
+      .push   (prep_valid && align_ready),
+      .data_in(flags_prep),
+
+      .pop     (valid_out && ready_in),
+      .data_out(flags_product)
+  );
+
+  //s4
+  wire align_valid, align_ready;
+  wire [PW+3:0] mant_p_aligned, mant_c_aligned;
+  wire [7:0] exp_aligned;
+  wire sign_p_aligned, sign_c_aligned;
+  wire round_mode_aligned, mode_fp_aligned;
+  wire is_p_nan, is_c_nan, is_p_inf, is_c_inf;
+
+  fp_align #(
+      .P(PW)
+  ) align (
+      .clk  (clk),
+      .rst_n(rst_n),
+
+      .valid_in(prep_valid),
+      .ready_in(addsub_ready),
+      .mant_a(mant_p),
+      .exp_a(exp_p),
+      .mant_b(mant_c),
+      .exp_b(exp_c),
+
+      .valid_out(align_valid),
+      .ready_out(align_ready),
+      .mant_a_aligned(mant_p_aligned),
+      .mant_b_aligned(mant_c_aligned),
+      .bigger_exp(exp_aligned),
+      .is_a_nan(is_p_nan),
+      .is_b_nan(is_c_nan),
+      .is_a_inf(is_p_inf),
+      .is_b_inf(is_c_inf),
+
+      .sign_a_in(sign_p),
+      .sign_a_out(sign_p_aligned),
+      .sign_b_in(sign_c),
+      .sign_b_out(sign_c_aligned),
+      .round_mode_in(round_mode_prep),
+      .round_mode_out(round_mode_aligned),
+      .mode_fp_in(mode_fp_prep),
+      .mode_fp_out(mode_fp_aligned)
+  );
+
+  //s5
+  wire addsub_valid, addsub_ready;
+  wire [PW+3:0] sum;
+  wire sum_carry, sum_sign;
+  wire [4:0] sum_flags;
+  wire [7:0] exp_addsub;
+  wire round_mode_addsub, mode_fp_addsub;
+
+  fp_addsub #(
+      .P(PW)
+  ) addsub (
+      .clk  (clk),
+      .rst_n(rst_n),
+
+      .valid_in(align_valid),
+      .ready_in(normalize_ready),
+      .mant_a_aligned(mant_p_aligned),
+      .mant_b_aligned(mant_c_aligned),
+      .sign_a(sign_p_aligned),
+      .sign_b(sign_c_aligned),
+      .is_a_nan(is_p_nan),
+      .is_b_nan(is_c_nan),
+      .is_a_inf(is_p_inf),
+      .is_b_inf(is_c_inf),
+
+      .valid_out(addsub_valid),
+      .ready_out(addsub_ready),
+      .sum(sum),
+      .carry_out(sum_carry),
+      .sign_out(sum_sign),
+      .flags_out(sum_flags),
+
+      .exp_in(exp_aligned),
+      .exp_out(exp_addsub),
+      .round_mode_in(round_mode_aligned),
+      .round_mode_out(round_mode_addsub),
+      .mode_fp_in(mode_fp_aligned),
+      .mode_fp_out(mode_fp_addsub)
+  );
+
+  //s6
+  wire normalize_valid, normalize_ready;
+  wire [PW+3:0] mant_normalized;
+  wire [7:0] exp_normalized;
+  wire [4:0] flags_normalized;
+  wire sign_normalized, round_mode_normalized, mode_fp_normalized;
+
+  fp_normalize #(
+      .P(PW)
+  ) normalize (
+      .clk  (clk),
+      .rst_n(rst_n),
+
+      .valid_in(addsub_valid),
+      .ready_in(round_ready),
+      .mant_in(sum),
+      .exp_in(exp_addsub),
+      .carry(sum_carry),
+      .flags_in(sum_flags),
+
+      .ready_out(normalize_ready),
+      .valid_out(normalize_valid),
+      .mant_out (mant_normalized),
+      .exp_out  (exp_normalized),
+      .flags_out(flags_normalized),
+
+      .sign_in(sum_sign),
+      .sign_out(sign_normalized),
+      .round_mode_in(round_mode_addsub),
+      .round_mode_out(round_mode_normalized),
+      .mode_fp_in(mode_fp_addsub),
+      .mode_fp_out(mode_fp_normalized)
+  );
+
+  // Down to single precision: 23 fraction bits, guard, round and sticky
+  wire [26:0] mant_narrow = {mant_normalized[PW+3:PW-22], |mant_normalized[PW-23:0]};
+
+  //s7
+  wire round_valid, round_ready;
+  wire [26:0] mant_rounded;
+  wire round_carry;
+  wire [4:0] flags_rounded;
+  wire [7:0] exp_rounded;
+  wire sign_rounded, mode_fp_rounded;
+
+  fp_round round (
+      .clk  (clk),
+      .rst_n(rst_n),
+
+      .valid_in(normalize_valid),
+      .ready_in(renormalize_ready),
+      .mant_in(mant_narrow),
+      .round_mode(round_mode_normalized),
+      .flags_in(flags_normalized),
+
+      .ready_out(round_ready),
+      .valid_out(round_valid),
+      .mant_rounded(mant_rounded),
+      .carry_out(round_carry),
+      .flags_out(flags_rounded),
+
+      .exp_in(exp_normalized),
+      .exp_out(exp_rounded),
+      .sign_in(sign_normalized),
+      .sign_out(sign_rounded),
+      .mode_fp_in(mode_fp_normalized),
+      .mode_fp_out(mode_fp_rounded)
+  );
+
+  //s8
+  wire renormalize_ready;
+  wire [4:0] flags_renormalized;
+
+  fp_normalize renormalize (
+      .clk  (clk),
+      .rst_n(rst_n),
+
+      .valid_in(round_valid),
+      .ready_in(ready_in),
+      .mant_in(mant_rounded),
+      .exp_in(exp_rounded),
+      .carry(round_carry),
+      .flags_in(flags_rounded),
+
+      .ready_out(renormalize_ready),
+      .valid_out(valid_out),
+      .mant_out (mant_out),
+      .exp_out  (exp_out),
+      .flags_out(flags_renormalized),
+
+      .sign_in(sign_rounded),
+      .sign_out(sign_out),
+      .mode_fp_in(mode_fp_rounded),
+      .mode_fp_out(mode_fp_out)
+  );
+
+  assign flags = flags_renormalized | flags_product;
+  assign ready_out = s1_ready;
+endmodule
+
+// In-order side queue for values that ride along an operation (e.g. the
+// destination register) without having to thread them through every stage.
+module fp_tag_fifo #(
+    parameter WIDTH = 5,
+    parameter DEPTH_BITS = 3
+) (
+    input wire clk,
+    input wire rst_n,
+
+    input wire push,
+    input wire [WIDTH-1:0] data_in,
+
+    input wire pop,
+    output wire [WIDTH-1:0] data_out
+);
+  localparam DEPTH = 1 << DEPTH_BITS;
+
+  reg [WIDTH-1:0] data[0:DEPTH-1];
+  reg [DEPTH_BITS-1:0] head, tail;
+
+  assign data_out = data[head];
+
+  always @(posedge clk) begin
+    if (!rst_n) begin
+      head <= 0;
+      tail <= 0;
+    end else begin
+      if (push) begin
+        data[tail] <= data_in;
+        tail <= tail + 1;
+      end
+
+      if (pop) begin
+        head <= head + 1;
+      end
+    end
+  end
+endmodule
+
+module fp_decoder (
+    input wire [3:0] op_code,
+    input wire start,
+    input wire adder_ready,
+    input wire multiplier_ready,
+    input wire fma_ready,
+    input wire sqrt_ready,
+    output wire adder_start,
+    output wire multiplier_start,
+    output wire fma_start,
+    output wire sqrt_start,
+    output wire ready_out
+);
+  wire is_adder_op = op_code == `OP_ADD || op_code == `OP_SUB;
+  wire is_multiplier_op = op_code == `OP_MUL || op_code == `OP_DIV;
+  wire is_fma_op = op_code == `OP_FMADD || op_code == `OP_FMSUB ||
+                   op_code == `OP_FNMSUB || op_code == `OP_FNMADD;
+  wire is_sqrt_op = op_code == `OP_SQRT;
+
+  assign adder_start = start && is_adder_op;
+  assign multiplier_start = start && is_multiplier_op;
+  assign fma_start = start && is_fma_op;
+  assign sqrt_start = start && is_sqrt_op;
+
+  assign ready_out = is_adder_op ? adder_ready :
+                     is_multiplier_op ? multiplier_ready :
+                     is_fma_op ? fma_ready :
+                     is_sqrt_op ? sqrt_ready : 1'b0;
+endmodule
+
+module fp_unpacker #(
+    parameter P_SINGLE = 23,
+    parameter E_SINGLE = 8,
+    parameter N_SINGLE = P_SINGLE + E_SINGLE + 1,
+    parameter P_HALF   = 10,
+    parameter E_HALF   = 5,
+    parameter N_HALF   = P_HALF + E_HALF + 1
+) (
+    input wire [N_SINGLE-1:0] op_a,
+    input wire [N_SINGLE-1:0] op_b,
+    input wire mode_fp,
+
+    output wire sign_a,
+    output wire sign_b,
+    output wire [E_SINGLE-1:0] exp_a,
+    output wire [E_SINGLE-1:0] exp_b,
+    output wire [P_SINGLE-1:0] mant_a,
+    output wire [P_SINGLE-1:0] mant_b
+);
+  localparam BIAS_HALF = 2 ** (E_HALF - 1) - 1;
+  localparam BIAS_SINGLE = 2 ** (E_SINGLE - 1) - 1;
+
+  wire fp_single = (mode_fp == `FP_SINGLE);
+
+  wire sign_a_half = op_a[N_HALF-1];
+  wire sign_b_half = op_b[N_HALF-1];
+  wire sign_a_single = op_a[N_SINGLE-1];
+  wire sign_b_single = op_b[N_SINGLE-1];
+
+  wire [E_HALF-1:0] exp_a_half = op_a[N_HALF-2:P_HALF];
+  wire [E_HALF-1:0] exp_b_half = op_b[N_HALF-2:P_HALF];
+  wire [E_SINGLE-1:0] exp_a_single = op_a[N_SINGLE-2:P_SINGLE];
+  wire [E_SINGLE-1:0] exp_b_single = op_b[N_SINGLE-2:P_SINGLE];
+
+  wire [P_HALF-1:0] mant_a_half = op_a[P_HALF-1:0];
+  wire [P_HALF-1:0] mant_b_half = op_b[P_HALF-1:0];
+  wire [P_SINGLE-1:0] mant_a_single = op_a[P_SINGLE-1:0];
+  wire [P_SINGLE-1:0] mant_b_single = op_b[P_SINGLE-1:0];
+
+  assign sign_a = fp_single ? sign_a_single : sign_a_half;
+  assign sign_b = fp_single ? sign_b_single : sign_b_half;
+
+  assign exp_a  = fp_single
+    ? exp_a_single
+    : (exp_a_half == 0 ? 0 : (exp_a_half - BIAS_HALF + BIAS_SINGLE));
+  assign exp_b  = fp_single
+    ? exp_b_single
+    : (exp_b_half == 0 ? 0 : (exp_b_half - BIAS_HALF + BIAS_SINGLE));
+
+  assign mant_a = fp_single ? mant_a_single : (mant_a_half << 13);
+  assign mant_b = fp_single ? mant_b_single : (mant_b_half << 13);
+endmodule
+
+module fp_packer #(
+    parameter P_SINGLE = 23,
+    parameter E_SINGLE = 8,
+    parameter N_SINGLE = P_SINGLE + E_SINGLE + 1,
+    parameter P_HALF   = 10,
+    parameter E_HALF   = 5,
+    parameter N_HALF   = P_HALF + E_HALF + 1
+) (
+    input wire sign,
+    input wire [E_SINGLE-1:0] exp,
+    input wire [P_SINGLE+3:0] mant,
+    input wire [4:0] flags_in,
+    input wire mode_fp,
+
+    output reg [N_SINGLE-1:0] result,
+    output reg [4:0] flags_out
+);
+  localparam BIAS_HALF = 2 ** (E_HALF - 1) - 1;
+  localparam BIAS_SINGLE = 2 ** (E_SINGLE - 1) - 1;
+
+  wire [E_HALF-1:0] exp_half = exp - BIAS_SINGLE + BIAS_HALF;
+  // round to nearest
+  wire [P_HALF-1:0] mant_half = mant[P_SINGLE+2-:P_HALF] + mant[P_SINGLE-P_HALF+2];
+
+  always @(*) begin
+    flags_out = flags_in;
+
+    if (mode_fp == `FP_SINGLE) begin
+      result = {sign, exp, mant[P_SINGLE+2:3]};
+    end else begin
+      result = {{(N_SINGLE - N_HALF) {1'b0}}, sign, exp_half, mant_half};
+
+      if (|mant[P_SINGLE-P_HALF-1:0]) begin
+        flags_out[`F_INEXACT] = 1'b1;
+      end
+    end
+  end
+endmodule
+
+
 module float_alu #(
     parameter P = 23,
     parameter E = 8,
-    parameter N = P + E + 1
+    parameter N = P + E + 1,
+    parameter TAG_BITS = 5
 ) (
     input wire clk,
     input wire rst_n,
     input wire [N-1:0] op_a,
     input wire [N-1:0] op_b,
-    input wire [2:0] op_code,
+    input wire [N-1:0] op_c,
+    input wire [3:0] op_code,
     input wire mode_fp,
     input wire round_mode,
+    input wire [TAG_BITS-1:0] tag_in,
     input wire start,
     input wire ready_in,
 
-    output reg valid_out,
-    output reg ready_out,
+    output wire valid_out,
+    output wire ready_out,
     output wire [N-1:0] result,
-    output wire [4:0] flags
+    output wire [4:0] flags,
+    output wire [TAG_BITS-1:0] tag_out
 );
   wire [N-1:0] op_a_unpacked, op_b_unpacked;
 
@@ -1776,19 +2651,45 @@ module float_alu #(
       .mant_b(op_b_unpacked[P-1:0])
   );
 
-  wire adder_start, adder_ready_in;
-  wire multiplier_start, multiplier_ready_in;
+  wire [N-1:0] op_c_unpacked;
+
+  fp_unpacker unpacker_c (
+      .op_a(op_c),
+      .op_b({N{1'b0}}),
+      .mode_fp(mode_fp),
+
+      .sign_a(op_c_unpacked[N-1]),
+      .sign_b(),
+      .exp_a (op_c_unpacked[N-2:P]),
+      .exp_b (),
+      .mant_a(op_c_unpacked[P-1:0]),
+      .mant_b()
+  );
+
+  wire adder_start, multiplier_start, fma_start, sqrt_start;
 
+  // A finished square root takes the multiplier's input over, see below
   fp_decoder decoder (
       .op_code(op_code),
       .start(start),
-      .ready_in(ready_in),
+      .adder_ready(adder_ready),
+      .multiplier_ready(multiplier_ready && !sqrt_valid),
+      .fma_ready(fma_ready),
+      .sqrt_ready(sqrt_ready),
       .adder_start(adder_start),
-      .adder_ready_in(adder_ready_in),
       .multiplier_start(multiplier_start),
-      .multiplier_ready_in(multiplier_ready_in)
+      .fma_start(fma_start),
+      .sqrt_start(sqrt_start),
+      .ready_out(ready_out)
   );
 
+  // All units are fully pipelined and may finish on the same cycle, in which
+  // case the multiplier goes first, then the FMA unit, and the others hold
+  // their results.
+  wire multiplier_ready_in = ready_in;
+  wire fma_ready_in = ready_in && !multiplier_valid;
+  wire adder_ready_in = ready_in && !multiplier_valid && !fma_valid;
+
   wire adder_valid, adder_ready;
   wire adder_result;
   wire adder_sign;
@@ -1834,15 +2735,44 @@ module float_alu #(
       .except_flags(recip_flags)
   );
 
-  fp_multiplier multiplier (
+  // Square roots are worked out over several cycles, and then go through the
+  // multiplier too, times one. A finished one goes in ahead of any new
+  // multiplication or division.
+  wire sqrt_valid, sqrt_ready;
+  wire [N-1:0] op_a_sqrt;
+  wire [4:0] sqrt_flags;
+  wire sqrt_round_mode;
+  wire sqrt_mode_fp;
+
+  fp_sqrt sqrt (
       .clk(clk),
       .rst_n(rst_n),
-      .op_a(op_a_unpacked),
-      .op_b(op_code == `OP_MUL ? op_b_unpacked : op_b_inv),
-      .mode_fp(mode_fp),
+      .start(sqrt_start),
+      .ready_in(multiplier_ready),
+
+      .valid_out(sqrt_valid),
+      .ready_out(sqrt_ready),
+
+      .in_bits(op_a_unpacked),
       .round_mode(round_mode),
-      .initial_flags(op_code == `OP_MUL ? 5'b0 : recip_flags),
-      .start(multiplier_start),
+      .mode_fp_in(mode_fp),
+
+      .out_bits(op_a_sqrt),
+      .except_flags(sqrt_flags),
+      .round_mode_out(sqrt_round_mode),
+      .mode_fp_out(sqrt_mode_fp)
+  );
+
+  fp_multiplier multiplier (
+      .clk(clk),
+      .rst_n(rst_n),
+      .op_a(sqrt_valid ? op_a_sqrt : op_a_unpacked),
+      .op_b(sqrt_valid ? {1'b0, 8'd127, 23'b0} :
+            op_code == `OP_MUL ? op_b_unpacked : op_b_inv),
+      .mode_fp(sqrt_valid ? sqrt_mode_fp : mode_fp),
+      .round_mode(sqrt_valid ? sqrt_round_mode : round_mode),
+      .initial_flags(sqrt_valid ? sqrt_flags : op_code == `OP_MUL ? 5'b0 : recip_flags),
+      .start(multiplier_start || sqrt_valid),
       .ready_in(multiplier_ready_in),
 
       .valid_out(multiplier_valid),
@@ -1854,48 +2784,126 @@ module float_alu #(
       .mode_fp_out(multiplier_mode_fp)
   );
 
+  wire fma_valid, fma_ready;
+  wire fma_sign;
+  wire [E-1:0] fma_exp;
+  wire [P+3:0] fma_mant;
+  wire [4:0] fma_flags;
+  wire fma_mode_fp;
+
+  fp_fma fma (
+      .clk(clk),
+      .rst_n(rst_n),
+      .op_a(op_a_unpacked),
+      .op_b(op_b_unpacked),
+      .op_c(op_c_unpacked),
+      .negate_product(op_code == `OP_FNMSUB || op_code == `OP_FNMADD),
+      .negate_addend(op_code == `OP_FMSUB || op_code == `OP_FNMADD),
+      .mode_fp(mode_fp),
+      .round_mode(round_mode),
+      .start(fma_start),
+      .ready_in(fma_ready_in),
+
+      .valid_out(fma_valid),
+      .ready_out(fma_ready),
+      .sign_out(fma_sign),
+      .exp_out(fma_exp),
+      .mant_out(fma_mant),
+      .flags(fma_flags),
+      .mode_fp_out(fma_mode_fp)
+  );
+
+  wire [TAG_BITS-1:0] adder_tag, multiplier_tag, fma_tag, sqrt_tag;
+
+  fp_tag_fifo #(
+      .WIDTH     (TAG_BITS),
+      .DEPTH_BITS(1)
+  ) sqrt_tags (
+      .clk  (clk),
+      .rst_n(rst_n),
+
+      .push   (sqrt_start && sqrt_ready),
+      .data_in(tag_in),
+
+      .pop     (sqrt_valid && multiplier_ready),
+      .data_out(sqrt_tag)
+  );
+
+  fp_tag_fifo #(
+      .WIDTH(TAG_BITS)
+  ) adder_tags (
+      .clk  (clk),
+      .rst_n(rst_n),
+
+      .push   (adder_start && adder_ready),
+      .data_in(tag_in),
+
+      .pop     (adder_valid && adder_ready_in),
+      .data_out(adder_tag)
+  );
+
+  fp_tag_fifo #(
+      .WIDTH(TAG_BITS)
+  ) multiplier_tags (
+      .clk  (clk),
+      .rst_n(rst_n),
+
+      .push   ((multiplier_start || sqrt_valid) && multiplier_ready),
+      .data_in(sqrt_valid ? sqrt_tag : tag_in),
+
+      .pop     (multiplier_valid && multiplier_ready_in),
+      .data_out(multiplier_tag)
+  );
+
+  fp_tag_fifo #(
+      .WIDTH(TAG_BITS)
+  ) fma_tags (
+      .clk  (clk),
+      .rst_n(rst_n),
+
+      .push   (fma_start && fma_ready),
+      .data_in(tag_in),
+
+      .pop     (fma_valid && fma_ready_in),
+      .data_out(fma_tag)
+  );
+
   reg result_sign;
   reg [E-1:0] result_exp;
   reg [P+3:0] result_mant;
   reg [4:0] result_flags;
   reg result_mode_fp;
+  reg [TAG_BITS-1:0] result_tag;
 
-  always @(*) begin
-    case (op_code)
-      `OP_ADD, `OP_SUB: begin
-        valid_out = adder_valid;
-        ready_out = adder_ready;
-
-        result_sign = adder_sign;
-        result_exp = adder_exp;
-        result_mant = adder_mant;
-
-        result_flags = adder_flags;
-        result_mode_fp = adder_mode_fp;
-      end
-      `OP_MUL, `OP_DIV: begin
-        valid_out = multiplier_valid;
-        ready_out = multiplier_ready;
-
-        result_sign = multiplier_sign;
-        result_exp = multiplier_exp;
-        result_mant = multiplier_mant;
-
-        result_flags = multiplier_flags;
-        result_mode_fp = multiplier_mode_fp;
-      end
-      default: begin
-        valid_out = 1'b0;
-        ready_out = 1'b0;
+  assign valid_out = multiplier_valid || fma_valid || adder_valid;
+  assign tag_out   = result_tag;
 
-        result_sign = 1'b0;
-        result_exp = 8'b0;
-        result_mant = 27'b0;
+  always @(*) begin
+    if (multiplier_valid) begin
+      result_sign = multiplier_sign;
+      result_exp = multiplier_exp;
+      result_mant = multiplier_mant;
+
+      result_flags = multiplier_flags;
+      result_mode_fp = multiplier_mode_fp;
+      result_tag = multiplier_tag;
+    end else if (fma_valid) begin
+      result_sign = fma_sign;
+      result_exp = fma_exp;
+      result_mant = fma_mant;
+
+      result_flags = fma_flags;
+      result_mode_fp = fma_mode_fp;
+      result_tag = fma_tag;
+    end else begin
+      result_sign = adder_sign;
+      result_exp = adder_exp;
+      result_mant = adder_mant;
 
-        result_flags = 5'b0;
-        result_mode_fp = 1'b0;
-      end
-    endcase
+      result_flags = adder_flags;
+      result_mode_fp = adder_mode_fp;
+      result_tag = adder_tag;
+    end
   end
 
   fp_packer packer (
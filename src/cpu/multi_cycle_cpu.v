@@ -14,6 +14,7 @@
 `define RESULT_SRC_ALU_OUT 2'd0
 `define RESULT_SRC_DATA 2'd1
 `define RESULT_SRC_ALU_RESULT 2'd2
+`define RESULT_SRC_MULDIV 2'd3
 
 `define ADR_SRC_PC 1'd0
 `define ADR_SRC_RESULT 1'd1
@@ -40,13 +41,17 @@ module mcc_control (
     output reg [1:0] alu_src_b,
     output reg [2:0] imm_src,
     output reg reg_write,
-    output reg [2:0] data_ext_control
+    output reg [2:0] data_ext_control,
+
+    output reg  md_start,
+    input  wire md_done
 );
   localparam S_FETCH = 3'd0;
   localparam S_DECODE = 3'd1;
   localparam S_EXECUTE = 3'd2;
   localparam S_WRITE = 3'd3;
   localparam S_MEM_READ = 3'd4;
+  localparam S_MULDIV = 3'd5;
 
   localparam OP_LOAD = 7'b0000011;
   localparam OP_ALU_IMM = 7'b0010011;
@@ -72,6 +77,7 @@ module mcc_control (
     imm_src = 3'bxxx;
     reg_write = 0;
     data_ext_control = 3'bxxx;
+    md_start = 0;
 
     case (state)
       S_FETCH: begin
@@ -147,7 +153,7 @@ module mcc_control (
             alu_src_b   = `ALU_SRC_B_RD2;
             alu_control = {funct7[5], funct3};
 
-            next_state  = S_WRITE;
+            next_state  = funct7 == 7'b0000001 ? S_MULDIV : S_WRITE;
           end
           OP_LUI: begin
             imm_src = `IMM_SRC_U;
@@ -186,6 +192,18 @@ module mcc_control (
           default: next_state = S_FETCH;
         endcase
       end
+      S_MULDIV: begin
+        // Wait here until the divider is done, then write back directly
+        md_start = 1;
+
+        if (md_done) begin
+          result_src = `RESULT_SRC_MULDIV;
+          reg_write  = 1;
+          next_state = S_FETCH;
+        end else begin
+          next_state = S_MULDIV;
+        end
+      end
       S_MEM_READ: begin
         result_src = `RESULT_SRC_ALU_OUT;
         adr_src = `ADR_SRC_RESULT;
@@ -300,6 +318,8 @@ module multi_cycle_cpu (
   wire [2:0] imm_src;
   wire reg_write;
   wire [2:0] data_ext_control;
+  wire md_start;
+  wire md_done;
 
   wire [2:0] funct3 = instr[14:12];
 
@@ -322,7 +342,10 @@ module multi_cycle_cpu (
       .alu_src_b(alu_src_b),
       .imm_src(imm_src),
       .reg_write(reg_write),
-      .data_ext_control(data_ext_control)
+      .data_ext_control(data_ext_control),
+
+      .md_start(md_start),
+      .md_done (md_done)
   );
 
   wire alu_zero;
@@ -393,6 +416,22 @@ module multi_cycle_cpu (
       .borrow(alu_borrow)
   );
 
+  wire [31:0] md_result;
+
+  cpu_muldiv muldiv (
+      .clk  (clk),
+      .rst_n(rst_n),
+
+      .src_a  (rd1_buf),
+      .src_b  (rd2_buf),
+      .control(funct3),
+      .start  (md_start),
+      .stall  (1'b0),
+
+      .done  (md_done),
+      .result(md_result)
+  );
+
   reg [31:0] alu_out;
   reg [31:0] result;
 
@@ -415,6 +454,7 @@ module multi_cycle_cpu (
       `RESULT_SRC_ALU_OUT:    result = alu_out;
       `RESULT_SRC_DATA:       result = data_ext;
       `RESULT_SRC_ALU_RESULT: result = alu_result;
+      `RESULT_SRC_MULDIV:     result = md_result;
       default:                result = {32{1'bx}};
     endcase
   end
@@ -5,26 +5,46 @@
 `include "cpu_imm_extend.vh"
 `include "cpu_alu.vh"
 `include "float_alu.vh"
+`include "cpu_muldiv.vh"
+`include "pipelined_cpu.vh"
 
 `define FORWARD_NONE 2'd0
 `define FORWARD_WRITEBACK 2'd1
 `define FORWARD_MEMORY 2'd2
-
-module pl_hazard_unit (
+// Integer operands only, from pipe B with DUAL_ISSUE
+`define FORWARD_WRITEBACK_B 3'd3
+`define FORWARD_MEMORY_B 3'd4
+
+module pl_hazard_unit #(
+    parameter integer DUAL_ISSUE   = 0,
+    parameter integer EARLY_BRANCH = 0
+) (
     input wire [4:0] rs1_e,
     input wire [4:0] rs2_e,
+    input wire [4:0] rs3_e,
     input wire [4:0] rd_m,
     input wire [4:0] rd_w,
 
     input  wire       reg_write_m,
     input  wire       reg_write_w,
-    output reg  [1:0] forward_a_e,
-    output reg  [1:0] forward_b_e,
+    output reg  [2:0] forward_a_e,
+    output reg  [2:0] forward_b_e,
+
+    // Pipe B, see DUAL_ISSUE in pipelined_cpu
+    input  wire [4:0] rs1_b_e,
+    input  wire [4:0] rs2_b_e,
+    input  wire [4:0] rd_b_m,
+    input  wire [4:0] rd_b_w,
+    input  wire       reg_write_b_m,
+    input  wire       reg_write_b_w,
+    output reg  [2:0] forward_a_b_e,
+    output reg  [2:0] forward_b_b_e,
 
     input  wire       regf_write_m,
     input  wire       regf_write_w,
     output reg  [1:0] forward_af_e,
     output reg  [1:0] forward_bf_e,
+    output reg  [1:0] forward_cf_e,
 
     input  wire [11:0] csr_addr_e,
     input  wire [11:0] csr_addr_m,
@@ -35,52 +55,221 @@ module pl_hazard_unit (
 
     input wire [4:0] rs1_d,
     input wire [4:0] rs2_d,
+    input wire [4:0] rs3_d,
+    input wire [4:0] rd_d,
     input wire [4:0] rd_e,
     input wire [2:0] result_src_e,
 
+    input wire [4:0] rs1_b_d,
+    input wire [4:0] rs2_b_d,
+
+    // Conditional branches and jal resolved in Decode, see EARLY_BRANCH in
+    // pipelined_cpu. Their operands are forwarded from Memory.
+    input  wire       branch_cond_d,
+    input  wire       redirect_d,
+    input  wire       reg_write_e,
+    input  wire [4:0] rd_b_e,
+    input  wire       reg_write_b_e,
+    input  wire [2:0] result_src_m,
+    output reg  [2:0] forward_a_d,
+    output reg  [2:0] forward_b_d,
+
+    // The instruction in Fetch and the one after it, which goes down pipe B
+    // along with it if pair_f is set
+    input  wire [31:0] instr_f,
+    input  wire [31:0] instr_next_f,
+    input  wire        instr_next_valid,
+    // Predicted to go on to the next instruction
+    input  wire        pred_step_f,
+    output wire        pair_f,
+
+    input wire        rs1f_read_d,
+    input wire        rs2f_read_d,
+    input wire        rs3f_read_d,
+    input wire        regf_write_d,
+    input wire [31:0] fp_busy,
+
     input wire fp_alu_enable_e,
-    input wire fp_alu_valid_out_e,
+    input wire fp_alu_ready_e,
+
+    // A float operation in Decode, and the CSR accesses down the pipeline,
+    // to keep fflags and frm in order with float operations
+    input wire        fp_op_d,
+    input wire [11:0] csr_addr_d,
+    input wire        csr_write_d,
+    input wire        csr_write_e,
+
+    input wire md_enable_e,
+    input wire md_done_e,
 
-    input wire [1:0] pc_src_e,
+    input wire instr_ready,
+    input wire data_ready,
 
-    input wire stall_f_irq,
-    input wire stall_d_irq,
-    input wire stall_e_irq,
-    input wire flush_d_irq,
-    input wire flush_e_irq,
-    input wire flush_m_irq,
-    input wire trap_stages,
+    input wire redirect_e,
+
+    input wire trap,
     input wire trap_mret_d,
+    input wire wfi_d,
+    input wire sleeping,
 
     output reg stall_f,
     output reg stall_d,
     output reg flush_d,
     output reg stall_e,
     output reg flush_e,
-    output reg flush_m
+    output reg stall_m,
+    output reg flush_m,
+    output reg flush_w,
+
+    output reg take_redirect_e,
+    output reg take_redirect_d,
+    output reg take_mret_d,
+    output reg take_wfi_d,
+
+    output wire [7:0] events
 );
-  wire lw_stall = result_src_e == `RESULT_SRC_DATA && (rs1_d == rd_e || rs2_d == rd_e);
-  wire fp_alu_stall = fp_alu_enable_e && !fp_alu_valid_out_e;
+  localparam OP_LOAD = 7'b0000011;
+  localparam OP_OP_IMM = 7'b0010011;
+  localparam OP_AUIPC = 7'b0010111;
+  localparam OP_OP = 7'b0110011;
+  localparam OP_LUI = 7'b0110111;
+  localparam OP_OP_FP = 7'b1010011;
+  localparam OP_BRANCH = 7'b1100011;
+  localparam OP_JALR = 7'b1100111;
+  localparam OP_JAL = 7'b1101111;
+  localparam OP_SYSTEM = 7'b1110011;
+
+  // Pipe B only has an integer ALU. It takes the instruction after Fetch's
+  // when that one can't jump anywhere (nor is predicted to), the next one is
+  // an OP other than RV32M, an OP-IMM, a LUI or an AUIPC, and it doesn't read
+  // what the first one writes. Both may write the same register, in which case
+  // pipe B's younger result wins.
+  wire [6:0] op_f = instr_f[6:0];
+  wire [6:0] op_next_f = instr_next_f[6:0];
+  wire [4:0] rd_f = instr_f[11:7];
+  wire [4:0] rs1_next_f = instr_next_f[19:15];
+  wire [4:0] rs2_next_f = instr_next_f[24:20];
+
+  wire step_f = op_f != OP_BRANCH && op_f != OP_JAL && op_f != OP_JALR && op_f != OP_SYSTEM;
+  wire writes_f = op_f == OP_LOAD || op_f == OP_OP_IMM || op_f == OP_AUIPC || op_f == OP_OP ||
+                  op_f == OP_LUI || op_f == OP_OP_FP;
+
+  wire simple_next_f = op_next_f == OP_OP_IMM || op_next_f == OP_LUI || op_next_f == OP_AUIPC ||
+                       (op_next_f == OP_OP && instr_next_f[31:25] != 7'b0000001);
+  wire rs1_read_next_f = op_next_f == OP_OP_IMM || op_next_f == OP_OP;
+  wire rs2_read_next_f = op_next_f == OP_OP;
+  wire depends_next_f = writes_f && rd_f != 0 &&
+                        ((rs1_read_next_f && rs1_next_f == rd_f) ||
+                         (rs2_read_next_f && rs2_next_f == rd_f));
+
+  assign pair_f = DUAL_ISSUE && instr_next_valid && pred_step_f && step_f && simple_next_f &&
+                  !depends_next_f;
+
+  wire lw_stall = result_src_e == `RESULT_SRC_DATA &&
+                  (rs1_d == rd_e || rs2_d == rd_e || (rs3f_read_d && rs3_d == rd_e) ||
+                   rs1_b_d == rd_e || rs2_b_d == rd_e);
+
+  // FP registers with a result still in flight, including an operation in
+  // Execute that is about to be issued
+  wire [31:0] fp_pending = fp_busy | (fp_alu_enable_e ? 32'b1 << rd_e : 32'b0);
+  wire fp_raw_stall = (rs1f_read_d && fp_pending[rs1_d]) || (rs2f_read_d && fp_pending[rs2_d]) ||
+                      (rs3f_read_d && fp_pending[rs3_d]) || (regf_write_d && fp_pending[rd_d]);
+  // A branch in Decode compares its operands right away, so they can't still
+  // be computed in Execute or loaded in Memory
+  function branch_waits(input [4:0] rs);
+    branch_waits = rs != 0 && ((reg_write_e && rs == rd_e) || (reg_write_b_e && rs == rd_b_e) ||
+                               (reg_write_m && result_src_m == `RESULT_SRC_DATA && rs == rd_m));
+  endfunction
+
+  wire branch_stall = EARLY_BRANCH && branch_cond_d &&
+                      (branch_waits(rs1_d) || branch_waits(rs2_d));
+
+  // Float operations raise their flags in fflags as they finish, and take
+  // their rounding mode from frm in Decode. An access to those waits for the
+  // float operations before it to finish, and the ones after it wait for it to
+  // get past Memory, as Writeback's CSR write is seen in Decode right away.
+  function fp_csr(input [11:0] addr, input write);
+    fp_csr = write && (addr == `CSR_FFLAGS || addr == `CSR_FRM || addr == `CSR_FCSR);
+  endfunction
+
+  wire fp_csr_stall = (fp_csr(csr_addr_d, csr_write_d) &&
+                       (|fp_pending || result_src_e == `RESULT_SRC_FP_MISC ||
+                        result_src_m == `RESULT_SRC_FP_MISC)) ||
+                      (fp_op_d && (fp_csr(csr_addr_e, csr_write_e) ||
+                                   fp_csr(csr_addr_m, csr_write_m)));
+
+  wire d_stall = lw_stall || fp_raw_stall || branch_stall || fp_csr_stall;
+
+  // float_alu can't take the operation in Execute yet, or the divider is
+  // still working on it
+  wire fp_alu_stall = fp_alu_enable_e && !fp_alu_ready_e;
+  wire md_stall = md_enable_e && !md_done_e;
+
+  // Memory access still waiting on the data cache, which holds everything
+  // behind it
+  wire m_stall = !data_ready;
+  wire e_stall = fp_alu_stall || md_stall || m_stall;
+
+  // Instruction cache miss, Decode gets bubbles meanwhile
+  wire i_stall = !instr_ready;
+
+  // A misprediction in Execute overrides any stall in Fetch/Decode, since those
+  // instructions are on the wrong path anyway.
+  wire redirect = redirect_e && !e_stall;
+  wire mret = trap_mret_d && !d_stall && !e_stall;
+  wire d_hold = (d_stall && !redirect) || e_stall;
+  // A misprediction caught in Decode only squashes Fetch, unless Execute has
+  // an older one
+  wire redirect_early = redirect_d && !d_hold && !redirect;
+
+  // wfi goes on to retire as a nop, while Fetch holds the instruction after
+  // it and Decode only gets bubbles until an interrupt wakes the core up
+  wire wfi = wfi_d && !d_hold && !redirect;
+  wire sleep = wfi || sleeping;
+
+  // Performance counter events, see cpu_csr_file.vh. The stall conditions
+  // mean nothing on the cycle a trap flushes the pipeline.
+  assign events[`HPM_EVENT_NONE] = 0;
+  assign events[`HPM_EVENT_LOAD_USE] = lw_stall && !trap;
+  assign events[`HPM_EVENT_FP_STALL] = (fp_raw_stall || fp_alu_stall || fp_csr_stall) && !trap;
+  assign events[`HPM_EVENT_MULDIV_STALL] = md_stall && !trap;
+  assign events[`HPM_EVENT_BRANCH_FLUSH] = (redirect || redirect_early || branch_stall) && !trap;
+  assign events[`HPM_EVENT_TRAP] = trap;
+  assign events[`HPM_EVENT_ICACHE_STALL] = i_stall && !trap;
+  assign events[`HPM_EVENT_DCACHE_STALL] = m_stall;
+
+  // Where an integer operand comes from, the youngest write first. In the same
+  // stage, pipe B holds the younger instruction.
+  function [2:0] forward_int(input [4:0] rs);
+    if (rs == 0) forward_int = `FORWARD_NONE;
+    else if (rs == rd_b_m && reg_write_b_m) forward_int = `FORWARD_MEMORY_B;
+    else if (rs == rd_m && reg_write_m) forward_int = `FORWARD_MEMORY;
+    else if (rs == rd_b_w && reg_write_b_w) forward_int = `FORWARD_WRITEBACK_B;
+    else if (rs == rd_w && reg_write_w) forward_int = `FORWARD_WRITEBACK;
+    else forward_int = `FORWARD_NONE;
+  endfunction
+
+  // Decode reads what Writeback writes from the register file, which is written
+  // half a cycle early, so early branches only forward from Memory
+  function [2:0] forward_int_d(input [4:0] rs);
+    if (rs == 0) forward_int_d = `FORWARD_NONE;
+    else if (rs == rd_b_m && reg_write_b_m) forward_int_d = `FORWARD_MEMORY_B;
+    else if (rs == rd_m && reg_write_m) forward_int_d = `FORWARD_MEMORY;
+    else forward_int_d = `FORWARD_NONE;
+  endfunction
 
   always @(*) begin
-    forward_a_e        = `FORWARD_NONE;
-    forward_b_e        = `FORWARD_NONE;
+    forward_a_e        = forward_int(rs1_e);
+    forward_b_e        = forward_int(rs2_e);
+    forward_a_b_e      = forward_int(rs1_b_e);
+    forward_b_b_e      = forward_int(rs2_b_e);
+    forward_a_d        = EARLY_BRANCH ? forward_int_d(rs1_d) : `FORWARD_NONE;
+    forward_b_d        = EARLY_BRANCH ? forward_int_d(rs2_d) : `FORWARD_NONE;
     forward_af_e       = `FORWARD_NONE;
     forward_bf_e       = `FORWARD_NONE;
+    forward_cf_e       = `FORWARD_NONE;
     forward_csr_data_e = `FORWARD_NONE;
 
-    if (rs1_e == rd_m && reg_write_m && rs1_e != 0) begin
-      forward_a_e = `FORWARD_MEMORY;
-    end else if (rs1_e == rd_w && reg_write_w && rs1_e != 0) begin
-      forward_a_e = `FORWARD_WRITEBACK;
-    end
-
-    if (rs2_e == rd_m && reg_write_m && rs2_e != 0) begin
-      forward_b_e = `FORWARD_MEMORY;
-    end else if (rs2_e == rd_w && reg_write_w && rs2_e != 0) begin
-      forward_b_e = `FORWARD_WRITEBACK;
-    end
-
     if (rs1_e == rd_m && regf_write_m) begin
       forward_af_e = `FORWARD_MEMORY;
     end else if (rs1_e == rd_w && regf_write_w) begin
@@ -93,121 +282,83 @@ module pl_hazard_unit (
       forward_bf_e = `FORWARD_WRITEBACK;
     end
 
+    if (rs3_e == rd_m && regf_write_m) begin
+      forward_cf_e = `FORWARD_MEMORY;
+    end else if (rs3_e == rd_w && regf_write_w) begin
+      forward_cf_e = `FORWARD_WRITEBACK;
+    end
+
     if (csr_addr_e == csr_addr_m && csr_write_m) begin
       forward_csr_data_e = `FORWARD_MEMORY;
     end else if (csr_addr_e == csr_addr_w && csr_write_w) begin
       forward_csr_data_e = `FORWARD_WRITEBACK;
     end
 
-    if (trap_stages) begin
-      stall_f = stall_f_irq;
-      stall_d = stall_d_irq;
-      stall_e = stall_e_irq;
-      flush_d = flush_d_irq;
-      flush_e = flush_e_irq;
-      flush_m = flush_m_irq;
+    if (trap) begin
+      // Everything from Execute back restarts after the handler, while Memory
+      // finishes its access and moves on as usual
+      stall_f         = 0;
+      stall_d         = 0;
+      stall_e         = 0;
+      flush_d         = 1;
+      flush_e         = 1;
+      stall_m         = m_stall;
+      flush_m         = !m_stall;
+      flush_w         = m_stall;
+      take_redirect_e = 0;
+      take_redirect_d = 0;
+      take_mret_d     = 0;
+      take_wfi_d      = 0;
     end else begin
-      stall_f = lw_stall || fp_alu_stall;
-      stall_d = lw_stall || fp_alu_stall;
-      stall_e = fp_alu_stall;
-      flush_d = trap_mret_d || pc_src_e != `PC_SRC_STEP;
-      flush_e = lw_stall || pc_src_e != `PC_SRC_STEP;
-      flush_m = fp_alu_stall;
+      stall_f         = d_hold || (i_stall && !redirect && !redirect_early && !mret) || sleep;
+      stall_d         = d_hold;
+      stall_e         = e_stall;
+      flush_d         = mret || redirect || redirect_early || (i_stall && !d_hold) || sleep;
+      flush_e         = (d_stall && !e_stall) || redirect;
+      stall_m         = m_stall;
+      flush_m         = e_stall && !m_stall;
+      flush_w         = m_stall;
+      take_redirect_e = redirect;
+      take_redirect_d = redirect_early;
+      take_mret_d     = mret && !redirect;
+      take_wfi_d      = wfi;
     end
   end
 endmodule
 
+// Takes an interrupt in a single cycle: Fetch jumps to the trap vector right
+// away, Decode and Execute are flushed and restart from mepc later, and
+// whatever is already in Memory and Writeback carries on. The CSR file runs
+// half a cycle out of phase with the pipeline, so the trap is handed to it
+// registered, once Fetch has already moved on.
 module pl_interrupt_control (
     input wire clk,
     input wire rst_n,
 
+    // Pending and enabled, see cpu_csr_file
     input wire irq,
+    input wire [4:0] irq_cause,
+    // Something ahead would change the CSRs after the trap is taken
+    input wire hold,
+    input wire [31:0] epc,
 
-    output reg trap_pc,
-    output reg trap_stages,
-
-    output reg flush_m,
-    output reg flush_e,
-    output reg flush_d,
+    output wire trap,
 
-    output reg stall_e,
-    output reg stall_d,
-    output reg stall_f
+    output reg        csr_trap,
+    output reg [31:0] csr_trap_epc,
+    output reg [ 4:0] csr_trap_cause
 );
-  localparam S_IDLE = 2'd0;
-  localparam S_WAIT1 = 2'd1;
-  localparam S_WAIT2 = 2'd2;
-
-  reg [1:0] state, next_state;
-
-  wire irq_pending;
-  reg  ack;
-
-  irq_gate irq_g (
-      .clk  (clk),
-      .rst_n(rst_n),
-
-      .irq        (irq),
-      .ack        (ack),
-      .irq_pending(irq_pending)
-  );
-
-  always @(*) begin
-    flush_m     = 0;
-    flush_e     = 0;
-    flush_d     = 0;
-    stall_e     = 0;
-    stall_d     = 0;
-    stall_f     = 0;
-
-    ack         = 0;
-    trap_pc     = 0;
-    trap_stages = 0;
-
-    next_state  = state;
-
-    case (state)
-      S_IDLE: begin
-        if (irq_pending) begin
-          trap_stages = 1;
-          flush_m     = 1;
-          stall_e     = 1;
-          stall_d     = 1;
-          stall_f     = 1;
-
-          ack         = 1;
-          next_state  = S_WAIT1;
-        end
-      end
-      S_WAIT1: begin
-        trap_stages = 1;
-        flush_m     = 1;
-        stall_e     = 1;
-        stall_d     = 1;
-        stall_f     = 1;
-
-        next_state  = S_WAIT2;
-      end
-      S_WAIT2: begin
-        trap_stages = 1;
-        flush_m     = 1;
-        flush_e     = 1;
-        flush_d     = 1;
-
-        trap_pc     = 1;
-        next_state  = S_IDLE;
-      end
-      default: begin
-        next_state = S_IDLE;
-      end
-    endcase
-  end
+  assign trap = irq && !hold;
 
   always @(posedge clk) begin
     if (!rst_n) begin
-      state <= S_IDLE;
+      csr_trap       <= 0;
+      csr_trap_epc   <= 0;
+      csr_trap_cause <= 0;
     end else begin
-      state <= next_state;
+      csr_trap       <= trap;
+      csr_trap_epc   <= epc;
+      csr_trap_cause <= irq_cause;
     end
   end
 endmodule
@@ -217,52 +368,71 @@ module pl_forwarding_unit (
     input wire [31:0] rd2_e,
     input wire [31:0] rdf1_e,
     input wire [31:0] rdf2_e,
+    input wire [31:0] rdf3_e,
     input wire [31:0] csr_data_e,
 
     input wire [31:0] result_pre_m,
     input wire [31:0] csr_data_m,
     input wire [31:0] result_w,
 
-    input wire [1:0] forward_a_e,
-    input wire [1:0] forward_b_e,
+    // Pipe B, see DUAL_ISSUE in pipelined_cpu
+    input wire [31:0] rd1_b_e,
+    input wire [31:0] rd2_b_e,
+    input wire [31:0] result_b_m,
+    input wire [31:0] result_b_w,
+
+    // An early branch's operands, see EARLY_BRANCH in pipelined_cpu
+    input wire [31:0] rd1_d,
+    input wire [31:0] rd2_d,
+
+    input wire [2:0] forward_a_e,
+    input wire [2:0] forward_b_e,
+    input wire [2:0] forward_a_b_e,
+    input wire [2:0] forward_b_b_e,
+    input wire [2:0] forward_a_d,
+    input wire [2:0] forward_b_d,
     input wire [1:0] forward_af_e,
     input wire [1:0] forward_bf_e,
+    input wire [1:0] forward_cf_e,
     input wire [1:0] forward_csr_data_e,
 
     input wire regw_src_m,
 
     output reg [31:0] rd1_e_fw,
     output reg [31:0] rd2_e_fw,
+    output reg [31:0] rd1_b_e_fw,
+    output reg [31:0] rd2_b_e_fw,
+    output reg [31:0] rd1_d_fw,
+    output reg [31:0] rd2_d_fw,
     output reg [31:0] rdf1_e_fw,
     output reg [31:0] rdf2_e_fw,
+    output reg [31:0] rdf3_e_fw,
     output reg [31:0] csr_data_e_fw
 );
-  always @(*) begin
-    case (forward_a_e)
-      `FORWARD_NONE:      rd1_e_fw = rd1_e;
+  function [31:0] forward_int(input [2:0] forward, input [31:0] value);
+    case (forward)
+      `FORWARD_NONE: forward_int = value;
       `FORWARD_MEMORY: begin
         case (regw_src_m)
-          `REGW_SRC_RESULT: rd1_e_fw = result_pre_m;
-          `REGW_SRC_CSR:    rd1_e_fw = csr_data_m;
-          default:          rd1_e_fw = {32{1'bx}};
+          `REGW_SRC_RESULT: forward_int = result_pre_m;
+          `REGW_SRC_CSR:    forward_int = csr_data_m;
+          default:          forward_int = {32{1'bx}};
         endcase
       end
-      `FORWARD_WRITEBACK: rd1_e_fw = result_w;
-      default:            rd1_e_fw = {32{1'bx}};
+      `FORWARD_WRITEBACK:   forward_int = result_w;
+      `FORWARD_MEMORY_B:    forward_int = result_b_m;
+      `FORWARD_WRITEBACK_B: forward_int = result_b_w;
+      default:              forward_int = {32{1'bx}};
     endcase
+  endfunction
 
-    case (forward_b_e)
-      `FORWARD_NONE:      rd2_e_fw = rd2_e;
-      `FORWARD_MEMORY: begin
-        case (regw_src_m)
-          `REGW_SRC_RESULT: rd2_e_fw = result_pre_m;
-          `REGW_SRC_CSR:    rd2_e_fw = csr_data_m;
-          default:          rd2_e_fw = {32{1'bx}};
-        endcase
-      end
-      `FORWARD_WRITEBACK: rd2_e_fw = result_w;
-      default:            rd2_e_fw = {32{1'bx}};
-    endcase
+  always @(*) begin
+    rd1_e_fw   = forward_int(forward_a_e, rd1_e);
+    rd2_e_fw   = forward_int(forward_b_e, rd2_e);
+    rd1_b_e_fw = forward_int(forward_a_b_e, rd1_b_e);
+    rd2_b_e_fw = forward_int(forward_b_b_e, rd2_b_e);
+    rd1_d_fw   = forward_int(forward_a_d, rd1_d);
+    rd2_d_fw   = forward_int(forward_b_d, rd2_d);
 
     case (forward_af_e)
       `FORWARD_NONE:      rdf1_e_fw = rdf1_e;
@@ -278,6 +448,13 @@ module pl_forwarding_unit (
       default:            rdf2_e_fw = {32{1'bx}};
     endcase
 
+    case (forward_cf_e)
+      `FORWARD_NONE:      rdf3_e_fw = rdf3_e;
+      `FORWARD_MEMORY:    rdf3_e_fw = result_pre_m;
+      `FORWARD_WRITEBACK: rdf3_e_fw = result_w;
+      default:            rdf3_e_fw = {32{1'bx}};
+    endcase
+
     case (forward_csr_data_e)
       `FORWARD_NONE:      csr_data_e_fw = csr_data_e;
       `FORWARD_MEMORY:    csr_data_e_fw = result_pre_m;
@@ -287,35 +464,271 @@ module pl_forwarding_unit (
   end
 endmodule
 
-module pipelined_cpu (
+module pl_branch_predictor #(
+    parameter integer PREDICTOR = `BP_GSHARE,
+    parameter integer PHT_BITS  = 8,
+    parameter integer BTB_BITS  = 5,
+    parameter integer RAS_BITS  = 2
+) (
+    input wire clk,
+    input wire rst_n,
+
+    // Fetch lookup. pc_step_f is the address of the instruction after pc_f's.
+    input  wire [        31:0] pc_f,
+    input  wire [        31:0] pc_step_f,
+    input  wire                fetch_enable,
+    output wire [        31:0] pc_pred_f,
+    output wire [PHT_BITS-1:0] pht_idx_f,
+
+    // Execute update
+    input wire                update,
+    input wire                mispredict,
+    input wire [        31:0] update_pc,
+    input wire [        31:0] update_step,
+    input wire [        31:0] update_target,
+    input wire                update_taken,
+    input wire [         1:0] update_kind,
+    input wire [PHT_BITS-1:0] update_pht_idx,
+
+    // A trap flushes everything from Execute back without updating
+    input wire trap,
+
+    output reg [31:0] hits,
+    output reg [31:0] misses
+);
+  localparam BTB_SIZE = 1 << BTB_BITS;
+  localparam PHT_SIZE = 1 << PHT_BITS;
+  localparam RAS_SIZE = 1 << RAS_BITS;
+  // Compressed instructions can share a word, so the tag keeps pc[1]
+  localparam TAG_BITS = 31 - BTB_BITS;
+
+  integer i;
+
+  reg                btb_valid [0:BTB_SIZE-1];
+  reg [TAG_BITS-1:0] btb_tag   [0:BTB_SIZE-1];
+  reg [        31:0] btb_target[0:BTB_SIZE-1];
+  reg [         1:0] btb_kind  [0:BTB_SIZE-1];
+
+  reg [         1:0] pht       [0:PHT_SIZE-1];
+  reg [PHT_BITS-1:0] ghr;
+
+  // Speculative return stack (pushed/popped in Fetch) and committed one
+  // (updated as calls/returns resolve), used to repair the former on a
+  // misprediction or a trap.
+  reg [        31:0] ras       [0:RAS_SIZE-1];
+  reg [RAS_BITS-1:0] ras_top;
+  reg [        31:0] ras_c     [0:RAS_SIZE-1];
+  reg [RAS_BITS-1:0] ras_c_top;
+
+  // Fetch
+  wire [BTB_BITS-1:0] btb_idx_f = pc_f[BTB_BITS+1:2];
+  wire btb_hit_f = btb_valid[btb_idx_f] && btb_tag[btb_idx_f] == {pc_f[31:BTB_BITS+2], pc_f[1]};
+  wire [1:0] kind_f = btb_kind[btb_idx_f];
+  wire [RAS_BITS-1:0] ras_prev = ras_top - 1;
+
+  assign pht_idx_f = PREDICTOR == `BP_GSHARE ? pc_f[PHT_BITS+1:2] ^ ghr : pc_f[PHT_BITS+1:2];
+
+  wire taken_f = PREDICTOR != `BP_NONE && btb_hit_f &&
+                 (kind_f != `BTB_KIND_COND || pht[pht_idx_f][1]);
+  wire [31:0] target_f = kind_f == `BTB_KIND_RET ? ras[ras_prev] : btb_target[btb_idx_f];
+
+  assign pc_pred_f = taken_f ? target_f : pc_step_f;
+
+  // Execute
+  wire [BTB_BITS-1:0] btb_idx_u = update_pc[BTB_BITS+1:2];
+  wire [1:0] pht_entry_u = pht[update_pht_idx];
+
+  always @(posedge clk) begin
+    if (!rst_n) begin
+      for (i = 0; i < BTB_SIZE; i = i + 1) begin
+        btb_valid[i] <= 0;
+      end
+      for (i = 0; i < PHT_SIZE; i = i + 1) begin
+        pht[i] <= 2'b01;  // weakly not taken
+      end
+
+      ghr       <= 0;
+      ras_top   <= 0;
+      ras_c_top <= 0;
+      hits      <= 0;
+      misses    <= 0;
+    end else begin
+      if (fetch_enable && taken_f) begin
+        if (kind_f == `BTB_KIND_CALL) begin
+          ras[ras_top] <= pc_step_f;
+          ras_top      <= ras_top + 1;
+        end else if (kind_f == `BTB_KIND_RET) begin
+          ras_top <= ras_prev;
+        end
+      end
+
+      if (update) begin
+        if (mispredict) begin
+          misses <= misses + 1;
+        end else begin
+          hits <= hits + 1;
+        end
+
+        if (update_kind == `BTB_KIND_COND) begin
+          if (update_taken && pht_entry_u != 2'b11) begin
+            pht[update_pht_idx] <= pht_entry_u + 1;
+          end else if (!update_taken && pht_entry_u != 2'b00) begin
+            pht[update_pht_idx] <= pht_entry_u - 1;
+          end
+
+          ghr <= {ghr[PHT_BITS-2:0], update_taken};
+        end
+
+        if (update_taken) begin
+          btb_valid[btb_idx_u]  <= 1;
+          btb_tag[btb_idx_u]    <= {update_pc[31:BTB_BITS+2], update_pc[1]};
+          btb_target[btb_idx_u] <= update_target;
+          btb_kind[btb_idx_u]   <= update_kind;
+        end
+
+        if (update_kind == `BTB_KIND_CALL) begin
+          ras_c[ras_c_top] <= update_step;
+          ras_c_top        <= ras_c_top + 1;
+        end else if (update_kind == `BTB_KIND_RET) begin
+          ras_c_top <= ras_c_top - 1;
+        end
+
+        if (mispredict) begin
+          for (i = 0; i < RAS_SIZE; i = i + 1) begin
+            ras[i] <= ras_c[i];
+          end
+
+          if (update_kind == `BTB_KIND_CALL) begin
+            ras[ras_c_top] <= update_step;
+            ras_top        <= ras_c_top + 1;
+          end else if (update_kind == `BTB_KIND_RET) begin
+            ras_top <= ras_c_top - 1;
+          end else begin
+            ras_top <= ras_c_top;
+          end
+        end
+      end
+
+      // Calls and returns flushed by a trap have already moved the speculative
+      // stack, and are fetched again after mret
+      if (trap) begin
+        for (i = 0; i < RAS_SIZE; i = i + 1) begin
+          ras[i] <= ras_c[i];
+        end
+
+        ras_top <= ras_c_top;
+      end
+    end
+  end
+endmodule
+
+module pl_fp_scoreboard (
+    input wire clk,
+    input wire rst_n,
+
+    input wire       issue,
+    input wire [4:0] issue_rd,
+
+    input wire       retire,
+    input wire [4:0] retire_rd,
+
+    output wire [31:0] busy
+);
+  reg [31:0] pending;
+
+  // Retiring clears the bit on the same cycle, as the register file is
+  // written on the falling edge and Decode already sees the new value.
+  assign busy = pending & ~(retire ? 32'b1 << retire_rd : 32'b0);
+
+  always @(posedge clk) begin
+    if (!rst_n) begin
+      pending <= 0;
+    end else begin
+      pending <= busy | (issue ? 32'b1 << issue_rd : 32'b0);
+    end
+  end
+endmodule
+
+module pipelined_cpu #(
+    parameter integer BRANCH_PREDICTOR = `BP_GSHARE,
+    parameter integer BP_PHT_BITS      = 8,
+    parameter integer BP_BTB_BITS      = 5,
+    parameter integer BP_RAS_BITS      = 2,
+    // Give interrupt handlers their own copy of the integer registers, other
+    // than sp and gp, so they don't have to save any. Handlers can't nest.
+    parameter integer SHADOW_REGS      = 0,
+    // Issue up to two instructions per cycle, the second one down a pipe B
+    // that only handles simple integer operations (see pl_hazard_unit for the
+    // pairing rules). Needs instr_data_next.
+    parameter integer DUAL_ISSUE       = 0,
+    // Resolve conditional branches and jal in Decode, with their own
+    // comparator and target adder, so that a misprediction squashes one
+    // instruction rather than two. A branch waits in Decode while an operand
+    // is still being computed in Execute or loaded in Memory. jalr is still
+    // resolved in Execute.
+    parameter integer EARLY_BRANCH     = 0
+) (
     input wire clk,
     input wire rst_n,
 
     output wire [31:0] instr_addr,
     input  wire [31:0] instr_data,
+    input  wire        instr_ready,
+    // The word after instr_data's, if instr_next_valid
+    input  wire [31:0] instr_data_next,
+    input  wire        instr_next_valid,
 
     output wire [31:0] data_addr,
     output reg  [31:0] data_wdata,
     output wire [ 3:0] data_wenable,
+    output wire        data_ren,
     input  wire [31:0] data_rdata,
+    input  wire        data_ready,
+
+    // Local interrupts, mip bits IRQ_LOCAL and up, and the machine timer
+    input wire [`IRQ_LOCAL_LINES-1:0] irq,
+    input wire timer_irq,
+
+    // HPM_EVENT_MMIO_* performance counter events, from the system bus
+    input wire [7:0] ext_events,
 
-    input wire irq
+    output wire [31:0] bp_hits,
+    output wire [31:0] bp_misses
 );
-  wire [1:0] forward_a_e;
-  wire [1:0] forward_b_e;
+  localparam MRET_INSTR = 32'h30200073;
+  localparam WFI_INSTR = 32'h10500073;
+
+  wire [2:0] forward_a_e;
+  wire [2:0] forward_b_e;
+  wire [2:0] forward_a_b_e;
+  wire [2:0] forward_b_b_e;
+  wire [2:0] forward_a_d;
+  wire [2:0] forward_b_d;
   wire [1:0] forward_af_e;
   wire [1:0] forward_bf_e;
+  wire [1:0] forward_cf_e;
   wire [1:0] forward_csr_data_e;
   wire stall_f;
   wire stall_d;
   wire stall_e;
   wire flush_e;
+  wire stall_m;
   wire flush_m;
+  wire flush_w;
   wire flush_d;
-
-  pl_hazard_unit hazard_unit (
+  wire take_redirect_e;
+  wire take_redirect_d;
+  wire take_mret_d;
+  wire take_wfi_d;
+  wire [7:0] core_events;
+
+  pl_hazard_unit #(
+      .DUAL_ISSUE  (DUAL_ISSUE),
+      .EARLY_BRANCH(EARLY_BRANCH)
+  ) hazard_unit (
       .rs1_e(rs1_e),
       .rs2_e(rs2_e),
+      .rs3_e(rs3_e),
       .rd_m (rd_m),
       .rd_w (rd_w),
 
@@ -324,10 +737,20 @@ module pipelined_cpu (
       .forward_a_e(forward_a_e),
       .forward_b_e(forward_b_e),
 
+      .rs1_b_e      (rs1_b_e),
+      .rs2_b_e      (rs2_b_e),
+      .rd_b_m       (rd_b_m),
+      .rd_b_w       (rd_b_w),
+      .reg_write_b_m(reg_write_b_m),
+      .reg_write_b_w(reg_write_b_w),
+      .forward_a_b_e(forward_a_b_e),
+      .forward_b_b_e(forward_b_b_e),
+
       .regf_write_m(regf_write_m),
       .regf_write_w(regf_write_w),
       .forward_af_e(forward_af_e),
       .forward_bf_e(forward_bf_e),
+      .forward_cf_e(forward_cf_e),
 
       .csr_addr_e        (csr_addr_e),
       .csr_addr_m        (csr_addr_m),
@@ -338,65 +761,125 @@ module pipelined_cpu (
 
       .rs1_d       (rs1_d),
       .rs2_d       (rs2_d),
+      .rs3_d       (rs3_d),
+      .rd_d        (rd_d),
       .rd_e        (rd_e),
       .result_src_e(result_src_e),
 
-      .fp_alu_enable_e   (fp_alu_enable_e),
-      .fp_alu_valid_out_e(fp_alu_valid_out_e),
+      .rs1_b_d(rs1_b_d),
+      .rs2_b_d(rs2_b_d),
+
+      .branch_cond_d(branch_type_d == `BRANCH_COND),
+      .redirect_d   (mispredict_d),
+      .reg_write_e  (reg_write_e),
+      .rd_b_e       (rd_b_e),
+      .reg_write_b_e(reg_write_b_e),
+      .result_src_m (result_src_m),
+      .forward_a_d  (forward_a_d),
+      .forward_b_d  (forward_b_d),
+
+      .instr_f         (instr_f),
+      .instr_next_f    (instr_next_f),
+      .instr_next_valid(instr_next_valid && next_fits_f),
+      .pred_step_f     (pc_pred_f == pc_step_f),
+      .pair_f          (pair_f),
 
-      .pc_src_e(pc_src_e),
+      .rs1f_read_d (rs1f_read_d),
+      .rs2f_read_d (rs2f_read_d),
+      .rs3f_read_d (rs3f_read_d),
+      .regf_write_d(regf_write_d),
+      .fp_busy     (fp_busy),
 
-      .stall_f_irq(stall_f_irq),
-      .stall_d_irq(stall_d_irq),
-      .stall_e_irq(stall_e_irq),
-      .flush_d_irq(flush_d_irq),
-      .flush_e_irq(flush_e_irq),
-      .flush_m_irq(flush_m_irq),
-      .trap_stages(trap_stages),
-      .trap_mret_d(trap_mret_d),
+      .fp_alu_enable_e(fp_alu_enable_e),
+      .fp_alu_ready_e (fp_alu_ready_out_e),
+
+      .fp_op_d    (fp_alu_enable_d || fp_misc_d),
+      .csr_addr_d (csr_addr_d),
+      .csr_write_d(csr_write_d),
+      .csr_write_e(csr_write_e),
+
+      .md_enable_e(md_enable_e),
+      .md_done_e  (md_done_e),
+
+      .instr_ready(fetch_ready_f),
+      .data_ready (data_ready),
+
+      .redirect_e(mispredict_e),
+
+      .trap       (trap),
+      // wfi decodes as an mret too, but doesn't jump anywhere
+      .trap_mret_d(trap_mret_d && !wfi_d),
+      .wfi_d      (wfi_d),
+      .sleeping   (sleeping),
 
       .stall_f(stall_f),
       .stall_d(stall_d),
       .flush_d(flush_d),
       .stall_e(stall_e),
       .flush_e(flush_e),
-      .flush_m(flush_m)
+      .stall_m(stall_m),
+      .flush_m(flush_m),
+      .flush_w(flush_w),
+
+      .take_redirect_e(take_redirect_e),
+      .take_redirect_d(take_redirect_d),
+      .take_mret_d    (take_mret_d),
+      .take_wfi_d     (take_wfi_d),
+
+      .events(core_events)
   );
 
-  wire flush_m_irq;
-  wire flush_e_irq;
-  wire flush_d_irq;
+  wire trap;
+  wire irq_pending;
+  wire irq_wake;
+  wire [4:0] irq_cause;
+  wire [31:0] trap_vector;
 
-  wire stall_e_irq;
-  wire stall_d_irq;
-  wire stall_f_irq;
+  wire csr_trap;
+  wire [31:0] csr_trap_epc;
+  wire [4:0] csr_trap_cause;
 
-  wire trap_stages;
-  wire trap_pc;
+  // The oldest instruction the trap flushes, where the handler returns to
+  wire [31:0] trap_epc = !bubble_e ? pc_e : !bubble_d ? pc_d : pc_f;
+
+  // A CSR write or mret in Memory would land after the trap, so it waits for
+  // them to reach Writeback. With shadow registers, Memory must also be done
+  // with its access, so that no write to the interrupted bank is still pending
+  // once the handler's first instruction reaches Execute.
+  wire trap_hold = csr_write_m || mret_m || (SHADOW_REGS && !data_ready);
 
   pl_interrupt_control interrupt_control (
       .clk  (clk),
       .rst_n(rst_n),
 
-      .irq(irq),
-
-      .stall_f(stall_f_irq),
-      .stall_d(stall_d_irq),
-      .stall_e(stall_e_irq),
+      .irq      (irq_pending),
+      .irq_cause(irq_cause),
+      .hold     (trap_hold),
+      .epc      (trap_epc),
 
-      .flush_d(flush_d_irq),
-      .flush_e(flush_e_irq),
-      .flush_m(flush_m_irq),
+      .trap(trap),
 
-      .trap_stages(trap_stages),
-      .trap_pc(trap_pc)
+      .csr_trap      (csr_trap),
+      .csr_trap_epc  (csr_trap_epc),
+      .csr_trap_cause(csr_trap_cause)
   );
 
+  // Fetch is stopped by a wfi until some interrupt enabled in mie is pending.
+  // If mstatus.MIE is set it's taken right away, otherwise execution simply
+  // carries on after the wfi.
+  reg sleeping;
+
+  always @(posedge clk) begin
+    if (!rst_n || trap || irq_wake) begin
+      sleeping <= 0;
+    end else if (take_wfi_d) begin
+      sleeping <= 1;
+    end
+  end
+
   // 1. Fetch
   reg  [31:0] pc_f;
 
-  wire [31:0] trap_pc_next = !bubble_e ? pc_e : !bubble_d ? pc_d : pc_f;
-
   always @(posedge clk) begin
     if (!rst_n) begin
       pc_f <= 0;
@@ -408,40 +891,136 @@ module pipelined_cpu (
   reg [31:0] pc_next;
 
   always @(*) begin
-    if (trap_pc || trap_mret_d) begin
+    if (trap) begin
+      pc_next = trap_vector;
+    end else if (take_redirect_e) begin
+      pc_next = pc_actual_e;
+    end else if (take_redirect_d) begin
+      pc_next = pc_actual_d;
+    end else if (take_mret_d) begin
       pc_next = csr_data_d;
+    end else if (pair_f) begin
+      pc_next = pc_step_b_f;
     end else begin
-      case (pc_src_e)
-        `PC_SRC_STEP:    pc_next = pc_plus_4_f;
-        `PC_SRC_TARGET:  pc_next = pc_target_e;
-        `PC_SRC_ALU:     pc_next = alu_result_e & ~1;
-        `PC_SRC_CURRENT: pc_next = pc_f;
-        default:         pc_next = {32{1'bx}};
-      endcase
+      pc_next = pc_pred_f;
+    end
+  end
+
+  // A 32-bit instruction at a halfword address straddles two words. Its upper
+  // half comes from instr_data_next if there is one, otherwise from a second
+  // fetch of the next word, with the lower half kept in split_lo_f meanwhile.
+  reg        split_f;
+  reg [15:0] split_lo_f;
+
+  wire straddle_f = !instr_next_valid && !split_f && pc_f[1] && instr_data[1:0] == 2'b11;
+  wire fetch_ready_f = instr_ready && !straddle_f;
+
+  always @(posedge clk) begin
+    if (!rst_n || !stall_f) begin
+      split_f <= 0;
+    end else if (straddle_f && instr_ready) begin
+      split_f    <= 1;
+      split_lo_f <= instr_data[15:0];
     end
   end
 
-  assign instr_addr = pc_f;
-  wire [31:0] pc_plus_4_f = pc_f + 4;
+  assign instr_addr = split_f ? pc_f + 2 : pc_f;
+
+  // Bytes from pc_f up to the end of the next word
+  wire [63:0] window_f = pc_f[1] ? {16'b0, instr_data_next, instr_data[15:0]} :
+                                   {instr_data_next, instr_data};
+
+  wire [31:0] instr_f;
+  wire        compressed_f;
+
+  cpu_rvc_expander rvc_expander (
+      .data      (split_f ? {instr_data[15:0], split_lo_f} : window_f[31:0]),
+      .instr     (instr_f),
+      .compressed(compressed_f)
+  );
+
+  wire [31:0] pc_step_f = pc_f + (compressed_f ? 2 : 4);
+
+  // The instruction after Fetch's goes down pipe B along with it, if it's
+  // all within the window
+  wire pair_f;
+
+  wire [31:0] instr_next_f;
+  wire        compressed_next_f;
+
+  cpu_rvc_expander rvc_expander_b (
+      .data      (compressed_f ? window_f[47:16] : window_f[63:32]),
+      .instr     (instr_next_f),
+      .compressed(compressed_next_f)
+  );
+
+  wire next_fits_f = !pc_f[1] || compressed_f || compressed_next_f;
+  wire [31:0] pc_step_b_f = pc_step_f + (compressed_next_f ? 2 : 4);
+
+  wire [31:0] pc_pred_f;
+  wire [BP_PHT_BITS-1:0] pht_idx_f;
+
+  pl_branch_predictor #(
+      .PREDICTOR(BRANCH_PREDICTOR),
+      .PHT_BITS (BP_PHT_BITS),
+      .BTB_BITS (BP_BTB_BITS),
+      .RAS_BITS (BP_RAS_BITS)
+  ) branch_predictor (
+      .clk  (clk),
+      .rst_n(rst_n),
+
+      .pc_f        (pc_f),
+      .pc_step_f   (pc_step_f),
+      .fetch_enable(!stall_f && !flush_d),
+      .pc_pred_f   (pc_pred_f),
+      .pht_idx_f   (pht_idx_f),
+
+      .update        (bp_update_e),
+      .mispredict    (mispredict_e || redirected_e),
+      .update_pc     (pc_e),
+      .update_step   (pc_step_e),
+      .update_target (pc_actual_e),
+      .update_taken  (pc_src_e != `PC_SRC_STEP),
+      .update_kind   (bp_kind_e),
+      .update_pht_idx(pht_idx_e),
+
+      .trap(trap),
+
+      .hits  (bp_hits),
+      .misses(bp_misses)
+  );
 
 
   // 2. Decode
   reg  [31:0] instr_d;
   reg  [31:0] pc_d;
-  reg  [31:0] pc_plus_4_d;
+  reg  [31:0] pc_step_d;
+  reg  [31:0] pc_pred_d;
+  reg  [BP_PHT_BITS-1:0] pht_idx_d;
   reg         bubble_d;
+  // Pipe B's instruction sits at pc_step_d
+  reg  [31:0] instr_b_d;
+  reg         bubble_b_d;
 
   always @(posedge clk) begin
     if (!rst_n || flush_d) begin
       instr_d     <= 32'h00000013;  // nop
       pc_d        <= {32{1'bx}};
-      pc_plus_4_d <= {32{1'bx}};
+      pc_step_d   <= {32{1'bx}};
+      pc_pred_d   <= {32{1'bx}};
+      pht_idx_d   <= 0;
       bubble_d    <= 1;
+      instr_b_d   <= 32'h00000013;  // nop
+      bubble_b_d  <= 1;
     end else if (!stall_d) begin
-      instr_d     <= instr_data;
+      instr_d     <= instr_f;
       pc_d        <= pc_f;
-      pc_plus_4_d <= pc_plus_4_f;
+      pc_step_d   <= pc_step_f;
+      pc_pred_d   <= pc_pred_f;
+      pht_idx_d   <= pht_idx_f;
       bubble_d    <= 0;
+      instr_b_d   <= pair_f ? instr_next_f : 32'h00000013;
+      bubble_b_d  <= !pair_f;
     end
   end
 
@@ -463,20 +1042,26 @@ module pipelined_cpu (
 
   wire [ 4:0] rs1_d = instr_d[19:15];
   wire [ 4:0] rs2_d = instr_d[24:20];
+  wire [ 4:0] rs3_d = instr_d[31:27];
   wire [ 4:0] rd_d = instr_d[11:7];
   wire [31:0] imm_ext_d;
   wire [31:0] rd1_d;
   wire [31:0] rd2_d;
   wire [31:0] rdf1_d;
   wire [31:0] rdf2_d;
+  wire [31:0] rdf3_d;
   wire [31:0] csr_data_d;
   wire        trap_mret_d;
+  wire        wfi_d = instr_d == WFI_INSTR;
   wire        fp_alu_enable_d;
+  wire        fp_fused_d;
+  wire        md_enable_d;
 
   scc_control control (
       .op    (instr_d[6:0]),
       .funct3(funct3_d),
       .funct7(instr_d[31:25]),
+      .rs2   (rs2_d),
 
       .branch_type     (branch_type_d),
       .result_src      (result_src_d),
@@ -492,22 +1077,138 @@ module pipelined_cpu (
       .csr_write       (csr_write_d),
       .trap_mret       (trap_mret_d),
       .wd_sel          (wd_sel_d),
-      .fp_alu_enable   (fp_alu_enable_d)
+      .fp_alu_enable   (fp_alu_enable_d),
+      .fp_fused        (fp_fused_d),
+      .md_enable       (md_enable_d)
+  );
+
+  // Pipe B only ever gets OP, OP-IMM, LUI and AUIPC instructions
+  wire [ 4:0] rs1_b_d = instr_b_d[19:15];
+  wire [ 4:0] rs2_b_d = instr_b_d[24:20];
+  wire [ 4:0] rd_b_d = instr_b_d[11:7];
+  wire [ 2:0] result_src_b_d;
+  wire [ 3:0] alu_control_b_d;
+  wire [ 1:0] alu_src_b_b_d;
+  wire [ 2:0] imm_src_b_d;
+  wire        reg_write_b_d;
+  wire [31:0] imm_ext_b_d;
+  wire [31:0] rd1_b_d;
+  wire [31:0] rd2_b_d;
+
+  scc_control control_b (
+      .op    (instr_b_d[6:0]),
+      .funct3(instr_b_d[14:12]),
+      .funct7(instr_b_d[31:25]),
+      .rs2   (rs2_b_d),
+
+      .result_src (result_src_b_d),
+      .alu_control(alu_control_b_d),
+      .alu_src_b  (alu_src_b_b_d),
+      .imm_src    (imm_src_b_d),
+      .reg_write  (reg_write_b_d)
+  );
+
+  cpu_imm_extend imm_extend_b (
+      .data   (instr_b_d[31:7]),
+      .imm_src(imm_src_b_d),
+      .imm_ext(imm_ext_b_d)
   );
 
-  cpu_register_file register_file (
+  // Register bank Decode reads from. Each instruction takes it down the
+  // pipeline, so that the ones still draining after a trap or mret write back
+  // to the bank they read from.
+  reg bank_d;
+
+  always @(posedge clk) begin
+    if (!rst_n) begin
+      bank_d <= 0;
+    end else if (SHADOW_REGS && trap) begin
+      bank_d <= 1;
+    end else if (take_mret_d) begin
+      bank_d <= 0;
+    end
+  end
+
+  // Shared between both banks, so they're written to both
+  wire shared_reg_w = rd_w == 2 || rd_w == 3;
+  wire shared_reg_b_w = rd_b_w == 2 || rd_b_w == 3;
+
+  wire [31:0] rd1_main_d;
+  wire [31:0] rd2_main_d;
+  wire [31:0] rd1_b_main_d;
+  wire [31:0] rd2_b_main_d;
+
+  // Ports 4 to 6 belong to pipe B
+  cpu_register_file #(
+      .DUAL_ISSUE(DUAL_ISSUE)
+  ) register_file (
       .clk(~clk),
 
       .a1 (rs1_d),
       .a2 (rs2_d),
       .a3 (rd_w),
-      .we3(reg_write_w),
+      .we3(reg_write_w && (!bank_w || shared_reg_w)),
       .wd3(reg_wd3_w),
 
-      .rd1(rd1_d),
-      .rd2(rd2_d)
+      .rd1(rd1_main_d),
+      .rd2(rd2_main_d),
+
+      .a4 (rs1_b_d),
+      .a5 (rs2_b_d),
+      .a6 (rd_b_w),
+      .we6(reg_write_b_w && (!bank_w || shared_reg_b_w)),
+      .wd6(result_b_w),
+
+      .rd4(rd1_b_main_d),
+      .rd5(rd2_b_main_d)
   );
 
+  generate
+    if (SHADOW_REGS) begin : g_shadow_regs
+      wire [31:0] rd1_shadow_d;
+      wire [31:0] rd2_shadow_d;
+      wire [31:0] rd1_b_shadow_d;
+      wire [31:0] rd2_b_shadow_d;
+
+      cpu_register_file #(
+          .DUAL_ISSUE(DUAL_ISSUE)
+      ) shadow_register_file (
+          .clk(~clk),
+
+          .a1 (rs1_d),
+          .a2 (rs2_d),
+          .a3 (rd_w),
+          .we3(reg_write_w && (bank_w || shared_reg_w)),
+          .wd3(reg_wd3_w),
+
+          .rd1(rd1_shadow_d),
+          .rd2(rd2_shadow_d),
+
+          .a4 (rs1_b_d),
+          .a5 (rs2_b_d),
+          .a6 (rd_b_w),
+          .we6(reg_write_b_w && (bank_w || shared_reg_b_w)),
+          .wd6(result_b_w),
+
+          .rd4(rd1_b_shadow_d),
+          .rd5(rd2_b_shadow_d)
+      );
+
+      assign rd1_d   = bank_d ? rd1_shadow_d : rd1_main_d;
+      assign rd2_d   = bank_d ? rd2_shadow_d : rd2_main_d;
+      assign rd1_b_d = bank_d ? rd1_b_shadow_d : rd1_b_main_d;
+      assign rd2_b_d = bank_d ? rd2_b_shadow_d : rd2_b_main_d;
+    end else begin : g_no_shadow_regs
+      assign rd1_d   = rd1_main_d;
+      assign rd2_d   = rd2_main_d;
+      assign rd1_b_d = rd1_b_main_d;
+      assign rd2_b_d = rd2_b_main_d;
+    end
+  endgenerate
+
+  // Writeback has priority over float_alu, which holds its result meanwhile
+  wire fp_alu_retire = fp_alu_valid_out_e && !regf_write_w;
+
   cpu_register_file #(
       .HARDWIRE_ZERO(0)
   ) float_register_file (
@@ -515,41 +1216,125 @@ module pipelined_cpu (
 
       .a1 (rs1_d),
       .a2 (rs2_d),
-      .a3 (rd_w),
-      .we3(regf_write_w),
-      .wd3(reg_wd3_w),
+      .a3 (regf_write_w ? rd_w : fp_alu_tag_out_e),
+      .we3(regf_write_w || fp_alu_valid_out_e),
+      .wd3(regf_write_w ? reg_wd3_w : fp_alu_result_e),
 
       .rd1(rdf1_d),
       .rd2(rdf2_d)
   );
 
+  // Fused ops need a third read port, so rs3 gets its own copy of the FP
+  // registers with the same write port
+  cpu_register_file #(
+      .HARDWIRE_ZERO(0)
+  ) float_register_file_c (
+      .clk(~clk),
+
+      .a1 (rs3_d),
+      .a2 (5'b0),
+      .a3 (regf_write_w ? rd_w : fp_alu_tag_out_e),
+      .we3(regf_write_w || fp_alu_valid_out_e),
+      .wd3(regf_write_w ? reg_wd3_w : fp_alu_result_e),
+
+      .rd1(rdf3_d),
+      .rd2()
+  );
+
+  wire fp_misc_d = result_src_d == `RESULT_SRC_FP_MISC;
+  wire rs1f_read_d = fp_alu_enable_d || alu_src_a_d == `ALU_SRC_A_RDF1;
+  wire rs2f_read_d = (fp_alu_enable_d && alu_control_d != `OP_SQRT) ||
+                     (fp_misc_d && alu_control_d <= `FP_MISC_LE) ||
+                     (|mem_write_d && wd_sel_d == `WD_SEL_FLOAT);
+  wire rs3f_read_d = fp_fused_d;
+  wire [31:0] fp_busy;
+
+  pl_fp_scoreboard fp_scoreboard (
+      .clk  (clk),
+      .rst_n(rst_n),
+
+      .issue   (fp_alu_start_e && fp_alu_ready_out_e),
+      .issue_rd(rd_e),
+
+      .retire   (fp_alu_retire),
+      .retire_rd(fp_alu_tag_out_e),
+
+      .busy(fp_busy)
+  );
+
   wire [11:0] csr_addr_d = instr_d[31:20];
+  wire [ 2:0] frm;
 
   cpu_csr_file csr_file (
       .clk  (~clk),
       .rst_n(rst_n),
 
-      .raddr(trap_pc ? `CSR_MTVEC : trap_mret_d ? `CSR_MEPC : csr_addr_d),
+      .raddr(trap_mret_d ? `CSR_MEPC : csr_addr_d),
       .rdata(csr_data_d),
 
-      .waddr  (trap_pc ? `CSR_MEPC : csr_addr_w),
-      .wdata  (trap_pc ? trap_pc_next : result_w),
-      .wenable(trap_pc || csr_write_w),
+      .waddr  (csr_addr_w),
+      .wdata  (result_w),
+      .wenable(csr_write_w),
 
-      .bubble_w(bubble_w)
+      .bubble_w  (bubble_w),
+      .bubble_b_w(bubble_b_w),
+      .events    ({ext_events, core_events}),
+
+      .irq        (irq),
+      .timer_irq  (timer_irq),
+      .irq_pending(irq_pending),
+      .irq_cause  (irq_cause),
+      .trap_vector(trap_vector),
+      .irq_wake   (irq_wake),
+
+      .trap      (csr_trap),
+      .trap_epc  (csr_trap_epc),
+      .trap_cause(csr_trap_cause),
+      // mret jumps from Decode, but interrupts are only enabled once it retires
+      .mret      (mret_w),
+
+      .fp_flags(fp_flags_w | (fp_alu_retire ? fp_alu_flags_e : 5'b0)),
+      .frm     (frm)
   );
 
+  // Rounding mode of the float operation in Decode
+  wire [2:0] rm_d = funct3_d == `RM_DYN ? frm : funct3_d;
+
   cpu_imm_extend imm_extend (
       .data   (instr_d[31:7]),
       .imm_src(imm_src_d),
       .imm_ext(imm_ext_d)
   );
 
+  // With EARLY_BRANCH, conditional branches and jal find out where they go
+  // here. A jal the predictor got wrong redirects Fetch right away, as it
+  // needs no registers. Execute checks them again, which now always agrees.
+  wire [31:0] rd1_d_fw;
+  wire [31:0] rd2_d_fw;
+  wire [ 1:0] pc_src_d;
+
+  scc_branch_logic branch_logic_d (
+      .branch_type(branch_type_d),
+      .funct3     (funct3_d),
+      .alu_zero   (rd1_d_fw == rd2_d_fw),
+      .alu_borrow (rd1_d_fw < rd2_d_fw),
+      .alu_lt     ($signed(rd1_d_fw) < $signed(rd2_d_fw)),
+
+      .pc_src(pc_src_d)
+  );
+
+  wire [31:0] pc_actual_d = pc_src_d == `PC_SRC_TARGET ? pc_d + imm_ext_d : pc_step_d;
+  wire mispredict_d = EARLY_BRANCH && !bubble_d &&
+                      (branch_type_d == `BRANCH_COND || branch_type_d == `BRANCH_JAL) &&
+                      pc_actual_d != pc_pred_d;
+
   // 3. Execute
   reg        regw_src_e;
   reg        reg_write_e;
   reg        regf_write_e;
   reg        csr_write_e;
+  reg        mret_e;
+  reg        bank_e;
   reg [ 2:0] result_src_e;
   reg [ 3:0] mem_write_e;
   reg [ 2:0] data_ext_control_e;
@@ -559,31 +1344,40 @@ module pipelined_cpu (
   reg [11:0] csr_addr_e;
   reg        wd_sel_e;
   reg        fp_alu_enable_e;
+  reg        md_enable_e;
 
   reg [31:0] rd1_e;
   reg [31:0] rd2_e;
   reg [31:0] rdf1_e;
   reg [31:0] rdf2_e;
+  reg [31:0] rdf3_e;
   reg [31:0] csr_data_e;
   reg [31:0] pc_e;
+  reg [31:0] instr_e;
   reg [ 4:0] rs1_e;
   reg [ 4:0] rs2_e;
+  reg [ 4:0] rs3_e;
   reg [ 4:0] rd_e;
   reg [31:0] imm_ext_e;
-  reg [31:0] pc_plus_4_e;
+  reg [31:0] pc_step_e;
+  reg [31:0] pc_pred_e;
+  // Mispredicted, but already redirected from Decode
+  reg        redirected_e;
+  reg [BP_PHT_BITS-1:0] pht_idx_e;
   reg [ 2:0] branch_type_e;
   reg [ 2:0] funct3_e;
+  reg [ 2:0] rm_e;
 
   reg        bubble_e;
 
-  reg        fp_alu_start_e;
-
   always @(posedge clk) begin
     if (!rst_n || flush_e) begin
       regw_src_e         <= 0;
       reg_write_e        <= 0;
       regf_write_e       <= 0;
       csr_write_e        <= 0;
+      mret_e             <= 0;
+      bank_e             <= 0;
       result_src_e       <= `RESULT_SRC_ALU;
       mem_write_e        <= 0;
       data_ext_control_e <= 4'b0000;
@@ -593,29 +1387,38 @@ module pipelined_cpu (
       csr_addr_e         <= 0;
       wd_sel_e           <= `WD_SEL_INT;
       fp_alu_enable_e    <= 0;
+      md_enable_e        <= 0;
 
       rd1_e              <= 32'b0;
       rd2_e              <= 32'b0;
       rdf1_e             <= 32'b0;
       rdf2_e             <= 32'b0;
+      rdf3_e             <= 32'b0;
       csr_data_e         <= 32'b0;
       pc_e               <= {32{1'bx}};
+      instr_e            <= 32'h00000013;  // nop
       rs1_e              <= 0;
       rs2_e              <= 0;
+      rs3_e              <= 0;
       rd_e               <= 0;
       imm_ext_e          <= {32{1'bx}};
-      pc_plus_4_e        <= {32{1'bx}};
+      pc_step_e          <= {32{1'bx}};
+      pc_pred_e          <= {32{1'bx}};
+      redirected_e       <= 0;
+      pht_idx_e          <= 0;
       branch_type_e      <= `BRANCH_NONE;
       funct3_e           <= 3'bxxx;
+      rm_e               <= `RM_RNE;
 
       bubble_e           <= 1;
-
-      fp_alu_start_e     <= 0;
     end else if (!stall_e) begin
       regw_src_e         <= regw_src_d;
       reg_write_e        <= reg_write_d;
       regf_write_e       <= regf_write_d;
       csr_write_e        <= csr_write_d;
+      // ecall decodes as an mret too, but mustn't touch mstatus
+      mret_e             <= trap_mret_d && instr_d == MRET_INSTR;
+      bank_e             <= bank_d;
       result_src_e       <= result_src_d;
       mem_write_e        <= mem_write_d;
       data_ext_control_e <= data_ext_control_d;
@@ -625,27 +1428,86 @@ module pipelined_cpu (
       csr_addr_e         <= csr_addr_d;
       wd_sel_e           <= wd_sel_d;
       fp_alu_enable_e    <= fp_alu_enable_d;
+      md_enable_e        <= md_enable_d;
 
       rd1_e              <= rd1_d;
       rd2_e              <= rd2_d;
       rdf1_e             <= rdf1_d;
       rdf2_e             <= rdf2_d;
+      rdf3_e             <= rdf3_d;
       csr_data_e         <= csr_data_d;
       pc_e               <= pc_d;
+      instr_e            <= instr_d;
       rs1_e              <= rs1_d;
       rs2_e              <= rs2_d;
+      rs3_e              <= rs3_d;
       rd_e               <= rd_d;
       imm_ext_e          <= imm_ext_d;
-      pc_plus_4_e        <= pc_plus_4_d;
+      pc_step_e          <= pc_step_d;
+      pc_pred_e          <= take_redirect_d ? pc_actual_d : pc_pred_d;
+      redirected_e       <= take_redirect_d;
+      pht_idx_e          <= pht_idx_d;
       branch_type_e      <= branch_type_d;
       funct3_e           <= funct3_d;
+      rm_e               <= rm_d;
 
       bubble_e           <= bubble_d;
+    end else begin
+      // Memory or Writeback is flushed while Execute stalls, so keep whatever
+      // was being forwarded from them
+      rd1_e              <= rd1_e_fw;
+      rd2_e              <= rd2_e_fw;
+      rdf1_e             <= rdf1_e_fw;
+      rdf2_e             <= rdf2_e_fw;
+      rdf3_e             <= rdf3_e_fw;
+      csr_data_e         <= csr_data_e_fw;
+    end
+  end
 
-      fp_alu_start_e     <= fp_alu_enable_d;
+  // Pipe B moves along with pipe A, its instruction at pc_step_e
+  reg        bubble_b_e;
+  reg        reg_write_b_e;
+  reg [ 2:0] result_src_b_e;
+  reg [ 3:0] alu_control_b_e;
+  reg [ 1:0] alu_src_b_b_e;
+  reg [31:0] rd1_b_e;
+  reg [31:0] rd2_b_e;
+  reg [ 4:0] rs1_b_e;
+  reg [ 4:0] rs2_b_e;
+  reg [ 4:0] rd_b_e;
+  reg [31:0] imm_ext_b_e;
+  reg [31:0] instr_b_e;
+
+  always @(posedge clk) begin
+    if (!rst_n || flush_e) begin
+      bubble_b_e      <= 1;
+      reg_write_b_e   <= 0;
+      result_src_b_e  <= `RESULT_SRC_ALU;
+      alu_control_b_e <= 4'b0000;
+      alu_src_b_b_e   <= 0;
+      rd1_b_e         <= 32'b0;
+      rd2_b_e         <= 32'b0;
+      rs1_b_e         <= 0;
+      rs2_b_e         <= 0;
+      rd_b_e          <= 0;
+      imm_ext_b_e     <= {32{1'bx}};
+      instr_b_e       <= 32'h00000013;  // nop
+    end else if (!stall_e) begin
+      bubble_b_e      <= bubble_b_d;
+      reg_write_b_e   <= reg_write_b_d;
+      result_src_b_e  <= result_src_b_d;
+      alu_control_b_e <= alu_control_b_d;
+      alu_src_b_b_e   <= alu_src_b_b_d;
+      rd1_b_e         <= rd1_b_d;
+      rd2_b_e         <= rd2_b_d;
+      rs1_b_e         <= rs1_b_d;
+      rs2_b_e         <= rs2_b_d;
+      rd_b_e          <= rd_b_d;
+      imm_ext_b_e     <= imm_ext_b_d;
+      instr_b_e       <= instr_b_d;
     end else begin
-      // Disable fp_alu_start after first stall
-      fp_alu_start_e <= 0;
+      rd1_b_e         <= rd1_b_e_fw;
+      rd2_b_e         <= rd2_b_e_fw;
     end
   end
 
@@ -659,31 +1521,53 @@ module pipelined_cpu (
   wire [31:0] rd2_e_fw;
   wire [31:0] rdf1_e_fw;
   wire [31:0] rdf2_e_fw;
+  wire [31:0] rdf3_e_fw;
   wire [31:0] csr_data_e_fw;
+  wire [31:0] rd1_b_e_fw;
+  wire [31:0] rd2_b_e_fw;
 
   pl_forwarding_unit forwarding_unit (
       .rd1_e     (rd1_e),
       .rd2_e     (rd2_e),
       .rdf1_e    (rdf1_e),
       .rdf2_e    (rdf2_e),
+      .rdf3_e    (rdf3_e),
       .csr_data_e(csr_data_e),
 
       .result_pre_m(result_pre_m),
       .csr_data_m  (csr_data_m),
       .result_w    (result_w),
 
+      .rd1_b_e   (rd1_b_e),
+      .rd2_b_e   (rd2_b_e),
+      .result_b_m(result_b_m),
+      .result_b_w(result_b_w),
+
+      .rd1_d(rd1_d),
+      .rd2_d(rd2_d),
+
       .forward_a_e       (forward_a_e),
       .forward_b_e       (forward_b_e),
+      .forward_a_b_e     (forward_a_b_e),
+      .forward_b_b_e     (forward_b_b_e),
+      .forward_a_d       (forward_a_d),
+      .forward_b_d       (forward_b_d),
       .forward_af_e      (forward_af_e),
       .forward_bf_e      (forward_bf_e),
+      .forward_cf_e      (forward_cf_e),
       .forward_csr_data_e(forward_csr_data_e),
 
       .regw_src_m(regw_src_m),
 
       .rd1_e_fw     (rd1_e_fw),
       .rd2_e_fw     (rd2_e_fw),
+      .rd1_b_e_fw   (rd1_b_e_fw),
+      .rd2_b_e_fw   (rd2_b_e_fw),
+      .rd1_d_fw     (rd1_d_fw),
+      .rd2_d_fw     (rd2_d_fw),
       .rdf1_e_fw    (rdf1_e_fw),
       .rdf2_e_fw    (rdf2_e_fw),
+      .rdf3_e_fw    (rdf3_e_fw),
       .csr_data_e_fw(csr_data_e_fw)
   );
 
@@ -718,9 +1602,28 @@ module pipelined_cpu (
       .lt    (alu_lt_e)
   );
 
+  wire [31:0] alu_result_b_e;
+
+  cpu_alu alu_b (
+      .src_a  (rd1_b_e_fw),
+      .src_b  (alu_src_b_b_e == `ALU_SRC_B_IMM ? imm_ext_b_e : rd2_b_e_fw),
+      .control(alu_control_b_e),
+
+      .result(alu_result_b_e)
+  );
+
+  // auipc is the only one not taking the ALU's result
+  wire [31:0] result_b_e = result_src_b_e == `RESULT_SRC_PC_TARGET ? pc_step_e + imm_ext_b_e :
+                                                                    alu_result_b_e;
+
+  // FP operations leave the pipeline here and write back on their own, so
+  // they're only issued once float_alu can take them.
+  wire fp_alu_start_e = fp_alu_enable_e && !trap && data_ready;
   wire fp_alu_valid_out_e;
   wire fp_alu_ready_out_e;
   wire [31:0] fp_alu_result_e;
+  wire [4:0] fp_alu_flags_e;
+  wire [4:0] fp_alu_tag_out_e;
 
   float_alu fp_alu (
       .clk  (clk),
@@ -728,16 +1631,58 @@ module pipelined_cpu (
 
       .op_a      (rdf1_e_fw),
       .op_b      (rdf2_e_fw),
-      .op_code   (alu_control_e[2:0]),
+      .op_c      (rdf3_e_fw),
+      .op_code   (alu_control_e),
       .mode_fp   (`FP_SINGLE),
-      .round_mode(funct3_e[0]),
+      // Only truncates or rounds to nearest even, so the other modes do the
+      // latter
+      .round_mode(rm_e == `RM_RTZ),
 
+      .tag_in  (rd_e),
       .start   (fp_alu_start_e),
-      .ready_in(1'b1),
+      .ready_in(!regf_write_w),
 
       .valid_out(fp_alu_valid_out_e),
       .ready_out(fp_alu_ready_out_e),
-      .result   (fp_alu_result_e)
+      .result   (fp_alu_result_e),
+      .flags    (fp_alu_flags_e),
+      .tag_out  (fp_alu_tag_out_e)
+  );
+
+  // The rest of the F extension takes a single cycle, and goes down the
+  // pipeline like an ALU result
+  wire [31:0] fp_misc_result_e;
+  wire [ 4:0] fp_misc_flags_e;
+
+  fp_misc fp_misc_unit (
+      .op        (alu_control_e),
+      .op_a      (rdf1_e_fw),
+      .op_b      (rdf2_e_fw),
+      .int_a     (rd1_e_fw),
+      .round_mode(rm_e),
+
+      .result(fp_misc_result_e),
+      .flags (fp_misc_flags_e)
+  );
+
+  // While Memory waits on the dcache the divider holds off sampling its
+  // operands, but a division that is already running carries on, rather than
+  // starting over after the miss.
+  wire        md_done_e;
+  wire [31:0] md_result_e;
+
+  cpu_muldiv muldiv (
+      .clk  (clk),
+      .rst_n(rst_n),
+
+      .src_a  (rd1_e_fw),
+      .src_b  (rd2_e_fw),
+      .control(funct3_e),
+      .start  (md_enable_e && !trap),
+      .stall  (!data_ready),
+
+      .done  (md_done_e),
+      .result(md_result_e)
   );
 
   wire [1:0] pc_src_e;
@@ -752,6 +1697,41 @@ module pipelined_cpu (
       .pc_src(pc_src_e)
   );
 
+  reg [31:0] pc_actual_e;
+  reg [ 1:0] bp_kind_e;
+
+  // x1/x5 are the link registers, as in the RAS hints of the ISA manual
+  wire link_rd_e = rd_e == 1 || rd_e == 5;
+  wire link_rs1_e = rs1_e == 1 || rs1_e == 5;
+
+  always @(*) begin
+    case (pc_src_e)
+      `PC_SRC_STEP:    pc_actual_e = pc_step_e;
+      `PC_SRC_TARGET:  pc_actual_e = pc_target_e;
+      `PC_SRC_ALU:     pc_actual_e = alu_result_e & ~1;
+      `PC_SRC_CURRENT: pc_actual_e = pc_f;
+      default:         pc_actual_e = {32{1'bx}};
+    endcase
+
+    case (branch_type_e)
+      `BRANCH_COND: bp_kind_e = `BTB_KIND_COND;
+      `BRANCH_JAL:  bp_kind_e = link_rd_e ? `BTB_KIND_CALL : `BTB_KIND_JUMP;
+      `BRANCH_JALR: begin
+        if (rd_e == 0 && link_rs1_e) begin
+          bp_kind_e = `BTB_KIND_RET;
+        end else begin
+          bp_kind_e = link_rd_e ? `BTB_KIND_CALL : `BTB_KIND_JUMP;
+        end
+      end
+      default:      bp_kind_e = `BTB_KIND_JUMP;
+    endcase
+  end
+
+  wire mispredict_e = !bubble_e && (pc_src_e == `PC_SRC_CURRENT || pc_actual_e != pc_pred_e);
+  wire bp_update_e = !bubble_e && !stall_e && !trap &&
+                     (branch_type_e == `BRANCH_COND || branch_type_e == `BRANCH_JAL ||
+                      branch_type_e == `BRANCH_JALR);
+
 
   // 4. Memory
   reg        bubble_m;
@@ -759,6 +1739,8 @@ module pipelined_cpu (
   reg        reg_write_m;
   reg        regf_write_m;
   reg        csr_write_m;
+  reg        mret_m;
+  reg        bank_m;
   reg [ 2:0] result_src_m;
   reg [ 3:0] mem_write_m;
   reg [ 2:0] data_ext_control_m;
@@ -769,10 +1751,16 @@ module pipelined_cpu (
 
   reg [31:0] csr_data_m;
   reg [31:0] alu_result_m;
-  reg [31:0] fp_alu_result_m;
+  reg [31:0] md_result_m;
+  reg [31:0] fp_misc_result_m;
+  reg [ 4:0] fp_flags_m;
   reg [ 4:0] rd_m;
   reg [31:0] pc_target_m;
-  reg [31:0] pc_plus_4_m;
+  reg [31:0] pc_step_m;
+
+  // Only observed by the simulation harness' commit trace
+  reg [31:0] pc_m;
+  reg [31:0] instr_m;
 
   always @(posedge clk) begin
     if (!rst_n || flush_m) begin
@@ -781,6 +1769,8 @@ module pipelined_cpu (
       reg_write_m        <= 0;
       regf_write_m       <= 0;
       csr_write_m        <= 0;
+      mret_m             <= 0;
+      bank_m             <= 0;
       result_src_m       <= `RESULT_SRC_ALU;
       mem_write_m        <= 4'b0000;
       data_ext_control_m <= 4'b0000;
@@ -791,16 +1781,22 @@ module pipelined_cpu (
 
       csr_data_m         <= 32'b0;
       alu_result_m       <= 32'b0;
-      fp_alu_result_m    <= 32'b0;
+      md_result_m        <= 32'b0;
+      fp_misc_result_m   <= 32'b0;
+      fp_flags_m         <= 5'b0;
       rd_m               <= 5'b0;
       pc_target_m        <= {32{1'bx}};
-      pc_plus_4_m        <= {32{1'bx}};
-    end else begin
+      pc_step_m          <= {32{1'bx}};
+      pc_m               <= {32{1'bx}};
+      instr_m            <= 32'h00000013;  // nop
+    end else if (!stall_m) begin
       bubble_m           <= bubble_e;
       regw_src_m         <= regw_src_e;
       reg_write_m        <= reg_write_e;
-      regf_write_m       <= regf_write_e;
+      regf_write_m       <= regf_write_e && !fp_alu_enable_e;
       csr_write_m        <= csr_write_e;
+      mret_m             <= mret_e;
+      bank_m             <= bank_e;
       result_src_m       <= result_src_e;
       mem_write_m        <= mem_write_e;
       data_ext_control_m <= data_ext_control_e;
@@ -811,10 +1807,36 @@ module pipelined_cpu (
 
       csr_data_m         <= csr_data_e_fw;
       alu_result_m       <= alu_result_e;
-      fp_alu_result_m    <= fp_alu_result_e;
+      md_result_m        <= md_result_e;
+      fp_misc_result_m   <= fp_misc_result_e;
+      fp_flags_m         <= result_src_e == `RESULT_SRC_FP_MISC ? fp_misc_flags_e : 5'b0;
       rd_m               <= rd_e;
       pc_target_m        <= pc_target_e;
-      pc_plus_4_m        <= pc_plus_4_e;
+      pc_step_m          <= pc_step_e;
+      pc_m               <= pc_e;
+      instr_m            <= instr_e;
+    end
+  end
+
+  reg        bubble_b_m;
+  reg        reg_write_b_m;
+  reg [ 4:0] rd_b_m;
+  reg [31:0] result_b_m;
+  reg [31:0] instr_b_m;
+
+  always @(posedge clk) begin
+    if (!rst_n || flush_m) begin
+      bubble_b_m    <= 1;
+      reg_write_b_m <= 0;
+      rd_b_m        <= 5'b0;
+      result_b_m    <= 32'b0;
+      instr_b_m     <= 32'h00000013;  // nop
+    end else if (!stall_m) begin
+      bubble_b_m    <= bubble_b_e;
+      reg_write_b_m <= reg_write_b_e;
+      rd_b_m        <= rd_b_e;
+      result_b_m    <= result_b_e;
+      instr_b_m     <= instr_b_e;
     end
   end
 
@@ -822,6 +1844,7 @@ module pipelined_cpu (
 
   assign data_addr    = alu_result_m;
   assign data_wenable = mem_write_m;
+  assign data_ren     = result_src_m == `RESULT_SRC_DATA;
 
   always @(*) begin
     case (wd_sel_m)
@@ -844,8 +1867,9 @@ module pipelined_cpu (
     case (result_src_m)
       `RESULT_SRC_ALU:       result_pre_m = alu_result_m;
       `RESULT_SRC_PC_TARGET: result_pre_m = pc_target_m;
-      `RESULT_SRC_PC_STEP:   result_pre_m = pc_plus_4_m;
-      `RESULT_SRC_FP_ALU:    result_pre_m = fp_alu_result_m;
+      `RESULT_SRC_PC_STEP:   result_pre_m = pc_step_m;
+      `RESULT_SRC_MULDIV:    result_pre_m = md_result_m;
+      `RESULT_SRC_FP_MISC:   result_pre_m = fp_misc_result_m;
       default:               result_pre_m = {32{1'bx}};
     endcase
   end
@@ -855,6 +1879,8 @@ module pipelined_cpu (
   reg        reg_write_w;
   reg        regf_write_w;
   reg        csr_write_w;
+  reg        mret_w;
+  reg        bank_w;
   reg        regw_src_w;
 
   reg [31:0] result_pre_w;
@@ -863,14 +1889,22 @@ module pipelined_cpu (
   reg [31:0] csr_data_w;
   reg [ 4:0] rd_w;
   reg [11:0] csr_addr_w;
+  // fp_misc's flags, accrued in fflags as it retires
+  reg [ 4:0] fp_flags_w;
+
+  reg [31:0] pc_w;
+  reg [31:0] instr_w;
+  reg [31:0] data_addr_w;
 
   always @(posedge clk) begin
     if (!rst_n) begin
-      bubble_w     <= 0;
+      bubble_w     <= 1;
       result_pre_w <= 0;
       reg_write_w  <= 0;
       regf_write_w <= 0;
       csr_write_w  <= 0;
+      mret_w       <= 0;
+      bank_w       <= 0;
       regw_src_w   <= 0;
 
       result_src_w <= 0;
@@ -878,12 +1912,26 @@ module pipelined_cpu (
       csr_data_w   <= 32'b0;
       rd_w         <= 5'b0;
       csr_addr_w   <= 0;
+      fp_flags_w   <= 0;
+
+      pc_w         <= {32{1'bx}};
+      instr_w      <= 32'h00000013;  // nop
+      data_addr_w  <= 0;
+    end else if (flush_w) begin
+      bubble_w     <= 1;
+      reg_write_w  <= 0;
+      regf_write_w <= 0;
+      csr_write_w  <= 0;
+      mret_w       <= 0;
+      fp_flags_w   <= 0;
     end else begin
       bubble_w     <= bubble_m;
       result_pre_w <= result_pre_m;
       reg_write_w  <= reg_write_m;
       regf_write_w <= regf_write_m;
       csr_write_w  <= csr_write_m;
+      mret_w       <= mret_m;
+      bank_w       <= bank_m;
       regw_src_w   <= regw_src_m;
 
       result_src_w <= result_src_m;
@@ -891,6 +1939,40 @@ module pipelined_cpu (
       csr_data_w   <= csr_data_m;
       rd_w         <= rd_m;
       csr_addr_w   <= csr_addr_m;
+      fp_flags_w   <= fp_flags_m;
+
+      pc_w         <= pc_m;
+      instr_w      <= instr_m;
+      data_addr_w  <= alu_result_m;
+    end
+  end
+
+  reg        bubble_b_w;
+  reg        reg_write_b_w;
+  reg [ 4:0] rd_b_w;
+  reg [31:0] result_b_w;
+  reg [31:0] instr_b_w;
+  // Only observed by the simulation harness' commit trace, like pc_w
+  reg [31:0] pc_b_w;
+
+  always @(posedge clk) begin
+    if (!rst_n) begin
+      bubble_b_w    <= 1;
+      reg_write_b_w <= 0;
+      rd_b_w        <= 5'b0;
+      result_b_w    <= 0;
+      instr_b_w     <= 32'h00000013;  // nop
+      pc_b_w        <= {32{1'bx}};
+    end else if (flush_w) begin
+      bubble_b_w    <= 1;
+      reg_write_b_w <= 0;
+    end else begin
+      bubble_b_w    <= bubble_b_m;
+      reg_write_b_w <= reg_write_b_m;
+      rd_b_w        <= rd_b_m;
+      result_b_w    <= result_b_m;
+      instr_b_w     <= instr_b_m;
+      pc_b_w        <= pc_step_m;
     end
   end
 
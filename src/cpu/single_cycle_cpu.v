@@ -1,13 +1,16 @@
 `default_nettype none
 
 `include "single_cycle_cpu.vh"
+`include "cpu_csr_file.vh"
 `include "cpu_imm_extend.vh"
 `include "cpu_alu.vh"
+`include "float_alu.vh"
 
 module scc_control (
     input wire [6:0] op,
     input wire [2:0] funct3,
     input wire [6:0] funct7,
+    input wire [4:0] rs2,
 
     output reg [2:0] branch_type,
     output reg [2:0] result_src,
@@ -24,6 +27,8 @@ module scc_control (
     output reg trap_mret,
     output reg wd_sel,
     output reg fp_alu_enable,
+    output reg fp_fused,
+    output reg md_enable,
     output reg matmul_enable
 );
   always @(*) begin
@@ -41,6 +46,8 @@ module scc_control (
     trap_mret = 0;
     wd_sel = 1'bx;
     fp_alu_enable = 0;
+    fp_fused = 0;
+    md_enable = 0;
     matmul_enable = 0;
 
     data_ext_control = funct3;
@@ -80,10 +87,16 @@ module scc_control (
         endcase
       end
       7'b0110011: begin  // alu (registers)
-        alu_src_b   = `ALU_SRC_B_RD2;
-        alu_control = {funct7[5], funct3};
-        result_src  = `RESULT_SRC_ALU;
-        reg_write   = 1;
+        if (funct7 == 7'b0000001) begin  // mul/div
+          md_enable  = 1;
+          result_src = `RESULT_SRC_MULDIV;
+          reg_write  = 1;
+        end else begin
+          alu_src_b   = `ALU_SRC_B_RD2;
+          alu_control = {funct7[5], funct3};
+          result_src  = `RESULT_SRC_ALU;
+          reg_write   = 1;
+        end
       end
       7'b0110111: begin  // lui
         imm_src = `IMM_SRC_U;
@@ -139,38 +152,115 @@ module scc_control (
           csr_write  = 1;
         end
       end
-      7'b1010011: begin  // some float instructions
+      7'b1010011: begin  // float instructions other than fused ones
         casez (funct7)
           7'b00000zz: begin  // fadd
             fp_alu_enable = 1;
-            alu_control = {1'bx, `OP_ADD};
+            alu_control   = `OP_ADD;
             result_src    = `RESULT_SRC_FP_ALU;
             regf_write    = 1;
           end
           7'b00001zz: begin  // fsub
             fp_alu_enable = 1;
-            alu_control = {1'bx, `OP_SUB };
+            alu_control   = `OP_SUB;
             result_src    = `RESULT_SRC_FP_ALU;
             regf_write    = 1;
           end
           7'b00010zz: begin  // fmul
             fp_alu_enable = 1;
-            alu_control = {1'bx, `OP_MUL};
+            alu_control   = `OP_MUL;
             result_src    = `RESULT_SRC_FP_ALU;
             regf_write    = 1;
           end
           7'b00011zz: begin  // fdiv
             fp_alu_enable = 1;
-            alu_control = {1'bx, `OP_DIV};
+            alu_control   = `OP_DIV;
+            result_src    = `RESULT_SRC_FP_ALU;
+            regf_write    = 1;
+          end
+          7'b0101100: begin  // fsqrt
+            fp_alu_enable = 1;
+            alu_control   = `OP_SQRT;
             result_src    = `RESULT_SRC_FP_ALU;
             regf_write    = 1;
           end
-          7'b1110000: begin  // fmv.x.w
+          // The rest go through fp_misc in Execute, taking rs1 from the
+          // float registers unless it's an integer to convert
+          7'b0010000: begin  // fsgnj, fsgnjn, fsgnjx
+            alu_src_a  = `ALU_SRC_A_RDF1;
+            result_src = `RESULT_SRC_FP_MISC;
+            regf_write = 1;
+
+            case (funct3)
+              3'b000:  alu_control = `FP_MISC_SGNJ;
+              3'b001:  alu_control = `FP_MISC_SGNJN;
+              3'b010:  alu_control = `FP_MISC_SGNJX;
+              default: begin
+                branch_type = `BRANCH_BREAK;
+                regf_write  = 0;
+              end
+            endcase
+          end
+          7'b0010100: begin  // fmin, fmax
+            alu_src_a  = `ALU_SRC_A_RDF1;
+            result_src = `RESULT_SRC_FP_MISC;
+            regf_write = 1;
+
+            case (funct3)
+              3'b000:  alu_control = `FP_MISC_MIN;
+              3'b001:  alu_control = `FP_MISC_MAX;
+              default: begin
+                branch_type = `BRANCH_BREAK;
+                regf_write  = 0;
+              end
+            endcase
+          end
+          7'b1010000: begin  // fle, flt, feq
+            alu_src_a  = `ALU_SRC_A_RDF1;
+            result_src = `RESULT_SRC_FP_MISC;
+            reg_write  = 1;
+
+            case (funct3)
+              3'b000:  alu_control = `FP_MISC_LE;
+              3'b001:  alu_control = `FP_MISC_LT;
+              3'b010:  alu_control = `FP_MISC_EQ;
+              default: begin
+                branch_type = `BRANCH_BREAK;
+                reg_write   = 0;
+              end
+            endcase
+          end
+          7'b1100000: begin  // fcvt.w.s, fcvt.wu.s
             alu_src_a   = `ALU_SRC_A_RDF1;
-            alu_control = `ALU_PASS_A;
-            result_src  = `RESULT_SRC_ALU;
+            alu_control = rs2[0] ? `FP_MISC_CVT_WU : `FP_MISC_CVT_W;
+            result_src  = `RESULT_SRC_FP_MISC;
             reg_write   = 1;
           end
+          7'b1101000: begin  // fcvt.s.w, fcvt.s.wu
+            alu_src_a   = `ALU_SRC_A_RD1;
+            alu_control = rs2[0] ? `FP_MISC_CVT_S_WU : `FP_MISC_CVT_S_W;
+            result_src  = `RESULT_SRC_FP_MISC;
+            regf_write  = 1;
+          end
+          7'b1110000: begin
+            alu_src_a = `ALU_SRC_A_RDF1;
+            reg_write = 1;
+
+            case (funct3)
+              3'b000: begin  // fmv.x.w
+                alu_control = `ALU_PASS_A;
+                result_src  = `RESULT_SRC_ALU;
+              end
+              3'b001: begin  // fclass
+                alu_control = `FP_MISC_CLASS;
+                result_src  = `RESULT_SRC_FP_MISC;
+              end
+              default: begin
+                branch_type = `BRANCH_BREAK;
+                reg_write   = 0;
+              end
+            endcase
+          end
           7'b1111000: begin  // fmv.w.x
             alu_src_a   = `ALU_SRC_A_RD1;
             alu_control = `ALU_PASS_A;
@@ -182,6 +272,34 @@ module scc_control (
           end
         endcase
       end
+      7'b1000011: begin  // fmadd.s
+        fp_alu_enable = 1;
+        fp_fused      = 1;
+        alu_control   = `OP_FMADD;
+        result_src    = `RESULT_SRC_FP_ALU;
+        regf_write    = 1;
+      end
+      7'b1000111: begin  // fmsub.s
+        fp_alu_enable = 1;
+        fp_fused      = 1;
+        alu_control   = `OP_FMSUB;
+        result_src    = `RESULT_SRC_FP_ALU;
+        regf_write    = 1;
+      end
+      7'b1001011: begin  // fnmsub.s
+        fp_alu_enable = 1;
+        fp_fused      = 1;
+        alu_control   = `OP_FNMSUB;
+        result_src    = `RESULT_SRC_FP_ALU;
+        regf_write    = 1;
+      end
+      7'b1001111: begin  // fnmadd.s
+        fp_alu_enable = 1;
+        fp_fused      = 1;
+        alu_control   = `OP_FNMADD;
+        result_src    = `RESULT_SRC_FP_ALU;
+        regf_write    = 1;
+      end
       7'b0000111: begin  // flw
         imm_src     = `IMM_SRC_I;
         alu_src_b   = `ALU_SRC_B_IMM;
@@ -264,6 +382,7 @@ module single_cycle_cpu (
   wire        regw_src;
   wire        reg_write;
   wire        csr_write;
+  wire        md_enable;
   wire        alu_zero;
   wire        alu_borrow;
   wire        alu_lt;
@@ -277,6 +396,7 @@ module single_cycle_cpu (
       .op    (op),
       .funct3(funct3),
       .funct7(funct7),
+      .rs2   (instr_data[24:20]),
 
       .branch_type     (branch_type),
       .result_src      (result_src),
@@ -288,7 +408,8 @@ module single_cycle_cpu (
       .imm_src         (imm_src),
       .regw_src        (regw_src),
       .reg_write       (reg_write),
-      .csr_write       (csr_write)
+      .csr_write       (csr_write),
+      .md_enable       (md_enable)
   );
 
   scc_branch_logic branch_logic (
@@ -314,6 +435,24 @@ module single_cycle_cpu (
   wire [31:0] rd1, rd2;
   wire [31:0] pc_plus_4 = pc + 4;
 
+  wire [31:0] md_result;
+
+  cpu_muldiv #(
+      .ITERATIVE_DIV(0)
+  ) muldiv (
+      .clk  (clk),
+      .rst_n(rst_n),
+
+      .src_a  (rd1),
+      .src_b  (rd2),
+      .control(funct3),
+      .start  (md_enable),
+      .stall  (1'b0),
+
+      .done  (),
+      .result(md_result)
+  );
+
   wire [31:0] data_ext;
 
   cpu_data_extend data_extend (
@@ -330,6 +469,7 @@ module single_cycle_cpu (
       `RESULT_SRC_DATA:      result = data_ext;
       `RESULT_SRC_PC_TARGET: result = pc_target;
       `RESULT_SRC_PC_STEP:   result = pc_plus_4;
+      `RESULT_SRC_MULDIV:    result = md_result;
       default:               result = {32{1'bx}};
     endcase
   end
@@ -355,7 +495,28 @@ module single_cycle_cpu (
 
       .waddr  (instr_data[31:20]),
       .wdata  (result),
-      .wenable(csr_write)
+      .wenable(csr_write),
+
+      .bubble_w  (1'b0),
+      .bubble_b_w(1'b1),
+      .events    ({`HPM_EVENTS{1'b0}}),
+
+      // No interrupts or traps on this core
+      .irq        ({`IRQ_LOCAL_LINES{1'b0}}),
+      .timer_irq  (1'b0),
+      .irq_pending(),
+      .irq_cause  (),
+      .trap_vector(),
+      .irq_wake   (),
+
+      .trap      (1'b0),
+      .trap_epc  (32'b0),
+      .trap_cause(5'b0),
+      .mret      (1'b0),
+
+      // Nor float registers, so no FP unit raises flags
+      .fp_flags(5'b0),
+      .frm     ()
   );
 
   wire [4:0] a1 = instr_data[19:15];
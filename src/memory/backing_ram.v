@@ -0,0 +1,77 @@
+`default_nettype none
+
+// Simulation model of a slow main memory behind the caches. Each port serves
+// one whole line per request: req is held until ready pulses, LATENCY cycles
+// after the request was made. Port 1 reads and writes, port 2 only reads.
+//
+// Contents are loaded from the same word-per-line .mem file as dual_word_ram.
+module backing_ram #(
+    parameter SIZE_WORDS  = 2 ** 16,
+    parameter SOURCE_FILE = "",
+    parameter WORD_BITS   = 2,
+    parameter LATENCY     = 8,
+    parameter ADDR_WIDTH  = $clog2(4 * SIZE_WORDS)
+) (
+    input wire clk,
+    input wire rst_n,
+
+    input  wire                                 req_1,
+    input  wire                                 we_1,
+    input  wire [                         31:0] addr_1,
+    input  wire [(32 * (2 ** WORD_BITS)) - 1:0] wdata_1,
+    output wire                                 ready_1,
+    output reg  [(32 * (2 ** WORD_BITS)) - 1:0] rdata_1,
+
+    input  wire                                 req_2,
+    input  wire [                         31:0] addr_2,
+    output wire                                 ready_2,
+    output reg  [(32 * (2 ** WORD_BITS)) - 1:0] rdata_2
+);
+  localparam LINE_WORDS = 2 ** WORD_BITS;
+
+  reg [31:0] data[0:SIZE_WORDS-1];
+
+  wire [ADDR_WIDTH-3:0] line_addr_1 = {addr_1[ADDR_WIDTH-1:WORD_BITS+2], {WORD_BITS{1'b0}}};
+  wire [ADDR_WIDTH-3:0] line_addr_2 = {addr_2[ADDR_WIDTH-1:WORD_BITS+2], {WORD_BITS{1'b0}}};
+
+  reg [$clog2(LATENCY+1):0] count_1, count_2;
+
+  assign ready_1 = req_1 && count_1 == LATENCY - 1;
+  assign ready_2 = req_2 && count_2 == LATENCY - 1;
+
+  integer i, j;
+
+  always @(*) begin
+    for (i = 0; i < LINE_WORDS; i = i + 1) begin
+      rdata_1[32*i+:32] = data[line_addr_1+i];
+      rdata_2[32*i+:32] = data[line_addr_2+i];
+    end
+  end
+
+  always @(posedge clk) begin
+    if (!rst_n) begin
+      count_1 <= 0;
+      count_2 <= 0;
+    end else begin
+      count_1 <= req_1 && !ready_1 ? count_1 + 1 : 0;
+      count_2 <= req_2 && !ready_2 ? count_2 + 1 : 0;
+
+      if (ready_1 && we_1) begin
+        for (j = 0; j < LINE_WORDS; j = j + 1) begin
+          data[line_addr_1+j] <= wdata_1[32*j+:32];
+        end
+      end
+    end
+  end
+
+  // +firmware=<file> on the command line takes precedence over SOURCE_FILE
+  reg [8*256-1:0] source_plusarg;
+
+  initial begin
+    if ($value$plusargs("firmware=%s", source_plusarg)) begin
+      $readmemh(source_plusarg, data);
+    end else if (SOURCE_FILE != "") begin
+      $readmemh(SOURCE_FILE, data);
+    end
+  end
+endmodule
@@ -0,0 +1,182 @@
+`default_nettype none
+
+// Write-back, write-allocate cache for the data port. Hits are combinational
+// like dual_word_ram, with stores written on the clock edge. On a miss, ready
+// drops while a dirty victim is written back and the line is fetched.
+//
+// The CPU side follows dual_word_ram: wdata/wenable are aligned to the low
+// bytes and placed at the address offset, and rdata is shifted down by it.
+module dcache #(
+    parameter SET_BITS  = 6,
+    parameter WORD_BITS = 2,
+    parameter WAYS      = 1
+) (
+    input wire clk,
+    input wire rst_n,
+
+    input  wire        ren,
+    input  wire [31:0] addr,
+    input  wire [31:0] wdata,
+    input  wire [ 3:0] wenable,
+    output wire [31:0] rdata,
+    output wire        ready,
+
+    output wire                                 mem_req,
+    output wire                                 mem_we,
+    output wire [                         31:0] mem_addr,
+    output wire [(32 * (2 ** WORD_BITS)) - 1:0] mem_wdata,
+    input  wire                                 mem_ready,
+    input  wire [(32 * (2 ** WORD_BITS)) - 1:0] mem_rdata,
+
+    output reg [31:0] hits,
+    output reg [31:0] misses,
+    output reg [31:0] refill_cycles
+);
+  localparam SETS = 2 ** SET_BITS;
+  localparam LINE_WORDS = 2 ** WORD_BITS;
+  localparam LINE_BITS = 32 * LINE_WORDS;
+  localparam OFFSET_BITS = WORD_BITS + 2;
+  localparam TAG_BITS = 32 - SET_BITS - OFFSET_BITS;
+  localparam WAY_BITS = WAYS > 1 ? $clog2(WAYS) : 1;
+
+  localparam S_IDLE = 2'd0;
+  localparam S_WRITEBACK = 2'd1;
+  localparam S_REFILL = 2'd2;
+
+  reg [LINE_BITS-1:0] lines[0:SETS*WAYS-1];
+  reg [TAG_BITS-1:0] tags[0:SETS*WAYS-1];
+  reg valid[0:SETS*WAYS-1];
+  reg dirty[0:SETS*WAYS-1];
+  reg [WAY_BITS-1:0] next_victim[0:SETS-1];
+
+  wire req = ren || |wenable;
+
+  wire [TAG_BITS-1:0] tag = addr[31:SET_BITS+OFFSET_BITS];
+  wire [SET_BITS-1:0] set = addr[SET_BITS+OFFSET_BITS-1:OFFSET_BITS];
+  wire [WORD_BITS-1:0] word = addr[OFFSET_BITS-1:2];
+  wire [1:0] offset = addr[1:0];
+
+  reg hit;
+  reg [WAY_BITS-1:0] hit_way, victim_way;
+  reg has_invalid;
+  integer w;
+
+  always @(*) begin
+    hit = 0;
+    hit_way = 0;
+    has_invalid = 0;
+    victim_way = next_victim[set];
+
+    for (w = WAYS - 1; w >= 0; w = w - 1) begin
+      if (valid[set*WAYS+w] && tags[set*WAYS+w] == tag) begin
+        hit = 1;
+        hit_way = w;
+      end
+
+      if (!valid[set*WAYS+w]) begin
+        has_invalid = 1;
+        victim_way  = w;
+      end
+    end
+  end
+
+  wire [LINE_BITS-1:0] hit_line = lines[set*WAYS+hit_way];
+  wire [31:0] hit_word = hit_line[32*word+:32];
+
+  assign rdata = hit_word >> (8 * offset);
+  assign ready = !req || (hit && state == S_IDLE);
+
+  reg [31:0] wvalue;
+
+  always @(*) begin
+    wvalue = hit_word;
+
+    if (wenable[0]) wvalue[7+(8*offset)-:8] = wdata[7:0];
+    if (wenable[1]) wvalue[15+(8*offset)-:8] = wdata[15:8];
+    if (wenable[2]) wvalue[23+(8*offset)-:8] = wdata[23:16];
+    if (wenable[3]) wvalue[31+(8*offset)-:8] = wdata[31:24];
+  end
+
+  reg [1:0] state;
+  reg [TAG_BITS-1:0] miss_tag;
+  reg [SET_BITS-1:0] miss_set;
+  reg [WAY_BITS-1:0] miss_way;
+
+  wire [SET_BITS+WAY_BITS-1:0] miss_idx = miss_set * WAYS + miss_way;
+
+  assign mem_req   = state != S_IDLE;
+  assign mem_we    = state == S_WRITEBACK;
+  assign mem_addr  = {state == S_WRITEBACK ? tags[miss_idx] : miss_tag, miss_set,
+                      {OFFSET_BITS{1'b0}}};
+  assign mem_wdata = lines[miss_idx];
+
+  // The access that missed is retried once the line is in, which isn't a hit
+  reg retry;
+  integer i;
+
+  always @(posedge clk) begin
+    if (!rst_n) begin
+      state         <= S_IDLE;
+      retry         <= 0;
+      hits          <= 0;
+      misses        <= 0;
+      refill_cycles <= 0;
+
+      for (i = 0; i < SETS * WAYS; i = i + 1) begin
+        valid[i] <= 0;
+        dirty[i] <= 0;
+      end
+
+      for (i = 0; i < SETS; i = i + 1) next_victim[i] <= 0;
+    end else begin
+      case (state)
+        S_IDLE: begin
+          if (req && hit) begin
+            if (!retry) hits <= hits + 1;
+            retry <= 0;
+
+            if (|wenable) begin
+              lines[set*WAYS+hit_way][32*word+:32] <= wvalue;
+              dirty[set*WAYS+hit_way] <= 1;
+            end
+          end else if (req) begin
+            miss_tag <= tag;
+            miss_set <= set;
+            miss_way <= victim_way;
+            misses   <= misses + 1;
+
+            if (!has_invalid) begin
+              next_victim[set] <= victim_way == WAYS - 1 ? 0 : victim_way + 1;
+            end
+
+            if (valid[set*WAYS+victim_way] && dirty[set*WAYS+victim_way]) begin
+              state <= S_WRITEBACK;
+            end else begin
+              state <= S_REFILL;
+            end
+          end
+        end
+        S_WRITEBACK: begin
+          refill_cycles <= refill_cycles + 1;
+
+          if (mem_ready) begin
+            dirty[miss_idx] <= 0;
+            state           <= S_REFILL;
+          end
+        end
+        S_REFILL: begin
+          refill_cycles <= refill_cycles + 1;
+
+          if (mem_ready) begin
+            lines[miss_idx] <= mem_rdata;
+            tags[miss_idx]  <= miss_tag;
+            valid[miss_idx] <= 1;
+            retry           <= 1;
+            state           <= S_IDLE;
+          end
+        end
+        default: state <= S_IDLE;
+      endcase
+    end
+  end
+endmodule
@@ -13,7 +13,9 @@ module dual_word_ram #(
     output wire [          31:0] rdata_1,
 
     input  wire [ADDR_WIDTH-1:0] addr_2,
-    output wire [          31:0] rdata_2
+    output wire [          31:0] rdata_2,
+    // The word after addr_2's, so that two instructions can be fetched at once
+    output wire [          31:0] rdata_2_next
 );
   reg [31:0] data[0:SIZE_WORDS-1];
 
@@ -22,6 +24,7 @@ module dual_word_ram #(
 
   wire [29:0] word_addr_2 = addr_2[ADDR_WIDTH-1:2];
   wire [1:0] offset_2 = addr_2[1:0];
+  wire [29:0] word_addr_2_next = word_addr_2 == SIZE_WORDS - 1 ? 0 : word_addr_2 + 1;
 
   reg [31:0] wvalue;
 
@@ -40,9 +43,15 @@ module dual_word_ram #(
 
   assign rdata_1 = data[word_addr_1] >> (8 * offset_1);
   assign rdata_2 = data[word_addr_2] >> (8 * offset_2);
+  assign rdata_2_next = data[word_addr_2_next];
+
+  // +firmware=<file> on the command line takes precedence over SOURCE_FILE
+  reg [8*256-1:0] source_plusarg;
 
   initial begin
-    if (SOURCE_FILE != "") begin
+    if ($value$plusargs("firmware=%s", source_plusarg)) begin
+      $readmemh(source_plusarg, data);
+    end else if (SOURCE_FILE != "") begin
       $readmemh(SOURCE_FILE, data);
     end
   end
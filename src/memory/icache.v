@@ -0,0 +1,137 @@
+`default_nettype none
+
+// Read-only cache for the instruction port. Lookups are combinational, so hits
+// are served in the same cycle just like dual_word_ram. On a miss, ready drops
+// until the line has been fetched from memory.
+//
+// WAYS = 1 is direct-mapped. With more ways, invalid ways are filled first and
+// then replaced round-robin within each set.
+module icache #(
+    parameter SET_BITS  = 6,
+    parameter WORD_BITS = 2,
+    parameter WAYS      = 1
+) (
+    input wire clk,
+    input wire rst_n,
+
+    input  wire        req,
+    input  wire [31:0] addr,
+    output wire [31:0] rdata,
+    output wire        ready,
+
+    output wire                                 mem_req,
+    output wire [                         31:0] mem_addr,
+    input  wire                                 mem_ready,
+    input  wire [(32 * (2 ** WORD_BITS)) - 1:0] mem_rdata,
+
+    output reg [31:0] hits,
+    output reg [31:0] misses,
+    output reg [31:0] refill_cycles
+);
+  localparam SETS = 2 ** SET_BITS;
+  localparam LINE_WORDS = 2 ** WORD_BITS;
+  localparam LINE_BITS = 32 * LINE_WORDS;
+  localparam OFFSET_BITS = WORD_BITS + 2;
+  localparam TAG_BITS = 32 - SET_BITS - OFFSET_BITS;
+  localparam WAY_BITS = WAYS > 1 ? $clog2(WAYS) : 1;
+
+  localparam S_IDLE = 1'd0;
+  localparam S_REFILL = 1'd1;
+
+  reg [LINE_BITS-1:0] lines[0:SETS*WAYS-1];
+  reg [TAG_BITS-1:0] tags[0:SETS*WAYS-1];
+  reg valid[0:SETS*WAYS-1];
+  reg [WAY_BITS-1:0] next_victim[0:SETS-1];
+
+  wire [TAG_BITS-1:0] tag = addr[31:SET_BITS+OFFSET_BITS];
+  wire [SET_BITS-1:0] set = addr[SET_BITS+OFFSET_BITS-1:OFFSET_BITS];
+  wire [WORD_BITS-1:0] word = addr[OFFSET_BITS-1:2];
+  wire [1:0] offset = addr[1:0];
+
+  reg hit;
+  reg [WAY_BITS-1:0] hit_way, victim_way;
+  reg has_invalid;
+  integer w;
+
+  always @(*) begin
+    hit = 0;
+    hit_way = 0;
+    has_invalid = 0;
+    victim_way = next_victim[set];
+
+    for (w = WAYS - 1; w >= 0; w = w - 1) begin
+      if (valid[set*WAYS+w] && tags[set*WAYS+w] == tag) begin
+        hit = 1;
+        hit_way = w;
+      end
+
+      if (!valid[set*WAYS+w]) begin
+        has_invalid = 1;
+        victim_way  = w;
+      end
+    end
+  end
+
+  wire [LINE_BITS-1:0] hit_line = lines[set*WAYS+hit_way];
+  wire [31:0] hit_word = hit_line[32*word+:32];
+
+  assign rdata = hit_word >> (8 * offset);
+  assign ready = !req || hit;
+
+  reg state;
+  reg [TAG_BITS-1:0] miss_tag;
+  reg [SET_BITS-1:0] miss_set;
+  reg [WAY_BITS-1:0] miss_way;
+
+  assign mem_req  = state == S_REFILL;
+  assign mem_addr = {miss_tag, miss_set, {OFFSET_BITS{1'b0}}};
+
+  reg [31:0] last_addr;
+  integer i;
+
+  always @(posedge clk) begin
+    if (!rst_n) begin
+      state         <= S_IDLE;
+      hits          <= 0;
+      misses        <= 0;
+      refill_cycles <= 0;
+      last_addr     <= {32{1'b1}};
+
+      for (i = 0; i < SETS * WAYS; i = i + 1) valid[i] <= 0;
+      for (i = 0; i < SETS; i = i + 1) next_victim[i] <= 0;
+    end else begin
+      // Fetch repeats the same address while the pipeline is stalled, which
+      // shouldn't count as more hits
+      if (req && hit && addr != last_addr) hits <= hits + 1;
+      if (req && hit) last_addr <= addr;
+
+      case (state)
+        S_IDLE: begin
+          if (req && !hit) begin
+            miss_tag  <= tag;
+            miss_set  <= set;
+            miss_way  <= victim_way;
+            misses    <= misses + 1;
+            last_addr <= addr;
+            state     <= S_REFILL;
+
+            if (!has_invalid) begin
+              next_victim[set] <= victim_way == WAYS - 1 ? 0 : victim_way + 1;
+            end
+          end
+        end
+        S_REFILL: begin
+          refill_cycles <= refill_cycles + 1;
+
+          if (mem_ready) begin
+            lines[miss_set*WAYS+miss_way] <= mem_rdata;
+            tags[miss_set*WAYS+miss_way]  <= miss_tag;
+            valid[miss_set*WAYS+miss_way] <= 1;
+            state                         <= S_IDLE;
+          end
+        end
+        default: state <= S_IDLE;
+      endcase
+    end
+  end
+endmodule
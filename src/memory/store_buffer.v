@@ -0,0 +1,91 @@
+`default_nettype none
+
+// FIFO of stores in front of the data cache, so that a store is done as soon
+// as it is queued instead of waiting for the cache, which can take a whole
+// line refill on a miss. Queued stores are written to the cache in order
+// whenever the port is free.
+//
+// A load is sent to the cache ahead of the queued stores, unless it touches a
+// word one of them writes, in which case it waits until the queue has been
+// written back up to that store. A store that started going into the cache
+// keeps the port until it's done. Both sides follow dcache's interface.
+module store_buffer #(
+    parameter ENTRY_BITS = 2
+) (
+    input wire clk,
+    input wire rst_n,
+
+    input  wire        ren,
+    input  wire [31:0] addr,
+    input  wire [31:0] wdata,
+    input  wire [ 3:0] wenable,
+    output wire [31:0] rdata,
+    output wire        ready,
+
+    output wire        mem_ren,
+    output wire [31:0] mem_addr,
+    output wire [31:0] mem_wdata,
+    output wire [ 3:0] mem_wenable,
+    input  wire [31:0] mem_rdata,
+    input  wire        mem_ready
+);
+  localparam ENTRIES = 2 ** ENTRY_BITS;
+
+  reg [31:0] addrs[0:ENTRIES-1];
+  reg [31:0] wdatas[0:ENTRIES-1];
+  reg [3:0] wenables[0:ENTRIES-1];
+
+  reg [ENTRY_BITS-1:0] head, tail;
+  reg [ENTRY_BITS:0] count;
+
+  wire empty = count == 0;
+  wire full = count == ENTRIES;
+
+  // Whether a queued store writes the word the load reads
+  reg load_conflict;
+  integer i;
+
+  always @(*) begin
+    load_conflict = 0;
+
+    for (i = 0; i < ENTRIES; i = i + 1) begin
+      if (i < count && addrs[(head+i)%ENTRIES][31:2] == addr[31:2]) load_conflict = 1;
+    end
+  end
+
+  // The oldest store is being written to the cache
+  reg  draining;
+  wire drain = !empty && (!ren || load_conflict || draining);
+
+  wire push = |wenable && !full;
+  wire pop = drain && mem_ready;
+
+  assign mem_ren     = ren && !drain;
+  assign mem_addr    = drain ? addrs[head] : addr;
+  assign mem_wdata   = wdatas[head];
+  assign mem_wenable = drain ? wenables[head] : 4'b0000;
+
+  assign rdata = mem_rdata;
+  assign ready = |wenable ? !full : !ren || (!drain && mem_ready);
+
+  always @(posedge clk) begin
+    if (!rst_n) begin
+      head     <= 0;
+      tail     <= 0;
+      count    <= 0;
+      draining <= 0;
+    end else begin
+      if (push) begin
+        addrs[tail]    <= addr;
+        wdatas[tail]   <= wdata;
+        wenables[tail] <= wenable;
+        tail           <= tail + 1;
+      end
+
+      if (pop) head <= head + 1;
+
+      count    <= count + push - pop;
+      draining <= drain && !mem_ready;
+    end
+  end
+endmodule
@@ -1,59 +1,261 @@
 `default_nettype none
 
+`include "cpu_muldiv.vh"
+
+// Four channels (two square, sawtooth and cosine) mixed into a PWM duty cycle.
+// Besides setting a channel's period directly, firmware can point it at an
+// array of {period, duration} words in RAM, which the sequencer walks through
+// on its own, one step per tick.
+//
+// Each channel takes 32 bytes, followed by the global registers at 0x80:
+//
+// | Offset | Register | Description                                        |
+// | 0x00   | PERIOD   | Wave period in cycles, 0 = silent                  |
+// | 0x04   | VOLUME   | 0 to PWM_MAX                                       |
+// | 0x08   | SEQ      | Address of the sequence                            |
+// | 0x0C   | SEQ_LEN  | Sequence length                                    |
+// | 0x10   | CTRL     | Write {stop, pause, loop, start}, read {pause,     |
+// |        |          | loop, playing}                                     |
+// | 0x14   | POSITION | Index of the next step                             |
+// | 0x18   | TIMER    | Ticks left in the current step                     |
+// | 0x80   | TICK     | Cycles per tick                                    |
+//
+// Starting a channel fetches its first step on the next tick. A paused channel
+// is silent and doesn't advance.
 module audio_unit #(
     parameter PWM_WIDTH = 8,
     parameter WAVE_DATA_SIZE = 256,
-    parameter WAVE_DATA_SOURCE = "/home/jdgt/Code/utec/arqui/riscv-cpu/data/cosine.mem"
+    parameter WAVE_DATA_SOURCE = "/home/jdgt/Code/utec/arqui/riscv-cpu/data/cosine.mem",
+    // One frame of video_unit, as firmware used to tick sequences on v_sync
+    parameter TICK_CYCLES = 1040 * 666
 ) (
     input wire clk,
     input wire rst_n,
 
-    input wire [1:0] channel_sel,
-    input wire pv_sel,
+    input wire [7:0] addr,
 
     input wire [31:0] wdata,
     input wire wenable,
     output reg [31:0] rdata,
 
+    // Sequence reads
+    output reg  [31:0] m_addr,
+    output reg         m_ren,
+    input  wire [31:0] m_rdata,
+    input  wire        m_ready,
+
+    // Pulses when a channel reaches the end of a sequence that doesn't loop
+    output reg irq,
+
     output wire [PWM_WIDTH:0] out
 );
   localparam PWM_MAX = 2 ** PWM_WIDTH;
   localparam CHANNELS = 4;
+  localparam WAVE_IDX_BITS = $clog2(WAVE_DATA_SIZE);
+
+  localparam REG_PERIOD = 3'd0;
+  localparam REG_VOLUME = 3'd1;
+  localparam REG_SEQ = 3'd2;
+  localparam REG_SEQ_LEN = 3'd3;
+  localparam REG_CTRL = 3'd4;
+  localparam REG_POSITION = 3'd5;
+  localparam REG_TIMER = 3'd6;
+
+  localparam CTRL_START = 0;
+  localparam CTRL_LOOP = 1;
+  localparam CTRL_PAUSE = 2;
+  localparam CTRL_STOP = 3;
+
+  localparam FETCH_IDLE = 2'd0;
+  localparam FETCH_PERIOD = 2'd1;
+  localparam FETCH_DURATION = 2'd2;
+
+  wire       global_sel = addr[7];
+  wire [1:0] channel_sel = addr[6:5];
+  wire [2:0] reg_sel = addr[4:2];
+
+  reg [       31:0] periods      [0:CHANNELS-1];
+  reg [PWM_WIDTH:0] volumes      [0:CHANNELS-1];
+  reg [       31:0] seq_addrs    [0:CHANNELS-1];
+  reg [       31:0] seq_lens     [0:CHANNELS-1];
+  reg [       31:0] seq_positions[0:CHANNELS-1];
+  reg [       31:0] timers       [0:CHANNELS-1];
+
+  reg [CHANNELS-1:0] playing;
+  reg [CHANNELS-1:0] looping;
+  reg [CHANNELS-1:0] paused;
+  reg [CHANNELS-1:0] fetch_pending;
 
-  reg [       31:0] periods[0:CHANNELS-1];
-  reg [PWM_WIDTH:0] volumes[0:CHANNELS-1];
+  reg [31:0] tick_cycles;
+  reg [31:0] tick_ctr;
+  wire tick = tick_ctr == 0;
+
+  // One channel's step is fetched at a time
+  reg [1:0] fetch_state;
+  reg [1:0] fetch_channel;
+  reg [31:0] fetch_period;
+  // The channel was restarted or stopped while its step was being fetched
+  reg fetch_abort;
+
+  reg [1:0] fetch_next;
+  integer j;
+
+  always @(*) begin
+    fetch_next = 0;
+
+    for (j = CHANNELS - 1; j >= 0; j = j - 1) begin
+      if (fetch_pending[j]) fetch_next = j;
+    end
+
+    m_ren  = fetch_state != FETCH_IDLE;
+    m_addr = seq_addrs[fetch_channel] + {seq_positions[fetch_channel], 3'b000} +
+             (fetch_state == FETCH_DURATION ? 32'd4 : 32'd0);
+  end
 
   wire [31:0] ctr_1, ctr_2, ctr_3, ctr_4;
 
-  reg [$clog2(WAVE_DATA_SIZE)-1:0] wave_data[0:WAVE_DATA_SIZE-1];
+  reg [WAVE_IDX_BITS-1:0] wave_data[0:WAVE_DATA_SIZE-1];
 
   integer i;
 
   always @(posedge clk) begin
     if (!rst_n) begin
       for (i = 0; i < CHANNELS; i = i + 1) begin
-        periods[i] <= 0;
-        volumes[i] <= PWM_MAX;
+        periods[i]       <= 0;
+        volumes[i]       <= PWM_MAX;
+        seq_addrs[i]     <= 0;
+        seq_lens[i]      <= 0;
+        seq_positions[i] <= 0;
+        timers[i]        <= 0;
       end
+
+      playing       <= 0;
+      looping       <= 0;
+      paused        <= 0;
+      fetch_pending <= 0;
+
+      tick_cycles   <= TICK_CYCLES;
+      tick_ctr      <= TICK_CYCLES - 1;
+
+      fetch_state   <= FETCH_IDLE;
+      fetch_channel <= 0;
+      fetch_period  <= 0;
+      fetch_abort   <= 0;
+      irq           <= 0;
     end else begin
-      if (wenable) begin
-        if (!pv_sel) begin
-          periods[channel_sel] <= wdata;
-        end else begin
-          volumes[channel_sel] <= wdata[PWM_WIDTH:0];
+      irq      <= 0;
+      tick_ctr <= tick ? tick_cycles - 1 : tick_ctr - 1;
+
+      if (tick) begin
+        for (i = 0; i < CHANNELS; i = i + 1) begin
+          if (playing[i] && !paused[i]) begin
+            if (timers[i] != 0) begin
+              timers[i] <= timers[i] - 1;
+            end else if (seq_positions[i] < seq_lens[i]) begin
+              fetch_pending[i] <= 1;
+            end else begin
+              // Finished
+              playing[i] <= 0;
+              periods[i] <= 0;
+              irq        <= 1;
+            end
+          end
+        end
+      end
+
+      case (fetch_state)
+        FETCH_IDLE: begin
+          if (|fetch_pending) begin
+            fetch_channel <= fetch_next;
+            fetch_abort   <= 0;
+            fetch_state   <= FETCH_PERIOD;
+          end
         end
+        FETCH_PERIOD: begin
+          if (m_ready) begin
+            fetch_period <= m_rdata;
+            fetch_state  <= FETCH_DURATION;
+          end
+        end
+        FETCH_DURATION: begin
+          if (m_ready) begin
+            if (!fetch_abort) begin
+              periods[fetch_channel] <= fetch_period;
+              // The step's own tick counts too
+              timers[fetch_channel]  <= m_rdata == 0 ? 0 : m_rdata - 1;
+
+              if (looping[fetch_channel] &&
+                  seq_positions[fetch_channel] + 1 >= seq_lens[fetch_channel]) begin
+                seq_positions[fetch_channel] <= 0;
+              end else begin
+                seq_positions[fetch_channel] <= seq_positions[fetch_channel] + 1;
+              end
+            end
+
+            fetch_pending[fetch_channel] <= 0;
+            fetch_state <= FETCH_IDLE;
+          end
+        end
+        default: ;
+      endcase
+
+      if (wenable && global_sel) begin
+        tick_cycles <= wdata;
+        tick_ctr    <= wdata - 1;
+      end else if (wenable) begin
+        case (reg_sel)
+          REG_PERIOD: periods[channel_sel] <= wdata;
+          REG_VOLUME: volumes[channel_sel] <= wdata[PWM_WIDTH:0];
+          REG_SEQ:    seq_addrs[channel_sel] <= wdata;
+          REG_SEQ_LEN: seq_lens[channel_sel] <= wdata;
+          REG_CTRL: begin
+            looping[channel_sel] <= wdata[CTRL_LOOP];
+            paused[channel_sel]  <= wdata[CTRL_PAUSE];
+
+            if (wdata[CTRL_START] || wdata[CTRL_STOP]) begin
+              playing[channel_sel]       <= wdata[CTRL_START] && !wdata[CTRL_STOP];
+              seq_positions[channel_sel] <= 0;
+              timers[channel_sel]        <= 0;
+              fetch_pending[channel_sel] <= 0;
+
+              if (fetch_state != FETCH_IDLE && fetch_channel == channel_sel) fetch_abort <= 1;
+            end
+          end
+          default: ;
+        endcase
       end
     end
   end
 
   always @(*) begin
-    if (!pv_sel) begin
-      rdata = periods[channel_sel];
+    if (global_sel) begin
+      rdata = tick_cycles;
     end else begin
-      rdata = {{(32 - PWM_WIDTH + 1) {1'b0}}, volumes[channel_sel]};
+      case (reg_sel)
+        REG_PERIOD:   rdata = periods[channel_sel];
+        REG_VOLUME:   rdata = {{(32 - PWM_WIDTH + 1) {1'b0}}, volumes[channel_sel]};
+        REG_SEQ:      rdata = seq_addrs[channel_sel];
+        REG_SEQ_LEN:  rdata = seq_lens[channel_sel];
+        REG_CTRL: begin
+          rdata = {29'b0, paused[channel_sel], looping[channel_sel], playing[channel_sel]};
+        end
+        REG_POSITION: rdata = seq_positions[channel_sel];
+        REG_TIMER:    rdata = timers[channel_sel];
+        default:      rdata = 32'b0;
+      endcase
     end
   end
 
+  // The sawtooth and cosine channels keep playing their previous period until
+  // the phase increment for the new one is ready, see below
+  reg [31:0] inc_period_3, inc_period_4;
+
+  // Paused channels are muted, but keep their period for when they resume
+  wire [31:0] period_1 = paused[0] ? 32'b0 : periods[0];
+  wire [31:0] period_2 = paused[1] ? 32'b0 : periods[1];
+  wire [31:0] period_3 = paused[2] ? 32'b0 : inc_period_3;
+  wire [31:0] period_4 = paused[3] ? 32'b0 : inc_period_4;
+
   counter cnt1 (
       .clk(clk),
       .rst_n(rst_n),
@@ -71,32 +273,150 @@ module audio_unit #(
   counter cnt3 (
       .clk(clk),
       .rst_n(rst_n),
-      .compare(periods[2]),
+      .compare(inc_period_3),
       .out(ctr_3)
   );
 
   counter cnt4 (
       .clk(clk),
       .rst_n(rst_n),
-      .compare(periods[3]),
+      .compare(inc_period_4),
       .out(ctr_4)
   );
 
+  // The sawtooth and cosine channels need ctr / (period - 1). Instead of
+  // dividing every cycle, a phase accumulator adds 1 / (period - 1) as a Q1.32
+  // increment alongside each counter, and restarts with it. The increment is
+  // rounded up and the phase clamped to 1.0, so it reaches the end of the
+  // wave exactly when the counter does, and is off by at most an LSB before.
+  localparam [32:0] PHASE_ONE = 33'h1_0000_0000;
+
+  reg [32:0] phase_3, phase_4;
+  reg [32:0] phase_inc_3, phase_inc_4;
+
+  // Increments are recomputed by a single iterative divider whenever a period
+  // changes, which takes about 33 cycles. The channel switches to the new
+  // period once that's done, with its phase set to where the counter would
+  // have taken it, so the wave is exact on every cycle.
+  reg        div_busy;
+  reg        div_channel_4;
+  reg [31:0] div_period;
+
+  wire [31:0] div_period_prev = div_channel_4 ? inc_period_4 : inc_period_3;
 
-  wire channel_1 = periods[0] != 0 && ctr_1 >= (periods[0] / 2);
-  wire channel_2 = periods[1] != 0 && ctr_2 >= (periods[1] / 2);
-  wire [31:0] channel_3 = (periods[2] == 0) ? 0 : ctr_3;
+  wire        div_done;
+  wire [31:0] div_quotient;
+
+  // ceil(2^32 / d) == floor((2^32 - 1) / d) + 1
+  wire [32:0] div_inc = {1'b0, div_quotient} + 33'd1;
+
+  // The counter's next value, still under the previous period, times the new
+  // increment
+  wire [31:0] div_ctr = div_channel_4 ? ctr_4 : ctr_3;
+  wire [31:0] div_ctr_next = div_ctr >= div_period_prev - 1 ? 32'b0 : div_ctr + 1;
+  wire [64:0] div_phase = div_ctr_next * div_inc;
+  wire [32:0] div_phase_clamped = div_phase > PHASE_ONE ? PHASE_ONE : div_phase[32:0];
+
+  cpu_muldiv #(
+      .ITERATIVE_DIV(1)
+  ) divider (
+      .clk  (clk),
+      .rst_n(rst_n),
 
-  wire [$clog2(WAVE_DATA_SIZE)-1:0] wave_idx = (ctr_4 * (WAVE_DATA_SIZE - 1)) / (periods[3] - 1);
-  wire [7:0] channel_4 = wave_data[wave_idx];
+      .src_a  (32'hFFFF_FFFF),
+      .src_b  (div_period - 1),
+      .control(`MD_DIVU),
+      .start  (div_busy),
+      .stall  (1'b0),
 
-  wire [PWM_WIDTH+1:0] channel_1_norm = channel_1 ? volumes[0] : 0;
-  wire [PWM_WIDTH+1:0] channel_2_norm = channel_2 ? volumes[1] : 0;
-  wire [PWM_WIDTH+1:0] channel_3_norm = (channel_3 * volumes[2]) / (periods[2] - 1);
-  wire [PWM_WIDTH+1:0] channel_4_norm = (channel_4 * volumes[3]) / 255;
+      .done  (div_done),
+      .result(div_quotient)
+  );
+
+  wire [33:0] phase_3_next = phase_3 + phase_inc_3;
+  wire [33:0] phase_4_next = phase_4 + phase_inc_4;
+  wire [32:0] phase_3_step = phase_3_next > PHASE_ONE ? PHASE_ONE : phase_3_next[32:0];
+  wire [32:0] phase_4_step = phase_4_next > PHASE_ONE ? PHASE_ONE : phase_4_next[32:0];
+
+  always @(posedge clk) begin
+    if (!rst_n) begin
+      phase_3       <= 0;
+      phase_4       <= 0;
+      // As if computed for a period of 0
+      phase_inc_3   <= 33'd2;
+      phase_inc_4   <= 33'd2;
+      inc_period_3  <= 0;
+      inc_period_4  <= 0;
+      div_busy      <= 0;
+      div_channel_4 <= 0;
+      div_period    <= 0;
+    end else begin
+      phase_3 <= ctr_3 >= inc_period_3 - 1 ? 33'b0 : phase_3_step;
+      phase_4 <= ctr_4 >= inc_period_4 - 1 ? 33'b0 : phase_4_step;
+
+      if (!div_busy) begin
+        if (periods[2] != inc_period_3) begin
+          div_channel_4 <= 0;
+          div_period    <= periods[2];
+          div_busy      <= 1;
+        end else if (periods[3] != inc_period_4) begin
+          div_channel_4 <= 1;
+          div_period    <= periods[3];
+          div_busy      <= 1;
+        end
+      end else if (div_done) begin
+        if (div_channel_4) begin
+          phase_4      <= div_phase_clamped;
+          phase_inc_4  <= div_inc;
+          inc_period_4 <= div_period;
+        end else begin
+          phase_3      <= div_phase_clamped;
+          phase_inc_3  <= div_inc;
+          inc_period_3 <= div_period;
+        end
+
+        div_busy <= 0;
+      end
+    end
+  end
+
+  wire [PWM_WIDTH+33:0] saw_product = phase_3 * volumes[2];
+  wire [WAVE_IDX_BITS+32:0] wave_product = phase_4 * (WAVE_DATA_SIZE - 1);
+  wire [WAVE_IDX_BITS-1:0] wave_idx = period_4 == 0 ? 0 : wave_product[32+:WAVE_IDX_BITS];
+
+  // Mixer, pipelined so that no stage has more than a multiplier or an adder.
+  // out lags the oscillators by three cycles.
+  reg [PWM_WIDTH+1:0] channel_1_norm, channel_2_norm, channel_3_norm, channel_4_norm;
+  reg [7:0] wave_sample;
+  reg [PWM_WIDTH:0] wave_volume;
+  reg [PWM_WIDTH+2:0] partial_sum, sum;
+
+  always @(posedge clk) begin
+    if (!rst_n) begin
+      channel_1_norm <= 0;
+      channel_2_norm <= 0;
+      channel_3_norm <= 0;
+      channel_4_norm <= 0;
+      wave_sample    <= 0;
+      wave_volume    <= 0;
+      partial_sum    <= 0;
+      sum            <= 0;
+    end else begin
+      channel_1_norm <= period_1 != 0 && ctr_1 >= (period_1 >> 1) ? volumes[0] : 0;
+      channel_2_norm <= period_2 != 0 && ctr_2 >= (period_2 >> 1) ? volumes[1] : 0;
+      channel_3_norm <= period_3 == 0 ? 0 : saw_product[32+:PWM_WIDTH+2];
+      wave_sample    <= wave_data[wave_idx];
+      wave_volume    <= volumes[3];
+
+      // x / 255 == ((x + 1) * 257) >> 16 for every product of a sample and a volume
+      channel_4_norm <= (({8'b0, wave_sample} * wave_volume + 1) * 257) >> 16;
+      partial_sum    <= channel_1_norm + channel_2_norm + channel_3_norm;
+
+      sum            <= partial_sum + channel_4_norm;
+    end
+  end
 
-  wire [PWM_WIDTH+2:0] sum = channel_1_norm + channel_2_norm + channel_3_norm + channel_4_norm;
-  assign out = sum / 4;
+  assign out = sum >> 2;
 
   initial begin
     $readmemh(WAVE_DATA_SOURCE, wave_data);
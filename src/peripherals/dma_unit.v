@@ -0,0 +1,167 @@
+`default_nettype none
+
+// Copies data over the system bus on its own, taking the data bus whenever the
+// CPU leaves it idle. Meant for bulk uploads into the video memories.
+//
+// Each element takes a read and a write. A linear transfer reads COUNT
+// elements from SRC and writes them to DST, stepping each address by its
+// stride. A scatter transfer instead reads COUNT 32-bit entries from SRC, each
+// one holding {value[15:0], offset[15:0]}, and writes value to DST + offset.
+//
+// | Offset | Register | Description                                   |
+// | 0x00   | SRC      | Source address, or the scatter list           |
+// | 0x04   | DST      | Destination address, or the scatter base      |
+// | 0x08   | COUNT    | Elements left                                 |
+// | 0x0C   | STRIDE   | {DST stride, SRC stride} in bytes, signed     |
+// | 0x10   | CTRL     | {IRQ enable, scatter, size[1:0]}, starts      |
+// | 0x14   | STATUS   | {done, busy}, writing clears done             |
+//
+// Writes other than to STATUS are ignored while a transfer is running.
+module dma_unit (
+    input wire clk,
+    input wire rst_n,
+
+    input  wire [ 2:0] reg_sel,
+    input  wire [31:0] wdata,
+    input  wire        wenable,
+    output reg  [31:0] rdata,
+
+    output reg  [31:0] m_addr,
+    output reg  [31:0] m_wdata,
+    output reg  [ 3:0] m_wenable,
+    output reg         m_ren,
+    input  wire [31:0] m_rdata,
+    input  wire        m_ready,
+
+    // Pulses when a transfer with IRQ enable set finishes
+    output reg irq
+);
+  localparam REG_SRC = 3'd0;
+  localparam REG_DST = 3'd1;
+  localparam REG_COUNT = 3'd2;
+  localparam REG_STRIDE = 3'd3;
+  localparam REG_CTRL = 3'd4;
+  localparam REG_STATUS = 3'd5;
+
+  localparam SIZE_BYTE = 2'd0;
+  localparam SIZE_HALF = 2'd1;
+  localparam SIZE_WORD = 2'd2;
+
+  localparam STATE_IDLE = 2'd0;
+  localparam STATE_READ = 2'd1;
+  localparam STATE_WRITE = 2'd2;
+
+  reg [ 1:0] state;
+  reg [31:0] src;
+  reg [31:0] dst;
+  reg [31:0] count;
+  reg [31:0] stride;
+  reg [ 1:0] size;
+  reg        scatter;
+  reg        irq_enable;
+  reg        done;
+  reg [31:0] data;
+
+  wire busy = state != STATE_IDLE;
+
+  wire [31:0] src_stride = {{16{stride[15]}}, stride[15:0]};
+  wire [31:0] dst_stride = {{16{stride[31]}}, stride[31:16]};
+
+  always @(*) begin
+    m_addr    = src;
+    m_wdata   = scatter ? {16'b0, data[31:16]} : data;
+    m_wenable = 4'b0000;
+    m_ren     = 0;
+
+    case (state)
+      STATE_READ: m_ren = 1;
+      STATE_WRITE: begin
+        m_addr = scatter ? dst + data[15:0] : dst;
+
+        case (size)
+          SIZE_BYTE: m_wenable = 4'b0001;
+          SIZE_HALF: m_wenable = 4'b0011;
+          default:   m_wenable = 4'b1111;
+        endcase
+      end
+      default: ;
+    endcase
+  end
+
+  always @(posedge clk) begin
+    if (!rst_n) begin
+      state      <= STATE_IDLE;
+      src        <= 0;
+      dst        <= 0;
+      count      <= 0;
+      stride     <= 0;
+      size       <= SIZE_WORD;
+      scatter    <= 0;
+      irq_enable <= 0;
+      done       <= 0;
+      data       <= 0;
+      irq        <= 0;
+    end else begin
+      irq <= 0;
+
+      if (wenable && reg_sel == REG_STATUS) begin
+        done <= 0;
+      end else if (wenable && !busy) begin
+        case (reg_sel)
+          REG_SRC:    src <= wdata;
+          REG_DST:    dst <= wdata;
+          REG_COUNT:  count <= wdata;
+          REG_STRIDE: stride <= wdata;
+          REG_CTRL: begin
+            size       <= wdata[1:0];
+            scatter    <= wdata[2];
+            irq_enable <= wdata[3];
+
+            if (count != 0) begin
+              state <= STATE_READ;
+              done  <= 0;
+            end
+          end
+          default: ;
+        endcase
+      end
+
+      case (state)
+        STATE_READ: begin
+          if (m_ready) begin
+            data  <= m_rdata;
+            src   <= src + (scatter ? 32'd4 : src_stride);
+            state <= STATE_WRITE;
+          end
+        end
+        STATE_WRITE: begin
+          if (m_ready) begin
+            if (!scatter) dst <= dst + dst_stride;
+            count <= count - 1;
+
+            if (count == 1) begin
+              state <= STATE_IDLE;
+              done  <= 1;
+              irq   <= irq_enable;
+            end else begin
+              state <= STATE_READ;
+            end
+          end
+        end
+        default: ;
+      endcase
+    end
+  end
+
+  always @(*) begin
+    case (reg_sel)
+      REG_SRC:    rdata = src;
+      REG_DST:    rdata = dst;
+      REG_COUNT:  rdata = count;
+      REG_STRIDE: rdata = stride;
+      REG_CTRL:   rdata = {28'b0, irq_enable, scatter, size};
+      REG_STATUS: rdata = {30'b0, done, busy};
+      default:    rdata = 32'b0;
+    endcase
+  end
+endmodule
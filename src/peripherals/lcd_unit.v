@@ -1,31 +1,162 @@
 `default_nettype none
 
-// Consecutive writes don't work. Careful!
-module lcd_unit (
+// HD44780 driver with a TX FIFO, so the CPU doesn't have to pace its writes.
+// Entries are sent with the controller's setup, enable pulse and execution
+// times, so nothing has to poll the busy flag.
+//
+// | Offset | Write                    | Read                               |
+// | 0x0    | Queue an instruction     | Status {overflow, irq, full, busy} |
+// | 0x1    | Queue a data byte        | Last byte sent                     |
+// | 0x2    |                          | FIFO level                         |
+// | 0x3    | {IRQ enable, watermark}  | {IRQ enable, watermark}            |
+//
+// With IRQ enable set, irq pulses when the FIFO drains down to the watermark.
+// Writing the watermark register clears the irq and overflow flags.
+module lcd_unit #(
+    parameter CLOCK_FREQ = 50_000_000,
+    parameter FIFO_DEPTH = 16
+) (
     input wire clk,
     input wire rst_n,
 
-    input wire rs,
-    input wire [7:0] wdata,
-    input wire wenable,
+    input  wire [1:0] addr,
+    input  wire [7:0] wdata,
+    input  wire       wenable,
+    output reg  [7:0] rdata,
+
+    output reg irq,
 
     output reg [7:0] lcd_data,
     output reg [1:0] lcd_ctrl,
     output reg lcd_enable
 );
+  localparam CYCLES_PER_US = (CLOCK_FREQ + 999_999) / 1_000_000;
+
+  // Setup of RS and data before E rises (>= 40 ns), E pulse width (>= 230 ns)
+  // and execution time (37 us, 1.52 ms for clear and return home), each with
+  // some margin
+  localparam SETUP_CYCLES = CYCLES_PER_US / 10 + 1;
+  localparam ENABLE_CYCLES = CYCLES_PER_US / 2 + 1;
+  localparam EXEC_CYCLES = 40 * CYCLES_PER_US;
+  localparam LONG_EXEC_CYCLES = 1600 * CYCLES_PER_US;
+
+  localparam PTR_BITS = $clog2(FIFO_DEPTH);
+
+  localparam STATE_IDLE = 2'd0;
+  localparam STATE_SETUP = 2'd1;
+  localparam STATE_ENABLE = 2'd2;
+  localparam STATE_EXEC = 2'd3;
+
+  reg [8:0] fifo[0:FIFO_DEPTH-1];
+  reg [PTR_BITS-1:0] head, tail;
+  reg [PTR_BITS:0] level;
+
+  reg [1:0] state;
+  reg [$clog2(LONG_EXEC_CYCLES)-1:0] timer;
+  reg long_exec;
+
+  reg [6:0] watermark;
+  reg irq_enable;
+  reg irq_flag;
+  reg overflow;
+
+  wire full = level == FIFO_DEPTH;
+  wire busy = level != 0 || state != STATE_IDLE;
+
+  wire push = wenable && !addr[1];
+  wire pop = state == STATE_IDLE && level != 0;
+
+  wire [8:0] next_entry = fifo[head];
+
   always @(posedge clk) begin
     if (!rst_n) begin
+      head       <= 0;
+      tail       <= 0;
+      level      <= 0;
+      state      <= STATE_IDLE;
+      timer      <= 0;
+      long_exec  <= 0;
+      watermark  <= 0;
+      irq_enable <= 0;
+      irq_flag   <= 0;
+      overflow   <= 0;
+      irq        <= 0;
+
       lcd_data   <= 0;
       lcd_ctrl   <= 2'b00;
       lcd_enable <= 0;
     end else begin
-      if (wenable) begin
-        lcd_data   <= wdata;
-        lcd_ctrl   <= {rs, 1'b0};
-        lcd_enable <= 1;
-      end else begin
-        lcd_enable <= 0;
+      irq <= 0;
+
+      if (push && !full) begin
+        fifo[tail] <= {addr[0], wdata};
+        tail       <= tail + 1;
+      end else if (push) begin
+        overflow <= 1;
+      end
+
+      if (wenable && addr == 2'd3) begin
+        watermark  <= wdata[6:0];
+        irq_enable <= wdata[7];
+        irq_flag   <= 0;
+        overflow   <= 0;
       end
+
+      if (pop) head <= head + 1;
+
+      level <= level + (push && !full) - pop;
+
+      if (pop && !(push && !full) && level == watermark + 1 && irq_enable) begin
+        irq_flag <= 1;
+        irq      <= 1;
+      end
+
+      case (state)
+        STATE_IDLE: begin
+          if (pop) begin
+            lcd_data  <= next_entry[7:0];
+            lcd_ctrl  <= {next_entry[8], 1'b0};
+            // Clear display and return home take much longer than the rest
+            long_exec <= !next_entry[8] && next_entry[7:2] == 6'b0;
+            timer     <= SETUP_CYCLES - 1;
+            state     <= STATE_SETUP;
+          end
+        end
+        STATE_SETUP: begin
+          if (timer == 0) begin
+            lcd_enable <= 1;
+            timer      <= ENABLE_CYCLES - 1;
+            state      <= STATE_ENABLE;
+          end else begin
+            timer <= timer - 1;
+          end
+        end
+        STATE_ENABLE: begin
+          if (timer == 0) begin
+            lcd_enable <= 0;
+            timer      <= (long_exec ? LONG_EXEC_CYCLES : EXEC_CYCLES) - 1;
+            state      <= STATE_EXEC;
+          end else begin
+            timer <= timer - 1;
+          end
+        end
+        STATE_EXEC: begin
+          if (timer == 0) begin
+            state <= STATE_IDLE;
+          end else begin
+            timer <= timer - 1;
+          end
+        end
+      endcase
     end
   end
+
+  always @(*) begin
+    case (addr)
+      2'd0:    rdata = {4'b0, overflow, irq_flag, full, busy};
+      2'd1:    rdata = lcd_data;
+      2'd2:    rdata = {{(7 - PTR_BITS) {1'b0}}, level};
+      default: rdata = {irq_enable, watermark};
+    endcase
+  end
 endmodule
@@ -304,7 +304,10 @@ module nes_bridge #(
     // 01: joypad_valid
     // 1x: joypad
     input  wire [1:0] rdata_addr,
-    output reg  [7:0] rdata
+    output reg  [7:0] rdata,
+
+    // Pulses when a new joypad state has been read
+    output reg irq
 );
   localparam S_IDLE = 4'd0;
   localparam S_START_1 = 4'd1;
@@ -466,11 +469,13 @@ module nes_bridge #(
       joypad       <= 8'h00;
       joypad_valid <= 0;
       state        <= S_IDLE;
+      irq          <= 0;
     end else begin
       read_ctr     <= read_ctr_next;
       joypad       <= joypad_next;
       joypad_valid <= joypad_valid_next;
       state        <= state_next;
+      irq          <= joypad_valid_next && !joypad_valid;
     end
   end
 
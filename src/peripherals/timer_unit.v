@@ -0,0 +1,61 @@
+`default_nettype none
+
+// Machine timer, laid out like a RISC-V CLINT. mtime counts clock cycles, and
+// the interrupt stays high for as long as mtime >= mtimecmp.
+//
+// | Offset | Register   | Description                          |
+// | 0x0    | MTIME      | Low half of the cycle count          |
+// | 0x4    | MTIMEH     | High half of the cycle count         |
+// | 0x8    | MTIMECMP   | Low half of the compare value        |
+// | 0xC    | MTIMECMPH  | High half of the compare value       |
+//
+// mtimecmp starts out all ones, so the interrupt is off until it is set.
+module timer_unit (
+    input wire clk,
+    input wire rst_n,
+
+    input  wire [ 1:0] reg_sel,
+    input  wire [31:0] wdata,
+    input  wire        wenable,
+    output reg  [31:0] rdata,
+
+    output wire irq
+);
+  localparam REG_MTIME = 2'd0;
+  localparam REG_MTIMEH = 2'd1;
+  localparam REG_MTIMECMP = 2'd2;
+  localparam REG_MTIMECMPH = 2'd3;
+
+  reg [63:0] mtime;
+  reg [63:0] mtimecmp;
+
+  assign irq = mtime >= mtimecmp;
+
+  always @(posedge clk) begin
+    if (!rst_n) begin
+      mtime    <= 0;
+      mtimecmp <= {64{1'b1}};
+    end else begin
+      mtime <= mtime + 1;
+
+      if (wenable) begin
+        case (reg_sel)
+          REG_MTIME:     mtime[31:0] <= wdata;
+          REG_MTIMEH:    mtime[63:32] <= wdata;
+          REG_MTIMECMP:  mtimecmp[31:0] <= wdata;
+          REG_MTIMECMPH: mtimecmp[63:32] <= wdata;
+          default: ;
+        endcase
+      end
+    end
+  end
+
+  always @(*) begin
+    case (reg_sel)
+      REG_MTIME:     rdata = mtime[31:0];
+      REG_MTIMEH:    rdata = mtime[63:32];
+      REG_MTIMECMP:  rdata = mtimecmp[31:0];
+      default:       rdata = mtimecmp[63:32];
+    endcase
+  end
+endmodule
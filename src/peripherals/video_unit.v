@@ -1,29 +1,60 @@
 `default_nettype none
 
 // 800x600 @ ~72 Hz
+//
+// Tiles are 8x8 pixels, each drawn as a 4x4 block on screen, so the 200x150
+// screen shows a 25x19 window into a 32x32 tile map. The window moves with
+// the scroll offsets and wraps around the map.
+//
+// Tile attributes have two pages, at offsets 0 and TATTR_SIZE. Only one of
+// them is shown, and switching to the other waits for the next vertical blank,
+// so a frame can be drawn into the hidden page at any pace without tearing.
+// Scroll offsets take effect at the same time.
+//
+// On top of the tiles go up to SPRITES sprites, which use the same tile data
+// and palettes, with color 0 as transparent. At most SPRITES_PER_LINE of them
+// are drawn on a line, lower indices first.
+//
+// Nothing reads tile memory while pixels go out. During the horizontal blank
+// before each line, the attributes and pattern rows of the tiles it crosses
+// are fetched into a line buffer, one tile per cycle, and the sprites on it
+// into their slots. Scanout only indexes those registers.
+//
+// Tile attributes are {flip_y, flip_x, 2'b0, enable, palette[2:0], tdata[7:0]},
+// enable only being used by sprites.
+//
+// | Offset | Register | Description                                        |
+// | 0x000  | DISPLAY  | {display on}                                       |
+// | 0x004  | PAGE     | Write the page to show from the next vertical      |
+// |        |          | blank, read {flip pending, page shown}             |
+// | 0x008  | SCROLL_X | Map column at the left of the screen, in pixels    |
+// | 0x00C  | SCROLL_Y | Map row at the top of the screen, in pixels        |
+// | 0x100  | SPRITES  | One word per sprite: {tattr, y, x}, with x and y   |
+// |        |          | in screen pixels                                   |
 module video_unit (
     input wire clk,
     input wire wclk,
     input wire rst_n,
 
-    input wire [$clog2(TATTR_SIZE)-1:0] tattr_addr,
-    input wire [7:0] tattr_wdata,
-    input wire tattr_wenable,
-    output wire [7:0] tattr_rdata,
+    input wire [$clog2(4 * TATTR_SIZE)-1:0] tattr_addr,
+    input wire [15:0] tattr_wdata,
+    input wire [1:0] tattr_wenable,
+    output wire [15:0] tattr_rdata,
 
     input wire [$clog2(2 * TDATA_SIZE)-1:0] tdata_addr,
     input wire [15:0] tdata_wdata,
     input wire [1:0] tdata_wenable,
     output wire [15:0] tdata_rdata,
 
-
-    input  wire [ 3:0] pal_addr,
+    input  wire [ 4:0] pal_addr,
     input  wire [11:0] pal_wdata,
     input  wire        pal_wenable,
     output wire [11:0] pal_rdata,
 
-    input wire ctrl_wdata,
-    input wire ctrl_wenable,
+    input  wire [ 6:0] ctrl_addr,
+    input  wire [31:0] ctrl_wdata,
+    input  wire        ctrl_wenable,
+    output reg  [31:0] ctrl_rdata,
 
     output wire [3:0] vga_red,
     output wire [3:0] vga_green,
@@ -43,23 +74,58 @@ module video_unit (
   localparam V_BACK = V_SYNC + 6;
   localparam V_FRAME = V_BACK + 23;
 
+  localparam CTRL_DISPLAY = 7'h00;
+  localparam CTRL_PAGE = 7'h01;
+  localparam CTRL_SCROLL_X = 7'h02;
+  localparam CTRL_SCROLL_Y = 7'h03;
+
+  localparam SPRITES = 32;
+  localparam SPRITES_PER_LINE = 8;
+
+  localparam SPRITE_ENABLE = 16 + 11;
+
+  localparam PALETTES = 8;
+
   reg display_on;
-  reg [11:0] palette[0:3][0:3];
+  reg [11:0] palette[0:PALETTES-1][0:3];
+
+  // Written on wclk, while front_page follows it on clk once a frame ends
+  reg page_next;
+  reg front_page;
+  wire page_next_synced;
+  wire front_page_synced;
+
+  synchronizer page_next_synchronizer (
+      .clk(clk),
+      .in (page_next),
+      .out(page_next_synced)
+  );
+
+  synchronizer front_page_synchronizer (
+      .clk(wclk),
+      .in (front_page),
+      .out(front_page_synced)
+  );
 
-  assign pal_rdata = palette[pal_addr[3:2]][pal_addr[1:0]];
+  // Only sampled during vertical blank, when the CPU is expected to be done
+  // with them, so they aren't synchronized
+  reg [7:0] scroll_x_next, scroll_y_next;
+  reg [7:0] scroll_x, scroll_y;
 
-  localparam TILES_H = 25;
-  localparam TILES_V = 19;
-  localparam TILES_TOTAL = TILES_H * TILES_V;
-  localparam TATTR_SIZE = 2 ** $clog2(TILES_TOTAL);
+  reg [31:0] sprites[0:SPRITES-1];
 
-  localparam TD_TILES = 16;
+  assign pal_rdata = palette[pal_addr[4:2]][pal_addr[1:0]];
+
+  localparam MAP_SIZE = 32;
+  localparam TATTR_SIZE = MAP_SIZE * MAP_SIZE;
+
+  localparam TD_TILES = 256;
   localparam TDATA_SIZE = 8 * TD_TILES;
 
-  wire [7:0] tile_attrs;
+  wire [15:0] tile_attrs;
 
-  dual_byte_ram #(
-      .SIZE(TATTR_SIZE)
+  dual_hword_ram #(
+      .SIZE_HWORDS(2 * TATTR_SIZE)
   ) tattr_ram (
       .clk(wclk),
 
@@ -68,7 +134,7 @@ module video_unit (
       .wenable_1(tattr_wenable),
       .rdata_1  (tattr_rdata),
 
-      .addr_2 (tile_idx_next),
+      .addr_2 ({front_page, line_map_y[7:3], line_col, 1'b0}),
       .rdata_2(tile_attrs)
   );
 
@@ -84,7 +150,7 @@ module video_unit (
       .wenable_1(tdata_wenable),
       .rdata_1  (tdata_rdata),
 
-      .addr_2 ({tdata_idx, flip_x ? (3'd7 - tile_y) : tile_y, 1'b0}),
+      .addr_2 (sprite_fetch ? sprite_tdata_addr : line_tdata_addr),
       .rdata_2(tdata_show_data)
   );
 
@@ -95,26 +161,17 @@ module video_unit (
 
   reg h_sync_next, v_sync_next;
 
-  localparam TILE_IDX_WIDTH = $clog2(TILES_TOTAL);
-  reg [TILE_IDX_WIDTH-1:0] tile_idx_base, tile_idx_base_next;
-  reg [TILE_IDX_WIDTH-1:0] tile_idx, tile_idx_next;
-
-  wire [2:0] tile_x = x_pos_next[4:2];
-  wire [2:0] tile_y = y_pos_next[4:2];
+  // Pixels are looked up two cycles ahead, one for the line buffer and one
+  // for the palette
+  wire [$clog2(H_LINE)-1:0] lookup_x = x_pos >= H_LINE - 2 ? x_pos + 2 - H_LINE : x_pos + 2;
+  wire [7:0] screen_x = lookup_x[9:2];
 
   always @(*) begin
-    y_pos_next         = y_pos;
-    x_pos_next         = x_pos + 1;
+    y_pos_next     = y_pos;
+    x_pos_next     = x_pos + 1;
 
-    tile_idx_base_next = tile_idx_base;
-    tile_idx_next      = tile_idx;
-
-    h_visible_next     = h_visible;
-    v_visible_next     = v_visible;
-
-    if (x_pos[5] != x_pos_next[5] && h_visible) begin
-      tile_idx_next = tile_idx + 1;
-    end
+    h_visible_next = h_visible;
+    v_visible_next = v_visible;
 
     if (x_pos_next == H_FRONT) begin
       h_visible_next = 0;
@@ -125,21 +182,14 @@ module video_unit (
       x_pos_next = 0;
       y_pos_next = y_pos + 1;
 
-      if (y_pos[5] != y_pos_next[5]) begin
-        tile_idx_base_next = tile_idx_base + TILES_H;
-      end
-
       if (y_pos_next == V_FRONT) begin
         v_visible_next = 0;
-      end else if (y_pos_next == V_FRAME && tile_idx_base_next != TILES_V) begin
+      end else if (y_pos_next == V_FRAME) begin
         // Next frame
         v_visible_next = 1;
 
         y_pos_next = 0;
-        tile_idx_base_next = 0;
       end
-
-      tile_idx_next = tile_idx_base_next;
     end
 
     case (x_pos_next)
@@ -155,52 +205,225 @@ module video_unit (
     endcase
   end
 
+  integer i;
+
   always @(posedge wclk) begin
     if (!rst_n) begin
-      display_on <= 0;
+      display_on    <= 0;
+      page_next     <= 0;
+      scroll_x_next <= 0;
+      scroll_y_next <= 0;
+
+      for (i = 0; i < SPRITES; i = i + 1) begin
+        sprites[i] <= 0;
+      end
     end else begin
       if (pal_wenable) begin
-        palette[pal_addr[3:2]][pal_addr[1:0]] <= pal_wdata;
+        palette[pal_addr[4:2]][pal_addr[1:0]] <= pal_wdata;
       end
 
-      if (ctrl_wenable) begin
-        display_on <= ctrl_wdata;
+      if (ctrl_wenable && ctrl_addr[6]) begin
+        sprites[ctrl_addr[4:0]] <= ctrl_wdata;
+      end else if (ctrl_wenable) begin
+        case (ctrl_addr)
+          CTRL_DISPLAY:  display_on <= ctrl_wdata[0];
+          CTRL_PAGE:     page_next <= ctrl_wdata[0];
+          CTRL_SCROLL_X: scroll_x_next <= ctrl_wdata[7:0];
+          CTRL_SCROLL_Y: scroll_y_next <= ctrl_wdata[7:0];
+          default:       ;
+        endcase
       end
     end
   end
 
+  always @(*) begin
+    if (ctrl_addr[6]) begin
+      ctrl_rdata = sprites[ctrl_addr[4:0]];
+    end else begin
+      case (ctrl_addr)
+        CTRL_DISPLAY:  ctrl_rdata = {31'b0, display_on};
+        CTRL_PAGE:     ctrl_rdata = {30'b0, page_next != front_page_synced, front_page_synced};
+        CTRL_SCROLL_X: ctrl_rdata = {24'b0, scroll_x_next};
+        CTRL_SCROLL_Y: ctrl_rdata = {24'b0, scroll_y_next};
+        default:       ctrl_rdata = 32'b0;
+      endcase
+    end
+  end
+
+  // Everything here runs during the horizontal blank before each line, for the
+  // line coming next. Sprite evaluation checks every sprite against it, one per
+  // cycle, and the first SPRITES_PER_LINE hits get a slot. Meanwhile the line
+  // buffer reads the attributes of each tile the line crosses, with the tile's
+  // pattern row read a cycle behind. Once both are done, each slot fetches its
+  // row of tile data. None of it is used for drawing until the line starts.
+  localparam EVAL_START = H_FRONT + 1;
+  localparam FETCH_START = EVAL_START + SPRITES;
+  localparam FETCH_END = FETCH_START + SPRITES_PER_LINE;
+
+  // One more tile than fits on screen, for lines scrolled partway into one.
+  // Must be done before FETCH_START, since sprites take the tile data port.
+  localparam LINE_TILES = H_FRONT / 32 + 1;
+  localparam LINE_START = H_FRONT + 1;
+  localparam LINE_END = LINE_START + LINE_TILES + 1;
+
+  localparam SLOT_BITS = $clog2(SPRITES_PER_LINE);
+  localparam LINE_BITS = $clog2(LINE_TILES);
+
+  wire [$clog2(V_FRAME)-1:0] eval_line = y_pos == V_FRAME - 1 ? 0 : y_pos + 1;
+  wire [7:0] eval_y = eval_line[9:2];
+
+  reg [15:0] line_attrs[0:LINE_TILES-1];
+  reg [15:0] line_data[0:LINE_TILES-1];
+
+  wire [LINE_BITS-1:0] line_attrs_idx = x_pos - LINE_START;
+  wire [LINE_BITS-1:0] line_data_idx = x_pos - (LINE_START + 1);
+
+  wire [7:0] line_map_y = eval_y + scroll_y;
+  wire [4:0] line_col = scroll_x[7:3] + line_attrs_idx;
+
+  wire [15:0] line_fetch_attrs = line_attrs[line_data_idx];
+  wire [2:0] line_row = line_fetch_attrs[14] ? 3'd7 - line_map_y[2:0] : line_map_y[2:0];
+  wire [$clog2(2 * TDATA_SIZE)-1:0] line_tdata_addr = {line_fetch_attrs[7:0], line_row, 1'b0};
+
+  always @(posedge clk) begin
+    if (x_pos >= LINE_START && x_pos < LINE_START + LINE_TILES) begin
+      line_attrs[line_attrs_idx] <= tile_attrs;
+    end
+
+    if (x_pos >= LINE_START + 1 && x_pos < LINE_END) begin
+      line_data[line_data_idx] <= tdata_show_data;
+    end
+  end
+
+  reg [SPRITES_PER_LINE-1:0] slot_valid;
+  reg [7:0] slot_x[0:SPRITES_PER_LINE-1];
+  reg [15:0] slot_attrs[0:SPRITES_PER_LINE-1];
+  reg [2:0] slot_row[0:SPRITES_PER_LINE-1];
+  reg [15:0] slot_data[0:SPRITES_PER_LINE-1];
+  reg [SLOT_BITS:0] slot_count;
+
+  wire [$clog2(SPRITES)-1:0] eval_idx = x_pos - EVAL_START;
+  wire [31:0] eval_sprite = sprites[eval_idx];
+  wire [7:0] eval_row = eval_y - eval_sprite[15:8];
+  wire eval_hit = eval_sprite[SPRITE_ENABLE] && eval_row < 8;
+
+  wire sprite_fetch = x_pos >= FETCH_START && x_pos < FETCH_END;
+  wire [SLOT_BITS-1:0] fetch_slot = x_pos - FETCH_START;
+  wire [15:0] fetch_attrs = slot_attrs[fetch_slot];
+  wire [2:0] fetch_row = fetch_attrs[14] ? 3'd7 - slot_row[fetch_slot] : slot_row[fetch_slot];
+  wire [$clog2(2 * TDATA_SIZE)-1:0] sprite_tdata_addr = {fetch_attrs[7:0], fetch_row, 1'b0};
+
+  always @(posedge clk) begin
+    if (!rst_n) begin
+      slot_valid <= 0;
+      slot_count <= 0;
+    end else if (x_pos == H_FRONT) begin
+      slot_valid <= 0;
+      slot_count <= 0;
+    end else if (x_pos >= EVAL_START && x_pos < FETCH_START) begin
+      if (eval_hit && slot_count != SPRITES_PER_LINE) begin
+        slot_x[slot_count[SLOT_BITS-1:0]]     <= eval_sprite[7:0];
+        slot_attrs[slot_count[SLOT_BITS-1:0]] <= eval_sprite[31:16];
+        slot_row[slot_count[SLOT_BITS-1:0]]   <= eval_row[2:0];
+        slot_count                            <= slot_count + 1;
+      end
+    end else if (sprite_fetch) begin
+      slot_data[fetch_slot]  <= tdata_show_data;
+      slot_valid[fetch_slot] <= fetch_slot < slot_count;
+    end
+  end
+
   always @(posedge clk) begin
     if (!rst_n) begin
-      x_pos         <= 0;
-      y_pos         <= 0;
-      h_sync        <= 1;
-      v_sync        <= 1;
-      tile_idx_base <= 0;
-      tile_idx      <= 0;
-      h_visible     <= 1;
-      v_visible     <= 1;
+      x_pos      <= 0;
+      y_pos      <= 0;
+      h_sync     <= 1;
+      v_sync     <= 1;
+      h_visible  <= 1;
+      v_visible  <= 1;
+      front_page <= 0;
+      scroll_x   <= 0;
+      scroll_y   <= 0;
     end else begin
-      x_pos         <= x_pos_next;
-      y_pos         <= y_pos_next;
-      h_sync        <= h_sync_next;
-      v_sync        <= v_sync_next;
-      tile_idx_base <= tile_idx_base_next;
-      tile_idx      <= tile_idx_next;
-      h_visible     <= h_visible_next;
-      v_visible     <= v_visible_next;
+      x_pos     <= x_pos_next;
+      y_pos     <= y_pos_next;
+      h_sync    <= h_sync_next;
+      v_sync    <= v_sync_next;
+      h_visible <= h_visible_next;
+      v_visible <= v_visible_next;
+
+      // Flip and scroll as soon as the last visible line is done
+      if (v_visible && !v_visible_next) begin
+        front_page <= page_next_synced;
+        scroll_x   <= scroll_x_next;
+        scroll_y   <= scroll_y_next;
+      end
+    end
+  end
+
+
+  // Background tile under the pixel being looked up, out of the line buffer
+  wire [ 7:0] line_x = screen_x + scroll_x[2:0];
+  wire [15:0] line_pixel_attrs = line_attrs[line_x[7:3]];
+
+  // Topmost opaque sprite pixel, if any
+  reg         sprite_hit;
+  reg  [ 2:0] sprite_pal_idx;
+  reg  [ 1:0] sprite_color_idx;
+  reg  [ 7:0] sprite_dx;
+  reg  [ 2:0] sprite_col;
+  reg  [ 1:0] slot_color_idx;
+
+  integer     s;
+
+  always @(*) begin
+    sprite_hit       = 0;
+    sprite_pal_idx   = 0;
+    sprite_color_idx = 0;
+
+    for (s = SPRITES_PER_LINE - 1; s >= 0; s = s - 1) begin
+      sprite_dx  = screen_x - slot_x[s];
+      sprite_col = sprite_dx[2:0];
+
+      slot_color_idx = slot_attrs[s][15] ?
+          {slot_data[s][8+sprite_col], slot_data[s][sprite_col]} :
+          {slot_data[s][15-sprite_col], slot_data[s][7-sprite_col]};
+
+      if (slot_valid[s] && sprite_dx < 8 && slot_color_idx != 0) begin
+        sprite_hit       = 1;
+        sprite_pal_idx   = slot_attrs[s][10:8];
+        sprite_color_idx = slot_color_idx;
+      end
     end
   end
 
-  wire [ 3:0] tdata_idx = tile_attrs[3:0];
-  wire [ 1:0] pal_idx = tile_attrs[5:4];
-  wire        flip_x = tile_attrs[6];
-  wire        flip_y = tile_attrs[7];
+  reg  [15:0] bg_data_reg;
+  reg  [ 2:0] bg_pal_idx_reg;
+  reg         bg_flip_y_reg;
+  reg  [ 2:0] bg_col_reg;
+
+  reg         sprite_hit_reg;
+  reg  [ 2:0] sprite_pal_idx_reg;
+  reg  [ 1:0] sprite_color_idx_reg;
+
+  always @(posedge clk) begin
+    bg_data_reg          <= line_data[line_x[7:3]];
+    bg_pal_idx_reg       <= line_pixel_attrs[10:8];
+    bg_flip_y_reg        <= line_pixel_attrs[15];
+    bg_col_reg           <= line_x[2:0];
+
+    sprite_hit_reg       <= sprite_hit;
+    sprite_pal_idx_reg   <= sprite_pal_idx;
+    sprite_color_idx_reg <= sprite_color_idx;
+  end
+
+  wire [ 1:0] color_idx_noflip = {bg_data_reg[15-bg_col_reg], bg_data_reg[7-bg_col_reg]};
+  wire [ 1:0] color_idx_yesflip = {bg_data_reg[8+bg_col_reg], bg_data_reg[bg_col_reg]};
 
-  wire [ 1:0] color_idx_noflip = {tdata_show_data[15-tile_x], tdata_show_data[7-tile_x]};
-  wire [ 1:0] color_idx_yesflip = {tdata_show_data[8+tile_x], tdata_show_data[tile_x]};
+  wire [ 1:0] color_idx = bg_flip_y_reg ? color_idx_yesflip : color_idx_noflip;
 
-  wire [ 1:0] color_idx = flip_y ? color_idx_yesflip : color_idx_noflip;
-  wire [11:0] color_next = palette[pal_idx][color_idx];
+  wire [11:0] color_next = sprite_hit_reg ? palette[sprite_pal_idx_reg][sprite_color_idx_reg] :
+                                            palette[bg_pal_idx_reg][color_idx];
 
   reg  [ 3:0] vga_red_reg;
   reg  [ 3:0] vga_blue_reg;
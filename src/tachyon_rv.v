@@ -1,6 +1,24 @@
 `default_nettype none
 
-module tachyon_rv (
+`include "cpu_csr_file.vh"
+
+module tachyon_rv #(
+    // Put RAM behind instruction/data caches and a slower backing memory
+    // instead of the single-cycle dual_word_ram
+    parameter USE_CACHES      = 0,
+    parameter CACHE_SET_BITS  = 6,
+    parameter CACHE_WORD_BITS = 2,
+    parameter CACHE_WAYS      = 1,
+    parameter MEM_LATENCY     = 8,
+    // Queue stores in front of the data cache, with USE_CACHES (see
+    // store_buffer)
+    parameter STORE_BUFFER    = 0,
+    // See pipelined_cpu. Dual issue needs two instructions per fetch, which
+    // only the plain RAM gives, so it's off with caches.
+    parameter SHADOW_REGS     = 0,
+    parameter DUAL_ISSUE      = 0,
+    parameter EARLY_BRANCH    = 0
+) (
     input wire clk,
     input wire clk_vga,
     input wire rst_n,
@@ -30,6 +48,8 @@ module tachyon_rv (
   localparam SEL_VCTRL = 4'd6;
   localparam SEL_LCD = 4'd7;
   localparam SEL_AUDIO = 4'd8;
+  localparam SEL_DMA = 4'd9;
+  localparam SEL_TIMER = 4'd10;
 
   wire rst_n_sync;
 
@@ -40,36 +60,158 @@ module tachyon_rv (
   );
 
   wire [31:0] instr_data;
+  wire [31:0] instr_data_next;
   wire [31:0] instr_addr;
 
-  wire [31:0] data_addr, data_wdata;
-  wire [3:0] data_wenable;
+  wire instr_ready;
+  wire instr_next_valid;
 
-  pipelined_cpu koishi (
+  wire [31:0] cpu_data_addr, cpu_data_wdata;
+  wire [3:0] cpu_data_wenable;
+  wire cpu_data_ren;
+  wire cpu_data_ready;
+
+  pipelined_cpu #(
+      .SHADOW_REGS (SHADOW_REGS),
+      .DUAL_ISSUE  (DUAL_ISSUE),
+      .EARLY_BRANCH(EARLY_BRANCH)
+  ) koishi (
       .clk  (clk),
       .rst_n(rst_n_sync),
 
-      .instr_addr(instr_addr),
-      .instr_data(instr_data),
+      .instr_addr      (instr_addr),
+      .instr_data      (instr_data),
+      .instr_ready     (instr_ready),
+      .instr_data_next (instr_data_next),
+      .instr_next_valid(instr_next_valid),
 
-      .data_addr   (data_addr),
-      .data_wdata  (data_wdata),
-      .data_wenable(data_wenable),
+      .data_addr   (cpu_data_addr),
+      .data_wdata  (cpu_data_wdata),
+      .data_wenable(cpu_data_wenable),
+      .data_ren    (cpu_data_ren),
       .data_rdata  (data_rdata),
+      .data_ready  (cpu_data_ready),
+
+      .irq      (irq),
+      .timer_irq(timer_irq),
+
+      .ext_events(mmio_events)
+  );
+
+  // The blanking interrupts fire as the sync pulses start. Both come from the
+  // video clock, and are turned into a pulse once synchronized.
+  wire v_sync_synced, h_sync_synced;
+  reg v_sync_prev, h_sync_prev;
 
-      .irq(~v_sync)
+  synchronizer v_sync_synchronizer (
+      .clk(clk),
+      .in (v_sync),
+      .out(v_sync_synced)
   );
 
+  synchronizer h_sync_synchronizer (
+      .clk(clk),
+      .in (h_sync),
+      .out(h_sync_synced)
+  );
+
+  always @(posedge clk) begin
+    if (!rst_n_sync) begin
+      v_sync_prev <= 1;
+      h_sync_prev <= 1;
+    end else begin
+      v_sync_prev <= v_sync_synced;
+      h_sync_prev <= h_sync_synced;
+    end
+  end
+
+  wire vblank_irq = v_sync_prev && !v_sync_synced;
+  wire hblank_irq = h_sync_prev && !h_sync_synced;
+
+  // Local interrupt n has cause IRQ_LOCAL + n, listed from the highest n down
+  wire [`IRQ_LOCAL_LINES-1:0] irq = {
+    {(`IRQ_LOCAL_LINES - 6) {1'b0}},
+    dma_irq,
+    audio_irq,
+    lcd_irq,
+    joypad_irq,
+    hblank_irq,
+    vblank_irq
+  };
+
+  // The data bus is shared between the CPU, the DMA controller and the audio
+  // sequencer. The latter two get it whenever the CPU isn't using it (the DMA
+  // first), and keep it until their access completes.
+  localparam OWNER_CPU = 2'd0;
+  localparam OWNER_DMA = 2'd1;
+  localparam OWNER_AUDIO = 2'd2;
+
+  wire [31:0] dma_addr, dma_wdata;
+  wire [3:0] dma_wenable;
+  wire dma_ren;
+
+  wire [31:0] audio_addr;
+  wire audio_ren;
+
+  wire cpu_access = cpu_data_ren || |cpu_data_wenable;
+  wire dma_access = dma_ren || |dma_wenable;
+  reg [1:0] bus_owner;
+
+  wire bus_free = bus_owner == OWNER_CPU && !cpu_access;
+  wire dma_grant = dma_access && (bus_owner == OWNER_DMA || bus_free);
+  wire audio_grant = audio_ren && (bus_owner == OWNER_AUDIO || (bus_free && !dma_access));
+
+  always @(posedge clk) begin
+    if (!rst_n_sync) begin
+      bus_owner <= OWNER_CPU;
+    end else if (data_ready) begin
+      bus_owner <= OWNER_CPU;
+    end else if (dma_grant) begin
+      bus_owner <= OWNER_DMA;
+    end else if (audio_grant) begin
+      bus_owner <= OWNER_AUDIO;
+    end
+  end
+
+  reg [31:0] data_addr;
+  reg [31:0] data_wdata;
+  reg [ 3:0] data_wenable;
+  reg        data_ren;
+  wire       data_ready;
+
+  always @(*) begin
+    if (dma_grant) begin
+      data_addr    = dma_addr;
+      data_wdata   = dma_wdata;
+      data_wenable = dma_wenable;
+      data_ren     = dma_ren;
+    end else if (audio_grant) begin
+      data_addr    = audio_addr;
+      data_wdata   = 32'b0;
+      data_wenable = 4'b0000;
+      data_ren     = 1;
+    end else begin
+      data_addr    = cpu_data_addr;
+      data_wdata   = cpu_data_wdata;
+      data_wenable = cpu_data_wenable;
+      data_ren     = cpu_data_ren;
+    end
+  end
+
+  assign cpu_data_ready = dma_grant || audio_grant ? !cpu_access : data_ready;
+
   reg [ 3:0] data_select;
   reg [31:0] data_rdata;
 
   always @(*) begin
     casez (data_addr[31:28])
       4'b000z: data_select = SEL_RAM;
-      4'b001z: data_select = SEL_RNG;
+      4'b0010: data_select = SEL_RNG;
+      4'b0011: data_select = SEL_DMA;
       4'b0100: data_select = SEL_VTATTR;
       4'b0101: data_select = SEL_VTDATA;
-      4'b011z: data_select = SEL_JOYPAD;
+      4'b0110: data_select = SEL_JOYPAD;
+      4'b0111: data_select = SEL_TIMER;
       4'b100z: data_select = SEL_VPAL;
       4'b101z: data_select = SEL_VCTRL;
       4'b110z: data_select = SEL_LCD;
@@ -80,32 +222,180 @@ module tachyon_rv (
     case (data_select)
       SEL_RAM:    data_rdata = mem_rdata;
       SEL_RNG:    data_rdata = rng_data;
-      SEL_VTATTR: data_rdata = {24'b0, tattr_rdata};
+      SEL_VTATTR: data_rdata = {16'b0, tattr_rdata};
       SEL_VTDATA: data_rdata = {16'b0, tdata_rdata};
       SEL_JOYPAD: data_rdata = {24'b0, joypad_rdata};
       SEL_VPAL:   data_rdata = {20'b0, pal_rdata};
-      SEL_LCD:    data_rdata = {24'b0, lcd_data};
+      SEL_VCTRL:  data_rdata = vctrl_rdata;
+      SEL_LCD:    data_rdata = {24'b0, lcd_rdata};
       SEL_AUDIO:  data_rdata = audio_rdata;
+      SEL_DMA:    data_rdata = dma_rdata;
+      SEL_TIMER:  data_rdata = timer_rdata;
       default:    data_rdata = {32{1'bx}};
     endcase
   end
 
 
-  wire [31:0] mem_rdata;
+  // One performance counter event per peripheral, in HPM_EVENT_MMIO_* order.
+  // Only the CPU's own accesses count, not the DMA's or the audio sequencer's.
+  wire mmio_access = !dma_grant && !audio_grant && (data_ren || |data_wenable);
+  wire [7:0] mmio_events = {
+    mmio_access && data_select == SEL_AUDIO,
+    mmio_access && data_select == SEL_LCD,
+    mmio_access && data_select == SEL_VCTRL,
+    mmio_access && data_select == SEL_VPAL,
+    mmio_access && data_select == SEL_JOYPAD,
+    mmio_access && data_select == SEL_VTDATA,
+    mmio_access && data_select == SEL_VTATTR,
+    mmio_access && data_select == SEL_RNG
+  };
 
-  dual_word_ram #(
-      .SOURCE_FILE("/home/jdgt/Code/utec/arqui/riscv-cpu/build/firmware/firmware.mem")
-  ) patchy (
-      .clk(clk),
+  wire [31:0] mem_rdata;
 
-      .addr_1   (data_addr[13:0]),
-      .wdata_1  (data_wdata),
-      .wenable_1(data_wenable & {4{data_select == SEL_RAM}}),
-      .rdata_1  (mem_rdata),
-
-      .addr_2 (instr_addr[13:0]),
-      .rdata_2(instr_data)
-  );
+  generate
+    if (USE_CACHES) begin : g_caches
+      localparam LINE_BITS = 32 * (2 ** CACHE_WORD_BITS);
+
+      wire icache_mem_req, icache_mem_ready;
+      wire [31:0] icache_mem_addr;
+      wire [LINE_BITS-1:0] icache_mem_rdata;
+
+      wire [31:0] icache_hits, icache_misses, icache_refill_cycles;
+
+      icache #(
+          .SET_BITS (CACHE_SET_BITS),
+          .WORD_BITS(CACHE_WORD_BITS),
+          .WAYS     (CACHE_WAYS)
+      ) marisa (
+          .clk  (clk),
+          .rst_n(rst_n_sync),
+
+          .req  (1'b1),
+          .addr (instr_addr),
+          .rdata(instr_data),
+          .ready(instr_ready),
+
+          .mem_req  (icache_mem_req),
+          .mem_addr (icache_mem_addr),
+          .mem_ready(icache_mem_ready),
+          .mem_rdata(icache_mem_rdata),
+
+          .hits         (icache_hits),
+          .misses       (icache_misses),
+          .refill_cycles(icache_refill_cycles)
+      );
+
+      assign instr_data_next  = {32{1'bx}};
+      assign instr_next_valid = 0;
+
+      wire dcache_ren, dcache_ready;
+      wire [31:0] dcache_addr, dcache_wdata, dcache_rdata;
+      wire [3:0] dcache_wenable;
+      wire dcache_mem_req, dcache_mem_we, dcache_mem_ready;
+      wire [31:0] dcache_mem_addr;
+      wire [LINE_BITS-1:0] dcache_mem_wdata, dcache_mem_rdata;
+
+      wire [31:0] dcache_hits, dcache_misses, dcache_refill_cycles;
+
+      wire ram_ren = data_ren && data_select == SEL_RAM;
+      wire [3:0] ram_wenable = data_wenable & {4{data_select == SEL_RAM}};
+
+      if (STORE_BUFFER) begin : g_store_buffer
+        store_buffer momiji (
+            .clk  (clk),
+            .rst_n(rst_n_sync),
+
+            .ren    (ram_ren),
+            .addr   (data_addr),
+            .wdata  (data_wdata),
+            .wenable(ram_wenable),
+            .rdata  (mem_rdata),
+            .ready  (data_ready),
+
+            .mem_ren    (dcache_ren),
+            .mem_addr   (dcache_addr),
+            .mem_wdata  (dcache_wdata),
+            .mem_wenable(dcache_wenable),
+            .mem_rdata  (dcache_rdata),
+            .mem_ready  (dcache_ready)
+        );
+      end else begin : g_no_store_buffer
+        assign dcache_ren     = ram_ren;
+        assign dcache_addr    = data_addr;
+        assign dcache_wdata   = data_wdata;
+        assign dcache_wenable = ram_wenable;
+        assign mem_rdata      = dcache_rdata;
+        assign data_ready     = dcache_ready;
+      end
+
+      dcache #(
+          .SET_BITS (CACHE_SET_BITS),
+          .WORD_BITS(CACHE_WORD_BITS),
+          .WAYS     (CACHE_WAYS)
+      ) alice (
+          .clk  (clk),
+          .rst_n(rst_n_sync),
+
+          .ren    (dcache_ren),
+          .addr   (dcache_addr),
+          .wdata  (dcache_wdata),
+          .wenable(dcache_wenable),
+          .rdata  (dcache_rdata),
+          .ready  (dcache_ready),
+
+          .mem_req  (dcache_mem_req),
+          .mem_we   (dcache_mem_we),
+          .mem_addr (dcache_mem_addr),
+          .mem_wdata(dcache_mem_wdata),
+          .mem_ready(dcache_mem_ready),
+          .mem_rdata(dcache_mem_rdata),
+
+          .hits         (dcache_hits),
+          .misses       (dcache_misses),
+          .refill_cycles(dcache_refill_cycles)
+      );
+
+      backing_ram #(
+          .SOURCE_FILE("/home/jdgt/Code/utec/arqui/riscv-cpu/build/firmware/firmware.mem"),
+          .WORD_BITS  (CACHE_WORD_BITS),
+          .LATENCY    (MEM_LATENCY)
+      ) patchy (
+          .clk  (clk),
+          .rst_n(rst_n_sync),
+
+          .req_1  (dcache_mem_req),
+          .we_1   (dcache_mem_we),
+          .addr_1 (dcache_mem_addr),
+          .wdata_1(dcache_mem_wdata),
+          .ready_1(dcache_mem_ready),
+          .rdata_1(dcache_mem_rdata),
+
+          .req_2  (icache_mem_req),
+          .addr_2 (icache_mem_addr),
+          .ready_2(icache_mem_ready),
+          .rdata_2(icache_mem_rdata)
+      );
+    end else begin : g_no_caches
+      dual_word_ram #(
+          .SOURCE_FILE("/home/jdgt/Code/utec/arqui/riscv-cpu/build/firmware/firmware.mem")
+      ) patchy (
+          .clk(clk),
+
+          .addr_1   (data_addr[13:0]),
+          .wdata_1  (data_wdata),
+          .wenable_1(data_wenable & {4{data_select == SEL_RAM}}),
+          .rdata_1  (mem_rdata),
+
+          .addr_2      (instr_addr[13:0]),
+          .rdata_2     (instr_data),
+          .rdata_2_next(instr_data_next)
+      );
+
+      assign instr_next_valid = 1;
+      assign instr_ready = 1;
+      assign data_ready  = 1;
+    end
+  endgenerate
 
   wire [31:0] rng_data;
 
@@ -114,32 +404,72 @@ module tachyon_rv (
       .out(rng_data)
   );
 
-  wire [ 7:0] tattr_rdata;
+  wire [31:0] dma_rdata;
+  wire        dma_irq;
+
+  dma_unit sakuya (
+      .clk  (clk),
+      .rst_n(rst_n_sync),
+
+      .reg_sel(data_addr[4:2]),
+      .wdata  (data_wdata),
+      .wenable(|data_wenable && data_select == SEL_DMA && !dma_grant),
+      .rdata  (dma_rdata),
+
+      .m_addr   (dma_addr),
+      .m_wdata  (dma_wdata),
+      .m_wenable(dma_wenable),
+      .m_ren    (dma_ren),
+      .m_rdata  (data_rdata),
+      .m_ready  (dma_grant && data_ready),
+
+      .irq(dma_irq)
+  );
+
+  wire [31:0] timer_rdata;
+  wire        timer_irq;
+
+  timer_unit eirin (
+      .clk  (clk),
+      .rst_n(rst_n_sync),
+
+      .reg_sel(data_addr[3:2]),
+      .wdata  (data_wdata),
+      .wenable(|data_wenable && data_select == SEL_TIMER),
+      .rdata  (timer_rdata),
+
+      .irq(timer_irq)
+  );
+
+  wire [15:0] tattr_rdata;
   wire [15:0] tdata_rdata;
   wire [11:0] pal_rdata;
+  wire [31:0] vctrl_rdata;
 
   video_unit keiki (
       .clk  (clk_vga),
       .wclk (clk),
       .rst_n(rst_n_sync),
 
-      .tattr_addr   (data_addr[8:0]),
-      .tattr_wdata  (data_wdata[7:0]),
-      .tattr_wenable(data_wenable[0] && data_select == SEL_VTATTR),
+      .tattr_addr   (data_addr[11:0]),
+      .tattr_wdata  (data_wdata[15:0]),
+      .tattr_wenable(data_wenable[1:0] & {2{data_select == SEL_VTATTR}}),
       .tattr_rdata  (tattr_rdata),
 
-      .tdata_addr   (data_addr[7:0]),
+      .tdata_addr   (data_addr[11:0]),
       .tdata_wdata  (data_wdata[15:0]),
       .tdata_wenable(data_wenable[1:0] & {2{data_select == SEL_VTDATA}}),
       .tdata_rdata  (tdata_rdata),
 
-      .pal_addr   (data_addr[4:1]),
+      .pal_addr   (data_addr[5:1]),
       .pal_wdata  (data_wdata[11:0]),
       .pal_wenable(&data_wenable[1:0] && data_select == SEL_VPAL),
       .pal_rdata  (pal_rdata),
 
-      .ctrl_wdata  (data_wdata[0]),
+      .ctrl_addr   (data_addr[8:2]),
+      .ctrl_wdata  (data_wdata),
       .ctrl_wenable(data_wenable[0] && data_select == SEL_VCTRL),
+      .ctrl_rdata  (vctrl_rdata),
 
       .vga_red  (vga_red),
       .vga_green(vga_green),
@@ -148,13 +478,19 @@ module tachyon_rv (
       .v_sync   (v_sync)
   );
 
+  wire [7:0] lcd_rdata;
+  wire       lcd_irq;
+
   lcd_unit nitori (
       .clk  (clk),
       .rst_n(rst_n_sync),
 
-      .rs     (data_addr[0]),
+      .addr   (data_addr[1:0]),
       .wdata  (data_wdata[7:0]),
       .wenable(data_wenable[0] && data_select == SEL_LCD),
+      .rdata  (lcd_rdata),
+
+      .irq(lcd_irq),
 
       .lcd_data  (lcd_data),
       .lcd_ctrl  (lcd_ctrl),
@@ -163,16 +499,23 @@ module tachyon_rv (
 
   wire [31:0] audio_rdata;
   wire [ 8:0] audio_duty;
+  wire        audio_irq;
 
   audio_unit raiko (
       .clk  (clk),
       .rst_n(rst_n_sync),
 
-      .channel_sel(data_addr[4:3]),
-      .pv_sel     (data_addr[2]),
-      .wdata      (data_wdata),
-      .wenable    (|data_wenable && data_select == SEL_AUDIO),
-      .rdata      (audio_rdata),
+      .addr   (data_addr[7:0]),
+      .wdata  (data_wdata),
+      .wenable(|data_wenable && data_select == SEL_AUDIO),
+      .rdata  (audio_rdata),
+
+      .m_addr (audio_addr),
+      .m_ren  (audio_ren),
+      .m_rdata(data_rdata),
+      .m_ready(audio_grant && data_ready),
+
+      .irq(audio_irq),
 
       .out(audio_duty)
   );
@@ -186,6 +529,7 @@ module tachyon_rv (
   );
 
   wire [7:0] joypad_rdata;
+  wire       joypad_irq;
 
   nes_bridge sanae (
       .clk  (clk),
@@ -196,6 +540,8 @@ module tachyon_rv (
       .rdata_addr(data_addr[1:0]),
       .rdata     (joypad_rdata),
 
+      .irq(joypad_irq),
+
       .scl_out(joypad_scl_out),
       .sda_in (joypad_sda_in),
       .sda_out(joypad_sda_out)
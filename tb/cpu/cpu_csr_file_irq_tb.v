@@ -0,0 +1,261 @@
+`timescale 1ns / 1ns `default_nettype none
+`include "tb_dump.vh"
+`include "cpu_csr_file.vh"
+
+// Drives cpu_csr_file's interrupt side directly. Local interrupts pulse for a
+// cycle and must stay pending in mip, the lowest local one must be taken
+// first and any of them before the timer, and the vector must be mtvec's base
+// plus 4 * cause when vectored, or the base alone otherwise. Taking an
+// interrupt must clear that one local line only, even as another pulse on it
+// arrives on the same cycle, while the timer follows its input. Traps must
+// save mstatus.MIE into MPIE and clear it, and mret must restore it, with
+// MIE only gating irq_pending, not irq_wake. Interrupts not enabled in mie
+// must do neither.
+module cpu_csr_file_irq_tb ();
+  reg clk, rst_n;
+  always #5 clk = ~clk;
+
+  `TB_DUMP(cpu_csr_file_irq_tb, clk)
+
+  localparam MTVEC_BASE = 32'h0000_0100;
+  localparam EPC = 32'h0000_1234;
+
+  localparam MIE = 32'h1 << `MSTATUS_MIE;
+  localparam MPIE = 32'h1 << `MSTATUS_MPIE;
+  // MPP always reads as machine mode
+  localparam MPP = 32'h1800;
+
+  reg  [11:0] raddr;
+  wire [31:0] rdata;
+
+  reg  [11:0] waddr;
+  reg  [31:0] wdata;
+  reg         wenable;
+
+  reg  [`IRQ_LOCAL_LINES-1:0] irq;
+  reg         timer_irq;
+
+  wire        irq_pending;
+  wire [ 4:0] irq_cause;
+  wire [31:0] trap_vector;
+  wire        irq_wake;
+
+  reg         trap;
+  reg  [31:0] trap_epc;
+  reg  [ 4:0] trap_cause;
+  reg         mret;
+
+  cpu_csr_file csr_file (
+      .clk  (clk),
+      .rst_n(rst_n),
+
+      .raddr(raddr),
+      .rdata(rdata),
+
+      .waddr  (waddr),
+      .wdata  (wdata),
+      .wenable(wenable),
+
+      .bubble_w  (1'b1),
+      .bubble_b_w(1'b1),
+      .events    ({`HPM_EVENTS{1'b0}}),
+
+      .irq        (irq),
+      .timer_irq  (timer_irq),
+      .irq_pending(irq_pending),
+      .irq_cause  (irq_cause),
+      .trap_vector(trap_vector),
+      .irq_wake   (irq_wake),
+
+      .trap      (trap),
+      .trap_epc  (trap_epc),
+      .trap_cause(trap_cause),
+      .mret      (mret),
+
+      .fp_flags(5'b0),
+      .frm     ()
+  );
+
+  integer errors, step;
+
+  task write_csr(input [11:0] addr, input [31:0] value);
+    begin
+      waddr   = addr;
+      wdata   = value;
+      wenable = 1;
+      @(negedge clk);
+      wenable = 0;
+    end
+  endtask
+
+  task pulse_irq(input [`IRQ_LOCAL_LINES-1:0] lines);
+    begin
+      irq = lines;
+      @(negedge clk);
+      irq = 0;
+    end
+  endtask
+
+  task take_trap(input [4:0] cause);
+    begin
+      trap       = 1;
+      trap_epc   = EPC + cause;
+      trap_cause = cause;
+      @(negedge clk);
+      trap = 0;
+    end
+  endtask
+
+  task take_mret;
+    begin
+      mret = 1;
+      @(negedge clk);
+      mret = 0;
+    end
+  endtask
+
+  task check_csr(input [11:0] addr, input [31:0] expected);
+    begin
+      raddr = addr;
+      #1;
+
+      if (rdata !== expected) begin
+        $display("step %0d: csr %h = %h, expected %h", step, addr, rdata, expected);
+        errors = errors + 1;
+      end
+    end
+  endtask
+
+  task check_irq(input pending, input wake, input [4:0] cause, input [31:0] vector);
+    begin
+      if (irq_pending !== pending || irq_wake !== wake) begin
+        $display("step %0d: pending %b and wake %b, expected %b and %b", step, irq_pending,
+                 irq_wake, pending, wake);
+        errors = errors + 1;
+      end
+
+      if (wake && (irq_cause !== cause || trap_vector !== vector)) begin
+        $display("step %0d: cause %0d to %h, expected %0d to %h", step, irq_cause,
+                 trap_vector, cause, vector);
+        errors = errors + 1;
+      end
+    end
+  endtask
+
+  initial begin
+    errors = 0;
+    step = 0;
+    raddr = 0;
+    waddr = 0;
+    wdata = 0;
+    wenable = 0;
+    irq = 0;
+    timer_irq = 0;
+    trap = 0;
+    trap_epc = 0;
+    trap_cause = 0;
+    mret = 0;
+
+    clk = 1;
+    rst_n = 0;
+    #15 rst_n = 1;
+    @(negedge clk);
+
+    // A pulse with nothing enabled stays pending, but wakes nothing
+    step = 1;
+    pulse_irq(16'h0008);
+    @(negedge clk);
+    check_csr(`CSR_MIP, 32'h1 << (`IRQ_LOCAL + 3));
+    check_irq(0, 0, 0, 0);
+
+    // Enabling it in mie wakes, and with mstatus.MIE interrupts
+    step = 2;
+    write_csr(`CSR_MTVEC, MTVEC_BASE | 1);
+    write_csr(`CSR_MIE, 32'hFFFF_FFFF);
+    check_csr(`CSR_MIE, 32'hFFFF_0080);
+    check_irq(0, 1, `IRQ_LOCAL + 3, MTVEC_BASE + 4 * (`IRQ_LOCAL + 3));
+    write_csr(`CSR_MSTATUS, MIE);
+    check_irq(1, 1, `IRQ_LOCAL + 3, MTVEC_BASE + 4 * (`IRQ_LOCAL + 3));
+
+    // Local interrupts go before the timer, lower ones first
+    step = 3;
+    timer_irq = 1;
+    @(negedge clk);
+    check_csr(`CSR_MIP, 32'h1 << (`IRQ_LOCAL + 3) | 32'h1 << `IRQ_MTI);
+    check_irq(1, 1, `IRQ_LOCAL + 3, MTVEC_BASE + 4 * (`IRQ_LOCAL + 3));
+    pulse_irq(16'h0002);
+    check_irq(1, 1, `IRQ_LOCAL + 1, MTVEC_BASE + 4 * (`IRQ_LOCAL + 1));
+
+    // Taking it clears its line only, and saves MIE into MPIE
+    step = 4;
+    take_trap(`IRQ_LOCAL + 1);
+    check_csr(`CSR_MIP, 32'h1 << (`IRQ_LOCAL + 3) | 32'h1 << `IRQ_MTI);
+    check_csr(`CSR_MSTATUS, MPP | MPIE);
+    check_csr(`CSR_MEPC, EPC + `IRQ_LOCAL + 1);
+    check_csr(`CSR_MCAUSE, 32'h8000_0000 | `IRQ_LOCAL + 1);
+    check_irq(0, 1, `IRQ_LOCAL + 3, MTVEC_BASE + 4 * (`IRQ_LOCAL + 3));
+
+    // mret brings MIE back
+    step = 5;
+    take_mret;
+    check_csr(`CSR_MSTATUS, MPP | MPIE | MIE);
+    check_irq(1, 1, `IRQ_LOCAL + 3, MTVEC_BASE + 4 * (`IRQ_LOCAL + 3));
+
+    // A pulse on the line being taken stays pending
+    step = 6;
+    irq = 16'h0008;
+    take_trap(`IRQ_LOCAL + 3);
+    irq = 0;
+    check_csr(`CSR_MIP, 32'h1 << (`IRQ_LOCAL + 3) | 32'h1 << `IRQ_MTI);
+    take_trap(`IRQ_LOCAL + 3);
+    check_csr(`CSR_MIP, 32'h1 << `IRQ_MTI);
+
+    // Trapping again with MIE clear saves a clear MPIE, which mret restores,
+    // setting MPIE
+    step = 7;
+    check_csr(`CSR_MSTATUS, MPP);
+    take_mret;
+    check_csr(`CSR_MSTATUS, MPP | MPIE);
+    check_irq(0, 1, `IRQ_MTI, MTVEC_BASE + 4 * `IRQ_MTI);
+    take_mret;
+    check_csr(`CSR_MSTATUS, MPP | MPIE | MIE);
+
+    // The timer stays pending until its input drops
+    step = 8;
+    check_irq(1, 1, `IRQ_MTI, MTVEC_BASE + 4 * `IRQ_MTI);
+    take_trap(`IRQ_MTI);
+    check_csr(`CSR_MIP, 32'h1 << `IRQ_MTI);
+    check_csr(`CSR_MCAUSE, 32'h8000_0000 | `IRQ_MTI);
+    timer_irq = 0;
+    @(negedge clk);
+    check_csr(`CSR_MIP, 0);
+    check_irq(0, 0, 0, 0);
+    take_mret;
+
+    // Direct mode sends everything to the base, and mip writes clear lines
+    step = 9;
+    write_csr(`CSR_MTVEC, MTVEC_BASE);
+    pulse_irq(16'h8000);
+    check_irq(1, 1, `IRQ_LOCAL + 15, MTVEC_BASE);
+    write_csr(`CSR_MIP, 0);
+    check_csr(`CSR_MIP, 0);
+    check_irq(0, 0, 0, 0);
+
+    // Disabling a line in mie masks it, but keeps it pending
+    step = 10;
+    write_csr(`CSR_MIE, 32'hFFFE_0080);
+    pulse_irq(16'h0001);
+    check_csr(`CSR_MIP, 32'h1 << `IRQ_LOCAL);
+    check_irq(0, 0, 0, 0);
+    write_csr(`CSR_MIE, 32'hFFFF_0080);
+    check_irq(1, 1, `IRQ_LOCAL, MTVEC_BASE);
+
+    $display("");
+    $display("%0d errors", errors);
+    if (errors != 0) $display("FAILED");
+    else $display("PASSED");
+    $display("");
+
+    $finish();
+  end
+endmodule
@@ -0,0 +1,122 @@
+`timescale 1ns / 1ns `default_nettype none
+`include "tb_dump.vh"
+`include "cpu_muldiv.vh"
+
+// Runs the same division on the iterative divider with stall low, with stall
+// raised in the middle of it, and with stall held from the start while the
+// operands are still garbage. The one in the middle must finish on the same
+// cycle as the first, the held one as many cycles later as it waited, and
+// the results must stay put for as long as stall is set after done.
+module cpu_muldiv_tb ();
+  reg clk, rst_n;
+  always #5 clk = ~clk;
+
+  `TB_DUMP(cpu_muldiv_tb, clk)
+
+  localparam DIVIDEND = 32'h7FFFFFFF;
+  localparam DIVISOR = 3;
+  localparam QUOTIENT = DIVIDEND / DIVISOR;
+  localparam WAIT = 4;
+
+  reg [31:0] src_a, src_b;
+  reg start, stall;
+
+  wire        done;
+  wire [31:0] result;
+
+  cpu_muldiv #(
+      .ITERATIVE_DIV(1)
+  ) muldiv (
+      .clk  (clk),
+      .rst_n(rst_n),
+
+      .src_a  (src_a),
+      .src_b  (src_b),
+      .control(`MD_DIVU),
+      .start  (start),
+      .stall  (stall),
+
+      .done  (done),
+      .result(result)
+  );
+
+  // Each run raises stall over [stall_from, stall_to) while holding start
+  reg [7:0] stall_from[0:2];
+  reg [7:0] stall_to[0:2];
+  integer expected[0:2];
+  integer errors, cycles, run, i;
+
+  initial begin
+    stall_from[0] = 0;
+    stall_to[0] = 0;
+    stall_from[1] = 3;
+    stall_to[1] = 3 + WAIT;
+    stall_from[2] = 0;
+    stall_to[2] = WAIT;
+
+    errors = 0;
+    start = 0;
+    stall = 0;
+    src_a = 0;
+    src_b = 0;
+
+    clk = 1;
+    rst_n = 0;
+    #15 rst_n = 1;
+    #1;
+
+    for (run = 0; run < 3; run = run + 1) begin
+      start  = 1;
+      cycles = 0;
+
+      while (!done) begin
+        stall = cycles >= stall_from[run] && cycles < stall_to[run];
+
+        // Operands are only valid once stall drops
+        src_a = stall && stall_from[run] == 0 ? 32'hDEADBEEF : DIVIDEND;
+        src_b = stall && stall_from[run] == 0 ? 32'd0 : DIVISOR;
+
+        @(posedge clk);
+        #1 cycles = cycles + 1;
+      end
+
+      // Stalling in the middle costs nothing, stalling at the start delays it
+      if (run == 0) begin
+        expected[0] = cycles;
+        expected[1] = cycles;
+        expected[2] = cycles + WAIT;
+      end
+
+      if (cycles != expected[run] || result !== QUOTIENT) begin
+        $display("run %0d: %h after %0d cycles, expected %h after %0d", run, result, cycles,
+                 QUOTIENT, expected[run]);
+        errors = errors + 1;
+      end
+
+      // Consumer held: done and the result stay
+      stall = 1;
+      for (i = 0; i < 3; i = i + 1) begin
+        @(posedge clk);
+        #1;
+        if (!done || result !== QUOTIENT) begin
+          $display("run %0d: result dropped while held", run);
+          errors = errors + 1;
+        end
+      end
+
+      stall = 0;
+      start = 0;
+      @(posedge clk);
+      #1;
+    end
+
+    $display("");
+    $display("division took %0d cycles", expected[0]);
+    $display("%0d errors", errors);
+    if (errors != 0) $display("FAILED");
+    else $display("PASSED");
+    $display("");
+
+    $finish();
+  end
+endmodule
@@ -1,9 +1,12 @@
 `timescale 1ns / 1ns `default_nettype none
+`include "tb_dump.vh"
 
 module pipelined_cpu_tb ();
   reg clk, rst_n;
   always #5 clk = ~clk;
 
+  `TB_DUMP(pipelined_cpu_tb, clk)
+
   wire [31:0] instr_addr;
   wire [31:0] data_addr;
   wire [31:0] data_wdata;
@@ -32,13 +35,19 @@ module pipelined_cpu_tb ();
 
       .instr_addr(instr_addr),
       .instr_data(instr_rdata),
+      .instr_ready(1'b1),
 
       .data_addr(data_addr),
       .data_wdata(data_wdata),
       .data_wenable(data_wenable),
+      .data_ren(),
       .data_rdata(data_rdata),
+      .data_ready(1'b1),
+
+      .irq(16'b0),
+      .timer_irq(1'b0),
 
-      .irq(1'b0)
+      .ext_events(8'b0)
   );
 
   always @(posedge clk) begin
@@ -49,8 +58,6 @@ module pipelined_cpu_tb ();
   end
 
   initial begin
-    $dumpvars(0, pipelined_cpu_tb);
-
     clk   = 1;
     rst_n = 0;
     #15 rst_n = 1;
@@ -0,0 +1,269 @@
+`timescale 1ns / 1ns `default_nettype none
+`include "tb_dump.vh"
+`include "tb_pl_core.vh"
+
+// Runs the same program without a predictor, with bimodal and with gshare:
+//
+//  1. A loop that calls three levels deep, which fits in the return stack.
+//     The innermost call branches to its return on all but the last
+//     iteration. Once trained, the predictors must get every call, return and
+//     branch right but that last one, where without one each taken one is a
+//     miss. That miss fetches the return and pops the return stack on the
+//     wrong path, which the predictor must undo.
+//  2. A loop that calls a function returning past the instruction after the
+//     call, so its return always misses. The instruction it skips must never
+//     retire, and the three-level calls right after must still be predicted.
+//  3. A recursion seven calls deep, which overflows the return stack.
+//
+// The accumulated values are stored along the way and must be the same for
+// all three. Misses are counted over the last iterations of each loop, by
+// which point gshare's history has settled.
+module pl_branch_predictor_tb ();
+  reg clk, rst_n;
+  always #5 clk = ~clk;
+
+  `TB_DUMP(pl_branch_predictor_tb, clk)
+
+  pl_branch_predictor_bench #(
+      .BRANCH_PREDICTOR(`BP_NONE)
+  ) none (
+      .clk  (clk),
+      .rst_n(rst_n)
+  );
+
+  pl_branch_predictor_bench #(
+      .BRANCH_PREDICTOR(`BP_BIMODAL)
+  ) bimodal (
+      .clk  (clk),
+      .rst_n(rst_n)
+  );
+
+  pl_branch_predictor_bench #(
+      .BRANCH_PREDICTOR(`BP_GSHARE)
+  ) gshare (
+      .clk  (clk),
+      .rst_n(rst_n)
+  );
+
+  integer errors;
+
+  initial begin
+    clk   = 1;
+    rst_n = 0;
+    #15 rst_n = 1;
+
+    wait (none.finished && bimodal.finished && gshare.finished);
+
+    errors = none.errors + bimodal.errors + gshare.errors;
+
+    $display("");
+    $display("program finished in %0d cycles, %0d with bimodal, %0d with gshare", none.cycles,
+             bimodal.cycles, gshare.cycles);
+    $display("misses: %0d, %0d with bimodal, %0d with gshare", none.core.cpu.bp_misses,
+             bimodal.core.cpu.bp_misses, gshare.core.cpu.bp_misses);
+    $display("%0d errors", errors);
+    if (errors != 0) $display("FAILED");
+    else $display("PASSED");
+    $display("");
+
+    $finish();
+  end
+endmodule
+
+module pl_branch_predictor_bench #(
+    parameter BRANCH_PREDICTOR = `BP_GSHARE
+) (
+    input wire clk,
+    input wire rst_n
+);
+  localparam DATA = 32'h1000;
+  localparam STACK = 32'h1800;
+
+  localparam CALL_ITERATIONS = 16;
+  localparam SKIP_ITERATIONS = 14;
+  localparam DEPTH = 6;
+  localparam RESULTS = CALL_ITERATIONS + SKIP_ITERATIONS + 1;
+
+  // Stores that open and close the windows misses are counted over
+  localparam CALL_FROM = 10;
+  localparam CALL_TO = CALL_ITERATIONS - 1;
+  localparam SKIP_FROM = CALL_ITERATIONS + 10;
+  localparam SKIP_TO = CALL_ITERATIONS + SKIP_ITERATIONS - 1;
+
+  // Without a predictor, every call, return and taken branch misses. With
+  // one, the innermost branch misses on the last iteration, as does every
+  // return that skips an instruction.
+  localparam CALL_MISSES = BRANCH_PREDICTOR == `BP_NONE ? 8 * (CALL_TO - CALL_FROM) - 1 : 1;
+  localparam SKIP_MISSES = BRANCH_PREDICTOR == `BP_NONE ? 10 * (SKIP_TO - SKIP_FROM) - 1 :
+                           SKIP_TO - SKIP_FROM + 1;
+
+  localparam RA = 1;
+  localparam SP = 2;
+  localparam S0 = 8;
+  localparam A0 = 10;
+  localparam A1 = 11;
+  localparam A2 = 12;
+  localparam T1 = 6;
+  localparam T3 = 28;
+  localparam T4 = 29;
+  localparam T5 = 30;
+
+  `include "tb_rv32.vh"
+
+  // The words the functions start at, placed so that no two branches of the
+  // first two loops share a BTB entry
+  localparam SKIP = 25;
+  localparam F1 = 28;
+  localparam F2 = 40;
+  localparam F3 = 48;
+  localparam REC = 52;
+
+  localparam RET = 32'h00008067;  // jalr zero, 0(ra)
+
+  wire [31:0] data_addr;
+  wire [31:0] data_wdata;
+  wire [ 3:0] data_wenable;
+
+  tb_pl_core #(
+      .BRANCH_PREDICTOR(BRANCH_PREDICTOR)
+  ) core (
+      .clk  (clk),
+      .rst_n(rst_n),
+
+      .data_addr   (data_addr),
+      .data_wdata  (data_wdata),
+      .data_wenable(data_wenable)
+  );
+
+  reg [31:0] expected[0:RESULTS-1];
+  reg [31:0] misses_from;
+  integer errors, cycles, stored, i;
+  reg finished;
+
+  always @(posedge clk) begin
+    if (rst_n && !finished) cycles = cycles + 1;
+
+    if (rst_n && |data_wenable && data_addr == DATA) begin
+      if (data_wdata !== expected[stored]) begin
+        $display("predictor %0d, result %0d: stored %0d, expected %0d", BRANCH_PREDICTOR,
+                 stored, data_wdata, expected[stored]);
+        errors = errors + 1;
+      end
+
+      // Branches before the store have been resolved, the ones after not yet
+      if (stored == CALL_FROM || stored == SKIP_FROM) misses_from = core.cpu.bp_misses;
+
+      if (stored == CALL_TO && core.cpu.bp_misses - misses_from != CALL_MISSES) begin
+        $display("predictor %0d: %0d misses over the calls, expected %0d", BRANCH_PREDICTOR,
+                 core.cpu.bp_misses - misses_from, CALL_MISSES);
+        errors = errors + 1;
+      end
+
+      if (stored == SKIP_TO && core.cpu.bp_misses - misses_from != SKIP_MISSES) begin
+        $display("predictor %0d: %0d misses over the skipping returns, expected %0d",
+                 BRANCH_PREDICTOR, core.cpu.bp_misses - misses_from, SKIP_MISSES);
+        errors = errors + 1;
+      end
+
+      stored = stored + 1;
+    end
+
+    if (rst_n && |data_wenable && data_addr == DATA + 4) begin
+      if (stored != RESULTS) begin
+        $display("predictor %0d: %0d results stored, expected %0d", BRANCH_PREDICTOR, stored,
+                 RESULTS);
+        errors = errors + 1;
+      end
+
+      finished = 1;
+    end
+  end
+
+  initial begin
+    for (i = 0; i < 2 ** 11; i = i + 1) core.ram.data[i] = NOP;
+
+    core.ram.data[0] = lui(S0, DATA >> 12);
+    core.ram.data[1] = lui(SP, STACK >> 12);
+    core.ram.data[2] = addi(A0, 0, 0);
+    core.ram.data[3] = addi(T3, 0, 0);
+    core.ram.data[4] = addi(T4, 0, CALL_ITERATIONS);
+    core.ram.data[5] = addi(T5, 0, CALL_ITERATIONS - 1);
+
+    // 1: a0 += 7 three levels down, and 16 more on the last iteration
+    core.ram.data[6] = jal(RA, (F1 - 6) * 4);
+    core.ram.data[7] = sw(A0, S0, 0);
+    core.ram.data[8] = addi(T3, T3, 1);
+    core.ram.data[9] = blt(T3, T4, -13'd12);
+
+    // 2: a0 += 1 in skip, which returns to the jal after the addi, then as in 1
+    core.ram.data[10] = addi(T3, 0, 0);
+    core.ram.data[11] = addi(T4, 0, SKIP_ITERATIONS);
+    core.ram.data[12] = addi(T5, 0, SKIP_ITERATIONS - 1);
+    core.ram.data[13] = jal(RA, (SKIP - 13) * 4);
+    core.ram.data[14] = addi(A0, A0, 100);  // never retires
+    core.ram.data[15] = jal(RA, (F1 - 15) * 4);
+    core.ram.data[16] = sw(A0, S0, 0);
+    core.ram.data[17] = addi(T3, T3, 1);
+    core.ram.data[18] = blt(T3, T4, -13'd20);
+
+    // 3: a2 = DEPTH + ... + 1
+    core.ram.data[19] = addi(A1, 0, DEPTH);
+    core.ram.data[20] = addi(A2, 0, 0);
+    core.ram.data[21] = jal(RA, (REC - 21) * 4);
+    core.ram.data[22] = sw(A2, S0, 0);
+    core.ram.data[23] = sw(0, S0, 4);
+    core.ram.data[24] = jal(0, 0);
+
+    core.ram.data[SKIP] = addi(A0, A0, 1);
+    core.ram.data[SKIP+1] = addi(RA, RA, 4);
+    core.ram.data[SKIP+2] = RET;
+
+    core.ram.data[F1] = addi(SP, SP, -12'd4);
+    core.ram.data[F1+1] = sw(RA, SP, 0);
+    core.ram.data[F1+2] = addi(A0, A0, 1);
+    core.ram.data[F1+3] = jal(RA, (F2 - (F1 + 3)) * 4);
+    core.ram.data[F1+4] = lw(RA, SP, 0);
+    core.ram.data[F1+5] = addi(SP, SP, 4);
+    core.ram.data[F1+6] = RET;
+
+    core.ram.data[F2] = addi(SP, SP, -12'd4);
+    core.ram.data[F2+1] = sw(RA, SP, 0);
+    core.ram.data[F2+2] = addi(A0, A0, 2);
+    core.ram.data[F2+3] = jal(RA, (F3 - (F2 + 3)) * 4);
+    core.ram.data[F2+4] = lw(RA, SP, 0);
+    core.ram.data[F2+5] = addi(SP, SP, 4);
+    core.ram.data[F2+6] = RET;
+
+    core.ram.data[F3] = addi(A0, A0, 4);
+    core.ram.data[F3+1] = blt(T3, T5, 13'd8);
+    core.ram.data[F3+2] = addi(A0, A0, 16);  // on the last iteration
+    core.ram.data[F3+3] = RET;
+
+    // rec: a2 += a1 for every a1 down to 1
+    core.ram.data[REC] = branch(3'b000, A1, 0, 13'd44);  // beq a1, zero, to the last ret
+    core.ram.data[REC+1] = addi(SP, SP, -12'd8);
+    core.ram.data[REC+2] = sw(RA, SP, 4);
+    core.ram.data[REC+3] = sw(A1, SP, 0);
+    core.ram.data[REC+4] = addi(A1, A1, -12'd1);
+    core.ram.data[REC+5] = jal(RA, -21'd20);
+    core.ram.data[REC+6] = lw(T1, SP, 0);
+    core.ram.data[REC+7] = add(A2, A2, T1);
+    core.ram.data[REC+8] = lw(RA, SP, 4);
+    core.ram.data[REC+9] = addi(SP, SP, 8);
+    core.ram.data[REC+10] = RET;
+    core.ram.data[REC+11] = RET;
+
+    for (i = 0; i < CALL_ITERATIONS; i = i + 1) expected[i] = 7 * (i + 1);
+    expected[CALL_ITERATIONS-1] = 7 * CALL_ITERATIONS + 16;
+    for (i = 0; i < SKIP_ITERATIONS; i = i + 1) begin
+      expected[CALL_ITERATIONS+i] = expected[CALL_ITERATIONS-1] + 8 * (i + 1);
+    end
+    expected[RESULTS-2] = expected[RESULTS-2] + 16;
+    expected[RESULTS-1] = DEPTH * (DEPTH + 1) / 2;
+
+    errors = 0;
+    cycles = 0;
+    stored = 0;
+    finished = 0;
+  end
+endmodule
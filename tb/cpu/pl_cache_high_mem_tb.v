@@ -0,0 +1,244 @@
+`timescale 1ns / 1ns `default_nettype none
+`include "tb_dump.vh"
+
+// Runs a program that only fits past the 16 KiB of dual_word_ram, fetched
+// through an instruction cache and storing through a small data cache, both in
+// front of a 256 KiB backing_ram. The entry point jumps to code at 36 KiB,
+// which fills a table at 128 KiB and copies it word by word to 192 KiB. Where
+// the 16 KiB RAM would alias the code, there's a loop that never finishes.
+// Every word copied must match the one stored, and once done, the backing
+// memory must hold the table while the words below it stay as loaded.
+module pl_cache_high_mem_tb ();
+  reg clk, rst_n;
+  always #5 clk = ~clk;
+
+  `TB_DUMP(pl_cache_high_mem_tb, clk)
+
+  localparam CODE = 32'h9000;
+  localparam DATA = 32'h20000;
+  localparam OUT = 32'h30000;
+  localparam WORDS = 64;
+  localparam MAX_CYCLES = 100_000;
+
+  localparam S0 = 8;
+  localparam S1 = 9;
+  localparam T0 = 5;
+  localparam T1 = 6;
+  localparam T2 = 7;
+  localparam T3 = 28;
+
+  `include "tb_rv32.vh"
+
+  wire [31:0] instr_addr;
+  wire [31:0] instr_data;
+  wire        instr_ready;
+  wire [31:0] data_addr;
+  wire [31:0] data_wdata;
+  wire [ 3:0] data_wenable;
+  wire        data_ren;
+  wire [31:0] data_rdata;
+  wire        data_ready;
+
+  wire icache_mem_req, icache_mem_ready;
+  wire [31:0] icache_mem_addr;
+  wire [127:0] icache_mem_rdata;
+
+  icache icache (
+      .clk  (clk),
+      .rst_n(rst_n),
+
+      .req  (1'b1),
+      .addr (instr_addr),
+      .rdata(instr_data),
+      .ready(instr_ready),
+
+      .mem_req  (icache_mem_req),
+      .mem_addr (icache_mem_addr),
+      .mem_ready(icache_mem_ready),
+      .mem_rdata(icache_mem_rdata),
+
+      .hits         (),
+      .misses       (),
+      .refill_cycles()
+  );
+
+  wire dcache_mem_req, dcache_mem_we, dcache_mem_ready;
+  wire [31:0] dcache_mem_addr;
+  wire [127:0] dcache_mem_wdata, dcache_mem_rdata;
+
+  // Four sets of four-word lines, so the table keeps being written back
+  dcache #(
+      .SET_BITS(2)
+  ) dcache (
+      .clk  (clk),
+      .rst_n(rst_n),
+
+      .ren    (data_ren),
+      .addr   (data_addr),
+      .wdata  (data_wdata),
+      .wenable(data_wenable),
+      .rdata  (data_rdata),
+      .ready  (data_ready),
+
+      .mem_req  (dcache_mem_req),
+      .mem_we   (dcache_mem_we),
+      .mem_addr (dcache_mem_addr),
+      .mem_wdata(dcache_mem_wdata),
+      .mem_ready(dcache_mem_ready),
+      .mem_rdata(dcache_mem_rdata),
+
+      .hits         (),
+      .misses       (),
+      .refill_cycles()
+  );
+
+  backing_ram ram (
+      .clk  (clk),
+      .rst_n(rst_n),
+
+      .req_1  (dcache_mem_req),
+      .we_1   (dcache_mem_we),
+      .addr_1 (dcache_mem_addr),
+      .wdata_1(dcache_mem_wdata),
+      .ready_1(dcache_mem_ready),
+      .rdata_1(dcache_mem_rdata),
+
+      .req_2  (icache_mem_req),
+      .addr_2 (icache_mem_addr),
+      .ready_2(icache_mem_ready),
+      .rdata_2(icache_mem_rdata)
+  );
+
+  pipelined_cpu cpu (
+      .clk  (clk),
+      .rst_n(rst_n),
+
+      .instr_addr      (instr_addr),
+      .instr_data      (instr_data),
+      .instr_ready     (instr_ready),
+      .instr_data_next (32'b0),
+      .instr_next_valid(1'b0),
+
+      .data_addr   (data_addr),
+      .data_wdata  (data_wdata),
+      .data_wenable(data_wenable),
+      .data_ren    (data_ren),
+      .data_rdata  (data_rdata),
+      .data_ready  (data_ready),
+
+      .irq      (16'b0),
+      .timer_irq(1'b0),
+
+      .ext_events(8'b0)
+  );
+
+  reg [31:0] low[0:CODE/4-1];
+  integer errors, cycles, copied, i;
+  reg finished;
+
+  always @(posedge clk) begin
+    if (rst_n && !finished) begin
+      cycles = cycles + 1;
+
+      if (cycles == MAX_CYCLES) begin
+        $display("no result after %0d cycles, pc at %h", cycles, instr_addr);
+        errors = errors + 1;
+        finished = 1;
+      end
+    end
+
+    if (rst_n && !finished && |data_wenable && data_ready) begin
+      if (data_addr == OUT + 4 * copied) begin
+        if (data_wdata !== 3 * copied + 1) begin
+          $display("word %0d: copied %h, expected %h", copied, data_wdata, 3 * copied + 1);
+          errors = errors + 1;
+        end
+
+        copied = copied + 1;
+      end else if (data_addr == OUT - 4) begin
+        if (copied != WORDS) begin
+          $display("copied %0d words, expected %0d", copied, WORDS);
+          errors = errors + 1;
+        end
+
+        for (i = 0; i < WORDS; i = i + 1) begin
+          if (ram.data[DATA/4+i] !== 3 * i + 1) begin
+            $display("word %0d: memory holds %h, expected %h", i, ram.data[DATA/4+i],
+                     3 * i + 1);
+            errors = errors + 1;
+          end
+        end
+
+        for (i = 0; i < CODE / 4; i = i + 1) begin
+          if (ram.data[i] !== low[i]) begin
+            $display("word %0d: memory holds %h, expected %h", i, ram.data[i], low[i]);
+            errors = errors + 1;
+          end
+        end
+
+        finished = 1;
+      end
+    end
+  end
+
+  initial begin
+    for (i = 0; i < 2 ** 16; i = i + 1) ram.data[i] = NOP;
+
+    ram.data[0] = lui(T0, CODE >> 12);
+    ram.data[1] = jalr(0, T0, 0);
+
+    // Where the code at CODE sits in the 16 KiB RAM
+    ram.data[(CODE%32'h4000)/4] = jal(0, 0);
+
+    ram.data[CODE/4+0] = lui(S0, DATA >> 12);
+    ram.data[CODE/4+1] = lui(S1, OUT >> 12);
+    ram.data[CODE/4+2] = addi(T0, 0, 0);
+    ram.data[CODE/4+3] = addi(T2, S0, 0);
+    ram.data[CODE/4+4] = addi(T3, 0, WORDS);
+    ram.data[CODE/4+5] = addi(T1, 0, 1);
+
+    // fill: word t0 = 3 * t0 + 1
+    ram.data[CODE/4+6] = sw(T1, T2, 0);
+    ram.data[CODE/4+7] = addi(T1, T1, 3);
+    ram.data[CODE/4+8] = addi(T2, T2, 4);
+    ram.data[CODE/4+9] = addi(T0, T0, 1);
+    ram.data[CODE/4+10] = blt(T0, T3, -13'd16);
+
+    ram.data[CODE/4+11] = addi(T0, 0, 0);
+    ram.data[CODE/4+12] = addi(T2, S0, 0);
+
+    // copy: word t0 of DATA to word t0 of OUT
+    ram.data[CODE/4+13] = lw(T1, T2, 0);
+    ram.data[CODE/4+14] = sw(T1, S1, 0);
+    ram.data[CODE/4+15] = addi(T2, T2, 4);
+    ram.data[CODE/4+16] = addi(S1, S1, 4);
+    ram.data[CODE/4+17] = addi(T0, T0, 1);
+    ram.data[CODE/4+18] = blt(T0, T3, -13'd20);
+
+    ram.data[CODE/4+19] = lui(S1, OUT >> 12);
+    ram.data[CODE/4+20] = sw(0, S1, -12'd4);
+    ram.data[CODE/4+21] = jal(0, 0);
+
+    for (i = 0; i < CODE / 4; i = i + 1) low[i] = ram.data[i];
+
+    errors = 0;
+    cycles = 0;
+    copied = 0;
+    finished = 0;
+
+    clk = 1;
+    rst_n = 0;
+    #15 rst_n = 1;
+
+    wait (finished);
+
+    $display("");
+    $display("%0d cycles", cycles);
+    $display("%0d errors", errors);
+    if (errors != 0) $display("FAILED");
+    else $display("PASSED");
+    $display("");
+
+    $finish();
+  end
+endmodule
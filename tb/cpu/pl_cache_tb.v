@@ -0,0 +1,255 @@
+`timescale 1ns / 1ns `default_nettype none
+`include "tb_dump.vh"
+
+// Fills sixteen lines' worth of words through a data cache that only holds
+// four (direct mapped) or eight (two ways) of them, behind a backing_ram that
+// takes LATENCY cycles per line, so dirty lines are evicted all along. A byte
+// store then misses on the first word, and every word is loaded back and
+// stored to a line that keeps evicting and being evicted by the ones read.
+// Every loaded value must match the one stored, and once done, the backing
+// memory must hold all of them.
+module pl_cache_tb ();
+  reg clk, rst_n;
+  always #5 clk = ~clk;
+
+  `TB_DUMP(pl_cache_tb, clk)
+
+  pl_cache_bench #(
+      .WAYS(1)
+  ) direct (
+      .clk  (clk),
+      .rst_n(rst_n)
+  );
+
+  pl_cache_bench #(
+      .WAYS(2)
+  ) two_way (
+      .clk  (clk),
+      .rst_n(rst_n)
+  );
+
+  integer errors;
+
+  initial begin
+    clk   = 1;
+    rst_n = 0;
+    #15 rst_n = 1;
+
+    wait (direct.finished && two_way.finished);
+
+    errors = direct.errors + two_way.errors;
+
+    $display("");
+    $display("direct mapped: %0d cycles, %0d hits, %0d misses, %0d refill cycles",
+             direct.cycles, direct.cache.hits, direct.cache.misses,
+             direct.cache.refill_cycles);
+    $display("two ways: %0d cycles, %0d hits, %0d misses, %0d refill cycles", two_way.cycles,
+             two_way.cache.hits, two_way.cache.misses, two_way.cache.refill_cycles);
+    $display("%0d errors", errors);
+    if (errors != 0) $display("FAILED");
+    else $display("PASSED");
+    $display("");
+
+    $finish();
+  end
+endmodule
+
+module pl_cache_bench #(
+    parameter WAYS = 1
+) (
+    input wire clk,
+    input wire rst_n
+);
+  localparam DATA = 32'h1000;
+  localparam OUT = 32'h3000;
+  localparam WORDS = 64;
+  localparam LATENCY = 20;
+
+  localparam S0 = 8;
+  localparam S1 = 9;
+  localparam T0 = 5;
+  localparam T1 = 6;
+  localparam T2 = 7;
+  localparam T3 = 28;
+  localparam T4 = 29;
+
+  `include "tb_rv32.vh"
+
+  wire [31:0] instr_addr;
+  wire [31:0] instr_data;
+  wire [31:0] data_addr;
+  wire [31:0] data_wdata;
+  wire [ 3:0] data_wenable;
+  wire        data_ren;
+  wire [31:0] data_rdata;
+  wire        data_ready;
+
+  dual_word_ram #(
+      .SIZE_WORDS(2 ** 11)
+  ) rom (
+      .clk(clk),
+
+      .addr_1   (13'b0),
+      .wdata_1  (32'b0),
+      .wenable_1(4'b0000),
+      .rdata_1  (),
+
+      .addr_2 (instr_addr[12:0]),
+      .rdata_2(instr_data)
+  );
+
+  wire mem_req, mem_we, mem_ready;
+  wire [31:0] mem_addr;
+  wire [127:0] mem_wdata, mem_rdata;
+
+  // Four sets of four-word lines
+  dcache #(
+      .SET_BITS (2),
+      .WORD_BITS(2),
+      .WAYS     (WAYS)
+  ) cache (
+      .clk  (clk),
+      .rst_n(rst_n),
+
+      .ren    (data_ren),
+      .addr   (data_addr),
+      .wdata  (data_wdata),
+      .wenable(data_wenable),
+      .rdata  (data_rdata),
+      .ready  (data_ready),
+
+      .mem_req  (mem_req),
+      .mem_we   (mem_we),
+      .mem_addr (mem_addr),
+      .mem_wdata(mem_wdata),
+      .mem_ready(mem_ready),
+      .mem_rdata(mem_rdata),
+
+      .hits         (),
+      .misses       (),
+      .refill_cycles()
+  );
+
+  backing_ram #(
+      .SIZE_WORDS(2 ** 12),
+      .LATENCY   (LATENCY)
+  ) ram (
+      .clk  (clk),
+      .rst_n(rst_n),
+
+      .req_1  (mem_req),
+      .we_1   (mem_we),
+      .addr_1 (mem_addr),
+      .wdata_1(mem_wdata),
+      .ready_1(mem_ready),
+      .rdata_1(mem_rdata),
+
+      .req_2  (1'b0),
+      .addr_2 (32'b0),
+      .ready_2(),
+      .rdata_2()
+  );
+
+  pipelined_cpu cpu (
+      .clk  (clk),
+      .rst_n(rst_n),
+
+      .instr_addr      (instr_addr),
+      .instr_data      (instr_data),
+      .instr_ready     (1'b1),
+      .instr_data_next (32'b0),
+      .instr_next_valid(1'b0),
+
+      .data_addr   (data_addr),
+      .data_wdata  (data_wdata),
+      .data_wenable(data_wenable),
+      .data_ren    (data_ren),
+      .data_rdata  (data_rdata),
+      .data_ready  (data_ready),
+
+      .irq      (16'b0),
+      .timer_irq(1'b0),
+
+      .ext_events(8'b0)
+  );
+
+  // What the program stores to word i, with the byte store on the first
+  function [31:0] word_value(input integer i);
+    word_value = i == 0 ? 32'h0000AB01 : 3 * i + 1;
+  endfunction
+
+  integer errors, cycles, loaded, i;
+  reg finished;
+
+  always @(posedge clk) begin
+    if (rst_n && !finished) cycles = cycles + 1;
+
+    if (rst_n && !finished && |data_wenable && data_ready) begin
+      if (data_addr == OUT) begin
+        if (data_wdata !== word_value(loaded)) begin
+          $display("%0d ways, word %0d: loaded %h, expected %h", WAYS, loaded, data_wdata,
+                   word_value(loaded));
+          errors = errors + 1;
+        end
+
+        loaded = loaded + 1;
+      end else if (data_addr == OUT + 4) begin
+        if (loaded != WORDS) begin
+          $display("%0d ways: loaded %0d words, expected %0d", WAYS, loaded, WORDS);
+          errors = errors + 1;
+        end
+
+        // The lines read back last are clean, and the rest were written back
+        for (i = 0; i < WORDS; i = i + 1) begin
+          if (ram.data[DATA/4+i] !== word_value(i)) begin
+            $display("%0d ways, word %0d: memory holds %h, expected %h", WAYS, i,
+                     ram.data[DATA/4+i], word_value(i));
+            errors = errors + 1;
+          end
+        end
+
+        finished = 1;
+      end
+    end
+  end
+
+  initial begin
+    for (i = 0; i < 2 ** 11; i = i + 1) rom.data[i] = NOP;
+
+    rom.data[0] = lui(S0, DATA >> 12);
+    rom.data[1] = lui(S1, OUT >> 12);
+    rom.data[2] = addi(T0, 0, 0);
+    rom.data[3] = addi(T2, S0, 0);
+    rom.data[4] = addi(T3, 0, WORDS);
+    rom.data[5] = addi(T1, 0, 1);
+
+    // fill: word t0 = 3 * t0 + 1
+    rom.data[6] = sw(T1, T2, 0);
+    rom.data[7] = addi(T1, T1, 3);
+    rom.data[8] = addi(T2, T2, 4);
+    rom.data[9] = addi(T0, T0, 1);
+    rom.data[10] = blt(T0, T3, -13'd16);
+
+    rom.data[11] = addi(T4, 0, 12'hAB);
+    rom.data[12] = s_type(3'b000, 7'b0100011, T4, S0, 12'd1);  // sb t4, 1(s0)
+    rom.data[13] = addi(T0, 0, 0);
+    rom.data[14] = addi(T2, S0, 0);
+
+    // read back: each word goes to OUT
+    rom.data[15] = lw(T1, T2, 0);
+    rom.data[16] = sw(T1, S1, 0);
+    rom.data[17] = addi(T2, T2, 4);
+    rom.data[18] = addi(T0, T0, 1);
+    rom.data[19] = blt(T0, T3, -13'd16);
+
+    rom.data[20] = sw(0, S1, 4);
+    rom.data[21] = jal(0, 0);
+
+    for (i = 0; i < 2 ** 12; i = i + 1) ram.data[i] = 0;
+
+    errors = 0;
+    cycles = 0;
+    loaded = 0;
+    finished = 0;
+  end
+endmodule
@@ -0,0 +1,155 @@
+`timescale 1ns / 1ns `default_nettype none
+`include "tb_dump.vh"
+`include "tb_pl_core.vh"
+
+// Runs a loop of integer operations on the scalar and the dual-issue pipeline.
+// The loop pairs up a load with a dependent instruction in pipe B, two writes
+// to the same register, pipe B results feeding the next pair and an auipc in
+// pipe B, and stores what it computes every iteration. Both cores must store
+// the same values, the dual-issue one in fewer cycles.
+module pl_dual_issue_tb ();
+  reg clk, rst_n;
+  always #5 clk = ~clk;
+
+  `TB_DUMP(pl_dual_issue_tb, clk)
+
+  pl_dual_issue_bench #(
+      .DUAL_ISSUE(0)
+  ) scalar (
+      .clk  (clk),
+      .rst_n(rst_n)
+  );
+
+  pl_dual_issue_bench #(
+      .DUAL_ISSUE(1)
+  ) dual (
+      .clk  (clk),
+      .rst_n(rst_n)
+  );
+
+  integer errors;
+
+  initial begin
+    clk   = 1;
+    rst_n = 0;
+    #15 rst_n = 1;
+
+    wait (scalar.finished && dual.finished);
+
+    errors = scalar.errors + dual.errors;
+
+    if (dual.cycles >= scalar.cycles) begin
+      $display("dual issue took %0d cycles, scalar %0d", dual.cycles, scalar.cycles);
+      errors = errors + 1;
+    end
+
+    $display("");
+    $display("loop finished in %0d cycles, %0d with dual issue", scalar.cycles, dual.cycles);
+    $display("%0d errors", errors);
+    if (errors != 0) $display("FAILED");
+    else $display("PASSED");
+    $display("");
+
+    $finish();
+  end
+endmodule
+
+module pl_dual_issue_bench #(
+    parameter DUAL_ISSUE = 0
+) (
+    input wire clk,
+    input wire rst_n
+);
+  localparam DATA = 32'h1000;
+  localparam ITERATIONS = 10;
+
+  localparam S0 = 8;
+  localparam T0 = 5;
+  localparam T1 = 6;
+  localparam T2 = 7;
+  localparam T3 = 28;
+  localparam T4 = 29;
+  localparam T5 = 30;
+  localparam T6 = 31;
+
+  `include "tb_rv32.vh"
+
+  wire [31:0] data_addr;
+  wire [31:0] data_wdata;
+  wire [ 3:0] data_wenable;
+
+  tb_pl_core #(
+      .DUAL_ISSUE(DUAL_ISSUE),
+      .NEXT_VALID(1)
+  ) core (
+      .clk  (clk),
+      .rst_n(rst_n),
+
+      .data_addr   (data_addr),
+      .data_wdata  (data_wdata),
+      .data_wenable(data_wenable)
+  );
+
+  integer errors, cycles, iteration, i;
+  reg [31:0] expected;
+  reg finished;
+
+  always @(posedge clk) begin
+    if (rst_n && !finished) cycles = cycles + 1;
+
+    if (rst_n && |data_wenable) begin
+      case (data_addr)
+        DATA + 4: expected = 7 * iteration + 8;
+        DATA + 8: expected = 32'h1234502C - iteration;
+        default:  expected = iteration + 1;
+      endcase
+
+      if (data_wdata !== expected) begin
+        $display("dual issue %0d, iteration %0d: stored %h at %h, expected %h", DUAL_ISSUE,
+                 iteration, data_wdata, data_addr, expected);
+        errors = errors + 1;
+      end
+
+      if (data_addr == DATA) begin
+        iteration = iteration + 1;
+        if (iteration == ITERATIONS) finished = 1;
+      end
+    end
+  end
+
+  initial begin
+    for (i = 0; i < 2 ** 11; i = i + 1) core.ram.data[i] = NOP;
+
+    core.ram.data[0] = lui(S0, DATA >> 12);
+    core.ram.data[1] = addi(T4, 0, 0);
+    core.ram.data[2] = addi(T5, 0, ITERATIONS);
+
+    // loop: t6 = i, as stored by the previous iteration
+    core.ram.data[3] = lw(T6, S0, 0);
+    core.ram.data[4] = addi(T0, T4, 1);  // t0 = i + 1
+    core.ram.data[5] = add(T1, T6, T4);  // t1 = 2i, right behind the load
+    core.ram.data[6] = add(T2, T0, T1);  // t2 = 3i + 1
+    core.ram.data[7] = slli(T3, T4, 2);  // t3 = 4i
+    core.ram.data[8] = addi(T0, 0, 5);
+    core.ram.data[9] = addi(T0, 0, 7);  // t0 = 7, the younger write
+    core.ram.data[10] = add(T2, T2, T0);  // t2 = 3i + 8
+    core.ram.data[11] = auipc(T1, 0);  // t1 = 44
+    core.ram.data[12] = add(T2, T2, T3);  // t2 = 7i + 8, reading t3 before the lui
+    core.ram.data[13] = lui(T3, 20'h12345);
+    core.ram.data[14] = sw(T2, S0, 4);
+    core.ram.data[15] = add(T1, T1, T3);
+    core.ram.data[16] = sub(T1, T1, T4);  // t1 = 0x1234502C - i
+    core.ram.data[17] = sw(T1, S0, 8);
+    core.ram.data[18] = addi(T4, T4, 1);
+    core.ram.data[19] = sw(T4, S0, 0);
+    core.ram.data[20] = blt(T4, T5, -13'd68);
+    core.ram.data[21] = jal(0, 0);
+
+    core.ram.data[DATA/4] = 0;
+
+    errors = 0;
+    cycles = 0;
+    iteration = 0;
+    finished = 0;
+  end
+endmodule
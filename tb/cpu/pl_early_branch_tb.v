@@ -0,0 +1,166 @@
+`timescale 1ns / 1ns `default_nettype none
+`include "tb_dump.vh"
+`include "tb_pl_core.vh"
+`include "pipelined_cpu.vh"
+
+// Runs a loop of branches right behind a load, on a result still in Execute
+// and on one in Memory, plus a jal, with branches resolved in Execute and in
+// Decode (EARLY_BRANCH). Without a predictor every taken branch is a
+// misprediction, which costs one cycle less when caught in Decode. Both cores
+// must store the same values, and a third one with the default predictor
+// checks that branches redirected from Decode are still trained on.
+module pl_early_branch_tb ();
+  reg clk, rst_n;
+  always #5 clk = ~clk;
+
+  `TB_DUMP(pl_early_branch_tb, clk)
+
+  pl_early_branch_bench #(
+      .PREDICTOR   (`BP_NONE),
+      .EARLY_BRANCH(0)
+  ) late (
+      .clk  (clk),
+      .rst_n(rst_n)
+  );
+
+  pl_early_branch_bench #(
+      .PREDICTOR   (`BP_NONE),
+      .EARLY_BRANCH(1)
+  ) early (
+      .clk  (clk),
+      .rst_n(rst_n)
+  );
+
+  pl_early_branch_bench #(
+      .PREDICTOR   (`BP_GSHARE),
+      .EARLY_BRANCH(1)
+  ) early_gshare (
+      .clk  (clk),
+      .rst_n(rst_n)
+  );
+
+  integer errors;
+
+  initial begin
+    clk   = 1;
+    rst_n = 0;
+    #15 rst_n = 1;
+
+    wait (late.finished && early.finished && early_gshare.finished);
+
+    errors = late.errors + early.errors + early_gshare.errors;
+
+    if (early.cycles >= late.cycles) begin
+      $display("early branches took %0d cycles, late ones %0d", early.cycles, late.cycles);
+      errors = errors + 1;
+    end
+
+    if (early_gshare.core.cpu.bp_hits == 0) begin
+      $display("the predictor never got a branch right");
+      errors = errors + 1;
+    end
+
+    $display("");
+    $display("loop finished in %0d cycles, %0d with early branches (%0d with gshare)",
+             late.cycles, early.cycles, early_gshare.cycles);
+    $display("%0d errors", errors);
+    if (errors != 0) $display("FAILED");
+    else $display("PASSED");
+    $display("");
+
+    $finish();
+  end
+endmodule
+
+module pl_early_branch_bench #(
+    parameter PREDICTOR    = `BP_GSHARE,
+    parameter EARLY_BRANCH = 0
+) (
+    input wire clk,
+    input wire rst_n
+);
+  localparam DATA = 32'h1000;
+  localparam ITERATIONS = 10;
+
+  localparam S0 = 8;
+  localparam T0 = 5;
+  localparam T1 = 6;
+  localparam T4 = 29;
+  localparam T5 = 30;
+  localparam T6 = 31;
+
+  `include "tb_rv32.vh"
+
+  wire [31:0] data_addr;
+  wire [31:0] data_wdata;
+  wire [ 3:0] data_wenable;
+
+  tb_pl_core #(
+      .BRANCH_PREDICTOR(PREDICTOR),
+      .EARLY_BRANCH    (EARLY_BRANCH)
+  ) core (
+      .clk  (clk),
+      .rst_n(rst_n),
+
+      .data_addr   (data_addr),
+      .data_wdata  (data_wdata),
+      .data_wenable(data_wenable)
+  );
+
+  integer errors, cycles, iteration, i;
+  reg [31:0] acc;
+  reg finished;
+
+  always @(posedge clk) begin
+    if (rst_n && !finished) cycles = cycles + 1;
+
+    if (rst_n && |data_wenable) begin
+      if (data_addr == DATA + 4) begin
+        acc = acc + (iteration % 2 ? 3 : 5);
+
+        if (data_wdata !== acc) begin
+          $display("predictor %0d, early %0d, iteration %0d: stored %0d, expected %0d", PREDICTOR,
+                   EARLY_BRANCH, iteration, data_wdata, acc);
+          errors = errors + 1;
+        end
+      end else if (data_addr == DATA) begin
+        iteration = iteration + 1;
+        if (iteration == ITERATIONS) finished = 1;
+      end
+    end
+  end
+
+  initial begin
+    for (i = 0; i < 2 ** 11; i = i + 1) core.ram.data[i] = NOP;
+
+    core.ram.data[0] = lui(S0, DATA >> 12);
+    core.ram.data[1] = addi(T4, 0, 0);
+    core.ram.data[2] = addi(T5, 0, ITERATIONS);
+    core.ram.data[3] = addi(T0, 0, 0);
+
+    // loop: t6 = i, as stored by the previous iteration
+    core.ram.data[4] = lw(T6, S0, 0);
+    core.ram.data[5] = branch(3'b000, T6, T4, 13'd8);  // beq t6, t4, +8, right behind the load
+    core.ram.data[6] = addi(T0, T0, 100);  // skipped
+    core.ram.data[7] = andi(T1, T6, 1);
+    core.ram.data[8] = branch(3'b000, T1, 0, 13'd12);  // beq t1, x0, even, on a result in Execute
+    core.ram.data[9] = addi(T0, T0, 3);
+    core.ram.data[10] = jal(0, 21'd8);  // j join
+    // even:
+    core.ram.data[11] = addi(T0, T0, 5);
+    // join:
+    core.ram.data[12] = sw(T0, S0, 4);
+    core.ram.data[13] = addi(T4, T4, 1);
+    core.ram.data[14] = sw(T4, S0, 0);
+    core.ram.data[15] = branch(3'b100, T4, T5, -13'd44);  // blt t4, t5, loop, on a result in Memory
+    core.ram.data[16] = jal(0, 0);
+
+    core.ram.data[DATA/4] = 0;
+
+    errors = 0;
+    cycles = 0;
+    iteration = 0;
+    acc = 0;
+    finished = 0;
+  end
+endmodule
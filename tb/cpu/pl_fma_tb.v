@@ -0,0 +1,120 @@
+`timescale 1ns / 1ns `default_nettype none
+`include "tb_dump.vh"
+`include "tb_pl_core.vh"
+
+// Runs the four fused operations on a = 1 + 2^-12 and c = 1 + 2^-11, where
+// a * a = c + 2^-24 only survives without rounding the product in between, and
+// the same with an fmul and an fadd, which give zero. Then an fmadd whose
+// result is the addend of the one right after it. Every value stored must be
+// the exact one.
+module pl_fma_tb ();
+  reg clk, rst_n;
+  always #5 clk = ~clk;
+
+  `TB_DUMP(pl_fma_tb, clk)
+
+  localparam DATA = 32'h1000;
+  localparam RESULTS = 6;
+
+  localparam S0 = 8;
+  localparam S1 = 9;
+
+  localparam RM_DYN = 3'b111;
+
+  localparam FMADD = 7'b1000011;
+  localparam FMSUB = 7'b1000111;
+  localparam FNMSUB = 7'b1001011;
+  localparam FNMADD = 7'b1001111;
+
+  `include "tb_rv32.vh"
+
+  wire [31:0] data_addr;
+  wire [31:0] data_wdata;
+  wire [ 3:0] data_wenable;
+
+  tb_pl_core core (
+      .clk  (clk),
+      .rst_n(rst_n),
+
+      .data_addr   (data_addr),
+      .data_wdata  (data_wdata),
+      .data_wenable(data_wenable)
+  );
+
+  reg [31:0] expected[0:RESULTS-1];
+  integer errors, stored, i;
+
+  always @(posedge clk) begin
+    if (rst_n && |data_wenable && data_addr < DATA + 4 * RESULTS) begin
+      i = (data_addr - DATA) / 4;
+
+      if (data_wdata !== expected[i]) begin
+        $display("result %0d: stored %h, expected %h", i, data_wdata, expected[i]);
+        errors = errors + 1;
+      end
+
+      stored = stored + 1;
+    end
+  end
+
+  initial begin
+    for (i = 0; i < 2 ** 11; i = i + 1) core.ram.data[i] = NOP;
+
+    core.ram.data[0] = lui(S0, DATA >> 12);
+    core.ram.data[1] = lui(S1, 20'h3F801);
+    core.ram.data[2] = addi(S1, S1, 12'h800);  // 1 + 2^-12
+    core.ram.data[3] = op_fp(7'b1111000, 0, S1, 3'b000, 1);  // fmv.w.x f1, s1
+    core.ram.data[4] = lui(S1, 20'h3F801);  // 1 + 2^-11
+    core.ram.data[5] = op_fp(7'b1111000, 0, S1, 3'b000, 3);
+    core.ram.data[6] = lui(S1, 20'hBF801);  // -(1 + 2^-11)
+    core.ram.data[7] = op_fp(7'b1111000, 0, S1, 3'b000, 4);
+    core.ram.data[8] = lui(S1, 20'h40000);  // 2.0
+    core.ram.data[9] = op_fp(7'b1111000, 0, S1, 3'b000, 5);
+    core.ram.data[10] = lui(S1, 20'h40400);  // 3.0
+    core.ram.data[11] = op_fp(7'b1111000, 0, S1, 3'b000, 6);
+    core.ram.data[12] = lui(S1, 20'h3F800);  // 1.0
+    core.ram.data[13] = op_fp(7'b1111000, 0, S1, 3'b000, 7);
+
+    core.ram.data[14] = op_fma(FMADD, 4, 1, 1, RM_DYN, 10);  // a * a + -c
+    core.ram.data[15] = fsw(10, S0, 0);
+    core.ram.data[16] = op_fma(FMSUB, 3, 1, 1, RM_DYN, 11);  // a * a - c
+    core.ram.data[17] = fsw(11, S0, 4);
+    core.ram.data[18] = op_fma(FNMSUB, 3, 1, 1, RM_DYN, 12);  // -(a * a) + c
+    core.ram.data[19] = fsw(12, S0, 8);
+    core.ram.data[20] = op_fma(FNMADD, 4, 1, 1, RM_DYN, 13);  // -(a * a) - -c
+    core.ram.data[21] = fsw(13, S0, 12);
+
+    core.ram.data[22] = op_fp(7'b0001000, 1, 1, RM_DYN, 14);  // fmul.s, rounds to c
+    core.ram.data[23] = op_fp(7'b0000000, 4, 14, RM_DYN, 14);  // fadd.s
+    core.ram.data[24] = fsw(14, S0, 16);
+
+    core.ram.data[25] = op_fma(FMADD, 7, 6, 5, RM_DYN, 15);  // 2 * 3 + 1
+    core.ram.data[26] = op_fma(FMADD, 15, 6, 5, RM_DYN, 15);  // 2 * 3 + 7
+    core.ram.data[27] = fsw(15, S0, 20);
+    core.ram.data[28] = jal(0, 0);
+
+    expected[0] = 32'h33800000;  // 2^-24
+    expected[1] = 32'h33800000;
+    expected[2] = 32'hB3800000;
+    expected[3] = 32'hB3800000;
+    expected[4] = 32'h00000000;
+    expected[5] = 32'h41500000;  // 13.0
+
+    errors = 0;
+    stored = 0;
+
+    clk = 1;
+    rst_n = 0;
+    #15 rst_n = 1;
+
+    wait (stored == RESULTS);
+
+    $display("");
+    $display("%0d errors", errors);
+    if (errors != 0) $display("FAILED");
+    else $display("PASSED");
+    $display("");
+
+    $finish();
+  end
+endmodule
@@ -0,0 +1,188 @@
+`timescale 1ns / 1ns `default_nettype none
+`include "tb_dump.vh"
+`include "tb_pl_core.vh"
+
+// Runs fsqrt, fmin/fmax, sign injection, compares, conversions both ways and
+// fclass, each right before the store of its result, then reads fflags and
+// changes frm to round the next conversion towards zero. Last, a run of fmuls
+// and a second fsqrt come right behind an fsqrt, which is still working its
+// result out, with different rounding. Every value stored must match the one
+// the F extension gives.
+module pl_fp_ops_tb ();
+  reg clk, rst_n;
+  always #5 clk = ~clk;
+
+  `TB_DUMP(pl_fp_ops_tb, clk)
+
+  localparam DATA = 32'h1000;
+  localparam RESULTS = 29;
+  // Enough to keep the multiplier busy until an fsqrt is done
+  localparam FMULS = 32;
+
+  localparam S0 = 8;
+  localparam S1 = 9;
+  localparam T0 = 5;
+  localparam T1 = 6;
+  localparam T2 = 7;
+  localparam T3 = 28;
+  localparam T4 = 29;
+  localparam T5 = 30;
+  localparam T6 = 31;
+
+  localparam CSR_FFLAGS = 12'h001;
+  localparam CSR_FRM = 12'h002;
+  localparam CSR_FCSR = 12'h003;
+
+  localparam RM_RTZ = 3'b001;
+  localparam RM_DYN = 3'b111;
+
+  `include "tb_rv32.vh"
+
+  wire [31:0] data_addr;
+  wire [31:0] data_wdata;
+  wire [ 3:0] data_wenable;
+
+  tb_pl_core core (
+      .clk  (clk),
+      .rst_n(rst_n),
+
+      .data_addr   (data_addr),
+      .data_wdata  (data_wdata),
+      .data_wenable(data_wenable)
+  );
+
+  reg [31:0] expected[0:RESULTS-1];
+  integer errors, stored, cycles, i;
+
+  always @(posedge clk) begin
+    if (rst_n && |data_wenable) begin
+      i = (data_addr - DATA) / 4;
+
+      if (data_wdata !== expected[i]) begin
+        $display("result %0d: stored %h, expected %h", i, data_wdata, expected[i]);
+        errors = errors + 1;
+      end
+
+      stored = stored + 1;
+    end
+  end
+
+  initial begin
+    for (i = 0; i < 2 ** 11; i = i + 1) core.ram.data[i] = NOP;
+
+    core.ram.data[0] = lui(S0, DATA >> 12);
+    core.ram.data[1] = lui(S1, 20'h40000);  // 2.0
+    core.ram.data[2] = op_fp(7'b1111000, 0, S1, 3'b000, 1);  // fmv.w.x f1, s1
+    core.ram.data[3] = lui(S1, 20'hBFC00);  // -1.5
+    core.ram.data[4] = op_fp(7'b1111000, 0, S1, 3'b000, 2);  // fmv.w.x f2, s1
+    core.ram.data[5] = lui(S1, 20'h40200);  // 2.5
+    core.ram.data[6] = op_fp(7'b1111000, 0, S1, 3'b000, 3);  // fmv.w.x f3, s1
+    core.ram.data[7] = addi(T4, 0, -12'd7);
+
+    core.ram.data[8] = op_fp(7'b0101100, 0, 1, RM_DYN, 4);  // fsqrt.s f4, f1
+    core.ram.data[9] = op_fp(7'b0101100, 0, 2, RM_DYN, 5);  // fsqrt.s f5, f2
+    core.ram.data[10] = fsw(4, S0, 0);
+    core.ram.data[11] = fsw(5, S0, 4);
+    core.ram.data[12] = op_fp(7'b0010100, 2, 1, 3'b000, 6);  // fmin.s f6, f1, f2
+    core.ram.data[13] = op_fp(7'b0010100, 2, 1, 3'b001, 7);  // fmax.s f7, f1, f2
+    core.ram.data[14] = fsw(6, S0, 8);
+    core.ram.data[15] = fsw(7, S0, 12);
+    core.ram.data[16] = op_fp(7'b0010000, 1, 1, 3'b001, 8);  // fneg.s f8, f1
+    core.ram.data[17] = op_fp(7'b0010000, 2, 2, 3'b010, 9);  // fabs.s f9, f2
+    core.ram.data[18] = fsw(8, S0, 16);
+    core.ram.data[19] = fsw(9, S0, 20);
+    core.ram.data[20] = op_fp(7'b1010000, 1, 2, 3'b001, T0);  // flt.s t0, f2, f1
+    core.ram.data[21] = op_fp(7'b1010000, 1, 1, 3'b010, T1);  // feq.s t1, f1, f1
+    core.ram.data[22] = op_fp(7'b1010000, 2, 1, 3'b000, T2);  // fle.s t2, f1, f2
+    core.ram.data[23] = sw(T0, S0, 24);
+    core.ram.data[24] = sw(T1, S0, 28);
+    core.ram.data[25] = sw(T2, S0, 32);
+    core.ram.data[26] = op_fp(7'b1100000, 0, 3, RM_DYN, T3);  // fcvt.w.s t3, f3
+    core.ram.data[27] = op_fp(7'b1100000, 0, 2, RM_RTZ, T5);  // fcvt.w.s t5, f2, rtz
+    core.ram.data[28] = op_fp(7'b1100000, 1, 2, RM_DYN, T6);  // fcvt.wu.s t6, f2
+    core.ram.data[29] = sw(T3, S0, 36);
+    core.ram.data[30] = sw(T5, S0, 40);
+    core.ram.data[31] = sw(T6, S0, 44);
+    core.ram.data[32] = op_fp(7'b1101000, 0, T4, RM_DYN, 10);  // fcvt.s.w f10, t4
+    core.ram.data[33] = fsw(10, S0, 48);
+    core.ram.data[34] = op_fp(7'b1110000, 0, 2, 3'b001, T0);  // fclass.s t0, f2
+    core.ram.data[35] = sw(T0, S0, 52);
+    core.ram.data[36] = csr(3'b010, T1, 0, CSR_FFLAGS);  // frflags t1
+    core.ram.data[37] = sw(T1, S0, 56);
+    core.ram.data[38] = csr(3'b101, 0, RM_RTZ, CSR_FRM);  // fsrmi rtz
+    core.ram.data[39] = op_fp(7'b1100000, 0, 2, RM_DYN, T2);  // fcvt.w.s t2, f2
+    core.ram.data[40] = sw(T2, S0, 60);
+    core.ram.data[41] = csr(3'b010, T3, 0, CSR_FCSR);  // frcsr t3
+    core.ram.data[42] = sw(T3, S0, 64);
+    core.ram.data[43] = csr(3'b101, 0, 0, CSR_FFLAGS);  // fsflagsi 0
+    core.ram.data[44] = csr(3'b010, T4, 0, CSR_FFLAGS);  // frflags t4
+    core.ram.data[45] = sw(T4, S0, 68);
+    core.ram.data[46] = sw(0, S0, 72);
+    // fsqrt takes a while, so the fmuls behind it finish first, one of them
+    // arriving as it's done, and the next fsqrt waits for it
+    core.ram.data[47] = op_fp(7'b0101100, 0, 3, 3'b000, 11);  // fsqrt.s f11, f3, rne
+
+    for (i = 0; i < FMULS; i = i + 1) begin
+      // fmul.s f(14 + i % 8), f1, f3, rne
+      core.ram.data[48+i] = op_fp(7'b0001000, 3, 1, 3'b000, 14 + i % 8);
+    end
+
+    core.ram.data[48+FMULS] = op_fp(7'b0101100, 0, 3, RM_RTZ, 13);  // fsqrt.s f13, f3, rtz
+
+    for (i = 0; i < 8; i = i + 1) core.ram.data[49+FMULS+i] = fsw(14 + i, S0, 76 + 4 * i);
+
+    core.ram.data[57+FMULS] = fsw(11, S0, 108);
+    core.ram.data[58+FMULS] = fsw(13, S0, 112);
+    core.ram.data[59+FMULS] = jal(0, 0);
+
+    expected[0] = 32'h3FB504F3;  // sqrt(2), rounded to nearest
+    expected[1] = 32'h7FC00000;  // sqrt(-1.5)
+    expected[2] = 32'hBFC00000;
+    expected[3] = 32'h40000000;
+    expected[4] = 32'hC0000000;
+    expected[5] = 32'h3FC00000;
+    expected[6] = 1;
+    expected[7] = 1;
+    expected[8] = 0;
+    expected[9] = 2;  // 2.5 to even
+    expected[10] = -1;
+    expected[11] = 0;  // out of range
+    expected[12] = 32'hC0E00000;  // -7.0
+    expected[13] = 1 << 1;  // negative normal
+    // Invalid from fsqrt and fcvt.wu.s, inexact from the rest
+    expected[14] = 5'b10001;
+    expected[15] = -1;  // -1.5 towards zero
+    expected[16] = {24'b0, RM_RTZ, 5'b10001};
+    expected[17] = 0;
+    expected[18] = 0;
+    for (i = 19; i < 27; i = i + 1) expected[i] = 32'h40A00000;  // 5.0
+    expected[27] = 32'h3FCA62C2;  // sqrt(2.5), rounded to nearest
+    expected[28] = 32'h3FCA62C1;  // and towards zero
+
+    errors = 0;
+    stored = 0;
+
+    clk = 1;
+    rst_n = 0;
+    #15 rst_n = 1;
+
+    cycles = 0;
+    while (stored < RESULTS && cycles < 1000) begin
+      @(posedge clk);
+      cycles = cycles + 1;
+    end
+
+    if (stored != RESULTS) begin
+      $display("%0d results stored, expected %0d", stored, RESULTS);
+      errors = errors + 1;
+    end
+
+    $display("");
+    $display("%0d errors", errors);
+    if (errors != 0) $display("FAILED");
+    else $display("PASSED");
+    $display("");
+
+    $finish();
+  end
+endmodule
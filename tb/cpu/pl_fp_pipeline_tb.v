@@ -0,0 +1,142 @@
+`timescale 1ns / 1ns `default_nettype none
+`include "tb_dump.vh"
+`include "tb_pl_core.vh"
+
+// Issues eight independent float operations back to back, mixing the adder
+// and the multiplier, then a chain of eight multiplications that each depend
+// on the one before. float_alu takes one operation per cycle, so the former
+// must take fewer cycles than the latter. Then an fmul and an fadd to the same
+// register, which the latter must win, and results passed between units. Every
+// value stored must be right.
+module pl_fp_pipeline_tb ();
+  reg clk, rst_n;
+  always #5 clk = ~clk;
+
+  `TB_DUMP(pl_fp_pipeline_tb, clk)
+
+  localparam DATA = 32'h1000;
+  localparam MARK = DATA + 32'h100;
+  localparam RESULTS = 11;
+
+  localparam S0 = 8;
+  localparam S1 = 9;
+
+  localparam RM_DYN = 3'b111;
+
+  localparam FADD = 7'b0000000;
+  localparam FSUB = 7'b0000100;
+  localparam FMUL = 7'b0001000;
+
+  `include "tb_rv32.vh"
+
+  wire [31:0] data_addr;
+  wire [31:0] data_wdata;
+  wire [ 3:0] data_wenable;
+
+  tb_pl_core core (
+      .clk  (clk),
+      .rst_n(rst_n),
+
+      .data_addr   (data_addr),
+      .data_wdata  (data_wdata),
+      .data_wenable(data_wenable)
+  );
+
+  reg [31:0] expected[0:RESULTS-1];
+  integer errors, stored, marks, independent, dependent, cycles, i;
+
+  always @(posedge clk) begin
+    if (rst_n) cycles = cycles + 1;
+
+    if (rst_n && |data_wenable && data_addr == MARK) begin
+      if (marks == 1) independent = cycles;
+      if (marks == 2) dependent = cycles;
+
+      cycles = 0;
+      marks  = marks + 1;
+    end else if (rst_n && |data_wenable) begin
+      i = (data_addr - DATA) / 4;
+
+      if (data_wdata !== expected[i]) begin
+        $display("result %0d: stored %h, expected %h", i, data_wdata, expected[i]);
+        errors = errors + 1;
+      end
+
+      stored = stored + 1;
+    end
+  end
+
+  initial begin
+    for (i = 0; i < 2 ** 11; i = i + 1) core.ram.data[i] = NOP;
+
+    core.ram.data[0] = lui(S0, DATA >> 12);
+    core.ram.data[1] = lui(S1, 20'h40000);  // 2.0
+    core.ram.data[2] = op_fp(7'b1111000, 0, S1, 3'b000, 1);  // fmv.w.x f1, s1
+    core.ram.data[3] = lui(S1, 20'h40400);  // 3.0
+    core.ram.data[4] = op_fp(7'b1111000, 0, S1, 3'b000, 2);  // fmv.w.x f2, s1
+    core.ram.data[5] = sw(0, S0, MARK - DATA);
+
+    core.ram.data[6] = op_fp(FMUL, 2, 1, RM_DYN, 10);  // 6.0
+    core.ram.data[7] = op_fp(FADD, 2, 1, RM_DYN, 11);  // 5.0
+    core.ram.data[8] = op_fp(FSUB, 1, 2, RM_DYN, 12);  // 1.0
+    core.ram.data[9] = op_fp(FMUL, 2, 2, RM_DYN, 13);  // 9.0
+    core.ram.data[10] = op_fp(FADD, 1, 1, RM_DYN, 14);  // 4.0
+    core.ram.data[11] = op_fp(FMUL, 1, 1, RM_DYN, 15);  // 4.0
+    core.ram.data[12] = op_fp(FSUB, 2, 1, RM_DYN, 16);  // -1.0
+    core.ram.data[13] = op_fp(FADD, 2, 2, RM_DYN, 17);  // 6.0
+    for (i = 0; i < 8; i = i + 1) core.ram.data[14+i] = fsw(10 + i, S0, 4 * i);
+    core.ram.data[22] = sw(0, S0, MARK - DATA);
+
+    // f20 = 2.0 ** 9
+    core.ram.data[23] = op_fp(FMUL, 1, 1, RM_DYN, 20);
+    for (i = 0; i < 7; i = i + 1) core.ram.data[24+i] = op_fp(FMUL, 1, 20, RM_DYN, 20);
+    core.ram.data[31] = fsw(20, S0, 32);
+    core.ram.data[32] = sw(0, S0, MARK - DATA);
+
+    core.ram.data[33] = op_fp(FMUL, 2, 2, RM_DYN, 21);  // 9.0, overwritten
+    core.ram.data[34] = op_fp(FADD, 1, 1, RM_DYN, 21);  // 4.0
+    core.ram.data[35] = fsw(21, S0, 36);
+    core.ram.data[36] = op_fp(FADD, 2, 21, RM_DYN, 22);  // 7.0
+    core.ram.data[37] = op_fp(FMUL, 1, 22, RM_DYN, 23);  // 14.0
+    core.ram.data[38] = fsw(23, S0, 40);
+    core.ram.data[39] = jal(0, 0);
+
+    expected[0] = 32'h40C00000;
+    expected[1] = 32'h40A00000;
+    expected[2] = 32'h3F800000;
+    expected[3] = 32'h41100000;
+    expected[4] = 32'h40800000;
+    expected[5] = 32'h40800000;
+    expected[6] = 32'hBF800000;
+    expected[7] = 32'h40C00000;
+    expected[8] = 32'h44000000;
+    expected[9] = 32'h40800000;
+    expected[10] = 32'h41600000;
+
+    errors = 0;
+    stored = 0;
+    marks = 0;
+    cycles = 0;
+
+    clk = 1;
+    rst_n = 0;
+    #15 rst_n = 1;
+
+    wait (stored == RESULTS);
+
+    if (independent >= dependent) begin
+      $display("independent operations were no faster than dependent ones");
+      errors = errors + 1;
+    end
+
+    $display("");
+    $display("8 independent operations took %0d cycles, 8 dependent ones %0d", independent,
+             dependent);
+    $display("%0d errors", errors);
+    if (errors != 0) $display("FAILED");
+    else $display("PASSED");
+    $display("");
+
+    $finish();
+  end
+endmodule
@@ -0,0 +1,142 @@
+`timescale 1ns / 1ns `default_nettype none
+`include "tb_dump.vh"
+`include "tb_pl_core.vh"
+`include "cpu_csr_file.vh"
+
+// Points mhpmcounter3 at load-use stalls and mhpmcounter4 at branch flushes,
+// then runs a loop with one load used right behind it on every iteration and
+// a backward branch that's taken on all but the last, on a core that predicts
+// every branch not taken. mhpmcounter5 is left on no event. Then both halves of
+// mhpmcounter3 are written so that the next stall carries into the upper one,
+// and the same is done for mcycle and minstret. Every value stored must be the
+// expected one.
+module pl_hpm_tb ();
+  reg clk, rst_n;
+  always #5 clk = ~clk;
+
+  `TB_DUMP(pl_hpm_tb, clk)
+
+  localparam DATA = 32'h1000;
+  localparam RESULTS = 8;
+  localparam ITERATIONS = 10;
+
+  localparam S0 = 8;
+  localparam T0 = 5;
+  localparam T1 = 6;
+  localparam T2 = 7;
+  localparam T3 = 28;
+
+  localparam CSRRS = 3'b010;
+
+  `include "tb_rv32.vh"
+
+  wire [31:0] data_addr;
+  wire [31:0] data_wdata;
+  wire [ 3:0] data_wenable;
+
+  tb_pl_core #(
+      .BRANCH_PREDICTOR(`BP_NONE)
+  ) core (
+      .clk  (clk),
+      .rst_n(rst_n),
+
+      .data_addr   (data_addr),
+      .data_wdata  (data_wdata),
+      .data_wenable(data_wenable)
+  );
+
+  reg [31:0] expected[0:RESULTS-1];
+  integer errors, stored, i;
+
+  always @(posedge clk) begin
+    if (rst_n && |data_wenable && data_addr < DATA + 4 * RESULTS) begin
+      i = (data_addr - DATA) / 4;
+
+      if (data_wdata !== expected[i]) begin
+        $display("result %0d: stored %h, expected %h", i, data_wdata, expected[i]);
+        errors = errors + 1;
+      end
+
+      stored = stored + 1;
+    end
+  end
+
+  initial begin
+    for (i = 0; i < 2 ** 11; i = i + 1) core.ram.data[i] = NOP;
+
+    core.ram.data[0] = lui(S0, DATA >> 12);
+    core.ram.data[1] = csrrsi(`CSR_MHPMEVENT3, `HPM_EVENT_LOAD_USE);
+    core.ram.data[2] = csrrsi(`CSR_MHPMEVENT3 + 1, `HPM_EVENT_BRANCH_FLUSH);
+    core.ram.data[3] = addi(T0, 0, 0);
+    core.ram.data[4] = addi(T3, 0, ITERATIONS);
+
+    // loop: one load-use stall each, and a flush on every taken branch
+    core.ram.data[5] = lw(T1, S0, 12'h100);
+    core.ram.data[6] = addi(T1, T1, 1);
+    core.ram.data[7] = addi(T0, T0, 1);
+    core.ram.data[8] = blt(T0, T3, -13'd12);
+
+    core.ram.data[9] = csr(CSRRS, T1, 0, `CSR_MHPMEVENT3);
+    core.ram.data[10] = sw(T1, S0, 0);
+    core.ram.data[11] = csr(CSRRS, T1, 0, `CSR_MHPMCOUNTER3);
+    core.ram.data[12] = sw(T1, S0, 4);
+    core.ram.data[13] = csr(CSRRS, T1, 0, `CSR_MHPMCOUNTER3 + 1);
+    core.ram.data[14] = sw(T1, S0, 8);
+    core.ram.data[15] = csr(CSRRS, T1, 0, `CSR_MHPMCOUNTER3 + 2);
+    core.ram.data[16] = sw(T1, S0, 12);
+
+    // mhpmcounter3 = 5:ffffffff, one stall away from carrying
+    core.ram.data[17] = addi(T2, 0, 5);
+    core.ram.data[18] = csrrw(`CSR_MHPMCOUNTER3H, T2);
+    core.ram.data[19] = addi(T2, 0, -12'd1);
+    core.ram.data[20] = csrrw(`CSR_MHPMCOUNTER3, T2);
+    core.ram.data[25] = lw(T1, S0, 12'h100);
+    core.ram.data[26] = addi(T1, T1, 1);
+    core.ram.data[27] = csr(CSRRS, T1, 0, `CSR_MHPMCOUNTER3);
+    core.ram.data[28] = sw(T1, S0, 16);
+    core.ram.data[29] = csr(CSRRS, T1, 0, `CSR_MHPMCOUNTER3H);
+    core.ram.data[30] = sw(T1, S0, 20);
+
+    // mcycle = 7:fffffff0 and minstret = 9:fffffffc, both carrying within the
+    // nops in between
+    core.ram.data[31] = addi(T2, 0, 7);
+    core.ram.data[32] = csrrw(`CSR_MCYCLEH, T2);
+    core.ram.data[33] = addi(T2, 0, 9);
+    core.ram.data[34] = csrrw(`CSR_MINSTRETH, T2);
+    core.ram.data[35] = addi(T2, 0, -12'd16);
+    core.ram.data[36] = csrrw(`CSR_MCYCLE, T2);
+    core.ram.data[37] = addi(T2, 0, -12'd4);
+    core.ram.data[38] = csrrw(`CSR_MINSTRET, T2);
+    core.ram.data[60] = csr(CSRRS, T1, 0, `CSR_MCYCLEH);
+    core.ram.data[61] = sw(T1, S0, 24);
+    core.ram.data[62] = csr(CSRRS, T1, 0, `CSR_MINSTRETH);
+    core.ram.data[63] = sw(T1, S0, 28);
+    core.ram.data[64] = jal(0, 0);
+
+    expected[0] = `HPM_EVENT_LOAD_USE;
+    expected[1] = ITERATIONS;
+    expected[2] = ITERATIONS - 1;
+    expected[3] = 0;
+    expected[4] = 0;
+    expected[5] = 6;
+    expected[6] = 8;
+    expected[7] = 10;
+
+    errors = 0;
+    stored = 0;
+
+    clk = 1;
+    rst_n = 0;
+    #15 rst_n = 1;
+
+    wait (stored == RESULTS);
+
+    $display("");
+    $display("%0d errors", errors);
+    if (errors != 0) $display("FAILED");
+    else $display("PASSED");
+    $display("");
+
+    $finish();
+  end
+endmodule
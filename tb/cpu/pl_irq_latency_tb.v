@@ -0,0 +1,236 @@
+`timescale 1ns / 1ns `default_nettype none
+`include "tb_dump.vh"
+`include "cpu_csr_file.vh"
+
+// Raises an interrupt at every offset into a loop of slow loads, divisions and
+// slow stores, with and without shadow registers, and reports the worst number
+// of cycles until the handler is fetched. The loop stores a counter every
+// iteration, which must come out in sequence if traps are precise and, with
+// shadow registers, if the handler (which clobbers the counter) gets its own.
+module pl_irq_latency_tb ();
+  reg clk, rst_n;
+  always #5 clk = ~clk;
+
+  `TB_DUMP(pl_irq_latency_tb, clk)
+
+  localparam MEM_STALL = 3;
+
+  pl_irq_latency_bench #(
+      .SHADOW_REGS(0),
+      .MEM_STALL  (MEM_STALL)
+  ) plain (
+      .clk  (clk),
+      .rst_n(rst_n)
+  );
+
+  pl_irq_latency_bench #(
+      .SHADOW_REGS(1),
+      .MEM_STALL  (MEM_STALL)
+  ) shadow (
+      .clk  (clk),
+      .rst_n(rst_n)
+  );
+
+  integer errors;
+
+  initial begin
+    clk   = 1;
+    rst_n = 0;
+    #15 rst_n = 1;
+
+    wait (plain.finished && shadow.finished);
+
+    errors = plain.errors + shadow.errors;
+
+    // Only a CSR write or mret in Memory holds the trap back, and the loop
+    // has neither. Shadow registers also wait for Memory's access.
+    if (plain.worst > 1) begin
+      $display("worst latency without shadow registers %0d, expected 1", plain.worst);
+      errors = errors + 1;
+    end
+    if (shadow.worst > 1 + MEM_STALL) begin
+      $display("worst latency with shadow registers %0d, expected at most %0d", shadow.worst,
+               1 + MEM_STALL);
+      errors = errors + 1;
+    end
+
+    $display("");
+    $display("worst interrupt latency: %0d cycles, %0d with shadow registers", plain.worst,
+             shadow.worst);
+    $display("%0d errors", errors);
+    if (errors != 0) $display("FAILED");
+    else $display("PASSED");
+    $display("");
+
+    $finish();
+  end
+endmodule
+
+module pl_irq_latency_bench #(
+    parameter SHADOW_REGS = 0,
+    // Cycles data_ready stays low for accesses from SLOW_BASE on
+    parameter MEM_STALL   = 3
+) (
+    input wire clk,
+    input wire rst_n
+);
+  localparam SLOW_BASE = 32'h1000;
+  localparam HANDLER = 32'h100;
+  // Every offset into an iteration of the loop, a few times over
+  localparam OFFSETS = 64;
+
+  localparam T0 = 5;
+  localparam S0 = 8;
+  localparam T4 = 29;
+  localparam T5 = 30;
+  localparam T6 = 31;
+
+  localparam MRET = 32'h30200073;
+
+  `include "tb_rv32.vh"
+
+  wire [31:0] instr_addr;
+  wire [31:0] instr_data;
+  wire [31:0] data_addr;
+  wire [31:0] data_wdata;
+  wire [ 3:0] data_wenable;
+  wire        data_ren;
+  wire [31:0] data_rdata;
+
+  reg  [ 3:0] stall_count;
+  wire        slow = data_addr >= SLOW_BASE && (|data_wenable || data_ren);
+  wire        data_ready = !slow || stall_count == MEM_STALL;
+
+  always @(posedge clk) begin
+    if (!rst_n || !slow || data_ready) begin
+      stall_count <= 0;
+    end else begin
+      stall_count <= stall_count + 1;
+    end
+  end
+
+  dual_word_ram #(
+      .SIZE_WORDS(2 ** 11)
+  ) ram (
+      .clk(clk),
+
+      .addr_1   (data_addr[12:0]),
+      .wdata_1  (data_wdata),
+      .wenable_1(data_ready ? data_wenable : 4'b0),
+      .rdata_1  (data_rdata),
+
+      .addr_2 (instr_addr[12:0]),
+      .rdata_2(instr_data)
+  );
+
+  reg [`IRQ_LOCAL_LINES-1:0] irq;
+
+  pipelined_cpu #(
+      .SHADOW_REGS(SHADOW_REGS)
+  ) cpu (
+      .clk  (clk),
+      .rst_n(rst_n),
+
+      .instr_addr (instr_addr),
+      .instr_data (instr_data),
+      .instr_ready(1'b1),
+
+      .data_addr   (data_addr),
+      .data_wdata  (data_wdata),
+      .data_wenable(data_wenable),
+      .data_ren    (data_ren),
+      .data_rdata  (data_rdata),
+      .data_ready  (data_ready),
+
+      .irq      (irq),
+      .timer_irq(1'b0),
+
+      .ext_events(8'b0)
+  );
+
+  integer errors, traps, stores, worst, latency, offset, i;
+  reg [31:0] last_count;
+  reg finished;
+
+  // The loop's counter, stored once per iteration
+  always @(posedge clk) begin
+    if (rst_n && data_ready && |data_wenable && data_addr == SLOW_BASE + 4) begin
+      if (data_wdata !== last_count + 1) begin
+        $display("shadow regs %0d: stored %0d after %0d", SHADOW_REGS, data_wdata, last_count);
+        errors = errors + 1;
+      end
+
+      last_count = data_wdata;
+      stores = stores + 1;
+    end
+
+    if (rst_n && cpu.trap) traps = traps + 1;
+  end
+
+  initial begin
+    for (i = 0; i < 2 ** 11; i = i + 1) ram.data[i] = NOP;
+
+    // Vectors straight to HANDLER, with local interrupt 0 enabled
+    ram.data[0] = addi(T0, 0, HANDLER);
+    ram.data[1] = csrrw(12'h305, T0);
+    ram.data[2] = lui(T0, 20'h10);
+    ram.data[3] = csrrw(12'h304, T0);
+    ram.data[4] = csrrsi(12'h300, 5'd8);
+    ram.data[5] = lui(S0, SLOW_BASE >> 12);
+    ram.data[6] = addi(T4, 0, 0);
+    ram.data[7] = addi(T5, 0, 7);
+
+    // loop:
+    ram.data[8] = lw(T6, S0, 0);
+    ram.data[9] = div(T6, T6, T5);
+    ram.data[10] = addi(T4, T4, 1);
+    ram.data[11] = sw(T4, S0, 4);
+    ram.data[12] = jal(0, -21'd16);
+
+    ram.data[HANDLER/4] = SHADOW_REGS ? addi(T4, 0, -12'd1) : NOP;
+    ram.data[HANDLER/4+1] = MRET;
+
+    ram.data[SLOW_BASE/4] = 100;
+
+    irq = 0;
+    errors = 0;
+    traps = 0;
+    stores = 0;
+    worst = 0;
+    last_count = 0;
+    finished = 0;
+
+    // Interrupts are enabled by the time the loop stores anything
+    wait (rst_n);
+    while (stores == 0) @(posedge clk);
+
+    for (offset = 0; offset < OFFSETS; offset = offset + 1) begin
+      repeat (offset) @(posedge clk);
+
+      // High across one falling edge, when the CSR file latches it
+      #1 irq[0] = 1;
+      latency = 0;
+
+      while (instr_addr !== HANDLER && latency < 100) begin
+        @(posedge clk);
+        #1 irq[0] = 0;
+        latency = latency + 1;
+      end
+
+      if (latency > worst) worst = latency;
+
+      // Back from the handler before the next one
+      while (!cpu.mret_w) @(posedge clk);
+      @(posedge clk);
+    end
+
+    repeat (50) @(posedge clk);
+
+    if (traps != OFFSETS) begin
+      $display("shadow regs %0d: %0d traps, expected %0d", SHADOW_REGS, traps, OFFSETS);
+      errors = errors + 1;
+    end
+
+    finished = 1;
+  end
+endmodule
@@ -0,0 +1,155 @@
+`timescale 1ns / 1ns `default_nettype none
+`include "tb_dump.vh"
+`include "tb_pl_core.vh"
+
+// Runs every RV32M instruction on operands of both signs, including division
+// by zero and the INT_MIN / -1 overflow, each right before the store of its
+// result. Then a div fed by a load, with a mul right behind it, and an add
+// right behind a remu. Every value stored must match the one the M extension
+// gives.
+module pl_muldiv_tb ();
+  reg clk, rst_n;
+  always #5 clk = ~clk;
+
+  `TB_DUMP(pl_muldiv_tb, clk)
+
+  localparam DATA = 32'h1000;
+  localparam RESULTS = 24;
+
+  localparam S0 = 8;
+  localparam A0 = 10;
+  localparam A1 = 11;
+  localparam T0 = 5;
+  localparam T1 = 6;
+  localparam T2 = 7;
+  localparam T3 = 28;
+  localparam T4 = 29;
+  localparam T5 = 30;
+
+  localparam MUL = 3'b000;
+  localparam MULH = 3'b001;
+  localparam MULHSU = 3'b010;
+  localparam MULHU = 3'b011;
+  localparam DIV = 3'b100;
+  localparam DIVU = 3'b101;
+  localparam REM = 3'b110;
+  localparam REMU = 3'b111;
+
+  localparam INT_MIN = 32'h80000000;
+
+  `include "tb_rv32.vh"
+
+  wire [31:0] data_addr;
+  wire [31:0] data_wdata;
+  wire [ 3:0] data_wenable;
+
+  tb_pl_core core (
+      .clk  (clk),
+      .rst_n(rst_n),
+
+      .data_addr   (data_addr),
+      .data_wdata  (data_wdata),
+      .data_wenable(data_wenable)
+  );
+
+  reg [31:0] expected[0:RESULTS-1];
+  integer errors, stored, i, pc, results;
+
+  always @(posedge clk) begin
+    if (rst_n && |data_wenable && data_addr < DATA + 4 * RESULTS) begin
+      i = (data_addr - DATA) / 4;
+
+      if (data_wdata !== expected[i]) begin
+        $display("result %0d: stored %h, expected %h", i, data_wdata, expected[i]);
+        errors = errors + 1;
+      end
+
+      stored = stored + 1;
+    end
+  end
+
+  // Appends a0 = rs1 <op> rs2 and the store of a0 right behind it
+  task check(input [2:0] funct3, input [4:0] rs1, input [4:0] rs2, input [31:0] value);
+    begin
+      core.ram.data[pc] = muldiv(funct3, A0, rs1, rs2);
+      core.ram.data[pc+1] = sw(A0, S0, 4 * results);
+      expected[results] = value;
+
+      pc = pc + 2;
+      results = results + 1;
+    end
+  endtask
+
+  initial begin
+    for (i = 0; i < 2 ** 11; i = i + 1) core.ram.data[i] = NOP;
+
+    core.ram.data[0] = lui(S0, DATA >> 12);
+    core.ram.data[1] = addi(T0, 0, 12'd7);
+    core.ram.data[2] = addi(T1, 0, -12'd2);
+    core.ram.data[3] = addi(T2, 0, -12'd7);
+    core.ram.data[4] = addi(T3, 0, 12'd2);
+    core.ram.data[5] = lui(T4, INT_MIN >> 12);
+    core.ram.data[6] = addi(T5, 0, -12'd1);
+
+    pc = 7;
+    results = 0;
+
+    check(DIV, T0, T1, -3);  // 7 / -2, towards zero
+    check(REM, T0, T1, 1);
+    check(DIV, T2, T3, -3);
+    check(REM, T2, T3, -1);  // takes the dividend's sign
+    check(DIV, T2, T1, 3);
+    check(REM, T2, T1, -1);
+    check(DIVU, T2, T3, 32'h7FFFFFFC);
+
+    check(DIV, T2, 0, -1);  // by zero
+    check(REM, T2, 0, -7);
+    check(DIVU, T0, 0, 32'hFFFFFFFF);
+    check(REMU, T0, 0, 7);
+
+    check(DIV, T4, T5, INT_MIN);  // overflows
+    check(REM, T4, T5, 0);
+    check(DIVU, T4, T5, 0);
+    check(REMU, T4, T5, INT_MIN);
+
+    check(MUL, T2, T1, 14);
+    check(MUL, T4, T5, INT_MIN);
+    check(MULH, T4, T5, 0);
+    check(MULH, T2, T3, -1);
+    check(MULHU, T5, T5, 32'hFFFFFFFE);
+    check(MULHSU, T2, T5, -7);  // -7 * (2^32 - 1)
+    check(MULHSU, T0, T5, 6);
+
+    // Load-use into the divider, and its result used right away
+    core.ram.data[pc] = sw(T2, S0, 12'h100);
+    core.ram.data[pc+1] = lw(A1, S0, 12'h100);
+    core.ram.data[pc+2] = div(A0, A1, T3);
+    core.ram.data[pc+3] = muldiv(MUL, A0, A0, T2);
+    core.ram.data[pc+4] = sw(A0, S0, 4 * results);
+    expected[results] = 21;  // -7 / 2 * -7
+
+    core.ram.data[pc+5] = muldiv(REMU, A0, T0, T3);
+    core.ram.data[pc+6] = add(A0, A0, T0);
+    core.ram.data[pc+7] = sw(A0, S0, 4 * (results + 1));
+    expected[results+1] = 8;  // 7 % 2 + 7
+
+    core.ram.data[pc+8] = jal(0, 0);
+
+    errors = 0;
+    stored = 0;
+
+    clk = 1;
+    rst_n = 0;
+    #15 rst_n = 1;
+
+    wait (stored == RESULTS);
+
+    $display("");
+    $display("%0d errors", errors);
+    if (errors != 0) $display("FAILED");
+    else $display("PASSED");
+    $display("");
+
+    $finish();
+  end
+endmodule
@@ -0,0 +1,178 @@
+`timescale 1ns / 1ns `default_nettype none
+`include "tb_dump.vh"
+`include "tb_pl_core.vh"
+
+// Runs a loop of mostly compressed instructions, with 32-bit ones straddling
+// word boundaries, a compressed call and return and a compressed branch, on
+// three cores: one reading the upper half of straddling instructions from the
+// RAM's next word, one that has to fetch it separately (as with the
+// instruction cache), and a dual-issue one. All must store the same values.
+module pl_rvc_tb ();
+  reg clk, rst_n;
+  always #5 clk = ~clk;
+
+  `TB_DUMP(pl_rvc_tb, clk)
+
+  pl_rvc_bench #(
+      .NEXT_VALID(1),
+      .DUAL_ISSUE(0)
+  ) plain (
+      .clk  (clk),
+      .rst_n(rst_n)
+  );
+
+  pl_rvc_bench #(
+      .NEXT_VALID(0),
+      .DUAL_ISSUE(0)
+  ) split (
+      .clk  (clk),
+      .rst_n(rst_n)
+  );
+
+  pl_rvc_bench #(
+      .NEXT_VALID(1),
+      .DUAL_ISSUE(1)
+  ) dual (
+      .clk  (clk),
+      .rst_n(rst_n)
+  );
+
+  integer errors;
+
+  initial begin
+    clk   = 1;
+    rst_n = 0;
+    #15 rst_n = 1;
+
+    wait (plain.finished && split.finished && dual.finished);
+
+    errors = plain.errors + split.errors + dual.errors;
+
+    $display("");
+    $display("loop finished in %0d cycles, %0d with split fetches, %0d with dual issue",
+             plain.cycles, split.cycles, dual.cycles);
+    $display("%0d errors", errors);
+    if (errors != 0) $display("FAILED");
+    else $display("PASSED");
+    $display("");
+
+    $finish();
+  end
+endmodule
+
+module pl_rvc_bench #(
+    // Whether the core gets the word after the fetched one
+    parameter NEXT_VALID = 1,
+    parameter DUAL_ISSUE = 0
+) (
+    input wire clk,
+    input wire rst_n
+);
+  localparam DATA = 32'h1000;
+  localparam ITERATIONS = 10;
+
+  `include "tb_rv32.vh"
+
+  wire [31:0] data_addr;
+  wire [31:0] data_wdata;
+  wire [ 3:0] data_wenable;
+
+  tb_pl_core #(
+      .DUAL_ISSUE(DUAL_ISSUE),
+      .NEXT_VALID(NEXT_VALID)
+  ) core (
+      .clk  (clk),
+      .rst_n(rst_n),
+
+      .data_addr   (data_addr),
+      .data_wdata  (data_wdata),
+      .data_wenable(data_wenable)
+  );
+
+  integer errors, cycles, iteration, i;
+  reg [31:0] expected;
+  reg finished;
+
+  always @(posedge clk) begin
+    if (rst_n && !finished) cycles = cycles + 1;
+
+    if (rst_n && |data_wenable) begin
+      case (data_addr)
+        DATA + 4:  expected = 9 * iteration + 200;
+        DATA + 8:  expected = 4 * iteration + 100;
+        DATA + 12: expected = 4 * iteration + 100 + (iteration % 2 ? 1000 : 0);
+        default:   expected = iteration + 1;
+      endcase
+
+      if (data_wdata !== expected) begin
+        $display("next valid %0d, dual issue %0d, iteration %0d: stored %h at %h, expected %h",
+                 NEXT_VALID, DUAL_ISSUE, iteration, data_wdata, data_addr, expected);
+        errors = errors + 1;
+      end
+
+      if (data_addr == DATA) begin
+        iteration = iteration + 1;
+        if (iteration == ITERATIONS) finished = 1;
+      end
+    end
+  end
+
+  // Lays the program out a halfword at a time
+  integer addr;
+
+  task emit16(input [15:0] instr);
+    begin
+      if (addr % 4 == 0) core.ram.data[addr/4][15:0] = instr;
+      else core.ram.data[addr/4][31:16] = instr;
+      addr = addr + 2;
+    end
+  endtask
+
+  task emit32(input [31:0] instr);
+    begin
+      emit16(instr[15:0]);
+      emit16(instr[31:16]);
+    end
+  endtask
+
+  initial begin
+    for (i = 0; i < 2 ** 11; i = i + 1) core.ram.data[i] = NOP;
+
+    addr = 0;
+    emit16(16'h6405);  // 0x00: c.lui s0, 1
+    emit16(16'h4501);  // 0x02: c.li a0, 0 (i)
+    emit16(16'h45A9);  // 0x04: c.li a1, 10
+
+    // loop:
+    emit16(16'h862A);  // 0x06: c.mv a2, a0
+    emit16(16'h060A);  // 0x08: c.slli a2, 2
+    emit32(32'h06460693);  // 0x0a: addi a3, a2, 100, across two words
+    emit16(16'h2839);  // 0x0e: c.jal func (a4 = 9i + 200)
+    emit16(16'hC058);  // 0x10: c.sw a4, 4(s0)
+    emit32(32'h00D42423);  // 0x12: sw a3, 8(s0), across two words
+    emit16(16'h87AA);  // 0x16: c.mv a5, a0
+    emit16(16'h8B85);  // 0x18: c.andi a5, 1
+    emit16(16'hC399);  // 0x1a: c.beqz a5, even
+    emit32(32'h3E868693);  // 0x1c: addi a3, a3, 1000
+
+    // even:
+    emit16(16'hC454);  // 0x20: c.sw a3, 12(s0)
+    emit16(16'h0505);  // 0x22: c.addi a0, 1
+    emit16(16'hC008);  // 0x24: c.sw a0, 0(s0)
+    emit32(32'hFEB540E3);  // 0x26: blt a0, a1, loop, across two words
+    emit16(16'hA001);  // 0x2a: c.j .
+
+    // func:
+    emit16(16'h8736);  // 0x2c: c.mv a4, a3
+    emit16(16'h9736);  // 0x2e: c.add a4, a3
+    emit16(16'h972A);  // 0x30: c.add a4, a0
+    emit16(16'h8082);  // 0x32: c.jr ra
+
+    core.ram.data[DATA/4] = 0;
+
+    errors = 0;
+    cycles = 0;
+    iteration = 0;
+    finished = 0;
+  end
+endmodule
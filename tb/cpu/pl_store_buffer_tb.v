@@ -0,0 +1,278 @@
+`timescale 1ns / 1ns `default_nettype none
+`include "tb_dump.vh"
+
+// Runs a loop behind a data cache, with and without the store buffer. Every
+// iteration stores back to the words the next one loads, and to a new cache
+// line, which misses. After the loop, one more new line is loaded back right
+// behind its store, while it's still queued. Both cores must store the same
+// values, and the one with the buffer must finish sooner.
+module pl_store_buffer_tb ();
+  reg clk, rst_n;
+  always #5 clk = ~clk;
+
+  `TB_DUMP(pl_store_buffer_tb, clk)
+
+  pl_store_buffer_bench #(
+      .STORE_BUFFER(0)
+  ) cached (
+      .clk  (clk),
+      .rst_n(rst_n)
+  );
+
+  pl_store_buffer_bench #(
+      .STORE_BUFFER(1)
+  ) buffered (
+      .clk  (clk),
+      .rst_n(rst_n)
+  );
+
+  integer errors;
+
+  initial begin
+    clk   = 1;
+    rst_n = 0;
+    #15 rst_n = 1;
+
+    wait (cached.finished && buffered.finished);
+
+    errors = cached.errors + buffered.errors;
+
+    if (buffered.cycles >= cached.cycles) begin
+      $display("the store buffer took %0d cycles, the data cache alone %0d", buffered.cycles,
+               cached.cycles);
+      errors = errors + 1;
+    end
+
+    $display("");
+    $display("loop finished in %0d cycles, %0d with the store buffer", cached.cycles,
+             buffered.cycles);
+    $display("%0d errors", errors);
+    if (errors != 0) $display("FAILED");
+    else $display("PASSED");
+    $display("");
+
+    $finish();
+  end
+endmodule
+
+module pl_store_buffer_bench #(
+    parameter STORE_BUFFER = 0
+) (
+    input wire clk,
+    input wire rst_n
+);
+  localparam DATA = 32'h1000;
+  localparam LINES = 32'h2000;
+  localparam ITERATIONS = 10;
+
+  localparam S0 = 8;
+  localparam S1 = 9;
+  localparam T0 = 5;
+  localparam T1 = 6;
+  localparam T2 = 7;
+  localparam T3 = 28;
+  localparam T4 = 29;
+  localparam T5 = 30;
+
+  `include "tb_rv32.vh"
+
+  wire [31:0] instr_addr;
+  wire [31:0] instr_data;
+  wire [31:0] data_addr;
+  wire [31:0] data_wdata;
+  wire [ 3:0] data_wenable;
+  wire        data_ren;
+  wire [31:0] data_rdata;
+  wire        data_ready;
+
+  dual_word_ram #(
+      .SIZE_WORDS(2 ** 11)
+  ) rom (
+      .clk(clk),
+
+      .addr_1   (13'b0),
+      .wdata_1  (32'b0),
+      .wenable_1(4'b0000),
+      .rdata_1  (),
+
+      .addr_2 (instr_addr[12:0]),
+      .rdata_2(instr_data)
+  );
+
+  wire dcache_ren, dcache_ready;
+  wire [31:0] dcache_addr, dcache_wdata, dcache_rdata;
+  wire [3:0] dcache_wenable;
+  wire mem_req, mem_we, mem_ready;
+  wire [31:0] mem_addr;
+  wire [127:0] mem_wdata, mem_rdata;
+
+  generate
+    if (STORE_BUFFER) begin : g_store_buffer
+      store_buffer buffer (
+          .clk  (clk),
+          .rst_n(rst_n),
+
+          .ren    (data_ren),
+          .addr   (data_addr),
+          .wdata  (data_wdata),
+          .wenable(data_wenable),
+          .rdata  (data_rdata),
+          .ready  (data_ready),
+
+          .mem_ren    (dcache_ren),
+          .mem_addr   (dcache_addr),
+          .mem_wdata  (dcache_wdata),
+          .mem_wenable(dcache_wenable),
+          .mem_rdata  (dcache_rdata),
+          .mem_ready  (dcache_ready)
+      );
+    end else begin : g_no_store_buffer
+      assign dcache_ren     = data_ren;
+      assign dcache_addr    = data_addr;
+      assign dcache_wdata   = data_wdata;
+      assign dcache_wenable = data_wenable;
+      assign data_rdata     = dcache_rdata;
+      assign data_ready     = dcache_ready;
+    end
+  endgenerate
+
+  dcache cache (
+      .clk  (clk),
+      .rst_n(rst_n),
+
+      .ren    (dcache_ren),
+      .addr   (dcache_addr),
+      .wdata  (dcache_wdata),
+      .wenable(dcache_wenable),
+      .rdata  (dcache_rdata),
+      .ready  (dcache_ready),
+
+      .mem_req  (mem_req),
+      .mem_we   (mem_we),
+      .mem_addr (mem_addr),
+      .mem_wdata(mem_wdata),
+      .mem_ready(mem_ready),
+      .mem_rdata(mem_rdata),
+
+      .hits         (),
+      .misses       (),
+      .refill_cycles()
+  );
+
+  backing_ram #(
+      .SIZE_WORDS(2 ** 12)
+  ) ram (
+      .clk  (clk),
+      .rst_n(rst_n),
+
+      .req_1  (mem_req),
+      .we_1   (mem_we),
+      .addr_1 (mem_addr),
+      .wdata_1(mem_wdata),
+      .ready_1(mem_ready),
+      .rdata_1(mem_rdata),
+
+      .req_2  (1'b0),
+      .addr_2 (32'b0),
+      .ready_2(),
+      .rdata_2()
+  );
+
+  pipelined_cpu cpu (
+      .clk  (clk),
+      .rst_n(rst_n),
+
+      .instr_addr      (instr_addr),
+      .instr_data      (instr_data),
+      .instr_ready     (1'b1),
+      .instr_data_next (32'b0),
+      .instr_next_valid(1'b0),
+
+      .data_addr   (data_addr),
+      .data_wdata  (data_wdata),
+      .data_wenable(data_wenable),
+      .data_ren    (data_ren),
+      .data_rdata  (data_rdata),
+      .data_ready  (data_ready),
+
+      .irq      (16'b0),
+      .timer_irq(1'b0),
+
+      .ext_events(8'b0)
+  );
+
+  integer errors, cycles, iteration, i;
+  reg [31:0] acc, expected;
+  reg started, finished;
+
+  always @(posedge clk) begin
+    if (rst_n && !finished) cycles = cycles + 1;
+
+    if (rst_n && |data_wenable && data_ready) begin
+      if (data_addr == DATA + 8) begin
+        started = 1;
+      end else if (started) begin
+        if (data_addr == DATA + 4) acc = acc + iteration + 7;
+
+        if (data_addr == LINES + 16 * (iteration + 1)) expected = iteration + 7;
+        else if (data_addr == DATA + 4) expected = acc;
+        else if (data_addr == DATA + 12) expected = 100 / (iteration + 7);
+        else if (data_addr == DATA + 16) expected = ITERATIONS + 7;
+        else if (data_addr == DATA) expected = iteration + 1;
+        else expected = {32{1'bx}};
+
+        if (data_wdata !== expected) begin
+          $display("store buffer %0d, iteration %0d: stored %0d at %h", STORE_BUFFER,
+                   iteration, data_wdata, data_addr);
+          errors = errors + 1;
+        end
+
+        if (data_addr == DATA) iteration = iteration + 1;
+        if (data_addr == DATA + 16) finished = 1;
+      end
+    end
+  end
+
+  initial begin
+    for (i = 0; i < 2 ** 11; i = i + 1) rom.data[i] = NOP;
+
+    rom.data[0] = lui(S0, DATA >> 12);
+    rom.data[1] = lui(S1, LINES >> 12);
+    rom.data[2] = addi(T4, 0, 0);
+    rom.data[3] = addi(T5, 0, ITERATIONS);
+    rom.data[4] = addi(T0, 0, 100);
+    rom.data[5] = sw(0, S0, 0);
+    rom.data[6] = sw(0, S0, 4);
+    rom.data[7] = sw(T0, S0, 8);
+
+    // loop: t0 = i, as stored by the previous iteration
+    rom.data[8] = lw(T0, S0, 0);
+    rom.data[9] = addi(T1, T0, 7);
+    rom.data[10] = addi(S1, S1, 16);
+    rom.data[11] = sw(T1, S1, 0);  // a new line every time
+    rom.data[12] = lw(T2, S0, 4);
+    rom.data[13] = add(T2, T2, T1);
+    rom.data[14] = sw(T2, S0, 4);
+    rom.data[15] = lw(T3, S0, 8);
+    rom.data[16] = divu(T3, T3, T1);
+    rom.data[17] = sw(T3, S0, 12);
+    rom.data[18] = addi(T4, T4, 1);
+    rom.data[19] = sw(T4, S0, 0);
+    rom.data[20] = blt(T4, T5, -13'd48);
+
+    // One more new line, loaded back while its store is still queued
+    rom.data[21] = addi(T1, T4, 7);
+    rom.data[22] = addi(S1, S1, 16);
+    rom.data[23] = sw(T1, S1, 0);
+    rom.data[24] = lw(T2, S1, 0);
+    rom.data[25] = sw(T2, S0, 16);
+    rom.data[26] = jal(0, 0);
+
+    errors = 0;
+    cycles = 0;
+    iteration = 0;
+    acc = 0;
+    started = 0;
+    finished = 0;
+  end
+endmodule
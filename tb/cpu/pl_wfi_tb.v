@@ -0,0 +1,291 @@
+`timescale 1ns / 1ns `default_nettype none
+`include "tb_dump.vh"
+`include "cpu_csr_file.vh"
+`include "pipelined_cpu.vh"
+
+// Runs four wfis on the pipelined core, with a timer_unit on the bus:
+//
+// - one with a local interrupt enabled in mie but mstatus.MIE clear, which
+//   must sleep until the interrupt arrives and then carry on with the code
+//   after it, without trapping,
+// - one in the shadow of a taken branch the core has no predictor for, which
+//   must be squashed without ever putting the core to sleep,
+// - one with the timer enabled and mstatus.MIE still clear, which must sleep
+//   until mtime reaches mtimecmp and then carry on,
+// - and the same with mstatus.MIE set, which must trap with mepc pointing
+//   past the wfi instead.
+//
+// Everything the program stores must come out as expected, after exactly one
+// trap and three wfis that sleep.
+module pl_wfi_tb ();
+  reg clk, rst_n;
+  always #5 clk = ~clk;
+
+  `TB_DUMP(pl_wfi_tb, clk)
+
+  localparam HANDLER = 32'h200;
+  localparam RESULTS = 32'h1000;
+  localparam TIMER = 32'h2000;
+  // Cycles from setting mtimecmp to the timer firing
+  localparam DELAY = 60;
+
+  localparam T0 = 5;
+  localparam T1 = 6;
+  localparam T2 = 7;
+  localparam S0 = 8;
+  localparam S1 = 9;
+  localparam T3 = 28;
+
+  localparam CSRRS = 3'b010;
+  localparam MRET = 32'h30200073;
+  localparam WFI = 32'h10500073;
+
+  `include "tb_rv32.vh"
+
+  wire [31:0] instr_addr;
+  wire [31:0] instr_data;
+  wire [31:0] data_addr;
+  wire [31:0] data_wdata;
+  wire [ 3:0] data_wenable;
+  wire        data_ren;
+  wire [31:0] ram_rdata;
+  wire [31:0] timer_rdata;
+  wire        timer_irq;
+
+  wire        timer_sel = data_addr >= TIMER;
+
+  dual_word_ram #(
+      .SIZE_WORDS(2 ** 11)
+  ) ram (
+      .clk(clk),
+
+      .addr_1   (data_addr[12:0]),
+      .wdata_1  (data_wdata),
+      .wenable_1(timer_sel ? 4'b0 : data_wenable),
+      .rdata_1  (ram_rdata),
+
+      .addr_2 (instr_addr[12:0]),
+      .rdata_2(instr_data)
+  );
+
+  timer_unit timer (
+      .clk  (clk),
+      .rst_n(rst_n),
+
+      .reg_sel(data_addr[3:2]),
+      .wdata  (data_wdata),
+      .wenable(timer_sel && |data_wenable),
+      .rdata  (timer_rdata),
+
+      .irq(timer_irq)
+  );
+
+  reg [`IRQ_LOCAL_LINES-1:0] irq;
+
+  pipelined_cpu #(
+      .BRANCH_PREDICTOR(`BP_NONE)
+  ) cpu (
+      .clk  (clk),
+      .rst_n(rst_n),
+
+      .instr_addr (instr_addr),
+      .instr_data (instr_data),
+      .instr_ready(1'b1),
+
+      .data_addr   (data_addr),
+      .data_wdata  (data_wdata),
+      .data_wenable(data_wenable),
+      .data_ren    (data_ren),
+      .data_rdata  (timer_sel ? timer_rdata : ram_rdata),
+      .data_ready  (1'b1),
+
+      .irq      (irq),
+      .timer_irq(timer_irq),
+
+      .ext_events(8'b0)
+  );
+
+  localparam RESULT_COUNT = 7;
+
+  reg [31:0] results [0:RESULT_COUNT-1];
+  reg [31:0] expected[0:RESULT_COUNT-1];
+  // How long each wfi sleeps, and for how many of those cycles the timer was
+  // already firing
+  integer asleep[0:2];
+  integer timer_awake[0:2];
+  integer errors, stores, traps, wfis, cycles, i;
+
+  always @(posedge clk) begin
+    if (rst_n) begin
+      if (|data_wenable && data_addr >= RESULTS && data_addr < RESULTS + 4 * RESULT_COUNT) begin
+        results[(data_addr-RESULTS)/4] = data_wdata;
+        stores = stores + 1;
+      end
+
+      if (cpu.trap) traps = traps + 1;
+      if (cpu.take_wfi_d) wfis = wfis + 1;
+
+      if (cpu.sleeping && wfis >= 1 && wfis <= 3) begin
+        asleep[wfis-1] = asleep[wfis-1] + 1;
+        if (timer_irq) timer_awake[wfis-1] = timer_awake[wfis-1] + 1;
+      end
+    end
+  end
+
+  initial begin
+    for (i = 0; i < 2 ** 11; i = i + 1) ram.data[i] = NOP;
+
+    // Vectors straight to HANDLER, with local interrupt 0 and the timer
+    // enabled in mie but mstatus.MIE clear
+    ram.data[0] = lui(S0, RESULTS >> 12);
+    ram.data[1] = lui(S1, TIMER >> 12);
+    ram.data[2] = addi(T0, 0, HANDLER);
+    ram.data[3] = csrrw(12'h305, T0);
+    ram.data[4] = lui(T0, 20'h10);
+    ram.data[5] = addi(T0, T0, 12'h080);
+    ram.data[6] = csrrw(12'h304, T0);
+
+    // Woken by the local interrupt, and carries on without trapping
+    ram.data[7] = addi(T1, 0, 1);
+    ram.data[8] = sw(T1, S0, 0);
+    ram.data[9] = WFI;
+    ram.data[10] = addi(T1, T1, 2);
+    ram.data[11] = addi(T1, T1, 4);
+    ram.data[12] = sw(T1, S0, 4);
+    ram.data[13] = csrrw(12'h344, 0);
+
+    // Squashed behind a taken branch
+    ram.data[14] = branch(3'b000, 0, 0, 13'd12);
+    ram.data[15] = WFI;
+    ram.data[16] = sw(T1, S0, 8);
+    ram.data[17] = addi(T1, T1, 4);
+    ram.data[18] = sw(T1, S0, 8);
+
+    // Woken by the timer without trapping, which is then turned back off.
+    // mtimecmp's low half goes first, so that it never fires early.
+    ram.data[19] = lw(T2, S1, 0);
+    ram.data[20] = addi(T2, T2, DELAY);
+    ram.data[21] = sw(T2, S1, 8);
+    ram.data[22] = sw(0, S1, 12);
+    ram.data[23] = WFI;
+    ram.data[24] = addi(T1, T1, 8);
+    ram.data[25] = sw(T1, S0, 12);
+    ram.data[26] = addi(T3, 0, -12'd1);
+    ram.data[27] = sw(T3, S1, 12);
+
+    // Woken by the timer, and traps
+    ram.data[28] = csrrsi(12'h300, 5'd8);
+    ram.data[29] = lw(T2, S1, 0);
+    ram.data[30] = addi(T2, T2, DELAY);
+    ram.data[31] = sw(T2, S1, 8);
+    ram.data[32] = sw(0, S1, 12);
+    ram.data[33] = WFI;
+    ram.data[34] = addi(T1, T1, 16);
+    ram.data[35] = sw(T1, S0, 24);
+    ram.data[36] = jal(0, 0);
+
+    // Stores mcause and mepc, and turns the timer back off
+    ram.data[HANDLER/4] = csr(CSRRS, T3, 0, 12'h342);
+    ram.data[HANDLER/4+1] = sw(T3, S0, 16);
+    ram.data[HANDLER/4+2] = csr(CSRRS, T3, 0, 12'h341);
+    ram.data[HANDLER/4+3] = sw(T3, S0, 20);
+    ram.data[HANDLER/4+4] = addi(T3, 0, -12'd1);
+    ram.data[HANDLER/4+5] = sw(T3, S1, 12);
+    ram.data[HANDLER/4+6] = MRET;
+
+    expected[0] = 1;
+    expected[1] = 7;
+    expected[2] = 11;
+    expected[3] = 19;
+    expected[4] = 32'h8000_0000 | `IRQ_MTI;
+    expected[5] = 34 * 4;
+    expected[6] = 35;
+
+    for (i = 0; i < RESULT_COUNT; i = i + 1) results[i] = 0;
+
+    for (i = 0; i < 3; i = i + 1) begin
+      asleep[i] = 0;
+      timer_awake[i] = 0;
+    end
+
+    irq = 0;
+    errors = 0;
+    stores = 0;
+    traps = 0;
+    wfis = 0;
+
+    clk = 1;
+    rst_n = 0;
+    #15 rst_n = 1;
+
+    // Nothing wakes the first wfi until the interrupt
+    cycles = 0;
+    while (!cpu.sleeping && cycles < 100) begin
+      @(posedge clk);
+      cycles = cycles + 1;
+    end
+
+    repeat (20) @(posedge clk);
+
+    if (!cpu.sleeping || stores != 1) begin
+      $display("first wfi: sleeping %b after %0d stores, expected asleep after 1",
+               cpu.sleeping, stores);
+      errors = errors + 1;
+    end
+
+    // High across one falling edge, when the CSR file latches it
+    #1 irq[0] = 1;
+    @(posedge clk);
+    #1 irq[0] = 0;
+
+    cycles = 0;
+    while (stores < 2 && cycles < 20) begin
+      @(posedge clk);
+      cycles = cycles + 1;
+    end
+
+    if (stores != 2 || traps != 0) begin
+      $display("first wfi: %0d stores and %0d traps after waking, expected 2 and none", stores,
+               traps);
+      errors = errors + 1;
+    end
+
+    cycles = 0;
+    while (stores < RESULT_COUNT && cycles < 1000) begin
+      @(posedge clk);
+      cycles = cycles + 1;
+    end
+
+    repeat (10) @(posedge clk);
+
+    for (i = 0; i < RESULT_COUNT; i = i + 1) begin
+      if (results[i] !== expected[i]) begin
+        $display("result %0d = %h, expected %h", i, results[i], expected[i]);
+        errors = errors + 1;
+      end
+    end
+
+    if (stores != RESULT_COUNT || traps != 1 || wfis != 3) begin
+      $display("%0d stores, %0d traps and %0d wfis, expected %0d, 1 and 3", stores, traps, wfis,
+               RESULT_COUNT);
+      errors = errors + 1;
+    end
+
+    // Asleep until the timer fires, and awake the cycle after
+    for (i = 1; i < 3; i = i + 1) begin
+      if (asleep[i] < DELAY - 10 || timer_awake[i] != 1) begin
+        $display("timer wfi %0d: asleep %0d cycles, %0d with the timer firing, expected 1",
+                 i, asleep[i], timer_awake[i]);
+        errors = errors + 1;
+      end
+    end
+
+    $display("");
+    $display("%0d errors", errors);
+    if (errors != 0) $display("FAILED");
+    else $display("PASSED");
+    $display("");
+
+    $finish();
+  end
+endmodule
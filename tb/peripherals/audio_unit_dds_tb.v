@@ -0,0 +1,199 @@
+`default_nettype none `timescale 1ns / 1ps
+`include "tb_dump.vh"
+`include "audio_unit_ref.vh"
+
+// Checks audio_unit's mixer against audio_unit_ref, the design from before its
+// dividers were replaced by phase accumulators, on every cycle including
+// across period changes. The outputs may differ by an LSB, and the new one
+// lags by three cycles. The sawtooth and cosine channels only switch to a new
+// period once its increment is ready, so their period writes reach the
+// reference on the cycle audio_unit switches.
+module audio_unit_dds_tb ();
+  reg clk, rst_n;
+  always #5 clk = ~clk;
+
+  `TB_DUMP(audio_unit_dds_tb, clk)
+
+  localparam LATENCY = 3;
+  localparam TOLERANCE = 1;
+
+  reg  [ 7:0] addr;
+  reg  [31:0] wdata;
+  reg         wenable;
+
+  reg  [ 7:0] ref_addr;
+  reg  [31:0] ref_wdata;
+  reg         ref_wenable;
+
+  wire [ 8:0] out;
+  wire [ 8:0] ref_out;
+
+  audio_unit audio (
+      .clk  (clk),
+      .rst_n(rst_n),
+
+      .addr   (addr),
+      .wdata  (wdata),
+      .wenable(wenable),
+
+      .m_rdata(32'b0),
+      .m_ready(1'b0),
+
+      .out(out)
+  );
+
+  audio_unit_ref audio_ref (
+      .clk  (clk),
+      .rst_n(rst_n),
+
+      .addr   (ref_addr),
+      .wdata  (ref_wdata),
+      .wenable(ref_wenable),
+
+      .m_rdata(32'b0),
+      .m_ready(1'b0),
+
+      .out(ref_out)
+  );
+
+  // The reference overshoots its sawtooth and cosine for the one cycle their
+  // counter is past a period that just got shorter, before wrapping
+  wire ref_valid = (audio_ref.period_3 == 0 || audio_ref.ctr_3 < audio_ref.period_3) &&
+      (audio_ref.period_4 == 0 || audio_ref.ctr_4 < audio_ref.period_4);
+
+  reg [8:0] ref_delay[0:LATENCY-1];
+  reg [LATENCY-1:0] valid_delay;
+  reg checking;
+  integer checked, mismatches, skipped, errors, k;
+
+  wire [8:0] expected = ref_delay[LATENCY-1];
+  wire [9:0] diff = out > expected ? out - expected : expected - out;
+
+  always @(posedge clk) begin
+    ref_delay[0] <= ref_out;
+    for (k = 1; k < LATENCY; k = k + 1) ref_delay[k] <= ref_delay[k-1];
+    valid_delay <= {valid_delay[LATENCY-2:0], ref_valid};
+
+    // The last cosine sample is left undefined by cosine.mem
+    if (checking && !valid_delay[LATENCY-1]) begin
+      skipped = skipped + 1;
+    end else if (checking && ^expected !== 1'bx) begin
+      checked = checked + 1;
+      if (out != expected) mismatches = mismatches + 1;
+
+      if (^out === 1'bx || diff > TOLERANCE) begin
+        if (errors < 10) $display("%0t: out = %0d, expected %0d", $time, out, expected);
+        errors = errors + 1;
+      end
+    end
+  end
+
+  task write_reg(input [7:0] reg_addr, input [31:0] value);
+    begin
+      @(negedge clk);
+      addr        = reg_addr;
+      wdata       = value;
+      wenable     = 1;
+      ref_addr    = reg_addr;
+      ref_wdata   = value;
+      ref_wenable = 1;
+      @(negedge clk);
+      wenable     = 0;
+      ref_wenable = 0;
+    end
+  endtask
+
+  // Holds the reference's write back until audio_unit switches to the period
+  task write_slow_period(input [7:0] reg_addr, input [31:0] value, input [31:0] current);
+    begin
+      @(negedge clk);
+      addr    = reg_addr;
+      wdata   = value;
+      wenable = 1;
+      @(negedge clk);
+      wenable = 0;
+
+      if (value != current) begin
+        while (!(audio.div_busy && audio.div_done)) @(negedge clk);
+      end
+
+      ref_addr    = reg_addr;
+      ref_wdata   = value;
+      ref_wenable = 1;
+      @(negedge clk);
+      ref_wenable = 0;
+    end
+  endtask
+
+  task set_periods(input [31:0] p1, input [31:0] p2, input [31:0] p3, input [31:0] p4);
+    begin
+      write_reg(8'h00, p1);
+      write_reg(8'h20, p2);
+      write_slow_period(8'h40, p3, audio.inc_period_3);
+      write_slow_period(8'h60, p4, audio.inc_period_4);
+    end
+  endtask
+
+  initial begin
+    clk         = 1;
+    rst_n       = 0;
+    addr        = 0;
+    wdata       = 0;
+    wenable     = 0;
+    ref_addr    = 0;
+    ref_wdata   = 0;
+    ref_wenable = 0;
+    valid_delay = 0;
+    checking    = 0;
+    checked     = 0;
+    mismatches  = 0;
+    skipped     = 0;
+    errors      = 0;
+
+    #20 rst_n = 1;
+    repeat (LATENCY) @(posedge clk);
+    checking = 1;
+
+    // Silence
+    repeat (1000) @(posedge clk);
+
+    write_reg(8'h24, 192);
+    write_reg(8'h44, 255);
+    write_reg(8'h64, 128);
+
+    set_periods(1000, 1500, 2000, 2500);
+    repeat (50_000) @(posedge clk);
+
+    set_periods(777, 4321, 12345, 333);
+    repeat (50_000) @(posedge clk);
+
+    // Pausing mutes a channel without stopping its counter
+    write_reg(8'h50, 32'b100);
+    write_reg(8'h70, 32'b100);
+    repeat (20_000) @(posedge clk);
+    write_reg(8'h50, 32'b000);
+    write_reg(8'h70, 32'b000);
+
+    // Shortest periods, down to an increment of 1.0
+    set_periods(2, 3, 2, 3);
+    repeat (1_000) @(posedge clk);
+
+    set_periods(257, 300, 258, 999);
+    repeat (50_000) @(posedge clk);
+
+    // Longer and then shorter periods, halfway through a wave
+    set_periods(5000, 5000, 6000, 7000);
+    repeat (3_000) @(posedge clk);
+    set_periods(4000, 4000, 5500, 6500);
+    repeat (50_000) @(posedge clk);
+
+    $display("");
+    $display("%0d samples checked, %0d off by one, %0d skipped, %0d errors", checked,
+             mismatches, skipped, errors);
+    if (errors != 0) $display("FAILED");
+    else $display("PASSED");
+    $display("");
+
+    $finish();
+  end
+endmodule
@@ -0,0 +1,292 @@
+`timescale 1ns / 1ns `default_nettype none
+`include "tb_dump.vh"
+
+// Drives audio_unit's sequencer from a memory that takes LATENCY cycles per
+// read, and records every channel's period on each tick:
+//
+// - channel 0 plays three steps lasting 2, 1 and 3 ticks and then ends,
+// - channel 1 loops over two one-tick steps,
+// - channel 2 is restarted while its first step is being fetched, which must
+//   be dropped so that the sequence starts over from its first step,
+// - channel 3 is stopped while its first step is being fetched, which must
+//   leave it silent.
+//
+// The interrupt must fire once for each of channels 0 and 2, on the tick they
+// end on.
+module audio_unit_seq_tb ();
+  reg clk, rst_n;
+  always #5 clk = ~clk;
+
+  `TB_DUMP(audio_unit_seq_tb, clk)
+
+  localparam TICK_CYCLES = 40;
+  localparam LATENCY = 6;
+  localparam TICKS = 64;
+
+  localparam REG_SEQ = 2;
+  localparam REG_SEQ_LEN = 3;
+  localparam REG_CTRL = 4;
+
+  localparam START = 1;
+  localparam LOOP = 2;
+  localparam STOP = 8;
+
+  reg  [ 7:0] addr;
+  reg  [31:0] wdata;
+  reg         wenable;
+
+  wire [31:0] m_addr;
+  wire        m_ren;
+  wire        m_ready;
+  wire        irq;
+
+  reg  [31:0] mem      [0:255];
+  reg  [ 3:0] mem_wait;
+
+  audio_unit #(
+      .TICK_CYCLES(TICK_CYCLES)
+  ) audio (
+      .clk  (clk),
+      .rst_n(rst_n),
+
+      .addr   (addr),
+      .wdata  (wdata),
+      .wenable(wenable),
+      .rdata  (),
+
+      .m_addr (m_addr),
+      .m_ren  (m_ren),
+      .m_rdata(mem[m_addr[9:2]]),
+      .m_ready(m_ready),
+
+      .irq(irq),
+
+      .out()
+  );
+
+  // Answers every read LATENCY cycles after it's asked
+  assign m_ready = m_ren && mem_wait == LATENCY - 1;
+
+  always @(posedge clk) begin
+    mem_wait <= m_ren && !m_ready ? mem_wait + 1 : 0;
+  end
+
+  // Each channel's period as each tick starts
+  reg [31:0] seen_0[0:TICKS-1];
+  reg [31:0] seen_1[0:TICKS-1];
+  reg [31:0] seen_2[0:TICKS-1];
+  reg [31:0] seen_3[0:TICKS-1];
+  reg [31:0] irq_ticks[0:3];
+  reg [31:0] expected[0:7];
+  integer errors, ticks, irqs, start, fetching, i;
+
+  always @(posedge clk) begin
+    if (rst_n) begin
+      if (irq) begin
+        if (irqs < 4) irq_ticks[irqs] = ticks;
+        irqs = irqs + 1;
+      end
+
+      if (audio.tick && ticks < TICKS) begin
+        seen_0[ticks] = audio.periods[0];
+        seen_1[ticks] = audio.periods[1];
+        seen_2[ticks] = audio.periods[2];
+        seen_3[ticks] = audio.periods[3];
+        ticks = ticks + 1;
+      end
+    end
+  end
+
+  initial begin
+    // {period, duration}
+    mem[8'h00] = 100;
+    mem[8'h01] = 2;
+    mem[8'h02] = 200;
+    mem[8'h03] = 1;
+    mem[8'h04] = 300;
+    mem[8'h05] = 3;
+
+    mem[8'h10] = 10;
+    mem[8'h11] = 1;
+    mem[8'h12] = 20;
+    mem[8'h13] = 1;
+
+    mem[8'h20] = 555;
+    mem[8'h21] = 1;
+    mem[8'h22] = 666;
+    mem[8'h23] = 1;
+
+    mem[8'h30] = 888;
+    mem[8'h31] = 1;
+
+    errors = 0;
+    ticks = 0;
+    irqs = 0;
+    addr = 0;
+    wdata = 0;
+    wenable = 0;
+
+    clk = 1;
+    rst_n = 0;
+    #15 rst_n = 1;
+
+    // Channels 0 and 1
+    @(negedge clk);
+    wenable = 1;
+    addr = 0 * 32 + REG_SEQ * 4;
+    wdata = 8'h00 * 4;
+    @(negedge clk);
+    addr  = 0 * 32 + REG_SEQ_LEN * 4;
+    wdata = 3;
+    @(negedge clk);
+    addr  = 1 * 32 + REG_SEQ * 4;
+    wdata = 8'h10 * 4;
+    @(negedge clk);
+    addr  = 1 * 32 + REG_SEQ_LEN * 4;
+    wdata = 2;
+    @(negedge clk);
+    addr  = 0 * 32 + REG_CTRL * 4;
+    wdata = START;
+    @(negedge clk);
+    addr  = 1 * 32 + REG_CTRL * 4;
+    wdata = LOOP | START;
+    start = ticks;
+    @(negedge clk);
+    wenable = 0;
+
+    while (ticks < start + 8) @(negedge clk);
+
+    expected[0] = 0;
+    expected[1] = 100;
+    expected[2] = 100;
+    expected[3] = 200;
+    expected[4] = 300;
+    expected[5] = 300;
+    expected[6] = 300;
+    expected[7] = 0;
+
+    for (i = 0; i < 8; i = i + 1) begin
+      if (seen_0[start+i] !== expected[i]) begin
+        $display("channel 0, tick %0d: period %0d, expected %0d", i, seen_0[start+i],
+                 expected[i]);
+        errors = errors + 1;
+      end
+
+      if (seen_1[start+i] !== (i == 0 ? 0 : i % 2 ? 10 : 20)) begin
+        $display("channel 1, tick %0d: period %0d, expected %0d", i, seen_1[start+i],
+                 i == 0 ? 0 : i % 2 ? 10 : 20);
+        errors = errors + 1;
+      end
+    end
+
+    if (irqs != 1 || irq_ticks[0] != start + 7) begin
+      $display("%0d irqs, the first on tick %0d, expected one on tick 7", irqs,
+               irq_ticks[0] - start);
+      errors = errors + 1;
+    end
+
+    // Channel 2, restarted while fetching
+    @(negedge clk);
+    wenable = 1;
+    addr = 1 * 32 + REG_CTRL * 4;
+    wdata = STOP;
+    @(negedge clk);
+    addr  = 2 * 32 + REG_SEQ * 4;
+    wdata = 8'h20 * 4;
+    @(negedge clk);
+    addr  = 2 * 32 + REG_SEQ_LEN * 4;
+    wdata = 2;
+    @(negedge clk);
+    addr  = 2 * 32 + REG_CTRL * 4;
+    wdata = START;
+    @(negedge clk);
+    wenable = 0;
+
+    while (!(m_ren && audio.fetch_channel == 2)) @(negedge clk);
+    @(negedge clk);
+
+    fetching = ticks;
+    wenable = 1;
+    addr = 2 * 32 + REG_CTRL * 4;
+    wdata = START;
+    @(negedge clk);
+    wenable = 0;
+
+    while (m_ren) @(negedge clk);
+
+    if (audio.seq_positions[2] !== 0 || audio.periods[2] !== 0) begin
+      $display("channel 2 at step %0d with period %0d after the dropped fetch",
+               audio.seq_positions[2], audio.periods[2]);
+      errors = errors + 1;
+    end
+
+    while (ticks < fetching + 5) @(negedge clk);
+
+    expected[0] = 0;
+    expected[1] = 555;
+    expected[2] = 666;
+    expected[3] = 0;
+
+    for (i = 0; i < 4; i = i + 1) begin
+      if (seen_2[fetching+i] !== expected[i]) begin
+        $display("channel 2, tick %0d after restarting: period %0d, expected %0d", i,
+                 seen_2[fetching+i], expected[i]);
+        errors = errors + 1;
+      end
+    end
+
+    if (irqs != 2 || irq_ticks[1] != fetching + 3) begin
+      $display("%0d irqs, the second on tick %0d after restarting, expected 3", irqs,
+               irq_ticks[1] - fetching);
+      errors = errors + 1;
+    end
+
+    // Channel 3, stopped while fetching
+    @(negedge clk);
+    wenable = 1;
+    addr = 3 * 32 + REG_SEQ * 4;
+    wdata = 8'h30 * 4;
+    @(negedge clk);
+    addr  = 3 * 32 + REG_SEQ_LEN * 4;
+    wdata = 1;
+    @(negedge clk);
+    addr  = 3 * 32 + REG_CTRL * 4;
+    wdata = START;
+    @(negedge clk);
+    wenable = 0;
+
+    while (!(m_ren && audio.fetch_channel == 3)) @(negedge clk);
+    @(negedge clk);
+
+    fetching = ticks;
+    wenable = 1;
+    addr = 3 * 32 + REG_CTRL * 4;
+    wdata = STOP;
+    @(negedge clk);
+    wenable = 0;
+
+    while (ticks < fetching + 4) @(negedge clk);
+
+    for (i = 0; i < 4; i = i + 1) begin
+      if (seen_3[fetching+i] !== 0) begin
+        $display("channel 3, tick %0d after stopping: period %0d, expected 0", i,
+                 seen_3[fetching+i]);
+        errors = errors + 1;
+      end
+    end
+
+    if (audio.playing[3] || audio.seq_positions[3] !== 0 || irqs != 2) begin
+      $display("channel 3 playing %b at step %0d, %0d irqs, expected stopped at 0 and 2",
+               audio.playing[3], audio.seq_positions[3], irqs);
+      errors = errors + 1;
+    end
+
+    $display("");
+    $display("%0d errors", errors);
+    if (errors != 0) $display("FAILED");
+    else $display("PASSED");
+    $display("");
+
+    $finish();
+  end
+endmodule
@@ -1,17 +1,24 @@
 `default_nettype none `timescale 1ns / 1ps
+`include "tb_dump.vh"
 
 module audio_unit_tb ();
   reg clk, rst_n;
   always #5 clk = ~clk;
 
+  `TB_DUMP(audio_unit_tb, clk)
+
   wire [8:0] out;
 
   audio_unit audio (
       .clk  (clk),
       .rst_n(rst_n),
 
+      .addr   (8'b0),
       .wenable(1'b0),
 
+      .m_rdata(32'b0),
+      .m_ready(1'b0),
+
       .out(out)
   );
 
@@ -29,8 +36,6 @@ module audio_unit_tb ();
   );
 
   initial begin
-    $dumpvars(0, audio_unit_tb);
-
     clk   = 1;
     rst_n = 0;
     #5 rst_n = 1;
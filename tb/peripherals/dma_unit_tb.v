@@ -0,0 +1,290 @@
+`timescale 1ns / 1ns `default_nettype none
+`include "tb_dump.vh"
+
+// Runs three transfers on the whole of tachyon_rv, since the bus arbitration
+// lives there, while the CPU keeps incrementing a counter in RAM:
+//
+// - eight words read backwards (source stride -4) into an ascending table,
+// - a scatter list of four halfwords, with IRQ enable,
+// - four halfwords read forwards and written backwards (destination stride
+//   -2), with IRQ enable.
+//
+// The CPU then reads the whole data area back. Every element must have landed
+// where it should and nothing else may have changed, the counter must hold
+// every increment, and the interrupt must pulse once for each transfer with IRQ
+// enable. This is done on the plain RAM and with caches. Only the latter keeps
+// the DMA on the bus across cycles, where the CPU can ask for it in the same
+// cycle as a DMA grant, and must be held then.
+module dma_unit_tb ();
+  reg clk, rst_n;
+  always #5 clk = ~clk;
+
+  `TB_DUMP(dma_unit_tb, clk)
+
+  dma_unit_bench #(
+      .USE_CACHES(0)
+  ) ram (
+      .clk  (clk),
+      .rst_n(rst_n)
+  );
+
+  dma_unit_bench #(
+      .USE_CACHES(1)
+  ) caches (
+      .clk  (clk),
+      .rst_n(rst_n)
+  );
+
+  integer errors;
+
+  initial begin
+    clk   = 1;
+    rst_n = 0;
+    #15 rst_n = 1;
+
+    wait (ram.finished && caches.finished);
+
+    errors = ram.errors + caches.errors;
+
+    if (caches.contended == 0) begin
+      $display("caches: the CPU never asked for the bus while the DMA had it");
+      errors = errors + 1;
+    end
+
+    $display("");
+    $display("RAM: %0d cycles", ram.cycles);
+    $display("caches: %0d cycles, the CPU held for the DMA in %0d", caches.cycles,
+             caches.contended);
+    $display("%0d errors", errors);
+    if (errors != 0) $display("FAILED");
+    else $display("PASSED");
+    $display("");
+
+    $finish();
+  end
+endmodule
+
+module dma_unit_bench #(
+    parameter USE_CACHES = 0
+) (
+    input wire clk,
+    input wire rst_n
+);
+  localparam DATA = 32'h2000;
+  localparam WORDS_SRC = DATA;
+  localparam HALVES_SRC = DATA + 32'h40;
+  localparam WORDS_DST = DATA + 32'h100;
+  localparam LIST = DATA + 32'h200;
+  localparam SCATTER_DST = DATA + 32'h300;
+  localparam HALVES_DST = DATA + 32'h400;
+  localparam COUNTER = DATA + 32'h500;
+  localparam READBACK = DATA + 32'h600;
+  localparam DONE = DATA + 32'h604;
+  localparam WORDS = (COUNTER - DATA) / 4 + 1;
+  localparam INCREMENTS = 8;
+
+  localparam SIZE_HALF = 12'd1;
+  localparam SIZE_WORD = 12'd2;
+  localparam SCATTER = 12'd4;
+  localparam IRQ = 12'd8;
+
+  localparam S0 = 8;
+  localparam S1 = 9;
+  localparam T0 = 5;
+  localparam T1 = 6;
+  localparam T2 = 7;
+
+  localparam BNE = 3'b001;
+
+  `include "tb_rv32.vh"
+
+  tachyon_rv #(
+      .USE_CACHES(USE_CACHES)
+  ) dut (
+      .clk    (clk),
+      .clk_vga(clk),
+      .rst_n  (rst_n),
+
+      .joypad_scl_out(),
+      .joypad_sda_in (1'b1),
+      .joypad_sda_out(),
+
+      .lcd_data  (),
+      .lcd_ctrl  (),
+      .lcd_enable(),
+
+      .vga_red  (),
+      .vga_green(),
+      .vga_blue (),
+      .h_sync   (),
+      .v_sync   (),
+
+      .audio_out()
+  );
+
+  reg [31:0] expected[0:2**12-1];
+  integer errors, cycles, irqs, contended, read, p, i;
+  reg finished;
+
+  // Copied into whichever memory the core has, once it has tried loading its
+  // SOURCE_FILE
+  reg [31:0] image[0:2**12-1];
+
+  generate
+    if (USE_CACHES) begin : g_caches
+      initial begin
+        #1;
+        for (i = 0; i < 2 ** 12; i = i + 1) dut.g_caches.patchy.data[i] = image[i];
+      end
+    end else begin : g_no_caches
+      initial begin
+        #1;
+        for (i = 0; i < 2 ** 12; i = i + 1) dut.g_no_caches.patchy.data[i] = image[i];
+      end
+    end
+  endgenerate
+
+  // Starts the transfer set up in t0 (source), t1 (destination), t2 (count)
+  // and the stride already written, with ctrl, then bumps the counter
+  // INCREMENTS times and waits for the DMA to go idle
+  task transfer(input [11:0] ctrl);
+    begin
+      image[p+0] = sw(T0, S1, 12'h00);
+      image[p+1] = sw(T1, S1, 12'h04);
+      image[p+2] = sw(T2, S1, 12'h08);
+      image[p+3] = addi(T0, 0, ctrl);
+      image[p+4] = sw(T0, S1, 12'h10);
+
+      image[p+5] = addi(T2, 0, INCREMENTS);
+      image[p+6] = lw(T1, S0, COUNTER - DATA);
+      image[p+7] = addi(T1, T1, 1);
+      image[p+8] = sw(T1, S0, COUNTER - DATA);
+      image[p+9] = addi(T2, T2, -12'd1);
+      image[p+10] = branch(BNE, T2, 0, -13'd16);
+
+      image[p+11] = lw(T1, S1, 12'h14);
+      image[p+12] = andi(T1, T1, 1);
+      image[p+13] = branch(BNE, T1, 0, -13'd8);
+
+      p = p + 14;
+    end
+  endtask
+
+  always @(posedge clk) begin
+    if (rst_n && !finished) begin
+      cycles = cycles + 1;
+
+      if (dut.dma_irq) irqs = irqs + 1;
+
+      if (dut.dma_grant && dut.cpu_access) begin
+        contended = contended + 1;
+
+        if (dut.cpu_data_ready) begin
+          $display("%0d: CPU access to %h let through under a DMA grant", USE_CACHES,
+                   dut.cpu_data_addr);
+          errors = errors + 1;
+        end
+      end
+
+      if (|dut.cpu_data_wenable && dut.cpu_data_ready) begin
+        if (dut.cpu_data_addr == READBACK) begin
+          if (dut.cpu_data_wdata !== expected[DATA/4+read]) begin
+            $display("%0d: %h holds %h, expected %h", USE_CACHES, DATA + 4 * read,
+                     dut.cpu_data_wdata, expected[DATA/4+read]);
+            errors = errors + 1;
+          end
+
+          read = read + 1;
+        end else if (dut.cpu_data_addr == DONE) begin
+          if (read != WORDS) begin
+            $display("%0d: read back %0d words, expected %0d", USE_CACHES, read, WORDS);
+            errors = errors + 1;
+          end
+
+          if (irqs != 2) begin
+            $display("%0d: %0d DMA interrupts, expected 2", USE_CACHES, irqs);
+            errors = errors + 1;
+          end
+
+          finished = 1;
+        end
+      end
+    end
+  end
+
+  initial begin
+    for (i = 0; i < 2 ** 12; i = i + 1) image[i] = i < DATA / 4 ? NOP : 0;
+
+    for (i = 0; i < 8; i = i + 1) image[WORDS_SRC/4+i] = 32'h11110000 + i;
+
+    image[HALVES_SRC/4+0] = 32'hB1B1B0B0;
+    image[HALVES_SRC/4+1] = 32'hB3B3B2B2;
+
+    // {value, offset}
+    image[LIST/4+0] = 32'hA0A00006;
+    image[LIST/4+1] = 32'hA1A10000;
+    image[LIST/4+2] = 32'hA2A20002;
+    image[LIST/4+3] = 32'hA3A30010;
+
+    for (i = 0; i < 2 ** 12; i = i + 1) expected[i] = image[i];
+
+    image[0] = lui(S1, 20'h30000);
+    image[1] = lui(S0, DATA >> 12);
+    p = 2;
+
+    // Words backwards: {+4, -4}
+    image[p+0] = lui(T0, 20'h00050);
+    image[p+1] = addi(T0, T0, -12'd4);
+    image[p+2] = sw(T0, S1, 12'h0C);
+    image[p+3] = addi(T0, S0, WORDS_SRC - DATA + 28);
+    image[p+4] = addi(T1, S0, WORDS_DST - DATA);
+    image[p+5] = addi(T2, 0, 8);
+    p = p + 6;
+    transfer(SIZE_WORD);
+
+    for (i = 0; i < 8; i = i + 1) expected[WORDS_DST/4+i] = 32'h11110000 + 7 - i;
+
+    image[p+0] = addi(T0, S0, LIST - DATA);
+    image[p+1] = addi(T1, S0, SCATTER_DST - DATA);
+    image[p+2] = addi(T2, 0, 4);
+    p = p + 3;
+    transfer(IRQ | SCATTER | SIZE_HALF);
+
+    expected[SCATTER_DST/4+0] = 32'hA2A2A1A1;
+    expected[SCATTER_DST/4+1] = 32'hA0A00000;
+    expected[SCATTER_DST/4+4] = 32'h0000A3A3;
+
+    // Halves forwards into a descending table: {-2, +2}
+    image[p+0] = lui(T0, 20'hFFFE0);
+    image[p+1] = addi(T0, T0, 12'd2);
+    image[p+2] = sw(T0, S1, 12'h0C);
+    image[p+3] = addi(T0, S0, HALVES_SRC - DATA);
+    image[p+4] = addi(T1, S0, HALVES_DST - DATA + 14);
+    image[p+5] = addi(T2, 0, 4);
+    p = p + 6;
+    transfer(IRQ | SIZE_HALF);
+
+    expected[HALVES_DST/4+2] = 32'hB2B2B3B3;
+    expected[HALVES_DST/4+3] = 32'hB0B0B1B1;
+
+    expected[COUNTER/4] = 3 * INCREMENTS;
+
+    // Read back every word from DATA to COUNTER
+    image[p+0] = addi(T0, S0, 0);
+    image[p+1] = addi(T2, 0, WORDS);
+    image[p+2] = lw(T1, T0, 0);
+    image[p+3] = sw(T1, S0, READBACK - DATA);
+    image[p+4] = addi(T0, T0, 4);
+    image[p+5] = addi(T2, T2, -12'd1);
+    image[p+6] = branch(BNE, T2, 0, -13'd16);
+    image[p+7] = sw(0, S0, DONE - DATA);
+    image[p+8] = jal(0, 0);
+
+    errors = 0;
+    cycles = 0;
+    irqs = 0;
+    contended = 0;
+    read = 0;
+    finished = 0;
+  end
+endmodule
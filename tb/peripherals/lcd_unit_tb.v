@@ -0,0 +1,216 @@
+`timescale 1ns / 1ns `default_nettype none
+`include "tb_dump.vh"
+
+// Queues a clear display, an entry mode set and three characters into a
+// four-entry FIFO with the watermark at 1, and then one more character while
+// it's full. Every entry sent must meet the HD44780's setup (40 ns) and enable
+// pulse (230 ns) times, and the next one must wait out its execution time (37
+// us, or 1.52 ms after clear display and return home). The last character must
+// be dropped and flag the overflow, and the interrupt must fire once, as the
+// FIFO drains from 2 to 1 entries. Writing the watermark clears both flags.
+module lcd_unit_tb ();
+  reg clk, rst_n;
+  always #(NS_PER_CYCLE / 2) clk = ~clk;
+
+  `TB_DUMP(lcd_unit_tb, clk)
+
+  // A slow clock keeps the 1.52 ms short in cycles
+  localparam CLOCK_FREQ = 10_000_000;
+  localparam NS_PER_CYCLE = 1_000_000_000 / CLOCK_FREQ;
+  localparam FIFO_DEPTH = 4;
+  localparam WATERMARK = 1;
+  localparam ENTRIES = 5;
+
+  localparam SETUP_NS = 40;
+  localparam ENABLE_NS = 230;
+  localparam EXEC_NS = 37_000;
+  localparam LONG_EXEC_NS = 1_520_000;
+
+  reg  [1:0] addr;
+  reg  [7:0] wdata;
+  reg        wenable;
+  wire [7:0] rdata;
+  wire       irq;
+
+  wire [7:0] lcd_data;
+  wire [1:0] lcd_ctrl;
+  wire       lcd_enable;
+
+  lcd_unit #(
+      .CLOCK_FREQ(CLOCK_FREQ),
+      .FIFO_DEPTH(FIFO_DEPTH)
+  ) lcd (
+      .clk  (clk),
+      .rst_n(rst_n),
+
+      .addr   (addr),
+      .wdata  (wdata),
+      .wenable(wenable),
+      .rdata  (rdata),
+
+      .irq(irq),
+
+      .lcd_data  (lcd_data),
+      .lcd_ctrl  (lcd_ctrl),
+      .lcd_enable(lcd_enable)
+  );
+
+  // {RS, byte} of each entry expected on the bus, in order
+  reg [8:0] expected[0:ENTRIES-1];
+  integer errors, sent, irqs, i;
+
+  time changed, rose, fell;
+  reg [8:0] prev_entry;
+  reg [8:0] lcd_bus;
+  reg enable_prev;
+
+  always @(posedge clk) begin
+    if (!rst_n) begin
+      lcd_bus = 0;
+      enable_prev = 0;
+    end else begin
+      if ({lcd_ctrl[1], lcd_data} !== lcd_bus) begin
+        if (lcd_enable) begin
+          $display("entry %0d: bus changed while E is high", sent);
+          errors = errors + 1;
+        end
+
+        lcd_bus = {lcd_ctrl[1], lcd_data};
+        changed = $time;
+      end
+
+      if (lcd_enable && !enable_prev) begin
+        rose = $time;
+
+        if (sent >= ENTRIES) begin
+          $display("entry %h sent after the last one", lcd_bus);
+          errors = errors + 1;
+        end else if (lcd_bus !== expected[sent]) begin
+          $display("entry %0d: sent %h, expected %h", sent, lcd_bus, expected[sent]);
+          errors = errors + 1;
+        end
+
+        if (rose - changed < SETUP_NS) begin
+          $display("entry %0d: %0d ns of setup", sent, rose - changed);
+          errors = errors + 1;
+        end
+
+        if (sent > 0) begin
+          // Clear display is 0x01 and return home 0x02/0x03
+          if (!prev_entry[8] && prev_entry[7:2] == 0) begin
+            if (rose - fell < LONG_EXEC_NS) begin
+              $display("entry %0d: %0d ns after clear or home", sent, rose - fell);
+              errors = errors + 1;
+            end
+          end else if (rose - fell < EXEC_NS || rose - fell >= LONG_EXEC_NS) begin
+            $display("entry %0d: %0d ns after the previous one", sent, rose - fell);
+            errors = errors + 1;
+          end
+        end
+
+        prev_entry = lcd_bus;
+      end
+
+      if (!lcd_enable && enable_prev) begin
+        fell = $time;
+
+        if (fell - rose < ENABLE_NS) begin
+          $display("entry %0d: %0d ns pulse", sent, fell - rose);
+          errors = errors + 1;
+        end
+
+        sent = sent + 1;
+      end
+
+      if (irq) begin
+        irqs = irqs + 1;
+
+        if (lcd.level !== WATERMARK) begin
+          $display("irq at level %0d, expected %0d", lcd.level, WATERMARK);
+          errors = errors + 1;
+        end
+      end
+
+      enable_prev = lcd_enable;
+    end
+  end
+
+  initial begin
+    expected[0] = {1'b0, 8'h01};  // clear display
+    expected[1] = {1'b0, 8'h06};  // entry mode set
+    expected[2] = {1'b1, "A"};
+    expected[3] = {1'b1, "B"};
+    expected[4] = {1'b1, "C"};
+
+    errors = 0;
+    sent = 0;
+    irqs = 0;
+    addr = 0;
+    wdata = 0;
+    wenable = 0;
+
+    clk = 1;
+    rst_n = 0;
+    #(3 * NS_PER_CYCLE / 2) rst_n = 1;
+
+    @(negedge clk);
+    addr = 3;
+    wdata = 8'h80 | WATERMARK;
+    wenable = 1;
+
+    // The first entry leaves right away, the other four fill the FIFO
+    for (i = 0; i < ENTRIES; i = i + 1) begin
+      @(negedge clk);
+      addr  = expected[i][8];
+      wdata = expected[i][7:0];
+    end
+
+    @(negedge clk);
+    addr  = 1;
+    wdata = "D";
+
+    @(negedge clk);
+    wenable = 0;
+    addr = 0;
+    #1;
+
+    if (rdata[3:1] !== 3'b101) begin
+      $display("status %b after pushing into a full FIFO, expected overflow and full",
+               rdata[3:0]);
+      errors = errors + 1;
+    end
+
+    while (rdata[0]) @(negedge clk);
+
+    if (sent != ENTRIES || irqs != 1) begin
+      $display("%0d entries sent and %0d irqs, expected %0d and 1", sent, irqs, ENTRIES);
+      errors = errors + 1;
+    end
+
+    if (rdata[3:0] !== 4'b1100) begin
+      $display("status %b once drained, expected overflow and irq", rdata[3:0]);
+      errors = errors + 1;
+    end
+
+    addr = 3;
+    wdata = 8'h80 | WATERMARK;
+    wenable = 1;
+    @(negedge clk);
+    wenable = 0;
+    addr = 0;
+    #1;
+
+    if (rdata[3:0] !== 4'b0000) begin
+      $display("status %b after writing the watermark, expected clear", rdata[3:0]);
+      errors = errors + 1;
+    end
+
+    $display("");
+    $display("%0d errors", errors);
+    if (errors != 0) $display("FAILED");
+    else $display("PASSED");
+    $display("");
+
+    $finish();
+  end
+endmodule
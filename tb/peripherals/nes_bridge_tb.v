@@ -1,9 +1,12 @@
 `default_nettype none `timescale 1ns / 1ps
+`include "tb_dump.vh"
 
 module nes_bridge_tb ();
   reg clk, rst_n;
   always #5 clk = ~clk;
 
+  `TB_DUMP(nes_bridge_tb, clk)
+
   reg  start;
 
   wire scl_out;
@@ -21,8 +24,6 @@ module nes_bridge_tb ();
   );
 
   initial begin
-    $dumpvars(0, nes_bridge_tb);
-
     clk   = 1;
     rst_n = 0;
     start = 0;
@@ -1,9 +1,12 @@
 `default_nettype none `timescale 1ns / 1ps
+`include "tb_dump.vh"
 
 module pwm_generator_tb ();
   reg clk, rst_n;
   always #5 clk = ~clk;
 
+  `TB_DUMP(pwm_generator_tb, clk)
+
   wire out;
 
   pwm_generator pwm (
@@ -16,8 +19,6 @@ module pwm_generator_tb ();
   );
 
   initial begin
-    $dumpvars(0, pwm_generator_tb);
-
     clk   = 1;
     rst_n = 0;
     #5 rst_n = 1;
@@ -1,68 +1,370 @@
 `timescale 1ns / 1ps `default_nettype none
+`include "tb_dump.vh"
 
+// Fills each tile attribute page with a single color and flips between them
+// in the middle of frames, checking that every frame comes out in one color
+// and that flips land on the frame after they're requested.
+//
+// Then two more frames are compared pixel by pixel against a model, with a map
+// of patterned tiles scrolled partway into a tile and across both edges of the
+// 32x32 map, and sprites:
+//
+// - ten on the same lines, of which only the first eight may show,
+// - two overlapping ones, the lower index on top except where it's
+//   transparent,
+// - one with transparent pixels over the background, one disabled, and one
+//   wrapping around the top left corner.
+//
+// The scroll offsets are written in the middle of both frames, and must only
+// move the picture from the next one on.
 module video_unit_tb ();
   reg clk, rst_n;
   always #5 clk = ~clk;
 
-  reg ctrl_wenable, ctrl_wdata;
+  `TB_DUMP(video_unit_tb, clk)
 
-  wire [3:0] vga_red;
-  wire [3:0] vga_green;
-  wire [3:0] vga_blue;
-  wire h_sync;
-  wire v_sync;
+  // The whole 32x32 map, so scrolling doesn't matter
+  localparam TILES_TOTAL = 32 * 32;
+  localparam PAGE_SIZE = TILES_TOTAL;
+  localparam V_FRONT_LINE = 600;
+
+  localparam SPRITES = 32;
+  localparam SPRITES_PER_LINE = 8;
+  localparam SPRITE_ENABLE = 16 + 11;
+
+  localparam CTRL_PAGE = 7'h01;
+  localparam CTRL_SCROLL_X = 7'h02;
+  localparam CTRL_SCROLL_Y = 7'h03;
+  localparam CTRL_SPRITES = 7'h40;
+
+  // Frames before this one are a single color
+  localparam MODEL_FRAME = 3;
+
+  localparam BLUE = 12'h00F;
+  localparam YELLOW = 12'hFF0;
+  localparam GREEN = 12'h0F0;
+
+  reg  [11:0] tattr_addr;
+  reg  [15:0] tattr_wdata;
+  reg  [ 1:0] tattr_wenable;
+
+  reg  [ 6:0] ctrl_addr;
+  reg  [31:0] ctrl_wdata;
+  reg         ctrl_wenable;
+  wire [31:0] ctrl_rdata;
+
+  wire [ 3:0] vga_red;
+  wire [ 3:0] vga_green;
+  wire [ 3:0] vga_blue;
+  wire        h_sync;
+  wire        v_sync;
 
   video_unit keiki (
       .clk  (clk),
       .wclk (clk),
       .rst_n(rst_n),
 
-      .tattr_wenable(1'b0),
-      .pal_wenable  (1'b0),
+      .tattr_addr   (tattr_addr),
+      .tattr_wdata  (tattr_wdata),
+      .tattr_wenable(tattr_wenable),
 
+      .pal_wenable(1'b0),
+
+      .ctrl_addr   (ctrl_addr),
       .ctrl_wdata  (ctrl_wdata),
       .ctrl_wenable(ctrl_wenable),
+      .ctrl_rdata  (ctrl_rdata),
 
-      .vga_red(vga_red),
+      .vga_red  (vga_red),
       .vga_green(vga_green),
-      .vga_blue(vga_blue),
-      .h_sync(h_sync),
-      .v_sync(v_sync)
+      .vga_blue (vga_blue),
+      .h_sync   (h_sync),
+      .v_sync   (v_sync)
   );
 
+  wire [11:0] color = {vga_red, vga_green, vga_blue};
+
+  integer frame, errors, pixels;
+  reg [11:0] frame_color;
+  reg frame_color_valid;
+  reg [11:0] expected[0:2];
+  reg v_visible_prev;
+
+  // What the model shows, latched along with the video unit at the end of
+  // each frame, and what was last written
+  reg [7:0] model_scroll_x, model_scroll_y, scroll_x, scroll_y;
+  reg model_page, page;
+  reg [31:0] sprites[0:SPRITES-1];
+  reg [11:0] model_pixel;
+
+  // Color of the screen pixel at (x, y), from the tile memory, palettes and
+  // sprites written into the video unit
+  function [11:0] model_color(input [7:0] x, input [7:0] y);
+    reg [7:0] map_x, map_y, row, col;
+    reg [15:0] attrs, data;
+    reg [1:0] color_idx;
+    integer n, slots;
+    reg found;
+    begin
+      map_x = x + model_scroll_x;
+      map_y = y + model_scroll_y;
+
+      attrs = keiki.tattr_ram.data[model_page*PAGE_SIZE+map_y[7:3]*32+map_x[7:3]];
+      data = keiki.tdata_ram.data[attrs[7:0]*8+map_y[2:0]];
+      color_idx = {data[15-map_x[2:0]], data[7-map_x[2:0]]};
+      model_color = keiki.palette[attrs[10:8]][color_idx];
+
+      slots = 0;
+      found = 0;
+
+      for (n = 0; n < SPRITES; n = n + 1) begin
+        row = y - sprites[n][15:8];
+        col = x - sprites[n][7:0];
+
+        if (sprites[n][SPRITE_ENABLE] && row < 8 && slots < SPRITES_PER_LINE) begin
+          slots = slots + 1;
+
+          data = keiki.tdata_ram.data[sprites[n][23:16]*8+row[2:0]];
+          color_idx = {data[15-col[2:0]], data[7-col[2:0]]};
+
+          if (!found && col < 8 && color_idx != 0) begin
+            model_color = keiki.palette[sprites[n][26:24]][color_idx];
+            found = 1;
+          end
+        end
+      end
+    end
+  endfunction
+
+  always @(posedge clk) begin
+    v_visible_prev <= keiki.v_visible;
+
+    if (rst_n && frame >= MODEL_FRAME && keiki.display_on && keiki.h_visible &&
+        keiki.v_visible && keiki.x_pos[1:0] == 0 && keiki.y_pos[1:0] == 0) begin
+      model_pixel = model_color(keiki.x_pos[9:2], keiki.y_pos[9:2]);
+      pixels = pixels + 1;
+
+      if (color !== model_pixel) begin
+        if (errors < 10) begin
+          $display("frame %0d, pixel (%0d, %0d): %h, expected %h", frame, keiki.x_pos[9:2],
+                   keiki.y_pos[9:2], color, model_pixel);
+        end
+        errors = errors + 1;
+      end
+    end
+
+    if (rst_n && frame < MODEL_FRAME && keiki.display_on && keiki.h_visible &&
+        keiki.v_visible) begin
+      if (!frame_color_valid) begin
+        frame_color       <= color;
+        frame_color_valid <= 1;
+      end else if (color != frame_color) begin
+        if (errors < 10) begin
+          $display("frame %0d, line %0d: %h after %h", frame, keiki.y_pos, color, frame_color);
+        end
+        errors = errors + 1;
+      end
+    end
+
+    if (v_visible_prev && !keiki.v_visible && keiki.display_on) begin
+      if (frame < MODEL_FRAME && frame_color != expected[frame]) begin
+        $display("frame %0d: showed %h, expected %h", frame, frame_color, expected[frame]);
+        errors = errors + 1;
+      end
+
+      frame = frame + 1;
+      frame_color_valid <= 0;
+
+      model_page     = page;
+      model_scroll_x = scroll_x;
+      model_scroll_y = scroll_y;
+    end
+  end
+
+  task write_ctrl(input [6:0] addr, input [31:0] value);
+    begin
+      @(negedge clk);
+      ctrl_addr    = addr;
+      ctrl_wdata   = value;
+      ctrl_wenable = 1;
+      @(negedge clk);
+      ctrl_wenable = 0;
+
+      case (addr)
+        CTRL_PAGE:     page = value[0];
+        CTRL_SCROLL_X: scroll_x = value[7:0];
+        CTRL_SCROLL_Y: scroll_y = value[7:0];
+        default:       if (addr[6]) sprites[addr[4:0]] = value;
+      endcase
+    end
+  endtask
+
+  task write_sprite(input [4:0] idx, input [2:0] pal, input [7:0] tile, input enable,
+                    input [7:0] y, input [7:0] x);
+    begin
+      write_ctrl(CTRL_SPRITES + idx, {4'b0, enable, pal, tile, y, x});
+    end
+  endtask
+
+  // Repaints a whole page with one tile and palette, one tile per cycle
+  task fill_page(input page, input [7:0] tile, input [2:0] pal);
+    integer i;
+    begin
+      for (i = 0; i < TILES_TOTAL; i = i + 1) begin
+        @(negedge clk);
+        tattr_addr    = 2 * (page * PAGE_SIZE + i);
+        tattr_wdata   = {5'b0, pal, tile};
+        tattr_wenable = 2'b11;
+      end
+
+      @(negedge clk);
+      tattr_wenable = 0;
+    end
+  endtask
+
+  task wait_line(input integer line);
+    begin
+      while (keiki.y_pos != line) @(posedge clk);
+    end
+  endtask
+
+  integer i;
+  reg [7:0] tile;
+  reg [15:0] pattern;
+
   initial begin
-    $dumpvars(0, video_unit_tb);
-
-    keiki.palette[0][0] = 12'h000;
-    keiki.palette[0][1] = 12'hF00;
-    keiki.palette[0][2] = 12'h0F0;
-    keiki.palette[0][3] = 12'h00F;
-
-    keiki.palette[1][0] = 12'hFFF;
-    keiki.palette[1][1] = 12'h0FF;
-    keiki.palette[1][2] = 12'hF0F;
-    keiki.palette[1][3] = 12'hFF0;
-
-    keiki.tattr_ram.data[0] = 8'bx000_1001;
-
-    keiki.tdata_ram.data[(9*8)+0] = 16'h7E3C;
-    keiki.tdata_ram.data[(9*8)+1] = 16'h4242;
-    keiki.tdata_ram.data[(9*8)+2] = 16'h4242;
-    keiki.tdata_ram.data[(9*8)+3] = 16'h4242;
-    keiki.tdata_ram.data[(9*8)+4] = 16'h5E7E;
-    keiki.tdata_ram.data[(9*8)+5] = 16'h0A7E;
-    keiki.tdata_ram.data[(9*8)+6] = 16'h567C;
-    keiki.tdata_ram.data[(9*8)+7] = 16'h7C38;
-
-    ctrl_wdata = 1;
+    keiki.palette[0][3] = BLUE;
+    keiki.palette[1][3] = YELLOW;
+    keiki.palette[6][3] = GREEN;
+
+    for (i = 0; i < 8; i = i + 1) begin
+      keiki.tdata_ram.data[8+i] = 16'hFFFF;
+      keiki.tdata_ram.data[8*200+i] = 16'hFFFF;
+    end
+
+    for (i = 0; i < TILES_TOTAL; i = i + 1) begin
+      keiki.tattr_ram.data[i] = 16'h0001;
+      keiki.tattr_ram.data[PAGE_SIZE+i] = 16'h0101;
+    end
+
+    expected[0] = BLUE;
+    expected[1] = YELLOW;
+    expected[2] = GREEN;
+
+    frame = 0;
+    errors = 0;
+    pixels = 0;
+    frame_color_valid = 0;
+    model_page = 0;
+    model_scroll_x = 0;
+    model_scroll_y = 0;
+    page = 0;
+    scroll_x = 0;
+    scroll_y = 0;
+    for (i = 0; i < SPRITES; i = i + 1) sprites[i] = 0;
+    v_visible_prev = 0;
+
+    tattr_addr = 0;
+    tattr_wdata = 0;
+    tattr_wenable = 0;
+    ctrl_addr = 0;
+    ctrl_wdata = 0;
+    ctrl_wenable = 0;
+
     clk = 1;
     rst_n = 0;
-    #5 rst_n = 1;
+    #20 rst_n = 1;
 
-    ctrl_wenable = 1;
-    #10;
-    ctrl_wenable = 0;
+    // The line buffer only gets filled from the first horizontal blank on
+    wait_line(1);
+    write_ctrl(7'h0, 1);
+
+    // Frame 0: ask for page 1 halfway through
+    wait_line(300);
+    write_ctrl(7'h1, 1);
+    ctrl_addr = 7'h1;
+    #50;
+    if (ctrl_rdata[1] !== 1'b1) begin
+      $display("flip not pending after the request");
+      errors = errors + 1;
+    end
+
+    // Frame 1: redraw page 0 while page 1 is shown, then flip back to it
+    wait_line(0);
+    #50;
+    if (ctrl_rdata[1:0] !== 2'b01) begin
+      $display("page status %b after the flip", ctrl_rdata[1:0]);
+      errors = errors + 1;
+    end
+
+    wait_line(100);
+    fill_page(0, 8'd200, 3'd6);
+    wait_line(500);
+    write_ctrl(7'h1, 0);
+
+    // Frame 2 shows the redrawn page, while page 1 gets a map where each tile's
+    // palette follows its column and its pattern the column and row, to be
+    // shown from the next frame on
+    wait_line(0);
+
+    for (i = 0; i < TILES_TOTAL; i = i + 1) begin
+      tile = 16 + (i / 8 + i / 32) % 4;
+      keiki.tattr_ram.data[PAGE_SIZE+i] = {5'b0, i[2:0], tile};
+    end
+
+    wait_line(300);
+    write_ctrl(CTRL_SCROLL_X, 8'hF3);
+    write_ctrl(CTRL_SCROLL_Y, 8'hED);
+    write_ctrl(CTRL_PAGE, 1);
+
+    // Palettes, tile data and sprites aren't latched, so they wait for the
+    // blank
+    wait_line(V_FRONT_LINE);
+
+    for (i = 0; i < 8 * 4; i = i + 1) keiki.palette[i/4][i%4] = 12'h800 | (i / 4) << 4 | i % 4;
+
+    for (i = 0; i < 4 * 8; i = i + 1) begin
+      pattern[15:8] = 8'h5A ^ i * 37;
+      pattern[7:0] = 8'hC3 ^ i * 13;
+      keiki.tdata_ram.data[16*8+i] = pattern;
+    end
+
+    // Columns 6 and 7 transparent, and fully opaque
+    for (i = 0; i < 8; i = i + 1) begin
+      keiki.tdata_ram.data[5*8+i] = 16'hF0CC;
+      keiki.tdata_ram.data[6*8+i] = 16'hFFFF;
+    end
+
+    for (i = 0; i < 10; i = i + 1) write_sprite(i, i % 8, 6, 1, 40, 10 + 12 * i);
+    write_sprite(10, 3, 5, 1, 80, 50);
+    write_sprite(11, 4, 6, 1, 80, 53);
+    write_sprite(12, 5, 5, 1, 84, 120);
+    write_sprite(13, 6, 6, 0, 100, 60);
+    write_sprite(14, 7, 6, 1, 8'hFC, 8'hFC);
+
+    // Frame 3 shows page 1 scrolled across the bottom right corner of the map,
+    // until the end even though the offsets change halfway through it
+    wait_line(0);
+    wait_line(300);
+    write_ctrl(CTRL_SCROLL_X, 8'h7C);
+    write_ctrl(CTRL_SCROLL_Y, 8'hA6);
+
+    // Frame 4 shows it scrolled across the bottom of the map only
+    wait_line(0);
+    wait_line(V_FRONT_LINE);
+    repeat (10) @(posedge clk);
+
+    if (pixels != 2 * 200 * 150) begin
+      $display("%0d pixels compared to the model, expected two frames", pixels);
+      errors = errors + 1;
+    end
+
+    $display("");
+    $display("%0d frames checked, %0d errors", frame, errors);
+    if (errors != 0) $display("FAILED");
+    else $display("PASSED");
+    $display("");
 
-    #100_000 $finish();
+    $finish();
   end
 endmodule
@@ -1,9 +1,12 @@
 `timescale 1ns / 1ns `default_nettype none
+`include "tb_dump.vh"
 
 module top_mcc_tb ();
   reg clk, rst_n;
   always #5 clk = ~clk;
 
+  `TB_DUMP(top_mcc_tb, clk)
+
   wire clk_out;
   wire [7:0] lcd_data;
   wire [1:0] lcd_ctrl;
@@ -20,8 +23,6 @@ module top_mcc_tb ();
   );
 
   initial begin
-    $dumpvars(0, top_mcc_tb);
-
     $display("");
 
     clk   = 1;
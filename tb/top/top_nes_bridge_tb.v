@@ -1,9 +1,12 @@
 `default_nettype none `timescale 1ns / 1ps
+`include "tb_dump.vh"
 
 module top_nes_bridge_tb ();
   reg clk, rst_n;
   always #5 clk = ~clk;
 
+  `TB_DUMP(top_nes_bridge_tb, clk)
+
   wire [7:0] led;
   tri1 scl_pin;
   tri1 sda_pin;
@@ -18,8 +21,6 @@ module top_nes_bridge_tb ();
   );
 
   initial begin
-    $dumpvars(0, top_nes_bridge_tb);
-
     clk   = 1;
     rst_n = 0;
     #1 rst_n = 1;
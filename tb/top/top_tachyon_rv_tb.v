@@ -1,9 +1,12 @@
 `timescale 1ns / 1ps `default_nettype none
+`include "tb_dump.vh"
 
 module top_tachyon_rv_tb ();
   reg clk, rst_n;
   always #5 clk = ~clk;
 
+  `TB_DUMP(top_tachyon_rv_tb, clk)
+
   wire [3:0] vga_red;
   wire [3:0] vga_green;
   wire [3:0] vga_blue;
@@ -40,8 +43,6 @@ module top_tachyon_rv_tb ();
   );
 
   initial begin
-    $dumpvars(0, top_tachyon_rv_tb);
-
     $display("");
 
     clk   = 1;